@@ -30,6 +30,12 @@
 
 #include <GL/glut.h>
 
+#include "../../The Plane Strikes Back/The_Plane_Strikes_Back_Naddanai/Culling.h"
+#include "../../The Plane Strikes Back/The_Plane_Strikes_Back_Naddanai/FrameLoop.h"
+#include "../../The Plane Strikes Back/The_Plane_Strikes_Back_Naddanai/Input.h"
+#include "../../The Plane Strikes Back/The_Plane_Strikes_Back_Naddanai/Lod.h"
+#include "../../The Plane Strikes Back/The_Plane_Strikes_Back_Naddanai/MeshCache.h"
+
 //|___________________
 //|
 //| Constants
@@ -43,6 +49,38 @@ const float P_HEIGHT = 1.5;
 // Camera's view frustum 
 const float CAM_FOV  = 60.0f;     // Field of view in degs
 
+// Main loop
+const float TICK_RATE      = 60.0f;     // Ticks per sec
+const float MAX_FRAME_RATE = 120.0f;    // Frames per sec at most
+
+// Plane and camera motion while a key is held
+const float MOVE_SPEED     = 10.0f;     // Units per sec
+const float TURN_RATE      = 90.0f;     // Degs per sec
+
+// Keyboard actions
+enum Action {A_NONE = 0,
+             A_PLANE_FORWARD, A_PLANE_BACKWARD, A_PLANE_LEFT, A_PLANE_RIGHT, A_PLANE_UP, A_PLANE_DOWN,
+             A_PLANE_ROLL_POSITIVE, A_PLANE_ROLL_NEGATIVE, A_PLANE_PITCH_POSITIVE, A_PLANE_PITCH_NEGATIVE,
+             A_PLANE_YAW_POSITIVE, A_PLANE_YAW_NEGATIVE,
+             A_CAM_FORWARD, A_CAM_BACKWARD, A_CAM_LEFT, A_CAM_RIGHT, A_CAM_DOWN, A_CAM_UP,
+             A_CAM_ROLL_NEGATIVE, A_CAM_ROLL_POSITIVE, A_CAM_PITCH_NEGATIVE, A_CAM_PITCH_POSITIVE,
+             A_CAM_YAW_NEGATIVE, A_CAM_YAW_POSITIVE};
+
+// Key bindings, each acting for as long as the key is held
+const KeyBinding KEY_BINDINGS[] = {
+  {'w', A_PLANE_FORWARD},        {'s', A_PLANE_BACKWARD},
+  {'a', A_PLANE_LEFT},           {'d', A_PLANE_RIGHT},
+  {'t', A_PLANE_UP},             {'r', A_PLANE_DOWN},
+  {'g', A_PLANE_ROLL_POSITIVE},  {'f', A_PLANE_ROLL_NEGATIVE},
+  {'z', A_PLANE_PITCH_POSITIVE}, {'x', A_PLANE_PITCH_NEGATIVE},
+  {'c', A_PLANE_YAW_POSITIVE},   {'v', A_PLANE_YAW_NEGATIVE},
+  {'u', A_CAM_FORWARD},          {'j', A_CAM_BACKWARD},
+  {'h', A_CAM_LEFT},             {'k', A_CAM_RIGHT},
+  {'l', A_CAM_DOWN},             {'o', A_CAM_UP},
+  {'n', A_CAM_ROLL_NEGATIVE},    {'m', A_CAM_ROLL_POSITIVE},
+  {',', A_CAM_PITCH_NEGATIVE},   {'.', A_CAM_PITCH_POSITIVE},
+  {'[', A_CAM_YAW_NEGATIVE},     {']', A_CAM_YAW_POSITIVE}};
+
 //|___________________
 //|
 //| Global Variables
@@ -57,7 +95,12 @@ gmtl::Matrix44f plane_pose; // T, as defined in the handout, initialized to IDEN
 
 // Camera pose
 gmtl::Matrix44f cam_pose;   // C, as defined in the handout
-gmtl::Matrix44f view_mat;   // View transform is C^-1 (inverse of the camera transform C)
+gmtl::Matrix44f view_mat;   // View transform is C^-1 (inverse of the drawn camera transform C)
+
+// Plane and camera poses at the last tick, and as drawn: interpolated from
+// there to their current poses
+gmtl::Matrix44f prev_plane_pose, draw_plane_pose;
+gmtl::Matrix44f prev_cam_pose, draw_cam_pose;
 
 gmtl::Matrix44f cam_topview_pose;
 gmtl::Matrix44f cam_topview_pose_n;
@@ -87,6 +130,40 @@ gmtl::Matrix44f xrotfix;
 gmtl::Matrix44f ytransfix; 
 gmtl::Matrix44f fixed_view_mat;
 
+// What each held action does over a tick: pose = pose * step
+struct PoseAction {
+  int                    action;
+  gmtl::Matrix44f       *pose;
+  const gmtl::Matrix44f *step;
+};
+
+const PoseAction POSE_ACTIONS[] = {
+  {A_PLANE_FORWARD,        &plane_pose, &ztransp_mat}, {A_PLANE_BACKWARD,       &plane_pose, &ztransn_mat},
+  {A_PLANE_LEFT,           &plane_pose, &xtransp_mat}, {A_PLANE_RIGHT,          &plane_pose, &xtransn_mat},
+  {A_PLANE_UP,             &plane_pose, &ytransp_mat}, {A_PLANE_DOWN,           &plane_pose, &ytransn_mat},
+  {A_PLANE_ROLL_POSITIVE,  &plane_pose, &zrotp_mat},   {A_PLANE_ROLL_NEGATIVE,  &plane_pose, &zrotn_mat},
+  {A_PLANE_PITCH_POSITIVE, &plane_pose, &xrotp_mat},   {A_PLANE_PITCH_NEGATIVE, &plane_pose, &xrotn_mat},
+  {A_PLANE_YAW_POSITIVE,   &plane_pose, &yrotp_mat},   {A_PLANE_YAW_NEGATIVE,   &plane_pose, &yrotn_mat},
+  {A_CAM_FORWARD,          &cam_pose,   &ztransn_mat}, {A_CAM_BACKWARD,         &cam_pose,   &ztransp_mat},   // Cameras look in their (local) -Z direction
+  {A_CAM_LEFT,             &cam_pose,   &xtransn_mat}, {A_CAM_RIGHT,            &cam_pose,   &xtransp_mat},
+  {A_CAM_DOWN,             &cam_pose,   &ytransn_mat}, {A_CAM_UP,               &cam_pose,   &ytransp_mat},
+  {A_CAM_ROLL_NEGATIVE,    &cam_pose,   &zrotn_mat},   {A_CAM_ROLL_POSITIVE,    &cam_pose,   &zrotp_mat},
+  {A_CAM_PITCH_NEGATIVE,   &cam_pose,   &xrotn_mat},   {A_CAM_PITCH_POSITIVE,   &cam_pose,   &xrotp_mat},
+  {A_CAM_YAW_NEGATIVE,     &cam_pose,   &yrotn_mat},   {A_CAM_YAW_POSITIVE,     &cam_pose,   &yrotp_mat}};
+
+// Held keys
+InputState input;
+
+// Retained plane mesh, built on first draw
+MeshCache mesh_cache;
+
+// Plane's level of detail in each viewport last frame
+int plane_level[2] = {LOD_FULL, LOD_FULL};
+
+// Main loop: fixed ticks, frames drawn in between
+FrameLoop frame_loop(TICK_RATE, MAX_FRAME_RATE);
+bool main_loop_asleep = false;          // IdleFunc unregistered until the next event
+
 //|___________________
 //|
 //| Function Prototypes
@@ -94,11 +171,22 @@ gmtl::Matrix44f fixed_view_mat;
 
 void InitMatrices();
 void InitGL(void);
+void InterpolatePose(gmtl::Matrix44f &pose, const gmtl::Matrix44f &from, const gmtl::Matrix44f &to, const float alpha);
+bool InterpolatePoses(const float alpha);
 void DisplayFunc(void);
+void IdleFunc(void);
+void WakeMainLoop(void);
+void Tick(void);
 void KeyboardFunc(unsigned char key, int x, int y);
+void KeyboardUpFunc(unsigned char key, int x, int y);
 void ReshapeFunc(int w, int h);
+void EntryFunc(int state);
+bool InView(const BoundingBox &box, const gmtl::Matrix44f &modelview);
+BoundingBox FrameBounds(const float l);
+BoundingBox PlaneBounds(void);
 void DrawCoordinateFrame(const float l);
-void DrawPlane(const float width, const float length, const float height);
+void DrawPlaneLod(const gmtl::Matrix44f &modelview, int &level);
+void BuildPlane(MeshBuilder &mesh, const float width, const float length, const float height);
 
 //|____________________________________________________________________
 //|
@@ -112,8 +200,8 @@ void DrawPlane(const float width, const float length, const float height);
 
 void InitMatrices()
 {
-  const float TRANS_AMOUNT = 1.0f;
-  const float ROT_AMOUNT   = gmtl::Math::deg2Rad(5.0f); // specified in degs, but get converted to radians
+  const float TRANS_AMOUNT = MOVE_SPEED/TICK_RATE;                    // Per tick
+  const float ROT_AMOUNT   = gmtl::Math::deg2Rad(TURN_RATE/TICK_RATE); // specified in degs, but get converted to radians
 
   const float ROT_CAM = gmtl::Math::deg2Rad(90.0f);
 
@@ -195,6 +283,9 @@ void InitMatrices()
   cam_pose.setState(gmtl::Matrix44f::AFFINE);            
   gmtl::invert(view_mat, cam_pose);                 // View transform is the inverse of the camera pose
 
+  prev_plane_pose = draw_plane_pose = plane_pose;
+  prev_cam_pose   = draw_cam_pose   = cam_pose;
+
   cam_topview_pose.set(1, 0, 0, 0.0f,
                        0, 1, 0, 0.0f,
                        0, 0, 1, 15.0f,
@@ -234,6 +325,66 @@ void InitGL(void)
   glShadeModel(GL_SMOOTH);
 }
 
+//|____________________________________________________________________
+//|
+//| Function: InterpolatePose
+//|
+//! \param pose   [out] Interpolated pose.
+//! \param from   [in] Pose at alpha 0.
+//! \param to     [in] Pose at alpha 1.
+//! \param alpha  [in] 0..1.
+//! \return None.
+//!
+//! Lerps the translation and slerps the rotation, so the pose stays rigid
+//! part way through a turn. Poses that match are copied as they are.
+//|____________________________________________________________________
+
+void InterpolatePose(gmtl::Matrix44f &pose, const gmtl::Matrix44f &from, const gmtl::Matrix44f &to, const float alpha)
+{
+  if (from == to || alpha >= 1) {
+    pose = to;
+    return;
+  }
+
+  gmtl::Quatf from_q, to_q, q;
+  gmtl::Vec3f p;
+
+  gmtl::set(from_q, from);
+  gmtl::set(to_q, to);
+  gmtl::slerp(q, alpha, from_q, to_q);
+  for (int k = 0; k < 3; k++) p[k] = from(k, 3) + alpha*(to(k, 3) - from(k, 3));
+
+  pose = gmtl::Matrix44f();
+  gmtl::setRot(pose, q);
+  gmtl::setTrans(pose, p);
+  pose.setState(gmtl::Matrix44f::AFFINE);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InterpolatePoses
+//|
+//! \param alpha  [in] How far the frame lies past the last tick, 0..1.
+//! \return True if either drawn pose changed.
+//!
+//! Drawn plane and camera poses, between their poses at the last tick and
+//! their current ones, and the view transform from the drawn camera.
+//|____________________________________________________________________
+
+bool InterpolatePoses(const float alpha)
+{
+  gmtl::Matrix44f plane, cam;
+
+  InterpolatePose(plane, prev_plane_pose, plane_pose, alpha);
+  InterpolatePose(cam, prev_cam_pose, cam_pose, alpha);
+  if (plane == draw_plane_pose && cam == draw_cam_pose) return false;
+
+  draw_plane_pose = plane;
+  draw_cam_pose   = cam;
+  gmtl::invert(view_mat, draw_cam_pose);
+  return true;
+}
+
 //|____________________________________________________________________
 //|
 //| Function: DisplayFunc
@@ -246,6 +397,8 @@ void InitGL(void)
 
 void DisplayFunc(void)
 {
+  WakeMainLoop();                       // Asleep when GLUT redraws an expose or reshape
+
   // Modelview matrix
   gmtl::Matrix44f modelview_mat;        // M, as defined in the handout
 
@@ -271,11 +424,11 @@ void DisplayFunc(void)
   glLoadMatrixf(modelview_mat.mData);
   DrawCoordinateFrame(100);
 
-  // Draws plane and its local frame
-  modelview_mat *= plane_pose;               // M = C^-1 * T
-  glLoadMatrixf(modelview_mat.mData);
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
-  DrawCoordinateFrame(3);
+  // Draws plane and its local frame, unless outside the view frustum
+  modelview_mat *= draw_plane_pose;          // M = C^-1 * T
+  if (InView(PlaneBounds(), modelview_mat)) {
+    DrawPlaneLod(modelview_mat, plane_level[0]);
+  }
 
 /*
   // Approach 2 (gives the same results as the approach 1)
@@ -287,7 +440,7 @@ void DisplayFunc(void)
 
   // Draws plane and its local frame
   glMultMatrixf(plane_pose.mData);           // M = C^-1 * T (OpenGL calls build transforms in left-to-right order)
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
+  mesh_cache.Draw(mesh_cache.Get(BuildPlane, P_WIDTH, P_LENGTH, P_HEIGHT));
   DrawCoordinateFrame(3);
 */
 
@@ -302,17 +455,93 @@ void DisplayFunc(void)
   glLoadMatrixf(modelview_mat.mData);
   DrawCoordinateFrame(100);
 
-  modelview_mat *= plane_pose;               // M = C^-1 * T
-  glLoadMatrixf(modelview_mat.mData);
-  DrawPlane(P_WIDTH, P_LENGTH, P_HEIGHT);
-  DrawCoordinateFrame(3);
+  modelview_mat *= draw_plane_pose;          // M = C^-1 * T
+  if (InView(PlaneBounds(), modelview_mat)) {
+    DrawPlaneLod(modelview_mat, plane_level[1]);
+  }
 
-  modelview_mat = fixed_view_mat * cam_pose;
-  glLoadMatrixf(modelview_mat.mData);
-  DrawCoordinateFrame(3);
+  modelview_mat = fixed_view_mat * draw_cam_pose;
+  if (InView(FrameBounds(3), modelview_mat)) {
+    glLoadMatrixf(modelview_mat.mData);
+    DrawCoordinateFrame(3);
+  }
+
+  glutSwapBuffers();                         // Double buffered: frames are shown whole
+
+  FramePacing pacing;
+  if (frame_loop.EndFrame(pacing)) PrintPacing(pacing);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: IdleFunc
+//|
+//! \param None.
+//! \return None.
+//!
+//! GLUT idle callback function: the main loop. Waits for the next frame
+//! to be due, runs the ticks that came due meanwhile and asks for a redraw
+//! only if the drawn poses moved, so a frame is drawn at most once however
+//! many keys were pressed. Once no key is held and the poses have come to
+//! rest, the loop unregisters itself until WakeMainLoop() is called from
+//! the next event, so an idle window costs no CPU time.
+//|____________________________________________________________________
+
+void IdleFunc(void)
+{
+  const int ticks = frame_loop.BeginFrame();
+
+  for (int t = 0; t < ticks; t++) Tick();
+  if (InterpolatePoses(frame_loop.Alpha())) {
+    glutPostRedisplay();
+  } else {
+    frame_loop.SkipFrame();
+    if (!input.AnyHeld() && prev_plane_pose == plane_pose && prev_cam_pose == cam_pose) {
+      main_loop_asleep = true;
+      glutIdleFunc(NULL);
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: WakeMainLoop
+//|
+//! \param None.
+//! \return None.
+//!
+//! Registers IdleFunc() again if it stopped with nothing to do. The
+//! frame clock restarts, so the time asleep is not owed as ticks.
+//|____________________________________________________________________
 
+void WakeMainLoop(void)
+{
+  if (!main_loop_asleep) return;
+  main_loop_asleep = false;
+  frame_loop.Resume();
+  glutIdleFunc(IdleFunc);
+}
 
-  glFlush(); // Ensure all OpenGL commands are executed
+//|____________________________________________________________________
+//|
+//| Function: Tick
+//|
+//! \param None.
+//! \return None.
+//!
+//! Applies one tick of every held action to the plane and camera poses,
+//! keeping the poses from before for interpolation.
+//|____________________________________________________________________
+
+void Tick(void)
+{
+  prev_plane_pose = plane_pose;
+  prev_cam_pose   = cam_pose;
+
+  for (size_t i = 0; i < sizeof(POSE_ACTIONS)/sizeof(POSE_ACTIONS[0]); i++) {
+    const PoseAction &action = POSE_ACTIONS[i];
+    if (input.Held(action.action)) *action.pose = *action.pose * *action.step;
+  }
 }
 
 //|____________________________________________________________________
@@ -327,110 +556,24 @@ void DisplayFunc(void)
 
 void KeyboardFunc(unsigned char key, int x, int y)
 {
-  switch (key) {
-//|____________________________________________________________________
-//|
-//| Plane controls
-//|____________________________________________________________________
-    
-    case 'w': // Forward translation of the plane (positive Z-translation)
-      plane_pose = plane_pose * ztransp_mat;
-      break;
-    case 's': // Backward translation of the plane
-      plane_pose = plane_pose * ztransn_mat;
-      break;
-
-    // Rotation
-    case 'g': // Rolls the plane (+ Z-rot)
-      plane_pose = plane_pose * zrotp_mat;
-      break;
-    case 'f': // Rolls the plane (- Z-rot)
-      plane_pose = plane_pose * zrotn_mat;
-      break;
-
-    // TODO: Add the remaining controls/transforms
-    // x axis
-    case 'a':
-        plane_pose = plane_pose * xtransp_mat;
-        break;
-    case 'd':
-        plane_pose = plane_pose * xtransn_mat;
-        break;
-    // y axis
-    case 't':
-        plane_pose = plane_pose * ytransp_mat;
-        break;
-    case 'r':
-        plane_pose = plane_pose * ytransn_mat;
-        break;
-    // Rotation
-    // x axis
-    case 'z':
-        plane_pose = plane_pose * xrotp_mat;
-        break;
-    case 'x':
-        plane_pose = plane_pose * xrotn_mat;
-        break;
-    // y axis
-    case 'c':
-        plane_pose = plane_pose * yrotp_mat;
-        break;
-    case 'v':
-        plane_pose = plane_pose * yrotn_mat;
-        break;
-
-//|____________________________________________________________________
-//|
-//| Camera controls
-//|____________________________________________________________________
-
-    case 'u': // Forward translation of the camera (negative Z-translation - cameras looks in its (local) -Z direction)
-      cam_pose = cam_pose * ztransn_mat;
-      break;
-    case 'j': // Backward translation of the camera
-      cam_pose = cam_pose * ztransp_mat;
-      break;
-
-
-    // TODO: Add the remaining controls
-    // Translation
-    // x axis
-    case 'h': 
-        cam_pose = cam_pose * xtransn_mat;
-        break;
-    case 'k': 
-        cam_pose = cam_pose * xtransp_mat;
-        break;
-    // y axis
-    case 'l':
-        cam_pose = cam_pose * ytransn_mat;
-        break;
-    case 'o':
-        cam_pose = cam_pose * ytransp_mat;
-        break;
-
-    // Rotation
-    case 'n': 
-        cam_pose = cam_pose * zrotn_mat;
-        break;
-    case 'm': 
-        cam_pose = cam_pose * zrotp_mat;
-        break;
-    case ',': 
-        cam_pose = cam_pose * xrotn_mat;
-        break;
-    case '.': 
-        cam_pose = cam_pose * xrotp_mat;
-        break;
-    case '[':
-        cam_pose = cam_pose * yrotn_mat;
-        break;
-    case ']' : 
-        cam_pose = cam_pose * yrotp_mat;
-        break;
-  }
-  gmtl::invert(view_mat, cam_pose);       // Updates view transform to reflect the change in camera transform
-  glutPostRedisplay();                    // Asks GLUT to redraw the screen
+  WakeMainLoop();
+  input.KeyDown(key, (glutGetModifiers() & GLUT_ACTIVE_CTRL) != 0);    // Held actions run in Tick()
+}
+
+//|____________________________________________________________________
+//|
+//| Function: KeyboardUpFunc
+//|
+//! \param None.
+//! \return None.
+//!
+//! GLUT keyboard-up callback function: called for every key release event.
+//|____________________________________________________________________
+
+void KeyboardUpFunc(unsigned char key, int x, int y)
+{
+  WakeMainLoop();
+  input.KeyUp(key, (glutGetModifiers() & GLUT_ACTIVE_CTRL) != 0);
 }
 
 //|____________________________________________________________________
@@ -450,6 +593,80 @@ void ReshapeFunc(int w, int h)
   w_height = h;
 }
 
+//|____________________________________________________________________
+//|
+//| Function: EntryFunc
+//|
+//! \param state  [in] GLUT_ENTERED or GLUT_LEFT.
+//! \return None.
+//!
+//! GLUT entry callback function: called when the mouse enters or leaves
+//! the window. GLUT reports no keyboard focus changes, and keys let go
+//! in another window send no release, so held keys are let go here.
+//|____________________________________________________________________
+
+void EntryFunc(int state)
+{
+  if (state == GLUT_LEFT) input.ReleaseAll();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InView
+//|
+//! \param box          [in] Bounds in the object's frame.
+//! \param modelview    [in] Modelview matrix of the object.
+//! \return False if the box is entirely outside the view frustum.
+//!
+//! Tests against the current projection matrix. The frustum is extracted
+//! with the object's modelview matrix, so its planes are in the object's
+//! frame and the box needs no transforming.
+//|____________________________________________________________________
+
+bool InView(const BoundingBox &box, const gmtl::Matrix44f &modelview)
+{
+  GLfloat projection[16];
+  Frustum frustum;
+
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  frustum.Extract(projection, modelview.mData);
+  return frustum.Classify(box) != CR_OUTSIDE;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FrameBounds
+//|
+//! \param l      [in] length of the three axes.
+//! \return Box around the coordinate frame's axes.
+//|____________________________________________________________________
+
+BoundingBox FrameBounds(const float l)
+{
+  const float origin[3] = {0, 0, 0}, end[3] = {l, l, l};
+  BoundingBox box = EmptyBox();
+
+  Grow(box, origin);
+  Grow(box, end);
+  return box;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PlaneBounds
+//|
+//! \param None.
+//! \return Box around the plane and its local frame, from the plane's mesh.
+//|____________________________________________________________________
+
+BoundingBox PlaneBounds(void)
+{
+  BoundingBox box = FrameBounds(3);
+
+  Merge(box, mesh_cache.Bounds(mesh_cache.Get(BuildPlane, P_WIDTH, P_LENGTH, P_HEIGHT)));
+  return box;
+}
+
 //|____________________________________________________________________
 //|
 //| Function: DrawCoordinateFrame
@@ -482,17 +699,60 @@ void DrawCoordinateFrame(const float l)
 
 //|____________________________________________________________________
 //|
-//| Function: DrawPlane
+//| Function: DrawPlaneLod
+//|
+//! \param modelview   [in] Modelview matrix of the plane.
+//! \param level       [in,out] Level of detail drawn last frame; updated.
+//! \return None.
+//!
+//! Draws the plane and its local frame at the level of detail for its
+//! projected size, or just the plane's impostor when it is that small.
+//|____________________________________________________________________
+
+void DrawPlaneLod(const gmtl::Matrix44f &modelview, int &level)
+{
+  const int plane = mesh_cache.Get(BuildPlane, P_WIDTH, P_LENGTH, P_HEIGHT);
+  const BoundingBox box = PlaneBounds();
+  GLfloat projection[16];
+  GLint viewport[4];
+  float center[3], radius = 0, half_size = 0;
+
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  for (int k = 0; k < 3; k++) {
+    center[k]  = (box.min[k] + box.max[k])/2;
+    radius    += (box.max[k] - box.min[k])*(box.max[k] - box.min[k])/4;
+    half_size += (box.max[k] - box.min[k])/6;
+  }
+  level = SelectLod(level, ProjectedSize(modelview.mData, projection, (float)viewport[3], center, sqrtf(radius)));
+
+  if (level == LOD_IMPOSTOR) {
+    GLfloat billboard[16];
+    BillboardMatrix(billboard, modelview.mData, center, half_size);
+    glLoadMatrixf(billboard);
+    mesh_cache.Draw(mesh_cache.Lod(plane, LOD_IMPOSTOR));
+    return;
+  }
+
+  glLoadMatrixf(modelview.mData);
+  mesh_cache.Draw(mesh_cache.Lod(plane, level));
+  DrawCoordinateFrame(3);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BuildPlane
 //|
+//! \param mesh        [out] Mesh to record into.
 //! \param width       [in] Width  of the plane.
 //! \param length      [in] Length of the plane.
 //! \param height      [in] Height of the plane.
 //! \return None.
 //!
-//! Draws the plane.
+//! Records the plane.
 //|____________________________________________________________________
 
-void DrawPlane(const float width, const float length, const float height)
+void BuildPlane(MeshBuilder &mesh, const float width, const float length, const float height)
 {
   float w = width / 2;
   float l = length / 2;
@@ -506,106 +766,106 @@ void DrawPlane(const float width, const float length, const float height)
   float jet = lima * 1.25;
   
   // Body
-  glBegin(GL_QUADS);
-  glColor3f(1.0f, 0.0f, 0.0f);
-
-  glVertex3f(-w,  -h, lima);
-  glVertex3f( w,  -h, lima);
-  glVertex3f( w,   h, lima);
-  glVertex3f(-w,   h, lima);
-
-  glVertex3f(-w, -h, -lima);
-  glVertex3f(-w,  h, -lima);
-  glVertex3f( w, -h, -lima);
-  glVertex3f( w,  h, -lima);
-
-  glVertex3f(w, -h, -lima);
-  glVertex3f(w,  h, -lima);
-  glVertex3f(w,  h,  lima);
-  glVertex3f(w, -h,  lima);
-
-  glVertex3f(-w, -h, -lima);
-  glVertex3f(-w, -h, lima);
-  glVertex3f(-w,  h, lima);
-  glVertex3f(-w,  h, -lima);
-
-  glVertex3f(-w, h, -lima);
-  glVertex3f(-w, h, lima);
-  glVertex3f(w, h, lima);
-  glVertex3f(w, h, -lima);
-
-  glVertex3f(-w, -h, -lima);
-  glVertex3f(w, -h, -lima);
-  glVertex3f(w, -h, lima);
-  glVertex3f(-w, -h, lima);
-  glEnd();
+  mesh.Begin(GL_QUADS);
+  mesh.Color3f(1.0f, 0.0f, 0.0f);
+
+  mesh.Vertex3f(-w,  -h, lima);
+  mesh.Vertex3f( w,  -h, lima);
+  mesh.Vertex3f( w,   h, lima);
+  mesh.Vertex3f(-w,   h, lima);
+
+  mesh.Vertex3f(-w, -h, -lima);
+  mesh.Vertex3f(-w,  h, -lima);
+  mesh.Vertex3f( w, -h, -lima);
+  mesh.Vertex3f( w,  h, -lima);
+
+  mesh.Vertex3f(w, -h, -lima);
+  mesh.Vertex3f(w,  h, -lima);
+  mesh.Vertex3f(w,  h,  lima);
+  mesh.Vertex3f(w, -h,  lima);
+
+  mesh.Vertex3f(-w, -h, -lima);
+  mesh.Vertex3f(-w, -h, lima);
+  mesh.Vertex3f(-w,  h, lima);
+  mesh.Vertex3f(-w,  h, -lima);
+
+  mesh.Vertex3f(-w, h, -lima);
+  mesh.Vertex3f(-w, h, lima);
+  mesh.Vertex3f(w, h, lima);
+  mesh.Vertex3f(w, h, -lima);
+
+  mesh.Vertex3f(-w, -h, -lima);
+  mesh.Vertex3f(w, -h, -lima);
+  mesh.Vertex3f(w, -h, lima);
+  mesh.Vertex3f(-w, -h, lima);
+  mesh.End();
 
   // head 
-  glBegin(GL_TRIANGLES);
-  glColor3f(0.0f, 0.0f, 1.0f);
+  mesh.Begin(GL_TRIANGLES);
+  mesh.Color3f(0.0f, 0.0f, 1.0f);
 
-  glVertex3f(w, h, lima);
-  glVertex3f(w, -h, lima);
-  glVertex3f(w, -h, lima + l);
+  mesh.Vertex3f(w, h, lima);
+  mesh.Vertex3f(w, -h, lima);
+  mesh.Vertex3f(w, -h, lima + l);
 
-  glVertex3f(-w, h, lima);
-  glVertex3f(-w, -h, lima);
-  glVertex3f(-w, -h, lima + l);
-  glEnd();
+  mesh.Vertex3f(-w, h, lima);
+  mesh.Vertex3f(-w, -h, lima);
+  mesh.Vertex3f(-w, -h, lima + l);
+  mesh.End();
 
-  glBegin(GL_QUADS);
-  glColor3f(0.0f, 0.0f, 1.0f);
+  mesh.Begin(GL_QUADS);
+  mesh.Color3f(0.0f, 0.0f, 1.0f);
 
-  glVertex3f(-w, -h, lima + l);
-  glVertex3f(-w, h, lima);
-  glVertex3f(w, h, lima);
-  glVertex3f(w, -h, lima + l);
+  mesh.Vertex3f(-w, -h, lima + l);
+  mesh.Vertex3f(-w, h, lima);
+  mesh.Vertex3f(w, h, lima);
+  mesh.Vertex3f(w, -h, lima + l);
 
-  glVertex3f(-w, -h, lima + l);
-  glVertex3f(-w, -h, lima);
-  glVertex3f(w, -h, lima);
-  glVertex3f(w, -h, lima + l);
-  glEnd();
+  mesh.Vertex3f(-w, -h, lima + l);
+  mesh.Vertex3f(-w, -h, lima);
+  mesh.Vertex3f(w, -h, lima);
+  mesh.Vertex3f(w, -h, lima + l);
+  mesh.End();
 
   // wing
-  glBegin(GL_TRIANGLES);
-  glColor3f(0.0f, 1.0f, 0.0f);
+  mesh.Begin(GL_TRIANGLES);
+  mesh.Color3f(0.0f, 1.0f, 0.0f);
 
-  glVertex3f(w, -h, -lima);
-  glVertex3f(whiskey, -h, -lima);
-  glVertex3f(w, -h, lima + l);
+  mesh.Vertex3f(w, -h, -lima);
+  mesh.Vertex3f(whiskey, -h, -lima);
+  mesh.Vertex3f(w, -h, lima + l);
 
-  glVertex3f(-w, -h, -lima);
-  glVertex3f(-whiskey, -h, -lima);
-  glVertex3f(-w, -h, lima + l);
-  glEnd();
+  mesh.Vertex3f(-w, -h, -lima);
+  mesh.Vertex3f(-whiskey, -h, -lima);
+  mesh.Vertex3f(-w, -h, lima + l);
+  mesh.End();
 
   // tail 
-  glBegin(GL_TRIANGLES);
-  glColor3f(0.0f, 1.0f, 1.0f);
-
-  glVertex3f(tango, h, -lima);
-  glVertex3f(tango, hotel, -lima);
-  glVertex3f(tango, h, tail_lima);
-
-  glVertex3f(-tango, h, -lima);
-  glVertex3f(-tango, hotel, -lima);
-  glVertex3f(-tango, h, tail_lima);
-  glEnd();
-
-  glBegin(GL_QUADS);
-  glColor3f(0.0f, 1.0f, 1.0f);
-
-  glVertex3f(-tango, h, tail_lima);
-  glVertex3f(-tango, hotel, -lima);
-  glVertex3f(tango, hotel, -lima);
-  glVertex3f(tango, h, tail_lima);
-
-  glVertex3f(-tango, h, -lima);
-  glVertex3f(-tango, hotel, -lima);
-  glVertex3f(tango, hotel, -lima);
-  glVertex3f(tango, h, -lima);
-  glEnd();
+  mesh.Begin(GL_TRIANGLES);
+  mesh.Color3f(0.0f, 1.0f, 1.0f);
+
+  mesh.Vertex3f(tango, h, -lima);
+  mesh.Vertex3f(tango, hotel, -lima);
+  mesh.Vertex3f(tango, h, tail_lima);
+
+  mesh.Vertex3f(-tango, h, -lima);
+  mesh.Vertex3f(-tango, hotel, -lima);
+  mesh.Vertex3f(-tango, h, tail_lima);
+  mesh.End();
+
+  mesh.Begin(GL_QUADS);
+  mesh.Color3f(0.0f, 1.0f, 1.0f);
+
+  mesh.Vertex3f(-tango, h, tail_lima);
+  mesh.Vertex3f(-tango, hotel, -lima);
+  mesh.Vertex3f(tango, hotel, -lima);
+  mesh.Vertex3f(tango, h, tail_lima);
+
+  mesh.Vertex3f(-tango, h, -lima);
+  mesh.Vertex3f(-tango, hotel, -lima);
+  mesh.Vertex3f(tango, hotel, -lima);
+  mesh.Vertex3f(tango, h, -lima);
+  mesh.End();
 }
 
 //|____________________________________________________________________
@@ -621,10 +881,11 @@ void DrawPlane(const float width, const float length, const float height)
 int main(int argc, char **argv)
 { 
   InitMatrices();
+  input.Bind(KEY_BINDINGS, sizeof(KEY_BINDINGS)/sizeof(KEY_BINDINGS[0]));
 
   glutInit(&argc, argv);
 
-  glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
   glutInitWindowSize(w_width, w_height);
   
   glutCreateWindow("Plane Episode 1");
@@ -632,6 +893,10 @@ int main(int argc, char **argv)
   glutDisplayFunc(DisplayFunc);
   glutReshapeFunc(ReshapeFunc);
   glutKeyboardFunc(KeyboardFunc);
+  glutKeyboardUpFunc(KeyboardUpFunc);
+  glutIgnoreKeyRepeat(1);                   // Held keys are tracked by InputState
+  glutEntryFunc(EntryFunc);                 // Held keys let go on leaving the window
+  glutIdleFunc(IdleFunc);                   // Main loop
   
   InitGL();
 
@@ -0,0 +1,494 @@
+//|___________________________________________________________________
+//!
+//! \file Culling.cpp
+//!
+//! \brief Bounding volumes and view-frustum culling (see Culling.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#include "Culling.h"
+#include "JobSystem.h"
+
+// Objects per leaf of the hierarchy
+const int BVH_LEAF_SIZE = 4;
+const int BVH_SPLIT_OBJECTS = 2048;     // Objects per subtree refit or queried as one job
+
+// Rebuild once the leaves' total surface area reaches this multiple of the
+// area right after the last build
+const float BVH_REBUILD_GROWTH = 2.0f;
+
+//|____________________________________________________________________
+//|
+//| Function: EmptyBox
+//|
+//! \param None.
+//! \return A box containing nothing.
+//|____________________________________________________________________
+
+BoundingBox EmptyBox()
+{
+  BoundingBox box = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+  return box;
+}
+
+bool IsEmpty(const BoundingBox &box)
+{
+  return box.min[0] > box.max[0];
+}
+
+void Grow(BoundingBox &box, const float point[3])
+{
+  for (int k = 0; k < 3; k++) {
+    box.min[k] = std::min(box.min[k], point[k]);
+    box.max[k] = std::max(box.max[k], point[k]);
+  }
+}
+
+void Merge(BoundingBox &box, const BoundingBox &other)
+{
+  if (IsEmpty(other)) return;
+  Grow(box, other.min);
+  Grow(box, other.max);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: TransformBox
+//|
+//! \param m      [in] Column-major affine matrix.
+//! \param box    [in] Box in the frame "m" maps from.
+//! \return Axis-aligned box around the transformed box.
+//!
+//! Transforms the center and takes the extent along each output axis as
+//! the sum of the absolute matrix entries times the half sizes.
+//|____________________________________________________________________
+
+BoundingBox TransformBox(const float m[16], const BoundingBox &box)
+{
+  BoundingBox out;
+
+  if (IsEmpty(box)) return box;
+
+  for (int r = 0; r < 3; r++) {
+    float center = m[12 + r], extent = 0;
+    for (int c = 0; c < 3; c++) {
+      center += m[4*c + r]*(box.min[c] + box.max[c])/2;
+      extent += fabsf(m[4*c + r])*(box.max[c] - box.min[c])/2;
+    }
+    out.min[r] = center - extent;
+    out.max[r] = center + extent;
+  }
+  return out;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Frustum::Extract
+//|
+//! \param projection   [in] Projection matrix, column-major.
+//! \param modelview    [in] Modelview matrix, column-major.
+//! \return None.
+//!
+//! Each plane is the last row of clip = projection*modelview plus or minus
+//! one of the other rows (Gribb and Hartmann).
+//|____________________________________________________________________
+
+void Frustum::Extract(const float projection[16], const float modelview[16])
+{
+  float clip[16];
+
+  for (int c = 0; c < 4; c++) {
+    for (int r = 0; r < 4; r++) {
+      clip[4*c + r] = projection[r]*modelview[4*c] + projection[4 + r]*modelview[4*c + 1] +
+                      projection[8 + r]*modelview[4*c + 2] + projection[12 + r]*modelview[4*c + 3];
+    }
+  }
+
+  for (int p = 0; p < 6; p++) {
+    const int   row  = p/2;                  // Left/right, bottom/top, near/far
+    const float sign = (p % 2) ? -1.0f : 1.0f;
+    float length;
+
+    for (int c = 0; c < 4; c++) planes[p][c] = clip[4*c + 3] + sign*clip[4*c + row];
+    length = sqrtf(planes[p][0]*planes[p][0] + planes[p][1]*planes[p][1] + planes[p][2]*planes[p][2]);
+    for (int c = 0; c < 4; c++) planes[p][c] /= length;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Frustum::Classify
+//|
+//! \param box    [in] Box in the frustum's frame.
+//! \return Where the box is w.r.t. the frustum.
+//!
+//! Tests the box corner furthest along each plane's normal (outside if it
+//! is behind) and the nearest one (crossing if it is behind). Boxes near a
+//! frustum corner can be reported as crossing when they are outside.
+//|____________________________________________________________________
+
+CullResult Frustum::Classify(const BoundingBox &box) const
+{
+  CullResult result = CR_INSIDE;
+
+  if (IsEmpty(box)) return CR_OUTSIDE;
+
+  for (int p = 0; p < 6; p++) {
+    const float *n = planes[p];
+    float far_d = n[3], near_d = n[3];
+
+    for (int k = 0; k < 3; k++) {
+      far_d  += n[k]*(n[k] >= 0 ? box.max[k] : box.min[k]);
+      near_d += n[k]*(n[k] >= 0 ? box.min[k] : box.max[k]);
+    }
+    if (far_d < 0) return CR_OUTSIDE;
+    if (near_d < 0) result = CR_INTERSECTS;
+  }
+  return result;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Frustum::Classify
+//|
+//! \param center   [in] Sphere center in the frustum's frame.
+//! \param radius   [in] Sphere radius.
+//! \return Where the sphere is w.r.t. the frustum.
+//|____________________________________________________________________
+
+CullResult Frustum::Classify(const float center[3], float radius) const
+{
+  CullResult result = CR_INSIDE;
+
+  for (int p = 0; p < 6; p++) {
+    const float *n = planes[p];
+    float d = n[0]*center[0] + n[1]*center[1] + n[2]*center[2] + n[3];
+
+    if (d < -radius) return CR_OUTSIDE;
+    if (d < radius) result = CR_INTERSECTS;
+  }
+  return result;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::BoundingVolumeHierarchy
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+  : radius(0), built_area(0), leaf_area(0), builds(0), tested(0)
+{
+}
+
+const float *BoundingVolumeHierarchy::Center(const float *centers, int stride, int object) const
+{
+  return (const float *)((const char *)centers + (size_t)object*stride);
+}
+
+// Orders object indices by one coordinate of their centers
+struct CenterLess {
+  const char *centers;
+  int         stride;
+  int         axis;
+  bool operator()(int a, int b) const {
+    return ((const float *)(centers + (size_t)a*stride))[axis] < ((const float *)(centers + (size_t)b*stride))[axis];
+  }
+};
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::Build
+//|
+//! \param centers  [in] Object centers (see Refit).
+//! \param stride   [in] Bytes between centers.
+//! \param first    [in] Range of "order" to build a subtree over.
+//! \param count    [in]
+//! \return Index of the subtree's root.
+//!
+//! Splits the range at the median of the centers along the axis where they
+//! spread most, until a range fits in a leaf. Boxes are left to Refit().
+//|____________________________________________________________________
+
+int BoundingVolumeHierarchy::Build(const float *centers, int stride, int first, int count)
+{
+  const int node = (int)nodes.size();
+  Node n = {EmptyBox(), node + 1, first, count};
+
+  nodes.push_back(n);
+  if (count <= BVH_LEAF_SIZE) return node;
+
+  BoundingBox spread = EmptyBox();
+  for (int i = first; i < first + count; i++) Grow(spread, Center(centers, stride, order[i]));
+
+  CenterLess less = {(const char *)centers, stride, 0};
+  for (int k = 1; k < 3; k++) {
+    if (spread.max[k] - spread.min[k] > spread.max[less.axis] - spread.min[less.axis]) less.axis = k;
+  }
+
+  const int half = count/2;
+  std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, less);
+  Build(centers, stride, first, half);
+  Build(centers, stride, first + half, count - half);
+  nodes[node].end = (int)nodes.size();
+  return node;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::Split
+//|
+//! \param None.
+//! \return None.
+//!
+//! Cuts the tree into subtrees of at most BVH_SPLIT_OBJECTS objects, the
+//! units of parallel work, and the nodes above them.
+//|____________________________________________________________________
+
+void BoundingVolumeHierarchy::Split()
+{
+  const int count = (int)nodes.size();
+  int i = 0;
+
+  splits.clear();
+  top.clear();
+  while (i < count) {
+    if (nodes[i].count <= BVH_SPLIT_OBJECTS || nodes[i].end == i + 1) {
+      splits.push_back(i);
+      i = nodes[i].end;
+    } else {
+      top.push_back(i++);
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::Refit
+//|
+//! \param centers  [in] First object's center; 3 floats.
+//! \param stride   [in] Bytes from one object's center to the next.
+//! \param count    [in] Number of objects.
+//! \param radius   [in] Bounding sphere radius of every object.
+//! \param jobs     [in] Job system to refit the subtrees on, or NULL.
+//! \return None.
+//!
+//! With jobs, the split subtrees are refit in parallel and then the nodes
+//! above them, last to first.
+//|____________________________________________________________________
+
+void BoundingVolumeHierarchy::Refit(const float *centers, int stride, int count, float radius, JobSystem *jobs)
+{
+  this->radius = radius;
+
+  if ((int)order.size() != count) {
+    order.resize(count);
+    for (int i = 0; i < count; i++) order[i] = i;
+    sorted_centers.resize(3*count);
+    built_area = 0;
+  } else if (built_area > 0 && leaf_area > BVH_REBUILD_GROWTH*built_area) {
+    built_area = 0;     // Regroup; the current order is as good a start as any
+  }
+  if (built_area == 0) {
+    nodes.clear();
+    if (count > 0) Build(centers, stride, 0, count);
+    Split();
+    builds++;
+  }
+
+  if (!jobs) {
+    RefitRange(centers, stride, 0, (int)nodes.size());
+  } else {
+    jobs->ParallelFor((int)splits.size(), 1, [&](int first, int last) {
+      for (int s = first; s < last; s++) RefitRange(centers, stride, splits[s], nodes[splits[s]].end);
+    });
+    for (int t = (int)top.size() - 1; t >= 0; t--) RefitRange(centers, stride, top[t], top[t] + 1);
+  }
+
+  leaf_area = LeafArea();
+  if (built_area == 0) built_area = leaf_area;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::LeafArea
+//|
+//! \param None.
+//! \return Total surface area of the leaf boxes, 0 without objects.
+//!
+//! A query's cost grows with the chance that a frustum plane crosses a
+//! leaf, which goes with the leaf's surface area.
+//|____________________________________________________________________
+
+float BoundingVolumeHierarchy::LeafArea() const
+{
+  double area = 0;
+
+  for (int i = 0; i < (int)nodes.size(); i++) {
+    const Node &n = nodes[i];
+    if (n.end != i + 1) continue;
+
+    const float dx = n.box.max[0] - n.box.min[0], dy = n.box.max[1] - n.box.min[1], dz = n.box.max[2] - n.box.min[2];
+    area += 2*((double)dx*dy + (double)dy*dz + (double)dz*dx);
+  }
+  return (float)area;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::RefitRange
+//|
+//! \param centers  [in] Object centers (see Refit).
+//! \param stride   [in] Bytes between centers.
+//! \param first    [in] Range of nodes to refit.
+//! \param end      [in]
+//! \return None.
+//!
+//! Children follow their parent in the node array, so a backward pass sees
+//! both children of a node before the node itself. The centers are copied
+//! in leaf order for Query().
+//|____________________________________________________________________
+
+void BoundingVolumeHierarchy::RefitRange(const float *centers, int stride, int first, int end)
+{
+  for (int i = end - 1; i >= first; i--) {
+    Node &n = nodes[i];
+
+    if (n.end == i + 1) {
+      n.box = EmptyBox();
+      for (int j = n.first; j < n.first + n.count; j++) {
+        const float *center = Center(centers, stride, order[j]);
+        for (int k = 0; k < 3; k++) sorted_centers[3*j + k] = center[k];
+        Grow(n.box, center);
+      }
+      for (int k = 0; k < 3; k++) {
+        n.box.min[k] -= radius;
+        n.box.max[k] += radius;
+      }
+    } else {
+      n.box = nodes[i + 1].box;                   // Left child
+      Merge(n.box, nodes[nodes[i + 1].end].box);  // Right child starts where the left one ends
+    }
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::Query
+//|
+//! \param frustum  [in] Frustum in the frame of the centers.
+//! \param visible  [in,out] Indices of the visible objects are appended.
+//! \param jobs     [in] Job system to query the subtrees on, or NULL.
+//! \return None.
+//!
+//! With jobs, the nodes above the split subtrees are tested first on the
+//! calling thread, which leaves each subtree outside, inside or to be
+//! queried. The subtrees are then queried in parallel, each into its own
+//! list, and the lists appended in tree order: the result is the same as
+//! without jobs.
+//|____________________________________________________________________
+
+void BoundingVolumeHierarchy::Query(const Frustum &frustum, std::vector<int> &visible, JobSystem *jobs) const
+{
+  const int count = (int)nodes.size();
+  const int split_count = (int)splits.size();
+  int i = 0, s = 0;
+
+  if (!jobs || split_count <= 1) {
+    tested = QueryRange(frustum, 0, count, visible);
+    return;
+  }
+
+  tested = 0;
+  split_state.assign(split_count, CR_OUTSIDE);
+  while (i < count) {
+    while (s < split_count && splits[s] < i) s++;     // Skipped with an outside node
+    if (s < split_count && splits[s] == i) {
+      split_state[s++] = CR_INTERSECTS;
+      i = nodes[i].end;
+      continue;
+    }
+
+    const Node &n = nodes[i];
+    const CullResult result = frustum.Classify(n.box);
+
+    tested++;
+    if (result == CR_OUTSIDE) {
+      i = n.end;
+    } else if (result == CR_INSIDE) {
+      for (; s < split_count && splits[s] < n.end; s++) split_state[s] = CR_INSIDE;
+      i = n.end;
+    } else {
+      i++;
+    }
+  }
+
+  std::atomic<int> split_tested(0);
+  split_visible.resize(split_count);
+  jobs->ParallelFor(split_count, 1, [&](int first, int last) {
+    for (int k = first; k < last; k++) {
+      const Node &n = nodes[splits[k]];
+      std::vector<int> &found = split_visible[k];
+
+      found.clear();
+      if (split_state[k] == CR_INSIDE) {
+        found.assign(order.begin() + n.first, order.begin() + n.first + n.count);
+      } else if (split_state[k] == CR_INTERSECTS) {
+        split_tested += QueryRange(frustum, splits[k], n.end, found);
+      }
+    }
+  });
+  tested += split_tested;
+  for (int k = 0; k < split_count; k++) visible.insert(visible.end(), split_visible[k].begin(), split_visible[k].end());
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BoundingVolumeHierarchy::QueryRange
+//|
+//! \param frustum  [in] Frustum in the frame of the centers.
+//! \param first    [in] Root of the subtree to query.
+//! \param end      [in] End of its subtree.
+//! \param visible  [in,out] Indices of the visible objects are appended.
+//! \return Nodes tested.
+//!
+//! A subtree outside the frustum is skipped and one inside it is taken
+//! whole; only leaves crossing a plane test their objects one by one.
+//! Uses the centers of the last Refit().
+//|____________________________________________________________________
+
+int BoundingVolumeHierarchy::QueryRange(const Frustum &frustum, int first, int end, std::vector<int> &visible) const
+{
+  int i = first, node_tests = 0;
+
+  while (i < end) {
+    const Node &n = nodes[i];
+    const CullResult result = frustum.Classify(n.box);
+
+    node_tests++;
+    if (result == CR_OUTSIDE) {
+      i = n.end;
+    } else if (result == CR_INSIDE) {
+      visible.insert(visible.end(), order.begin() + n.first, order.begin() + n.first + n.count);
+      i = n.end;
+    } else if (n.end == i + 1) {
+      for (int j = n.first; j < n.first + n.count; j++) {
+        if (frustum.Classify(&sorted_centers[3*j], radius) != CR_OUTSIDE) visible.push_back(order[j]);
+      }
+      i = n.end;
+    } else {
+      i++;
+    }
+  }
+  return node_tests;
+}
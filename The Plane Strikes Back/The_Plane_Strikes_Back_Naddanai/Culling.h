@@ -0,0 +1,113 @@
+//|___________________________________________________________________
+//!
+//! \file Culling.h
+//!
+//! \brief Bounding volumes, view-frustum tests and a bounding-volume
+//! hierarchy over many objects.
+//!
+//! The frustum is extracted from projection*modelview, so its planes are in
+//! whatever frame the modelview matrix maps from: with the view matrix alone
+//! they are in world coordinates, with a full modelview matrix they are in
+//! the object's own frame and its local bounds can be tested directly.
+//!
+//! The hierarchy stores its nodes in depth-first order with the end of each
+//! node's subtree, like SceneGraph, so a culled node skips its whole subtree
+//! by jumping ahead instead of popping a stack. Each frame only the boxes
+//! are refit bottom-up from the objects' current centers. As the objects
+//! move apart from the ones they were grouped with, the leaves stretch and
+//! queries slow down, so the tree is rebuilt once the leaves' total surface
+//! area has grown past a multiple of what it was after the last build.
+//!
+//! Given a JobSystem, refits and queries work on subtrees of up to a few
+//! thousand objects in parallel, then on the few nodes above them.
+//|___________________________________________________________________
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <vector>
+
+class JobSystem;
+
+// Axis-aligned box; empty when min > max
+struct BoundingBox {
+  float min[3];
+  float max[3];
+};
+
+enum CullResult {CR_OUTSIDE = 0, CR_INTERSECTS, CR_INSIDE};
+
+// Box that contains nothing; Grow() and Merge() start from it
+BoundingBox EmptyBox();
+bool IsEmpty(const BoundingBox &box);
+void Grow(BoundingBox &box, const float point[3]);
+void Merge(BoundingBox &box, const BoundingBox &other);
+
+// Box around "box" after the column-major affine transform "m"
+BoundingBox TransformBox(const float m[16], const BoundingBox &box);
+
+class Frustum
+{
+ public:
+  // Planes of projection*modelview, both column-major
+  void Extract(const float projection[16], const float modelview[16]);
+
+  CullResult Classify(const BoundingBox &box) const;
+  CullResult Classify(const float center[3], float radius) const;
+
+ private:
+  float planes[6][4];   // a*x + b*y + c*z + d >= 0 inside; (a, b, c) normalized
+};
+
+class BoundingVolumeHierarchy
+{
+ public:
+  BoundingVolumeHierarchy();
+
+  // Fits the tree to spheres of radius "radius" centered at "centers" (3
+  // floats every "stride" bytes). Rebuilds the tree when "count" changed
+  // or the leaves have grown too loose, otherwise only refits the boxes.
+  // "jobs" (NULL for none) refits subtrees in parallel.
+  void Refit(const float *centers, int stride, int count, float radius, JobSystem *jobs = NULL);
+
+  // Appends the indices of the objects in or crossing the frustum, in the
+  // same order with or without "jobs"
+  void Query(const Frustum &frustum, std::vector<int> &visible, JobSystem *jobs = NULL) const;
+
+  // Nodes the last Query() tested, out of NodeCount()
+  int  Tested() const       { return tested; }
+  int  NodeCount() const    { return (int)nodes.size(); }
+
+  // Times the tree was built
+  int  Builds() const       { return builds; }
+
+ private:
+  struct Node {
+    BoundingBox box;
+    int         end;        // One past the last node of this subtree
+    int         first;      // Range of "order" under this node
+    int         count;
+  };
+
+  int  Build(const float *centers, int stride, int first, int count);
+  void Split();
+  void RefitRange(const float *centers, int stride, int first, int end);
+  float LeafArea() const;
+  int  QueryRange(const Frustum &frustum, int first, int end, std::vector<int> &visible) const;
+  const float *Center(const float *centers, int stride, int object) const;
+
+  std::vector<Node>  nodes;
+  std::vector<int>   order;           // Object indices, grouped by leaf
+  std::vector<float> sorted_centers;  // 3 per object, in the same order
+  std::vector<int>   splits;          // Roots of the subtrees handled as one job, in order
+  std::vector<int>   top;             // Nodes above those subtrees, in order
+  mutable std::vector<char>             split_state;    // Per split subtree: outside, inside or to query
+  mutable std::vector<std::vector<int> > split_visible; // Query() results per split subtree
+  float              radius;
+  float              built_area;      // Leaf surface area after the last build, 0 until refit
+  float              leaf_area;       // ... after the last refit
+  int                builds;
+  mutable int        tested;
+};
+
+#endif
@@ -0,0 +1,521 @@
+//|___________________________________________________________________
+//!
+//! \file FleetRenderer.cpp
+//!
+//! \brief Instanced drawing of many articulated aircraft (see FleetRenderer.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "FleetRenderer.h"
+#include "GLExtensions.h"
+#include "JobSystem.h"
+#include "Lod.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const FleetJoint FLEET_FIXED_JOINT = {{0, 0, 0}, {0, 1, 0}, -1};
+
+// Generic attribute slots of the instance data (clear of the slots some
+// drivers alias to gl_Vertex and gl_Color)
+enum InstanceAttribute {IA_POSITION = 9, IA_ORIENTATION, IA_ANGLES};
+
+// Visible aircraft per range when selecting levels and packing in parallel
+const int PACK_GRAIN = 2048;
+
+// Places one copy of a part: child joint, then mount joint, then the
+// aircraft pose. A joint angle is dot(select, angles), select being one-hot
+// or zero for a fixed joint. With billboard_size set, the vertex is instead
+// a corner of an impostor quad facing the camera at the aircraft position.
+static const char *VERTEX_PROGRAM =
+  "#version 120\n"
+  "#extension GL_ARB_draw_instanced : require\n"
+  "attribute vec3 instance_position;\n"
+  "attribute vec4 instance_orientation;\n"
+  "attribute vec4 instance_angles;\n"
+  "uniform float copies;\n"
+  "uniform vec3  mount_offset[2];\n"
+  "uniform vec3  mount_axis[2];\n"
+  "uniform vec4  mount_select[2];\n"
+  "uniform vec3  child_offset;\n"
+  "uniform vec3  child_axis;\n"
+  "uniform vec4  child_select;\n"
+  "uniform float billboard_size;\n"
+  "\n"
+  "vec3 Rotate(vec3 axis, float degs, vec3 v)\n"
+  "{\n"
+  "  float a = radians(degs);\n"
+  "  return v*cos(a) + cross(axis, v)*sin(a) + axis*dot(axis, v)*(1.0 - cos(a));\n"
+  "}\n"
+  "\n"
+  "void main()\n"
+  "{\n"
+  "  if (billboard_size > 0.0) {\n"
+  "    vec4 eye = gl_ModelViewMatrix*vec4(instance_position, 1.0);\n"
+  "    eye.xy += gl_Vertex.xy*billboard_size;\n"
+  "    gl_Position   = gl_ProjectionMatrix*eye;\n"
+  "    gl_FrontColor = gl_Color;\n"
+  "    return;\n"
+  "  }\n"
+  "\n"
+  "  int  copy = int(mod(float(gl_InstanceIDARB), copies));\n"
+  "  vec4 q    = instance_orientation;\n"
+  "  vec3 v    = child_offset + Rotate(child_axis, dot(child_select, instance_angles), gl_Vertex.xyz);\n"
+  "\n"
+  "  v = mount_offset[copy] + Rotate(mount_axis[copy], dot(mount_select[copy], instance_angles), v);\n"
+  "  v = instance_position + v + 2.0*cross(q.xyz, cross(q.xyz, v) + q.w*v);\n"
+  "  gl_Position   = gl_ModelViewProjectionMatrix*vec4(v, 1.0);\n"
+  "  gl_FrontColor = gl_Color;\n"
+  "}\n";
+
+static float Length(const float v[3])
+{
+  return sqrtf(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::FleetRenderer
+//|
+//! \param meshes     [in] Cache holding the part meshes.
+//! \return None.
+//|____________________________________________________________________
+
+FleetRenderer::FleetRenderer(MeshCache &meshes)
+  : meshes(meshes), radius(0), impostor_size(0), bvh_tested(0), prepared(NULL), lod(true), initialized(false), program(0), instance_buffer(0), draw_calls(0)
+{
+  for (int l = 0; l < LOD_LEVELS; l++) level_first[l] = level_count[l] = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::AddPart
+//|
+//! \param part   [in] Part drawn on every aircraft.
+//! \return None.
+//!
+//! Grows the aircraft's bounding sphere to hold the part: the joints can
+//! point the part anywhere, so the sphere's radius is the joint offsets'
+//! lengths plus the mesh's furthest corner from its origin. The first part
+//! (the body) sizes the impostor: its mean half extent.
+//|____________________________________________________________________
+
+void FleetRenderer::AddPart(const FleetPart &part)
+{
+  const BoundingBox &box = meshes.Bounds(part.mesh);
+  float reach = 0;
+
+  for (int k = 0; k < 3; k++) {
+    float corner = std::max(fabsf(box.min[k]), fabsf(box.max[k]));
+    reach += corner*corner;
+  }
+  reach = sqrtf(reach) + Length(part.child.offset);
+  for (int c = 0; c < part.copies; c++) radius = std::max(radius, Length(part.mount[c].offset) + reach);
+
+  if (parts.empty()) impostor_size = (box.max[0] - box.min[0] + box.max[1] - box.min[1] + box.max[2] - box.min[2])/6;
+  parts.push_back(part);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Init
+//|
+//! \param None.
+//! \return True if instanced drawing is available.
+//!
+//! Compiles the vertex program and creates the instance buffer.
+//|____________________________________________________________________
+
+bool FleetRenderer::Init()
+{
+  const GLExtensions &gl = Extensions();
+  GLuint shader;
+  GLint ok;
+  char log[1024];
+
+  initialized = true;
+  if (!gl.instancing) {
+    printf("Instanced drawing unavailable; drawing the fleet one aircraft at a time\n");
+    return false;
+  }
+
+  shader = gl.CreateShader(GL_VERTEX_SHADER);
+  gl.ShaderSource(shader, 1, &VERTEX_PROGRAM, NULL);
+  gl.CompileShader(shader);
+  gl.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+  if (!ok) {
+    gl.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+    printf("Fleet vertex program failed to compile; drawing one aircraft at a time\n%s\n", log);
+    return false;
+  }
+
+  program = gl.CreateProgram();
+  gl.AttachShader(program, shader);
+  gl.BindAttribLocation(program, IA_POSITION,    "instance_position");
+  gl.BindAttribLocation(program, IA_ORIENTATION, "instance_orientation");
+  gl.BindAttribLocation(program, IA_ANGLES,      "instance_angles");
+  gl.LinkProgram(program);
+  gl.GetProgramiv(program, GL_LINK_STATUS, &ok);
+  if (!ok) {
+    gl.GetProgramInfoLog(program, sizeof(log), NULL, log);
+    printf("Fleet vertex program failed to link; drawing one aircraft at a time\n%s\n", log);
+    program = 0;
+    return false;
+  }
+
+  copies       = gl.GetUniformLocation(program, "copies");
+  mount_offset = gl.GetUniformLocation(program, "mount_offset");
+  mount_axis   = gl.GetUniformLocation(program, "mount_axis");
+  mount_select = gl.GetUniformLocation(program, "mount_select");
+  child_offset = gl.GetUniformLocation(program, "child_offset");
+  child_axis   = gl.GetUniformLocation(program, "child_axis");
+  child_select = gl.GetUniformLocation(program, "child_select");
+  billboard_size = gl.GetUniformLocation(program, "billboard_size");
+
+  gl.GenBuffers(1, &instance_buffer);
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Drawn
+//|
+//! \param None.
+//! \return Aircraft drawn by the last Draw(), at any level.
+//|____________________________________________________________________
+
+int FleetRenderer::Drawn() const
+{
+  int drawn = 0;
+
+  for (int l = 0; l < LOD_LEVELS; l++) drawn += level_count[l];
+  return drawn;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Draw
+//|
+//! \param aircraft   [in] Pose and joint angles of each aircraft.
+//! \param count      [in] Number of aircraft.
+//! \param frustum    [in] View frustum in world coordinates, or NULL.
+//! \return None.
+//|____________________________________________________________________
+
+void FleetRenderer::Draw(const AircraftInstance *aircraft, int count, const Frustum *frustum)
+{
+  GLfloat view[16], projection[16];
+  GLint viewport[4];
+
+  glGetFloatv(GL_MODELVIEW_MATRIX, view);
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  Prepare(aircraft, count, frustum, view, projection, (float)viewport[3]);
+  Submit();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Prepare
+//|
+//! \param aircraft         [in] Pose and joint angles of each aircraft.
+//! \param count            [in] Number of aircraft.
+//! \param frustum          [in] View frustum in world coordinates, or NULL.
+//! \param view             [in] World-to-eye matrix, column-major.
+//! \param projection       [in] Projection matrix, column-major.
+//! \param viewport_height  [in] In pixels.
+//! \param jobs             [in] Job system to spread the work over, or NULL.
+//! \return None.
+//!
+//! The aircraft to draw (the visible ones with a frustum) are gathered
+//! into a packed copy grouped by level of detail, which is then drawn in
+//! place of the whole fleet. With neither culling nor levels of detail the
+//! fleet is drawn as it is.
+//|____________________________________________________________________
+
+void FleetRenderer::Prepare(const AircraftInstance *aircraft, int count, const Frustum *frustum,
+                            const float view[16], const float projection[16], float viewport_height,
+                            JobSystem *jobs)
+{
+  for (int l = 0; l < LOD_LEVELS; l++) level_first[l] = level_count[l] = 0;
+  prepared   = aircraft;
+  bvh_tested = 0;
+  if (count <= 0) return;
+
+  if (!frustum && !lod) {
+    level_count[LOD_FULL] = count;
+    return;
+  }
+
+  visible.clear();
+  if (frustum) {
+    bvh.Refit(aircraft[0].position, sizeof(AircraftInstance), count, radius, jobs);
+    bvh.Query(*frustum, visible, jobs);
+    bvh_tested = bvh.Tested();
+  } else {
+    visible.resize(count);
+    for (int i = 0; i < count; i++) visible[i] = i;
+  }
+  if (visible.empty()) return;
+
+  SelectLevels(aircraft, count, view, projection, viewport_height, jobs);
+  Pack(aircraft, jobs);
+  prepared = &visible_aircraft[0];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Submit
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+void FleetRenderer::Submit()
+{
+  if (!initialized) Init();
+
+  draw_calls = 0;
+  if (Drawn() == 0) return;
+
+  if (program) {
+    DrawInstanced(prepared);
+  } else {
+    DrawEach(prepared);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::SelectLevels
+//|
+//! \param aircraft         [in] Pose and joint angles of each aircraft.
+//! \param count            [in] Number of aircraft.
+//! \param view             [in] World-to-eye matrix, column-major.
+//! \param projection       [in] Projection matrix, column-major.
+//! \param viewport_height  [in] In pixels.
+//! \param jobs             [in] Job system to spread the work over, or NULL.
+//! \return None.
+//!
+//! Updates the level of each visible aircraft from its projected size and
+//! lays the levels out one after the other (level_first, level_count).
+//! Aircraft that were not visible keep their level from when they were.
+//! The levels are also counted per range of "visible" for Pack().
+//|____________________________________________________________________
+
+void FleetRenderer::SelectLevels(const AircraftInstance *aircraft, int count, const float view[16],
+                                 const float projection[16], float viewport_height, JobSystem *jobs)
+{
+  const int visible_count = (int)visible.size();
+
+  if ((int)level.size() != count) level.assign(count, LOD_FULL);
+  range_level_count.assign(((visible_count + PACK_GRAIN - 1)/PACK_GRAIN)*LOD_LEVELS, 0);
+
+  ParallelFor(jobs, visible_count, PACK_GRAIN, [&](int first, int last) {
+    int *counts = &range_level_count[(first/PACK_GRAIN)*LOD_LEVELS];
+
+    for (int i = first; i < last; i++) {
+      const int n = visible[i];
+
+      if (lod) {
+        const float pixels = ProjectedSize(view, projection, viewport_height, aircraft[n].position, radius);
+        level[n] = (char)SelectLod(level[n], pixels);
+      } else {
+        level[n] = LOD_FULL;
+      }
+      counts[(int)level[n]]++;
+    }
+  });
+
+  for (size_t r = 0; r < range_level_count.size(); r++) level_count[r % LOD_LEVELS] += range_level_count[r];
+  for (int l = 1; l < LOD_LEVELS; l++) level_first[l] = level_first[l - 1] + level_count[l - 1];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::Pack
+//|
+//! \param aircraft   [in] Pose and joint angles of each aircraft.
+//! \param jobs       [in] Job system to spread the work over, or NULL.
+//! \return None.
+//!
+//! Copies the visible aircraft into "visible_aircraft", grouped by level.
+//! Each range of "visible" writes from where the ranges before it left off
+//! in every level, so the ranges run independently and the result is in
+//! the order of "visible" either way.
+//|____________________________________________________________________
+
+void FleetRenderer::Pack(const AircraftInstance *aircraft, JobSystem *jobs)
+{
+  int next[LOD_LEVELS];
+
+  for (int l = 0; l < LOD_LEVELS; l++) next[l] = level_first[l];
+  for (size_t r = 0; r < range_level_count.size(); r++) {
+    const int count = range_level_count[r];
+    range_level_count[r] = next[r % LOD_LEVELS];
+    next[r % LOD_LEVELS] += count;
+  }
+
+  visible_aircraft.resize(visible.size());
+  ParallelFor(jobs, (int)visible.size(), PACK_GRAIN, [&](int first, int last) {
+    int *slot = &range_level_count[(first/PACK_GRAIN)*LOD_LEVELS];
+
+    for (int i = first; i < last; i++) visible_aircraft[slot[(int)level[visible[i]]]++] = aircraft[visible[i]];
+  });
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::DrawInstanced
+//|
+//! \param aircraft   [in] Aircraft grouped by level (see level_first).
+//! \return None.
+//!
+//! Uploads the instance buffer once, then per level draws each part type
+//! (or the impostor) with one call, the instance attributes pointing at the
+//! level's range.
+//|____________________________________________________________________
+
+void FleetRenderer::DrawInstanced(const AircraftInstance *aircraft)
+{
+  const GLExtensions &gl = Extensions();
+  const GLsizei stride = sizeof(AircraftInstance);
+  const int count = Drawn();
+
+  gl.BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+  gl.BufferData(GL_ARRAY_BUFFER, (ptrdiff_t)count*stride, aircraft, GL_STREAM_DRAW);
+  gl.EnableVertexAttribArray(IA_POSITION);
+  gl.EnableVertexAttribArray(IA_ORIENTATION);
+  gl.EnableVertexAttribArray(IA_ANGLES);
+  gl.UseProgram(program);
+
+  for (int l = 0; l < LOD_LEVELS; l++) {
+    const ptrdiff_t base = (ptrdiff_t)level_first[l]*stride;
+
+    if (level_count[l] == 0) continue;
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    gl.VertexAttribPointer(IA_POSITION,    3, GL_FLOAT, GL_FALSE, stride, (const void *)(base + offsetof(AircraftInstance, position)));
+    gl.VertexAttribPointer(IA_ORIENTATION, 4, GL_FLOAT, GL_FALSE, stride, (const void *)(base + offsetof(AircraftInstance, orientation)));
+    gl.VertexAttribPointer(IA_ANGLES,      4, GL_FLOAT, GL_FALSE, stride, (const void *)(base + offsetof(AircraftInstance, angles)));
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);      // Mesh arrays are set up against their own buffers
+
+    if (l == LOD_IMPOSTOR) {
+      gl.Uniform1f(billboard_size, impostor_size);
+      gl.VertexAttribDivisor(IA_POSITION,    1);
+      gl.VertexAttribDivisor(IA_ORIENTATION, 1);
+      gl.VertexAttribDivisor(IA_ANGLES,      1);
+      meshes.DrawInstanced(meshes.Lod(parts[0].mesh, LOD_IMPOSTOR), level_count[l]);
+      gl.Uniform1f(billboard_size, 0);
+      draw_calls++;
+      continue;
+    }
+
+    for (size_t i = 0; i < parts.size(); i++) {
+      const FleetPart &part = parts[i];
+      float offsets[2][3], axes[2][3], selects[2][4] = {{0}}, child[4] = {0};
+
+      for (int c = 0; c < 2; c++) {
+        const FleetJoint &mount = part.mount[c < part.copies ? c : 0];
+        for (int k = 0; k < 3; k++) {
+          offsets[c][k] = mount.offset[k];
+          axes[c][k]    = mount.axis[k];
+        }
+        if (mount.angle >= 0) selects[c][mount.angle] = 1;
+      }
+      if (part.child.angle >= 0) child[part.child.angle] = 1;
+
+      gl.Uniform1f (copies, (float)part.copies);
+      gl.Uniform3fv(mount_offset, 2, offsets[0]);
+      gl.Uniform3fv(mount_axis,   2, axes[0]);
+      gl.Uniform4fv(mount_select, 2, selects[0]);
+      gl.Uniform3fv(child_offset, 1, part.child.offset);
+      gl.Uniform3fv(child_axis,   1, part.child.axis);
+      gl.Uniform4fv(child_select, 1, child);
+
+      // Each aircraft's entry serves its "copies" consecutive instances
+      gl.VertexAttribDivisor(IA_POSITION,    part.copies);
+      gl.VertexAttribDivisor(IA_ORIENTATION, part.copies);
+      gl.VertexAttribDivisor(IA_ANGLES,      part.copies);
+      meshes.DrawInstanced(meshes.Lod(part.mesh, l), level_count[l]*part.copies);
+      draw_calls++;
+    }
+  }
+
+  gl.UseProgram(0);
+  gl.DisableVertexAttribArray(IA_POSITION);
+  gl.DisableVertexAttribArray(IA_ORIENTATION);
+  gl.DisableVertexAttribArray(IA_ANGLES);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FleetRenderer::DrawEach
+//|
+//! \param aircraft   [in] Aircraft grouped by level (see level_first).
+//! \return None.
+//!
+//! Fallback: the same transforms built with the matrix stack. Parts are the
+//! outer loop so every aircraft reuses the arrays of the part's mesh.
+//! Impostors load a billboard matrix instead.
+//|____________________________________________________________________
+
+void FleetRenderer::DrawEach(const AircraftInstance *aircraft)
+{
+  for (int l = 0; l < LOD_IMPOSTOR; l++) {
+    for (size_t i = 0; i < parts.size(); i++) {
+      const FleetPart &part = parts[i];
+      const int mesh = meshes.Lod(part.mesh, l);
+
+      for (int n = level_first[l]; n < level_first[l] + level_count[l]; n++) {
+        const AircraftInstance &a = aircraft[n];
+        const float *q = a.orientation;
+        float s = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2]);
+        float angle = 2*atan2f(s, q[3])*180.0f/3.14159265f;
+
+        for (int c = 0; c < part.copies; c++) {
+          const FleetJoint *joints[2] = {&part.mount[c], &part.child};
+
+          glPushMatrix();
+          glTranslatef(a.position[0], a.position[1], a.position[2]);
+          if (s > 0) glRotatef(angle, q[0]/s, q[1]/s, q[2]/s);
+          for (int j = 0; j < 2; j++) {
+            glTranslatef(joints[j]->offset[0], joints[j]->offset[1], joints[j]->offset[2]);
+            if (joints[j]->angle >= 0) {
+              glRotatef(a.angles[joints[j]->angle], joints[j]->axis[0], joints[j]->axis[1], joints[j]->axis[2]);
+            }
+          }
+          meshes.Draw(mesh);
+          glPopMatrix();
+          draw_calls++;
+        }
+      }
+    }
+  }
+
+  if (level_count[LOD_IMPOSTOR] > 0) {
+    const int impostor = meshes.Lod(parts[0].mesh, LOD_IMPOSTOR);
+    GLfloat modelview[16], billboard[16];
+
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    for (int n = level_first[LOD_IMPOSTOR]; n < level_first[LOD_IMPOSTOR] + level_count[LOD_IMPOSTOR]; n++) {
+      BillboardMatrix(billboard, modelview, aircraft[n].position, impostor_size);
+      glPushMatrix();
+      glLoadMatrixf(billboard);
+      meshes.Draw(impostor);
+      glPopMatrix();
+      draw_calls++;
+    }
+  }
+}
@@ -0,0 +1,140 @@
+//|___________________________________________________________________
+//!
+//! \file FleetRenderer.h
+//!
+//! \brief Instanced drawing of many articulated aircraft.
+//!
+//! Each frame the pose (position and orientation quaternion) and joint
+//! angles of every aircraft are uploaded to one instance buffer. A part type
+//! (body, turret, ...) is then drawn for the whole fleet with one instanced
+//! call: a vertex program reads the aircraft's entry and applies the part's
+//! joints, so the number of draw calls stays at one per part type however
+//! large the fleet gets.
+//!
+//! A part hangs off the body through one joint (its mount) and optionally a
+//! second joint below that (e.g. the turret gun on the turret). A part that
+//! appears twice on each aircraft, like the stabilizers, has a mount per copy
+//! and still takes one call.
+//!
+//! Without instancing support (see GLExtensions.h) the fleet is drawn with
+//! the matrix stack, one MeshCache::Draw per part per aircraft.
+//!
+//! Given a view frustum, the aircraft are first culled through a bounding
+//! volume hierarchy over their positions (see Culling.h), refit every frame,
+//! and only the visible ones are uploaded and drawn. Each aircraft is
+//! bounded by a sphere around its position that holds every part at any
+//! joint angle, so the tree does not depend on the joints.
+//!
+//! Each drawn aircraft also gets a level of detail from its projected size
+//! (see Lod.h). The packed copy is grouped by level, uploaded once, and
+//! each level draws its part meshes with one call per part type. At the
+//! impostor level the whole aircraft is one camera-facing quad.
+//!
+//! Culling, level selection and packing (Prepare()) make no OpenGL calls
+//! and can run on a job system's threads; drawing (Submit()) stays on the
+//! GL thread.
+//|___________________________________________________________________
+
+#ifndef FLEET_RENDERER_H
+#define FLEET_RENDERER_H
+
+#include <vector>
+
+#include "Culling.h"
+#include "MeshCache.h"
+
+class JobSystem;
+
+struct AircraftInstance {
+  float position[3];
+  float orientation[4];     // Quaternion (x, y, z, w), same layout as gmtl::Quatf
+  float angles[4];          // Joint angles in degs, indexed by FleetJoint::angle
+};
+
+struct FleetJoint {
+  float offset[3];          // Joint position in the parent's frame
+  float axis[3];            // Unit rotation axis
+  int   angle;              // Index into AircraftInstance::angles, or -1 for a fixed joint
+};
+
+struct FleetPart {
+  int        mesh;          // MeshCache handle
+  int        copies;        // Copies per aircraft, 1 or 2
+  FleetJoint mount[2];      // Joint on the body, per copy
+  FleetJoint child;         // Joint below the mount
+};
+
+// Joint that leaves its child where it is
+extern const FleetJoint FLEET_FIXED_JOINT;
+
+class FleetRenderer
+{
+ public:
+  FleetRenderer(MeshCache &meshes);
+
+  void AddPart(const FleetPart &part);
+
+  // Culls the aircraft against "frustum" (in world coordinates; NULL for
+  // none), picks their levels of detail for the "view" and "projection"
+  // matrices and a viewport "viewport_height" pixels high, and packs the
+  // ones to draw. No OpenGL calls; "jobs" (NULL for none) spreads the work
+  // over threads. "aircraft" must stay valid until Submit().
+  void Prepare(const AircraftInstance *aircraft, int count, const Frustum *frustum,
+               const float view[16], const float projection[16], float viewport_height,
+               JobSystem *jobs = NULL);
+
+  // Draws what the last Prepare() packed; the current modelview matrix is
+  // the world frame
+  void Submit();
+
+  // Prepare() with the current matrices and viewport, then Submit()
+  void Draw(const AircraftInstance *aircraft, int count, const Frustum *frustum = NULL);
+
+  // Picks a level of detail per aircraft (on by default)
+  void SetLod(bool enabled) { lod = enabled; }
+
+  // Draw calls issued by the last Draw(), the aircraft it drew (in total or
+  // at one level of detail) and whether it was instanced
+  int  DrawCalls() const    { return draw_calls; }
+  int  Drawn() const;
+  int  Drawn(int level) const { return level_count[level]; }
+  bool Instanced() const    { return program != 0; }
+
+  // Bounding-volume nodes the last Prepare() tested against the frustum,
+  // out of BvhNodes() (0 without a frustum), and times the hierarchy was built
+  int  BvhTested() const    { return bvh_tested; }
+  int  BvhNodes() const     { return bvh.NodeCount(); }
+  int  BvhBuilds() const    { return bvh.Builds(); }
+
+ private:
+  bool Init();
+  void SelectLevels(const AircraftInstance *aircraft, int count, const float view[16],
+                    const float projection[16], float viewport_height, JobSystem *jobs);
+  void Pack(const AircraftInstance *aircraft, JobSystem *jobs);
+  void DrawInstanced(const AircraftInstance *aircraft);
+  void DrawEach(const AircraftInstance *aircraft);
+
+  MeshCache                    &meshes;
+  std::vector<FleetPart>        parts;
+  float                         radius;           // Bounding sphere of an aircraft, around its position
+  float                         impostor_size;    // Half side of the impostor quad
+  BoundingVolumeHierarchy       bvh;
+  int                           bvh_tested;
+  std::vector<int>              visible;          // Indices of the aircraft in the frustum
+  std::vector<AircraftInstance> visible_aircraft; // Grouped by level of detail
+  const AircraftInstance       *prepared;         // What Submit() draws: "visible_aircraft" or the caller's
+  bool                          lod;
+  std::vector<char>             level;            // Level of each aircraft last frame
+  int                           level_first[LOD_LEVELS];
+  int                           level_count[LOD_LEVELS];
+  std::vector<int>              range_level_count;  // Per range of "visible" and level: count, then first slot
+  bool                          initialized;
+  GLuint                        program;          // 0 without instancing
+  GLuint                        instance_buffer;
+  int                           draw_calls;
+
+  // Uniform locations
+  GLint copies, mount_offset, mount_axis, mount_select, child_offset, child_axis, child_select, billboard_size;
+};
+
+#endif
@@ -0,0 +1,597 @@
+//|___________________________________________________________________
+//!
+//! \file FlightDynamics.cpp
+//!
+//! \brief Flight dynamics for many aircraft at once (see FlightDynamics.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+
+#include "FlightDynamics.h"
+#include "JobSystem.h"
+#include "../../The Triangle Awakens/partial/CpuFeatures.h"
+
+// The SIMD kernels are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define FLIGHT_SSE2
+#define FLIGHT_AVX2
+#endif
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float MAX_THRUST     = 20.0f;     // Acceleration at full throttle (units/s^2)
+const float LINEAR_DRAG    = 1.0f;      // Per second; top speed is MAX_THRUST/LINEAR_DRAG
+const float MAX_TORQUE     = 3.0f;      // Angular acceleration at full control input (rads/s^2)
+const float ANGULAR_DRAG   = 2.0f;      // Per second; top turn rate is MAX_TORQUE/ANGULAR_DRAG
+
+const int   FLIGHT_GRAIN   = 4096;      // Aircraft per parallel range
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::Add
+//|
+//! \param position     [in] Initial position.
+//! \param orientation  [in] Initial orientation, unit quaternion (x, y, z, w).
+//! \return Index of the aircraft.
+//|____________________________________________________________________
+
+int FlightDynamics::Add(const float position[3], const float orientation[4])
+{
+  px.push_back(position[0]);
+  py.push_back(position[1]);
+  pz.push_back(position[2]);
+  qx.push_back(orientation[0]);
+  qy.push_back(orientation[1]);
+  qz.push_back(orientation[2]);
+  qw.push_back(orientation[3]);
+  prev_px.push_back(position[0]);
+  prev_py.push_back(position[1]);
+  prev_pz.push_back(position[2]);
+  prev_qx.push_back(orientation[0]);
+  prev_qy.push_back(orientation[1]);
+  prev_qz.push_back(orientation[2]);
+  prev_qw.push_back(orientation[3]);
+  vx.push_back(0);
+  vy.push_back(0);
+  vz.push_back(0);
+  wx.push_back(0);
+  wy.push_back(0);
+  wz.push_back(0);
+  throttle.push_back(0);
+  pitch.push_back(0);
+  yaw.push_back(0);
+  roll.push_back(0);
+  return (int)px.size() - 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::SetControls
+//|
+//! \param aircraft   [in] Index from Add().
+//! \param controls   [in] Control inputs, held until changed.
+//! \return None.
+//|____________________________________________________________________
+
+void FlightDynamics::SetControls(int aircraft, const FlightControls &controls)
+{
+  throttle[aircraft] = controls.throttle;
+  pitch[aircraft]    = controls.pitch;
+  yaw[aircraft]      = controls.yaw;
+  roll[aircraft]     = controls.roll;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StepLinear_Scalar
+//|
+//! \param count      [in] Number of aircraft.
+//! \param dt         [in] Time step in seconds.
+//! \param px..pz     [in/out] Positions.
+//! \param vx..vz     [in/out] Linear velocities.
+//! \param qx..qw     [in] Orientations.
+//! \param throttle   [in] Throttle inputs.
+//! \return None.
+//!
+//! Thrust along the nose, the orientation's +Z axis, against drag. The
+//! arrays come in as restrict parameters rather than locals so the compiler
+//! can vectorize without checking them for overlap. The SIMD kernels below
+//! do the same operations in the same order, so all of them agree exactly.
+//|____________________________________________________________________
+
+static void StepLinear_Scalar(int count, float dt,
+                              float *__restrict px, float *__restrict py, float *__restrict pz,
+                              float *__restrict vx, float *__restrict vy, float *__restrict vz,
+                              const float *__restrict qx, const float *__restrict qy,
+                              const float *__restrict qz, const float *__restrict qw,
+                              const float *__restrict throttle)
+{
+  const float decay = 1 - LINEAR_DRAG*dt;
+
+  for (int i = 0; i < count; i++) {
+    const float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+    const float a = throttle[i]*MAX_THRUST*dt;
+
+    vx[i] = vx[i]*decay + a*2*(x*z + w*y);
+    vy[i] = vy[i]*decay + a*2*(y*z - w*x);
+    vz[i] = vz[i]*decay + a*(1 - 2*(x*x + y*y));
+    px[i] += vx[i]*dt;
+    py[i] += vy[i]*dt;
+    pz[i] += vz[i]*dt;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: StepAngular_Scalar
+//|
+//! \param count      [in] Number of aircraft.
+//! \param dt         [in] Time step in seconds.
+//! \param qx..qw     [in/out] Orientations.
+//! \param wx..wz     [in/out] Angular velocities in the body frame.
+//! \param pitch..roll [in] Control inputs.
+//! \return None.
+//!
+//! Control torques against drag, then q += q*(w, 0)*dt/2. The result is
+//! renormalized with one Newton step towards unit length, which needs no
+//! square root and keeps the drift of a step at second order.
+//|____________________________________________________________________
+
+static void StepAngular_Scalar(int count, float dt,
+                               float *__restrict qx, float *__restrict qy,
+                               float *__restrict qz, float *__restrict qw,
+                               float *__restrict wx, float *__restrict wy, float *__restrict wz,
+                               const float *__restrict pitch, const float *__restrict yaw,
+                               const float *__restrict roll)
+{
+  const float decay   = 1 - ANGULAR_DRAG*dt;
+  const float half_dt = dt/2;
+
+  for (int i = 0; i < count; i++) {
+    const float ox = wx[i]*decay + pitch[i]*MAX_TORQUE*dt;
+    const float oy = wy[i]*decay + yaw[i]*MAX_TORQUE*dt;
+    const float oz = wz[i]*decay + roll[i]*MAX_TORQUE*dt;
+    const float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+
+    const float nx = x + half_dt*(w*ox + y*oz - z*oy);
+    const float ny = y + half_dt*(w*oy + z*ox - x*oz);
+    const float nz = z + half_dt*(w*oz + x*oy - y*ox);
+    const float nw = w - half_dt*(x*ox + y*oy + z*oz);
+    const float scale = 1.5f - 0.5f*(nx*nx + ny*ny + nz*nz + nw*nw);
+
+    wx[i] = ox;
+    wy[i] = oy;
+    wz[i] = oz;
+    qx[i] = nx*scale;
+    qy[i] = ny*scale;
+    qz[i] = nz*scale;
+    qw[i] = nw*scale;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Struct: FlightPoses
+//|
+//! The pose arrays CopyPoses reads: after the last step and before it.
+//|____________________________________________________________________
+
+struct FlightPoses {
+  const float *px, *py, *pz, *qx, *qy, *qz, *qw;
+  const float *prev_px, *prev_py, *prev_pz, *prev_qx, *prev_qy, *prev_qz, *prev_qw;
+};
+
+//|____________________________________________________________________
+//|
+//| Function: CopyPoses_Scalar
+//|
+//! \param s            [in] Pose arrays.
+//! \param p            [out] First record's position (3 floats).
+//! \param q            [out] First record's orientation (4 floats).
+//! \param stride       [in] Bytes from one record to the next.
+//! \param alpha        [in] 0 for the poses before the last step, 1 for after.
+//! \param first        [in] First aircraft.
+//! \param last         [in] One past the last aircraft.
+//! \return None.
+//!
+//! Positions are lerped. Orientations are lerped on the shorter arc (the
+//! end quaternion negated when the two point apart) and renormalized.
+//|____________________________________________________________________
+
+static void CopyPoses_Scalar(const FlightPoses &s, char *p, char *q, int stride, float alpha, int first, int last)
+{
+  const float from = 1 - alpha;
+
+  for (int i = first; i < last; i++, p += stride, q += stride) {
+    float *pi = (float *)p, *qi = (float *)q;
+    const float cosine = s.prev_qx[i]*s.qx[i] + s.prev_qy[i]*s.qy[i] + s.prev_qz[i]*s.qz[i] + s.prev_qw[i]*s.qw[i];
+    const float to = cosine < 0 ? -alpha : alpha;
+    float x = from*s.prev_qx[i] + to*s.qx[i], y = from*s.prev_qy[i] + to*s.qy[i];
+    float z = from*s.prev_qz[i] + to*s.qz[i], w = from*s.prev_qw[i] + to*s.qw[i];
+    const float scale = 1/sqrtf(x*x + y*y + z*z + w*w);
+
+    pi[0] = from*s.prev_px[i] + alpha*s.px[i];
+    pi[1] = from*s.prev_py[i] + alpha*s.py[i];
+    pi[2] = from*s.prev_pz[i] + alpha*s.pz[i];
+    qi[0] = x*scale;
+    qi[1] = y*scale;
+    qi[2] = z*scale;
+    qi[3] = w*scale;
+  }
+}
+
+#ifdef FLIGHT_SSE2
+//|____________________________________________________________________
+//|
+//| Function: StepLinear_SSE2, StepAngular_SSE2
+//|
+//! Four aircraft per step, the rest through the scalar kernels.
+//|____________________________________________________________________
+
+CPU_TARGET("sse2")
+static void StepLinear_SSE2(int count, float dt,
+                            float *__restrict px, float *__restrict py, float *__restrict pz,
+                            float *__restrict vx, float *__restrict vy, float *__restrict vz,
+                            const float *__restrict qx, const float *__restrict qy,
+                            const float *__restrict qz, const float *__restrict qw,
+                            const float *__restrict throttle)
+{
+  const __m128 vdt    = _mm_set1_ps(dt);
+  const __m128 decay  = _mm_set1_ps(1 - LINEAR_DRAG*dt);
+  const __m128 thrust = _mm_set1_ps(MAX_THRUST);
+  const __m128 one    = _mm_set1_ps(1);
+  const __m128 two    = _mm_set1_ps(2);
+  int i;
+
+  for (i = 0; i+4 <= count; i += 4) {
+    const __m128 x = _mm_loadu_ps(qx+i), y = _mm_loadu_ps(qy+i), z = _mm_loadu_ps(qz+i), w = _mm_loadu_ps(qw+i);
+    const __m128 a = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(throttle+i), thrust), vdt);
+    const __m128 a2 = _mm_mul_ps(a, two);
+
+    const __m128 nvx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(vx+i), decay),
+                                  _mm_mul_ps(a2, _mm_add_ps(_mm_mul_ps(x, z), _mm_mul_ps(w, y))));
+    const __m128 nvy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(vy+i), decay),
+                                  _mm_mul_ps(a2, _mm_sub_ps(_mm_mul_ps(y, z), _mm_mul_ps(w, x))));
+    const __m128 nvz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(vz+i), decay),
+                                  _mm_mul_ps(a, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y))))));
+    _mm_storeu_ps(vx+i, nvx);
+    _mm_storeu_ps(vy+i, nvy);
+    _mm_storeu_ps(vz+i, nvz);
+    _mm_storeu_ps(px+i, _mm_add_ps(_mm_loadu_ps(px+i), _mm_mul_ps(nvx, vdt)));
+    _mm_storeu_ps(py+i, _mm_add_ps(_mm_loadu_ps(py+i), _mm_mul_ps(nvy, vdt)));
+    _mm_storeu_ps(pz+i, _mm_add_ps(_mm_loadu_ps(pz+i), _mm_mul_ps(nvz, vdt)));
+  }
+  StepLinear_Scalar(count-i, dt, px+i, py+i, pz+i, vx+i, vy+i, vz+i, qx+i, qy+i, qz+i, qw+i, throttle+i);
+}
+
+CPU_TARGET("sse2")
+static void StepAngular_SSE2(int count, float dt,
+                             float *__restrict qx, float *__restrict qy,
+                             float *__restrict qz, float *__restrict qw,
+                             float *__restrict wx, float *__restrict wy, float *__restrict wz,
+                             const float *__restrict pitch, const float *__restrict yaw,
+                             const float *__restrict roll)
+{
+  const __m128 vdt     = _mm_set1_ps(dt);
+  const __m128 decay   = _mm_set1_ps(1 - ANGULAR_DRAG*dt);
+  const __m128 torque  = _mm_set1_ps(MAX_TORQUE);
+  const __m128 half_dt = _mm_set1_ps(dt/2);
+  const __m128 c15     = _mm_set1_ps(1.5f);
+  const __m128 c05     = _mm_set1_ps(0.5f);
+  int i;
+
+  for (i = 0; i+4 <= count; i += 4) {
+    const __m128 ox = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(wx+i), decay), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(pitch+i), torque), vdt));
+    const __m128 oy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(wy+i), decay), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(yaw+i), torque), vdt));
+    const __m128 oz = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(wz+i), decay), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(roll+i), torque), vdt));
+    const __m128 x = _mm_loadu_ps(qx+i), y = _mm_loadu_ps(qy+i), z = _mm_loadu_ps(qz+i), w = _mm_loadu_ps(qw+i);
+
+    const __m128 nx = _mm_add_ps(x, _mm_mul_ps(half_dt, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, ox), _mm_mul_ps(y, oz)), _mm_mul_ps(z, oy))));
+    const __m128 ny = _mm_add_ps(y, _mm_mul_ps(half_dt, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, oy), _mm_mul_ps(z, ox)), _mm_mul_ps(x, oz))));
+    const __m128 nz = _mm_add_ps(z, _mm_mul_ps(half_dt, _mm_sub_ps(_mm_add_ps(_mm_mul_ps(w, oz), _mm_mul_ps(x, oy)), _mm_mul_ps(y, ox))));
+    const __m128 nw = _mm_sub_ps(w, _mm_mul_ps(half_dt, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, ox), _mm_mul_ps(y, oy)), _mm_mul_ps(z, oz))));
+    const __m128 len = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)), _mm_mul_ps(nw, nw));
+    const __m128 scale = _mm_sub_ps(c15, _mm_mul_ps(c05, len));
+
+    _mm_storeu_ps(wx+i, ox);
+    _mm_storeu_ps(wy+i, oy);
+    _mm_storeu_ps(wz+i, oz);
+    _mm_storeu_ps(qx+i, _mm_mul_ps(nx, scale));
+    _mm_storeu_ps(qy+i, _mm_mul_ps(ny, scale));
+    _mm_storeu_ps(qz+i, _mm_mul_ps(nz, scale));
+    _mm_storeu_ps(qw+i, _mm_mul_ps(nw, scale));
+  }
+  StepAngular_Scalar(count-i, dt, qx+i, qy+i, qz+i, qw+i, wx+i, wy+i, wz+i, pitch+i, yaw+i, roll+i);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: CopyPoses_SSE2
+//|
+//! Blends four aircraft per step; the records are written field by field,
+//! since they are "stride" bytes apart.
+//|____________________________________________________________________
+
+CPU_TARGET("sse2")
+static void CopyPoses_SSE2(const FlightPoses &s, char *p, char *q, int stride, float alpha, int first, int last)
+{
+  const __m128 zero  = _mm_setzero_ps();
+  const __m128 one   = _mm_set1_ps(1);
+  const __m128 va    = _mm_set1_ps(alpha);
+  const __m128 neg_a = _mm_set1_ps(-alpha);
+  const __m128 from  = _mm_set1_ps(1 - alpha);
+  int i;
+
+  for (i = first; i+4 <= last; i += 4) {
+    const __m128 pqx = _mm_loadu_ps(s.prev_qx+i), pqy = _mm_loadu_ps(s.prev_qy+i);
+    const __m128 pqz = _mm_loadu_ps(s.prev_qz+i), pqw = _mm_loadu_ps(s.prev_qw+i);
+    const __m128 qx = _mm_loadu_ps(s.qx+i), qy = _mm_loadu_ps(s.qy+i), qz = _mm_loadu_ps(s.qz+i), qw = _mm_loadu_ps(s.qw+i);
+    const __m128 cosine = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(pqx, qx), _mm_mul_ps(pqy, qy)), _mm_mul_ps(pqz, qz)),
+                                     _mm_mul_ps(pqw, qw));
+    const __m128 apart = _mm_cmplt_ps(cosine, zero);
+    const __m128 to = _mm_or_ps(_mm_and_ps(apart, neg_a), _mm_andnot_ps(apart, va));
+    const __m128 x = _mm_add_ps(_mm_mul_ps(from, pqx), _mm_mul_ps(to, qx));
+    const __m128 y = _mm_add_ps(_mm_mul_ps(from, pqy), _mm_mul_ps(to, qy));
+    const __m128 z = _mm_add_ps(_mm_mul_ps(from, pqz), _mm_mul_ps(to, qz));
+    const __m128 w = _mm_add_ps(_mm_mul_ps(from, pqw), _mm_mul_ps(to, qw));
+    const __m128 scale = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                                                                          _mm_mul_ps(z, z)), _mm_mul_ps(w, w))));
+    float out[7][4];
+
+    _mm_storeu_ps(out[0], _mm_add_ps(_mm_mul_ps(from, _mm_loadu_ps(s.prev_px+i)), _mm_mul_ps(va, _mm_loadu_ps(s.px+i))));
+    _mm_storeu_ps(out[1], _mm_add_ps(_mm_mul_ps(from, _mm_loadu_ps(s.prev_py+i)), _mm_mul_ps(va, _mm_loadu_ps(s.py+i))));
+    _mm_storeu_ps(out[2], _mm_add_ps(_mm_mul_ps(from, _mm_loadu_ps(s.prev_pz+i)), _mm_mul_ps(va, _mm_loadu_ps(s.pz+i))));
+    _mm_storeu_ps(out[3], _mm_mul_ps(x, scale));
+    _mm_storeu_ps(out[4], _mm_mul_ps(y, scale));
+    _mm_storeu_ps(out[5], _mm_mul_ps(z, scale));
+    _mm_storeu_ps(out[6], _mm_mul_ps(w, scale));
+
+    for (int k = 0; k < 4; k++, p += stride, q += stride) {
+      float *pi = (float *)p, *qi = (float *)q;
+      pi[0] = out[0][k];
+      pi[1] = out[1][k];
+      pi[2] = out[2][k];
+      qi[0] = out[3][k];
+      qi[1] = out[4][k];
+      qi[2] = out[5][k];
+      qi[3] = out[6][k];
+    }
+  }
+  CopyPoses_Scalar(s, p, q, stride, alpha, i, last);
+}
+#endif
+
+#ifdef FLIGHT_AVX2
+//|____________________________________________________________________
+//|
+//| Function: StepLinear_AVX2, StepAngular_AVX2
+//|
+//! Eight aircraft per step, the rest through the SSE2 kernels. Built for
+//! AVX2 without FMA, so no multiply-add is fused and the results match the
+//! other kernels bit for bit.
+//|____________________________________________________________________
+
+CPU_TARGET("avx2")
+static void StepLinear_AVX2(int count, float dt,
+                            float *__restrict px, float *__restrict py, float *__restrict pz,
+                            float *__restrict vx, float *__restrict vy, float *__restrict vz,
+                            const float *__restrict qx, const float *__restrict qy,
+                            const float *__restrict qz, const float *__restrict qw,
+                            const float *__restrict throttle)
+{
+  const __m256 vdt    = _mm256_set1_ps(dt);
+  const __m256 decay  = _mm256_set1_ps(1 - LINEAR_DRAG*dt);
+  const __m256 thrust = _mm256_set1_ps(MAX_THRUST);
+  const __m256 one    = _mm256_set1_ps(1);
+  const __m256 two    = _mm256_set1_ps(2);
+  int i;
+
+  for (i = 0; i+8 <= count; i += 8) {
+    const __m256 x = _mm256_loadu_ps(qx+i), y = _mm256_loadu_ps(qy+i), z = _mm256_loadu_ps(qz+i), w = _mm256_loadu_ps(qw+i);
+    const __m256 a = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(throttle+i), thrust), vdt);
+    const __m256 a2 = _mm256_mul_ps(a, two);
+
+    const __m256 nvx = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(vx+i), decay),
+                                     _mm256_mul_ps(a2, _mm256_add_ps(_mm256_mul_ps(x, z), _mm256_mul_ps(w, y))));
+    const __m256 nvy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(vy+i), decay),
+                                     _mm256_mul_ps(a2, _mm256_sub_ps(_mm256_mul_ps(y, z), _mm256_mul_ps(w, x))));
+    const __m256 nvz = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(vz+i), decay),
+                                     _mm256_mul_ps(a, _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(_mm256_mul_ps(x, x),
+                                                                                                         _mm256_mul_ps(y, y))))));
+    _mm256_storeu_ps(vx+i, nvx);
+    _mm256_storeu_ps(vy+i, nvy);
+    _mm256_storeu_ps(vz+i, nvz);
+    _mm256_storeu_ps(px+i, _mm256_add_ps(_mm256_loadu_ps(px+i), _mm256_mul_ps(nvx, vdt)));
+    _mm256_storeu_ps(py+i, _mm256_add_ps(_mm256_loadu_ps(py+i), _mm256_mul_ps(nvy, vdt)));
+    _mm256_storeu_ps(pz+i, _mm256_add_ps(_mm256_loadu_ps(pz+i), _mm256_mul_ps(nvz, vdt)));
+  }
+  StepLinear_SSE2(count-i, dt, px+i, py+i, pz+i, vx+i, vy+i, vz+i, qx+i, qy+i, qz+i, qw+i, throttle+i);
+}
+
+CPU_TARGET("avx2")
+static void StepAngular_AVX2(int count, float dt,
+                             float *__restrict qx, float *__restrict qy,
+                             float *__restrict qz, float *__restrict qw,
+                             float *__restrict wx, float *__restrict wy, float *__restrict wz,
+                             const float *__restrict pitch, const float *__restrict yaw,
+                             const float *__restrict roll)
+{
+  const __m256 vdt     = _mm256_set1_ps(dt);
+  const __m256 decay   = _mm256_set1_ps(1 - ANGULAR_DRAG*dt);
+  const __m256 torque  = _mm256_set1_ps(MAX_TORQUE);
+  const __m256 half_dt = _mm256_set1_ps(dt/2);
+  const __m256 c15     = _mm256_set1_ps(1.5f);
+  const __m256 c05     = _mm256_set1_ps(0.5f);
+  int i;
+
+  for (i = 0; i+8 <= count; i += 8) {
+    const __m256 ox = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(wx+i), decay),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(pitch+i), torque), vdt));
+    const __m256 oy = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(wy+i), decay),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(yaw+i), torque), vdt));
+    const __m256 oz = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(wz+i), decay),
+                                    _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(roll+i), torque), vdt));
+    const __m256 x = _mm256_loadu_ps(qx+i), y = _mm256_loadu_ps(qy+i), z = _mm256_loadu_ps(qz+i), w = _mm256_loadu_ps(qw+i);
+
+    const __m256 nx = _mm256_add_ps(x, _mm256_mul_ps(half_dt, _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, ox), _mm256_mul_ps(y, oz)),
+                                                                            _mm256_mul_ps(z, oy))));
+    const __m256 ny = _mm256_add_ps(y, _mm256_mul_ps(half_dt, _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, oy), _mm256_mul_ps(z, ox)),
+                                                                            _mm256_mul_ps(x, oz))));
+    const __m256 nz = _mm256_add_ps(z, _mm256_mul_ps(half_dt, _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(w, oz), _mm256_mul_ps(x, oy)),
+                                                                            _mm256_mul_ps(y, ox))));
+    const __m256 nw = _mm256_sub_ps(w, _mm256_mul_ps(half_dt, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, ox), _mm256_mul_ps(y, oy)),
+                                                                            _mm256_mul_ps(z, oz))));
+    const __m256 len = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)),
+                                     _mm256_mul_ps(nw, nw));
+    const __m256 scale = _mm256_sub_ps(c15, _mm256_mul_ps(c05, len));
+
+    _mm256_storeu_ps(wx+i, ox);
+    _mm256_storeu_ps(wy+i, oy);
+    _mm256_storeu_ps(wz+i, oz);
+    _mm256_storeu_ps(qx+i, _mm256_mul_ps(nx, scale));
+    _mm256_storeu_ps(qy+i, _mm256_mul_ps(ny, scale));
+    _mm256_storeu_ps(qz+i, _mm256_mul_ps(nz, scale));
+    _mm256_storeu_ps(qw+i, _mm256_mul_ps(nw, scale));
+  }
+  StepAngular_SSE2(count-i, dt, qx+i, qy+i, qz+i, qw+i, wx+i, wy+i, wz+i, pitch+i, yaw+i, roll+i);
+}
+#endif
+
+//|____________________________________________________________________
+//|
+//| Struct: FlightKernels
+//|
+//! The widest kernels the CPU supports, chosen on first use.
+//|____________________________________________________________________
+
+struct FlightKernels {
+  void (*step_linear)(int count, float dt, float *px, float *py, float *pz, float *vx, float *vy, float *vz,
+                      const float *qx, const float *qy, const float *qz, const float *qw, const float *throttle);
+  void (*step_angular)(int count, float dt, float *qx, float *qy, float *qz, float *qw, float *wx, float *wy, float *wz,
+                       const float *pitch, const float *yaw, const float *roll);
+  void (*copy_poses)(const FlightPoses &s, char *p, char *q, int stride, float alpha, int first, int last);
+};
+
+static FlightKernels SelectKernels()
+{
+  FlightKernels k = { StepLinear_Scalar, StepAngular_Scalar, CopyPoses_Scalar };
+#ifdef FLIGHT_SSE2
+  unsigned features = CpuFeatures();
+
+  if (features & CPU_SSE2) {
+    k.step_linear  = StepLinear_SSE2;
+    k.step_angular = StepAngular_SSE2;
+    k.copy_poses   = CopyPoses_SSE2;
+  }
+  if (features & CPU_AVX2) {
+    k.step_linear  = StepLinear_AVX2;
+    k.step_angular = StepAngular_AVX2;
+  }
+#endif
+  return k;
+}
+
+static const FlightKernels &Kernels()
+{
+  static const FlightKernels kernels = SelectKernels();
+  return kernels;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::Step
+//|
+//! \param dt     [in] Time step in seconds.
+//! \param jobs   [in] Job system to spread the ranges over, or NULL.
+//! \return None.
+//|____________________________________________________________________
+
+void FlightDynamics::Step(float dt, JobSystem *jobs)
+{
+  ParallelFor(jobs, Count(), FLIGHT_GRAIN, [this, dt](int first, int last) { StepRange(dt, first, last); });
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::StepRange
+//|
+//! \param dt     [in] Time step in seconds.
+//! \param first  [in] First aircraft.
+//! \param last   [in] One past the last aircraft.
+//! \return None.
+//!
+//! Keeps the range's poses for interpolation, then runs linear and angular
+//! motion as separate passes, each touching only the arrays it needs.
+//! Thrust uses the orientation from the start of the step.
+//|____________________________________________________________________
+
+void FlightDynamics::StepRange(float dt, int first, int last)
+{
+  const int count = last - first;
+  if (count <= 0) return;
+
+  std::copy(&px[first], &px[first] + count, &prev_px[first]);
+  std::copy(&py[first], &py[first] + count, &prev_py[first]);
+  std::copy(&pz[first], &pz[first] + count, &prev_pz[first]);
+  std::copy(&qx[first], &qx[first] + count, &prev_qx[first]);
+  std::copy(&qy[first], &qy[first] + count, &prev_qy[first]);
+  std::copy(&qz[first], &qz[first] + count, &prev_qz[first]);
+  std::copy(&qw[first], &qw[first] + count, &prev_qw[first]);
+
+  const FlightKernels &kernels = Kernels();
+
+  kernels.step_linear(count, dt, &px[first], &py[first], &pz[first], &vx[first], &vy[first], &vz[first],
+             &qx[first], &qy[first], &qz[first], &qw[first], &throttle[first]);
+  kernels.step_angular(count, dt, &qx[first], &qy[first], &qz[first], &qw[first], &wx[first], &wy[first], &wz[first],
+              &pitch[first], &yaw[first], &roll[first]);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::CopyPoses
+//|
+//! \param position     [out] First record's position (3 floats).
+//! \param orientation  [out] First record's orientation (4 floats).
+//! \param stride       [in] Bytes from one record to the next.
+//! \param alpha        [in] 0 for the poses before the last step, 1 for after.
+//! \param jobs         [in] Job system to spread the ranges over, or NULL.
+//! \return None.
+//|____________________________________________________________________
+
+void FlightDynamics::CopyPoses(float *position, float *orientation, int stride, float alpha, JobSystem *jobs) const
+{
+  ParallelFor(jobs, Count(), FLIGHT_GRAIN, [=](int first, int last) { CopyRange(position, orientation, stride, alpha, first, last); });
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FlightDynamics::CopyRange
+//|
+//! \param position     [out] First record's position (3 floats).
+//! \param orientation  [out] First record's orientation (4 floats).
+//! \param stride       [in] Bytes from one record to the next.
+//! \param alpha        [in] 0 for the poses before the last step, 1 for after.
+//! \param first        [in] First aircraft.
+//! \param last         [in] One past the last aircraft.
+//! \return None.
+//|____________________________________________________________________
+
+void FlightDynamics::CopyRange(float *position, float *orientation, int stride, float alpha, int first, int last) const
+{
+  if (first >= last) return;
+
+  const FlightPoses poses = { &px[0], &py[0], &pz[0], &qx[0], &qy[0], &qz[0], &qw[0],
+                              &prev_px[0], &prev_py[0], &prev_pz[0], &prev_qx[0], &prev_qy[0], &prev_qz[0], &prev_qw[0] };
+  Kernels().copy_poses(poses, (char *)position + (ptrdiff_t)first*stride, (char *)orientation + (ptrdiff_t)first*stride,
+                       stride, alpha, first, last);
+}
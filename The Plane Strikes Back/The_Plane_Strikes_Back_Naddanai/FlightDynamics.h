@@ -0,0 +1,77 @@
+//|___________________________________________________________________
+//!
+//! \file FlightDynamics.h
+//!
+//! \brief Flight dynamics for many aircraft at once.
+//!
+//! The state of every aircraft (position, orientation quaternion, linear
+//! velocity, angular velocity in the body frame, control inputs) is kept as
+//! structure of arrays: one array per component, indexed by aircraft. A
+//! step walks each array front to back with no branches, so SSE2 or AVX2
+//! kernels (picked at run time, see CpuFeatures.h) handle 4 or 8 aircraft
+//! at once and 100k aircraft stream through in well under a millisecond of
+//! frame time. Aircraft do not interact, so a JobSystem can
+//! step disjoint ranges of them on several threads at once.
+//!
+//! The model is arcade flight: thrust along the nose (+Z) against linear
+//! drag, and control torques about the body axes against angular drag, so
+//! speed and turn rate settle at the control inputs' levels. Integration is
+//! semi-implicit Euler: velocities are updated first and the new velocities
+//! move the pose, which is stable for the drag terms at frame-sized steps
+//! and costs one derivative evaluation per step instead of RK4's four.
+//!
+//! Each step keeps the poses it started from, so the poses can be copied
+//! out interpolated between the last two steps (see FrameLoop.h).
+//! Orientations are blended by normalized lerp: over the few degrees an
+//! aircraft turns in one step it stays within a hair of slerp, without
+//! trigonometry per aircraft.
+//|___________________________________________________________________
+
+#ifndef FLIGHT_DYNAMICS_H
+#define FLIGHT_DYNAMICS_H
+
+#include <vector>
+
+class JobSystem;
+
+// Control inputs of an aircraft; throttle is 0..1, the others -1..1
+struct FlightControls {
+  float throttle;
+  float pitch;                  // About the body X axis
+  float yaw;                    // About the body Y axis
+  float roll;                   // About the body Z axis (the nose)
+};
+
+class FlightDynamics
+{
+ public:
+  // Adds an aircraft at rest with no control input; returns its index
+  int  Add(const float position[3], const float orientation[4]);
+
+  void SetControls(int aircraft, const FlightControls &controls);
+
+  // Advances every aircraft by "dt" seconds, in ranges spread over "jobs"
+  // (NULL to run on the calling thread)
+  void Step(float dt, JobSystem *jobs = NULL);
+
+  int  Count() const    { return (int)px.size(); }
+
+  // Copies positions and orientations (quaternion x, y, z, w) to records
+  // "stride" bytes apart, e.g. the fields of an array of AircraftInstance.
+  // The poses are "alpha" of the way from before the last step to after it.
+  void CopyPoses(float *position, float *orientation, int stride, float alpha = 1, JobSystem *jobs = NULL) const;
+
+ private:
+  std::vector<float> px, py, pz;                  // Position
+  std::vector<float> qx, qy, qz, qw;              // Orientation
+  std::vector<float> vx, vy, vz;                  // Linear velocity, world frame
+  std::vector<float> wx, wy, wz;                  // Angular velocity, body frame (rads/s)
+  std::vector<float> throttle, pitch, yaw, roll;  // Control inputs
+  std::vector<float> prev_px, prev_py, prev_pz;   // Pose before the last step
+  std::vector<float> prev_qx, prev_qy, prev_qz, prev_qw;
+
+  void StepRange(float dt, int first, int last);
+  void CopyRange(float *position, float *orientation, int stride, float alpha, int first, int last) const;
+};
+
+#endif
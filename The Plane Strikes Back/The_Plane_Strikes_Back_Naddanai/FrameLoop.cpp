@@ -0,0 +1,172 @@
+//|___________________________________________________________________
+//!
+//! \file FrameLoop.cpp
+//!
+//! \brief Main loop timing (see FrameLoop.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <thread>
+
+#include "FrameLoop.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+// Time before a due frame spent yielding instead of sleeping
+const std::chrono::milliseconds FRAME_SPIN(2);
+
+//|____________________________________________________________________
+//|
+//| Function: FrameLoop::FrameLoop
+//|
+//! \param tick_rate        [in] Simulation ticks per second.
+//! \param max_frame_rate   [in] Most frames per second, 0 for uncapped.
+//! \return None.
+//|____________________________________________________________________
+
+FrameLoop::FrameLoop(double tick_rate, double max_frame_rate)
+  : tick_seconds(1/tick_rate), frame_seconds(0), started(false), accumulator(0), ticks(0), dropped_ticks(0)
+{
+  last_begin = last_end = report_start = Clock::now();
+  SetMaxFrameRate(max_frame_rate);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FrameLoop::SetMaxFrameRate
+//|
+//! \param max_frame_rate   [in] Most frames per second, 0 for uncapped.
+//! \return None.
+//|____________________________________________________________________
+
+void FrameLoop::SetMaxFrameRate(double max_frame_rate)
+{
+  frame_seconds = max_frame_rate > 0 ? 1/max_frame_rate : 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FrameLoop::BeginFrame
+//|
+//! \param None.
+//! \return Ticks to run before drawing the frame.
+//!
+//! The first frame starts the clock and runs no ticks, so time spent
+//! loading is not owed to the simulation.
+//|____________________________________________________________________
+
+int FrameLoop::BeginFrame()
+{
+  Clock::time_point now = Clock::now();
+
+  if (!started) {
+    started = true;
+    last_begin = last_end = report_start = now;
+    return 0;
+  }
+
+  if (frame_seconds > 0) {
+    const Clock::time_point due = last_begin + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(frame_seconds));
+    if (now < due) {
+      WaitUntil(due);
+      now = Clock::now();
+    }
+  }
+
+  accumulator += std::chrono::duration<double>(now - last_begin).count();
+  last_begin = now;
+
+  int due_ticks = (int)(accumulator/tick_seconds);
+  accumulator -= due_ticks*tick_seconds;
+  if (due_ticks > MAX_TICKS_PER_FRAME) {
+    dropped_ticks += due_ticks - MAX_TICKS_PER_FRAME;
+    due_ticks = MAX_TICKS_PER_FRAME;
+  }
+  ticks += due_ticks;
+  return due_ticks;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FrameLoop::WaitUntil
+//|
+//! \param due  [in] When the next frame is due.
+//! \return None.
+//|____________________________________________________________________
+
+void FrameLoop::WaitUntil(Clock::time_point due) const
+{
+  const Clock::time_point now = Clock::now();
+
+  if (due - now > FRAME_SPIN) std::this_thread::sleep_for(due - now - FRAME_SPIN);
+  while (Clock::now() < due) std::this_thread::yield();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: FrameLoop::EndFrame
+//|
+//! \param pacing   [out] Statistics since the last report, when one is due.
+//! \return True if a report is due.
+//|____________________________________________________________________
+
+bool FrameLoop::EndFrame(FramePacing &pacing)
+{
+  const Clock::time_point now = Clock::now();
+
+  frame_ms.push_back(std::chrono::duration<float, std::milli>(now - last_end).count());
+  last_end = now;
+  if (std::chrono::duration<double>(now - report_start).count() < PACING_REPORT_SECONDS) return false;
+
+  const int frames = (int)frame_ms.size();
+  double sum = 0, squares = 0;
+
+  pacing.frames  = frames;
+  pacing.min_ms  = pacing.max_ms = frame_ms[0];
+  for (int i = 0; i < frames; i++) {
+    sum     += frame_ms[i];
+    squares += frame_ms[i]*frame_ms[i];
+    pacing.min_ms = std::min(pacing.min_ms, (double)frame_ms[i]);
+    pacing.max_ms = std::max(pacing.max_ms, (double)frame_ms[i]);
+  }
+  pacing.mean_ms   = sum/frames;
+  pacing.jitter_ms = sqrt(std::max(squares/frames - pacing.mean_ms*pacing.mean_ms, 0.0));
+  pacing.hitches   = 0;
+  for (int i = 0; i < frames; i++) pacing.hitches += frame_ms[i] > 1.5*pacing.mean_ms;
+
+  std::vector<float>::iterator p99 = frame_ms.begin() + (frames - 1)*99/100;
+  std::nth_element(frame_ms.begin(), p99, frame_ms.end());
+  pacing.p99_ms        = *p99;
+  pacing.ticks         = ticks;
+  pacing.dropped_ticks = dropped_ticks;
+
+  frame_ms.clear();
+  ticks = dropped_ticks = 0;
+  report_start = now;
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: PrintPacing
+//|
+//! \param pacing   [in] Report from FrameLoop::EndFrame().
+//! \return None.
+//|____________________________________________________________________
+
+void PrintPacing(const FramePacing &pacing)
+{
+  printf("%d frames: %.2f ms mean (%.2f-%.2f), jitter %.2f ms, 99%% under %.2f ms, %d hitches; %d ticks, %d dropped\n",
+         pacing.frames, pacing.mean_ms, pacing.min_ms, pacing.max_ms, pacing.jitter_ms, pacing.p99_ms,
+         pacing.hitches, pacing.ticks, pacing.dropped_ticks);
+}
@@ -0,0 +1,110 @@
+//|___________________________________________________________________
+//!
+//! \file FrameLoop.h
+//!
+//! \brief Main loop timing: fixed simulation ticks, paced frames and
+//! frame-pacing statistics.
+//!
+//! The simulation advances in ticks of a fixed length whatever the frame
+//! rate, so it behaves the same on every machine. Each frame runs the whole
+//! ticks that have come due since the last one, and is drawn with poses
+//! interpolated between the last two ticks by Alpha(), the fraction of a
+//! tick the frame lies past the last one. Motion looks smooth at any frame
+//! rate, at the cost of drawing up to one tick behind.
+//!
+//! Frames are capped to a maximum rate: BeginFrame() sleeps until the next
+//! frame is due, then yields for the last couple of milliseconds, which
+//! coarse OS timers would otherwise overshoot. When the machine can't keep
+//! up, a frame runs at most MAX_TICKS_PER_FRAME ticks and the rest of the
+//! owed time is dropped: the simulation slows down instead of falling
+//! further behind with every frame.
+//!
+//! EndFrame() records the time between frames and, every
+//! PACING_REPORT_SECONDS, hands back statistics on them: a steady frame
+//! time matters more than a high average rate.
+//!
+//! A frame with nothing new to show need not be drawn: SkipFrame() stands
+//! in for EndFrame() and keeps the idle time out of the statistics. A
+//! program with nothing at all to do can stop calling BeginFrame() until
+//! its next event, then Resume() the clock.
+//|___________________________________________________________________
+
+#ifndef FRAME_LOOP_H
+#define FRAME_LOOP_H
+
+#include <chrono>
+#include <vector>
+
+// Most ticks a frame catches up on; the rest of the owed time is dropped
+const int    MAX_TICKS_PER_FRAME   = 5;
+
+// Seconds between frame-pacing reports
+const double PACING_REPORT_SECONDS = 5.0;
+
+// Frame-pacing statistics since the last report. Times are between the
+// ends of consecutive frames, in milliseconds.
+struct FramePacing {
+  int    frames;
+  double mean_ms;
+  double min_ms;
+  double max_ms;
+  double jitter_ms;             // Standard deviation
+  double p99_ms;                // 99th percentile
+  int    hitches;               // Frames taking over 1.5 times the mean
+  int    ticks;                 // Simulation ticks run
+  int    dropped_ticks;         // Ticks skipped to catch up
+};
+
+class FrameLoop
+{
+ public:
+  // "tick_rate" ticks per second; at most "max_frame_rate" frames per
+  // second, or uncapped for 0
+  FrameLoop(double tick_rate, double max_frame_rate);
+
+  void  SetMaxFrameRate(double max_frame_rate);
+
+  // Waits until the next frame is due; returns the ticks to run before
+  // drawing it
+  int   BeginFrame();
+
+  // Seconds per tick
+  float TickSeconds() const     { return (float)tick_seconds; }
+
+  // How far this frame lies between the last tick and the next, 0..1
+  float Alpha() const           { return (float)(accumulator/tick_seconds); }
+
+  // Call once the frame is on screen. Returns true when a report is due,
+  // with the statistics since the last one in "pacing".
+  bool  EndFrame(FramePacing &pacing);
+
+  // Call instead of EndFrame() for a frame with nothing to draw, so the
+  // time idle is not counted as a frame time
+  void  SkipFrame()             { last_end = Clock::now(); }
+
+  // Call before the first BeginFrame() after frames stopped for a while,
+  // so the time stopped is neither owed to the simulation nor counted as
+  // a frame time
+  void  Resume()                { last_begin = last_end = Clock::now(); }
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  void  WaitUntil(Clock::time_point due) const;
+
+  double             tick_seconds;
+  double             frame_seconds;   // Shortest time between frames; 0 for uncapped
+  bool               started;
+  Clock::time_point  last_begin;      // Start of the last frame
+  Clock::time_point  last_end;        // End of the last frame
+  Clock::time_point  report_start;
+  double             accumulator;     // Seconds owed to the simulation, less than a tick after BeginFrame()
+  std::vector<float> frame_ms;        // Times between frames since the last report
+  int                ticks;
+  int                dropped_ticks;
+};
+
+// Prints a pacing report on one line
+void PrintPacing(const FramePacing &pacing);
+
+#endif
@@ -0,0 +1,82 @@
+//|___________________________________________________________________
+//!
+//! \file GLExtensions.cpp
+//!
+//! \brief OpenGL entry points beyond 1.1 (see GLExtensions.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <string.h>
+
+#include "GLExtensions.h"
+
+#include <GL/freeglut_ext.h>      // glutGetProcAddress
+
+//|____________________________________________________________________
+//|
+//| Function: Lookup
+//|
+//! \param function   [out] Entry point, NULL when missing.
+//! \param name       [in]  Core name of the function.
+//! \param arb_name   [in]  Name in the ARB extension, or NULL.
+//! \return True if found.
+//|____________________________________________________________________
+
+template <class Function>
+static bool Lookup(Function &function, const char *name, const char *arb_name = NULL)
+{
+  function = (Function)glutGetProcAddress(name);
+  if (!function && arb_name) function = (Function)glutGetProcAddress(arb_name);
+  return function != NULL;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: Extensions
+//|
+//! \param None.
+//! \return Entry points of the current context.
+//|____________________________________________________________________
+
+const GLExtensions &Extensions()
+{
+  static GLExtensions gl;
+  static bool loaded = false;
+
+  if (loaded) return gl;
+  memset(&gl, 0, sizeof(gl));
+
+  gl.buffers  = Lookup(gl.GenBuffers, "glGenBuffers", "glGenBuffersARB");
+  gl.buffers &= Lookup(gl.BindBuffer, "glBindBuffer", "glBindBufferARB");
+  gl.buffers &= Lookup(gl.BufferData, "glBufferData", "glBufferDataARB");
+
+  gl.instancing  = gl.buffers;
+  gl.instancing &= Lookup(gl.CreateShader,             "glCreateShader");
+  gl.instancing &= Lookup(gl.ShaderSource,             "glShaderSource");
+  gl.instancing &= Lookup(gl.CompileShader,            "glCompileShader");
+  gl.instancing &= Lookup(gl.GetShaderiv,              "glGetShaderiv");
+  gl.instancing &= Lookup(gl.GetShaderInfoLog,         "glGetShaderInfoLog");
+  gl.instancing &= Lookup(gl.CreateProgram,            "glCreateProgram");
+  gl.instancing &= Lookup(gl.AttachShader,             "glAttachShader");
+  gl.instancing &= Lookup(gl.BindAttribLocation,       "glBindAttribLocation");
+  gl.instancing &= Lookup(gl.LinkProgram,              "glLinkProgram");
+  gl.instancing &= Lookup(gl.GetProgramiv,             "glGetProgramiv");
+  gl.instancing &= Lookup(gl.GetProgramInfoLog,        "glGetProgramInfoLog");
+  gl.instancing &= Lookup(gl.UseProgram,               "glUseProgram");
+  gl.instancing &= Lookup(gl.GetUniformLocation,       "glGetUniformLocation");
+  gl.instancing &= Lookup(gl.Uniform1f,                "glUniform1f");
+  gl.instancing &= Lookup(gl.Uniform3fv,               "glUniform3fv");
+  gl.instancing &= Lookup(gl.Uniform4fv,               "glUniform4fv");
+  gl.instancing &= Lookup(gl.EnableVertexAttribArray,  "glEnableVertexAttribArray");
+  gl.instancing &= Lookup(gl.DisableVertexAttribArray, "glDisableVertexAttribArray");
+  gl.instancing &= Lookup(gl.VertexAttribPointer,      "glVertexAttribPointer");
+  gl.instancing &= Lookup(gl.VertexAttribDivisor,      "glVertexAttribDivisor",   "glVertexAttribDivisorARB");
+  gl.instancing &= Lookup(gl.DrawElementsInstanced,    "glDrawElementsInstanced", "glDrawElementsInstancedARB");
+
+  loaded = true;
+  return gl;
+}
@@ -0,0 +1,79 @@
+//|___________________________________________________________________
+//!
+//! \file GLExtensions.h
+//!
+//! \brief OpenGL entry points beyond 1.1.
+//!
+//! opengl32.dll only exports OpenGL 1.1, so the buffer, shader and
+//! instancing functions are looked up at run time through
+//! glutGetProcAddress. Extensions() does that once, on the first call,
+//! which must be with a current GL context, and reports what is present so
+//! callers can fall back to older paths.
+//|___________________________________________________________________
+
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <stddef.h>
+
+#include <GL/glut.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER           0x8892
+#define GL_ELEMENT_ARRAY_BUFFER   0x8893
+#define GL_STREAM_DRAW            0x88E0
+#define GL_STATIC_DRAW            0x88E4
+#endif
+
+#ifndef GL_VERTEX_SHADER
+#define GL_FRAGMENT_SHADER        0x8B30
+#define GL_VERTEX_SHADER          0x8B31
+#define GL_COMPILE_STATUS         0x8B81
+#define GL_LINK_STATUS            0x8B82
+#endif
+
+typedef char GLchar_t;
+
+struct GLExtensions {
+  bool buffers;           // Vertex buffer objects (OpenGL 1.5)
+  bool instancing;        // GLSL, instanced draws and per-instance attributes (OpenGL 3.3 or the ARB extensions)
+
+  // Buffer objects
+  void   (APIENTRY *GenBuffers)(GLsizei n, GLuint *buffers);
+  void   (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+  void   (APIENTRY *BufferData)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+
+  // Shaders
+  GLuint (APIENTRY *CreateShader)(GLenum type);
+  void   (APIENTRY *ShaderSource)(GLuint shader, GLsizei count, const GLchar_t *const *source, const GLint *length);
+  void   (APIENTRY *CompileShader)(GLuint shader);
+  void   (APIENTRY *GetShaderiv)(GLuint shader, GLenum name, GLint *value);
+  void   (APIENTRY *GetShaderInfoLog)(GLuint shader, GLsizei size, GLsizei *length, GLchar_t *log);
+  GLuint (APIENTRY *CreateProgram)(void);
+  void   (APIENTRY *AttachShader)(GLuint program, GLuint shader);
+  void   (APIENTRY *BindAttribLocation)(GLuint program, GLuint index, const GLchar_t *name);
+  void   (APIENTRY *LinkProgram)(GLuint program);
+  void   (APIENTRY *GetProgramiv)(GLuint program, GLenum name, GLint *value);
+  void   (APIENTRY *GetProgramInfoLog)(GLuint program, GLsizei size, GLsizei *length, GLchar_t *log);
+  void   (APIENTRY *UseProgram)(GLuint program);
+  GLint  (APIENTRY *GetUniformLocation)(GLuint program, const GLchar_t *name);
+  void   (APIENTRY *Uniform1f)(GLint location, GLfloat value);
+  void   (APIENTRY *Uniform3fv)(GLint location, GLsizei count, const GLfloat *value);
+  void   (APIENTRY *Uniform4fv)(GLint location, GLsizei count, const GLfloat *value);
+
+  // Generic attributes and instancing
+  void   (APIENTRY *EnableVertexAttribArray)(GLuint index);
+  void   (APIENTRY *DisableVertexAttribArray)(GLuint index);
+  void   (APIENTRY *VertexAttribPointer)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer);
+  void   (APIENTRY *VertexAttribDivisor)(GLuint index, GLuint divisor);
+  void   (APIENTRY *DrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instances);
+};
+
+// Entry points of the current context, looked up on the first call
+const GLExtensions &Extensions();
+
+#endif
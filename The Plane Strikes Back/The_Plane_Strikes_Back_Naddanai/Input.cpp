@@ -0,0 +1,158 @@
+//|___________________________________________________________________
+//!
+//! \file Input.cpp
+//!
+//! \brief Keyboard state (see Input.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "Input.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+// Shifted symbols and the keys they are on, US layout
+static const char SHIFTED[]   = "~!@#$%^&*()_+{}|:\"<>?";
+static const char UNSHIFTED[] = "`1234567890-=[]\\;',./";
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::InputState
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+InputState::InputState()
+{
+  memset(actions, 0, sizeof(actions));
+  memset(down, 0, sizeof(down));
+  memset(held, 0, sizeof(held));
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::Bind
+//|
+//! \param bindings   [in] Keys and their actions.
+//! \param count      [in] Number of bindings.
+//! \return None.
+//|____________________________________________________________________
+
+void InputState::Bind(const KeyBinding *bindings, int count)
+{
+  for (int i = 0; i < count; i++) {
+    const int action = bindings[i].action;
+    assert(action >= 0 && action < MAX_ACTIONS);
+    if (action < 0 || action >= MAX_ACTIONS) continue;
+    actions[Normalize(bindings[i].key, false)] = action;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::KeyDown
+//|
+//! \param key  [in] Key pressed.
+//! \param ctrl [in] Ctrl was held.
+//! \return Action the key is bound to, 0 for none.
+//!
+//! A key already down (a repeat that got through) is not counted twice.
+//|____________________________________________________________________
+
+int InputState::KeyDown(unsigned char key, bool ctrl)
+{
+  key = Normalize(key, ctrl);
+  if (!down[key]) {
+    down[key] = true;
+    held[actions[key]]++;
+  }
+  return actions[key];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::KeyUp
+//|
+//! \param key  [in] Key released.
+//! \param ctrl [in] Ctrl was held.
+//! \return None.
+//!
+//! A code below 32 is a control code with Ctrl held, but a key of its own
+//! (Enter, Backspace...) without; when Ctrl changed while the key was down,
+//! the other reading is the one that is down.
+//|____________________________________________________________________
+
+void InputState::KeyUp(unsigned char key, bool ctrl)
+{
+  if (!down[Normalize(key, ctrl)]) ctrl = !ctrl;
+  key = Normalize(key, ctrl);
+  if (down[key]) {
+    down[key] = false;
+    held[actions[key]]--;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::AnyHeld
+//|
+//! \param None.
+//! \return True while any bound key is down.
+//|____________________________________________________________________
+
+bool InputState::AnyHeld() const
+{
+  for (int a = 1; a < MAX_ACTIONS; a++) {
+    if (held[a] > 0) return true;
+  }
+  return false;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::ReleaseAll
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+void InputState::ReleaseAll()
+{
+  memset(down, 0, sizeof(down));
+  memset(held, 0, sizeof(held));
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InputState::Normalize
+//|
+//! \param key  [in] Key code from GLUT.
+//! \param ctrl [in] Ctrl was held.
+//! \return The code the key is tracked under: letters in lower case,
+//! symbols unshifted.
+//!
+//! With Ctrl held GLUT sends the control code instead: 1..26 for the
+//! letters, 27..31 for the five keys after them. It maps back to the key's
+//! own code. Without Ctrl, codes below 32 are keys of their own: Enter,
+//! Backspace, Tab and Escape.
+//|____________________________________________________________________
+
+unsigned char InputState::Normalize(unsigned char key, bool ctrl)
+{
+  if (ctrl && key < 32) key += '@';         // Ctrl+W is 0x17, 'W'
+
+  const char *shifted = key != 0 ? strchr(SHIFTED, key) : NULL;
+  if (shifted) key = UNSHIFTED[shifted - SHIFTED];
+  return (unsigned char)tolower(key);
+}
@@ -0,0 +1,72 @@
+//|___________________________________________________________________
+//!
+//! \file Input.h
+//!
+//! \brief Keyboard state: which keys are held, and the actions they are
+//! bound to.
+//!
+//! GLUT reports a held key as a stream of presses at the OS repeat rate.
+//! Acting on each press makes motion as fast as the repeat rate and queues
+//! a redraw per press. Instead, the key callbacks only record which keys
+//! are down and up (key repeat ignored), and the main loop applies the
+//! held actions once per simulation tick, by amounts scaled to the tick
+//! length. A key held down then moves things at the same speed on every
+//! machine, and no number of key events costs more than one frame.
+//!
+//! Actions are the program's own enum. Keys are bound to them through a
+//! table, so controls are changed in one place and several keys can share
+//! an action. Keys are tracked by their unmodified code (symbols by their
+//! unshifted key on a US layout): Shift or Ctrl pressed or released while
+//! a key is held does not leave it stuck down, and a binding for "w" or
+//! ";" also acts with Shift or Ctrl held. A key let go outside the window
+//! sends no release, so the program calls ReleaseAll() when the window
+//! stops getting keys.
+//|___________________________________________________________________
+
+#ifndef INPUT_H
+#define INPUT_H
+
+// Actions are 1..MAX_ACTIONS-1; 0 is no action
+const int MAX_ACTIONS = 64;
+
+// A key and the action it triggers
+struct KeyBinding {
+  unsigned char key;
+  int           action;
+};
+
+class InputState
+{
+ public:
+  InputState();
+
+  // Binds each key of the table to its action; call before any key arrives
+  void Bind(const KeyBinding *bindings, int count);
+
+  // From glutKeyboardFunc() and glutKeyboardUpFunc(), with "ctrl" true
+  // when glutGetModifiers() has GLUT_ACTIVE_CTRL. KeyDown() returns the
+  // action the key triggers, 0 for none.
+  int  KeyDown(unsigned char key, bool ctrl);
+  void KeyUp(unsigned char key, bool ctrl);
+
+  // True while any key bound to "action" is down
+  bool Held(int action) const   { return held[action] > 0; }
+
+  // +1, -1 or 0 from a pair of opposite actions, both held cancelling out
+  int  Axis(int positive, int negative) const { return Held(positive) - Held(negative); }
+
+  // True while any bound key is down
+  bool AnyHeld() const;
+
+  // Lets go of every key, for when the window loses the keyboard
+  void ReleaseAll();
+
+ private:
+  static unsigned char Normalize(unsigned char key, bool ctrl);
+
+  int  actions[256];            // Action of each key, 0 for none
+  bool down[256];
+  int  held[MAX_ACTIONS];       // Keys holding each action down
+};
+
+#endif
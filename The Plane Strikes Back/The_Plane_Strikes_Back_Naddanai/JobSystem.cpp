@@ -0,0 +1,328 @@
+//|___________________________________________________________________
+//!
+//! \file JobSystem.cpp
+//!
+//! \brief Work-stealing job scheduler (see JobSystem.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+
+#include "JobSystem.h"
+
+//|___________________
+//|
+//| Global Variables
+//|___________________
+
+// Queue of the running thread: 0 for the caller, 1.. for the workers
+static thread_local int thread_index = 0;
+
+//|____________________________________________________________________
+//|
+//| Function: TaskGraph::Add
+//|
+//! \param work   [in] What the task does.
+//! \return Handle of the task.
+//|____________________________________________________________________
+
+int TaskGraph::Add(const std::function<void()> &work)
+{
+  tasks.emplace_back();
+  Task &task = tasks.back();
+  task.work          = work;
+  task.prerequisites = 0;
+  task.waiting       = 0;
+  return (int)tasks.size() - 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: TaskGraph::AddDependency
+//|
+//! \param task          [in] Task that waits.
+//! \param prerequisite  [in] Task it waits for.
+//! \return None.
+//|____________________________________________________________________
+
+void TaskGraph::AddDependency(int task, int prerequisite)
+{
+  tasks[prerequisite].successors.push_back(task);
+  tasks[task].prerequisites++;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::JobSystem
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+JobSystem::JobSystem()
+  : queued(0), quit(false)
+{
+  queues.push_back(new Queue);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::~JobSystem
+//|
+//! \param None.
+//! \return None.
+//!
+//! Wakes the workers to quit and waits for them.
+//|____________________________________________________________________
+
+JobSystem::~JobSystem()
+{
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    quit = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+  for (size_t i = 0; i < queues.size(); i++) delete queues[i];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Start
+//|
+//! \param workers  [in] Worker threads to start, or -1 for one per core
+//!                      beyond the first.
+//! \return None.
+//|____________________________________________________________________
+
+void JobSystem::Start(int workers)
+{
+  if (workers < 0) workers = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+
+  for (int i = 0; i < workers; i++) queues.push_back(new Queue);
+  for (int i = 0; i < workers; i++) this->workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i + 1));
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Run
+//|
+//! \param graph  [in] Tasks to run.
+//! \return None.
+//!
+//! Queues the tasks without prerequisites; each finished task queues the
+//! successors it was the last prerequisite of. The caller works on the
+//! queued jobs until every task has finished.
+//|____________________________________________________________________
+
+void JobSystem::Run(TaskGraph &graph)
+{
+  const int count = graph.TaskCount();
+  std::atomic<int> pending(count);
+
+  for (int t = 0; t < count; t++) graph.tasks[t].waiting = graph.tasks[t].prerequisites;
+  for (int t = 0; t < count; t++) {
+    if (graph.tasks[t].prerequisites > 0) continue;
+
+    Job job;
+    job.work    = [this, &graph, t, &pending]() { RunTask(graph, t, &pending); };
+    job.pending = &pending;
+    Push(job);
+  }
+  Wait(pending);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::RunTask
+//|
+//! \param graph    [in] Graph being run.
+//! \param task     [in] Task whose prerequisites have all finished.
+//! \param pending  [in] Tasks of the run not yet finished.
+//! \return None.
+//|____________________________________________________________________
+
+void JobSystem::RunTask(TaskGraph &graph, int task, std::atomic<int> *pending)
+{
+  graph.tasks[task].work();
+
+  const std::vector<int> &successors = graph.tasks[task].successors;
+  for (size_t i = 0; i < successors.size(); i++) {
+    const int next = successors[i];
+    if (--graph.tasks[next].waiting > 0) continue;
+
+    Job job;
+    job.work    = [this, &graph, next, pending]() { RunTask(graph, next, pending); };
+    job.pending = pending;
+    Push(job);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::ParallelFor
+//|
+//! \param count  [in] Number of items.
+//! \param grain  [in] Items per range.
+//! \param body   [in] Called once per range with its first and one past
+//!                    its last item.
+//! \return None.
+//!
+//! The caller queues every range but the first, runs the first itself and
+//! then helps with the rest. The ranges are pushed last to first, so the
+//! caller pops them in order while thieves take the far end.
+//|____________________________________________________________________
+
+void JobSystem::ParallelFor(int count, int grain, const std::function<void(int first, int last)> &body)
+{
+  const int ranges = (count + grain - 1)/grain;
+
+  if (count <= 0) return;
+  if (ranges <= 1 || Threads() == 1) {
+    body(0, count);
+    return;
+  }
+
+  std::atomic<int> pending(ranges - 1);
+  for (int r = ranges - 1; r >= 1; r--) {
+    const int first = r*grain, last = std::min(first + grain, count);
+
+    Job job;
+    job.work    = [&body, first, last]() { body(first, last); };
+    job.pending = &pending;
+    Push(job);
+  }
+  body(0, grain);
+  Wait(pending);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Push
+//|
+//! \param job  [in] Job to queue on the running thread's deque.
+//! \return None.
+//!
+//! Taking the sleep lock between counting the job and notifying means a
+//! worker deciding to sleep either sees the job or gets the notification.
+//|____________________________________________________________________
+
+void JobSystem::Push(const Job &job)
+{
+  Queue &queue = *queues[thread_index];
+
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.jobs.push_back(job);
+  }
+  queued++;
+  if (!workers.empty()) {
+    { std::lock_guard<std::mutex> guard(sleep_lock); }
+    wake.notify_one();
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::RunOne
+//|
+//! \param None.
+//! \return True if a job was run, false if every queue was empty.
+//!
+//! Pops the newest job of the running thread's own deque, or else steals
+//! the oldest of the next non-empty one.
+//|____________________________________________________________________
+
+bool JobSystem::RunOne()
+{
+  const int count = Threads();
+  Job job;
+  bool found = false;
+
+  for (int k = 0; k < count && !found; k++) {
+    Queue &queue = *queues[(thread_index + k) % count];
+    std::lock_guard<std::mutex> guard(queue.lock);
+
+    if (queue.jobs.empty()) continue;
+    if (k == 0) {
+      job = std::move(queue.jobs.back());
+      queue.jobs.pop_back();
+    } else {
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    found = true;
+  }
+  if (!found) return false;
+
+  queued--;
+  job.work();
+  (*job.pending)--;
+  return true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::Wait
+//|
+//! \param pending  [in] Counter of the jobs waited for.
+//! \return None.
+//!
+//! Runs queued jobs, the running thread's own first, until the counter
+//! drops to zero. With nothing left to take, the waited-for jobs are
+//! running on other threads.
+//|____________________________________________________________________
+
+void JobSystem::Wait(const std::atomic<int> &pending)
+{
+  while (pending > 0) {
+    if (!RunOne()) std::this_thread::yield();
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: JobSystem::WorkerLoop
+//|
+//! \param index  [in] The worker's queue.
+//! \return None.
+//!
+//! Runs jobs while there are any, then sleeps until one is pushed.
+//|____________________________________________________________________
+
+void JobSystem::WorkerLoop(int index)
+{
+  thread_index = index;
+
+  for (;;) {
+    if (RunOne()) continue;
+
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    wake.wait(guard, [this]() { return queued > 0 || quit; });
+    if (quit) return;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: ParallelFor
+//|
+//! \param jobs   [in] Job system, or NULL.
+//! \param count  [in] Number of items.
+//! \param grain  [in] Items per range.
+//! \param body   [in] Called once per range.
+//! \return None.
+//|____________________________________________________________________
+
+void ParallelFor(JobSystem *jobs, int count, int grain, const std::function<void(int first, int last)> &body)
+{
+  if (jobs) {
+    jobs->ParallelFor(count, grain, body);
+  } else if (count > 0) {
+    body(0, count);
+  }
+}
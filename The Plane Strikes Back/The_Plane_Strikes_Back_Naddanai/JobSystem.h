@@ -0,0 +1,110 @@
+//|___________________________________________________________________
+//!
+//! \file JobSystem.h
+//!
+//! \brief Work-stealing job scheduler: task graphs and parallel loops.
+//!
+//! Every thread taking part (the workers and the thread that calls Run() or
+//! ParallelFor()) owns a deque of jobs. A thread pushes the jobs it spawns
+//! onto the back of its own deque and pops from the back, so it keeps
+//! working on what it just produced while that data is still in cache. A
+//! thread whose deque is empty steals from the front of another's, taking
+//! the oldest and usually largest piece of work. Idle workers sleep until a
+//! job is pushed.
+//!
+//! A thread waiting for jobs to finish runs queued jobs itself rather than
+//! blocking, so a job may start a ParallelFor() of its own and the calling
+//! thread always contributes. Without workers everything runs on the
+//! calling thread, in order.
+//!
+//! Nothing here touches OpenGL: jobs prepare data, the GL thread draws it.
+//|___________________________________________________________________
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tasks with dependencies between them, run together by JobSystem::Run().
+// A graph can be run again once Run() returns.
+class TaskGraph
+{
+ public:
+  // Adds a task; returns its handle
+  int  Add(const std::function<void()> &work);
+
+  // "task" starts only after "prerequisite" has finished
+  void AddDependency(int task, int prerequisite);
+
+  void Clear()                  { tasks.clear(); }
+  int  TaskCount() const        { return (int)tasks.size(); }
+
+ private:
+  friend class JobSystem;
+
+  struct Task {
+    std::function<void()> work;
+    std::vector<int>      successors;
+    int                   prerequisites;
+    std::atomic<int>      waiting;        // Prerequisites not yet finished in this run
+  };
+
+  std::deque<Task> tasks;               // Tasks hold atomics, which do not move
+};
+
+class JobSystem
+{
+ public:
+  JobSystem();
+  ~JobSystem();
+
+  // Starts "workers" threads besides the caller; -1 for one per core beyond
+  // the first. Until then everything runs on the calling thread.
+  void Start(int workers = -1);
+
+  // Threads working on jobs, the caller included
+  int  Threads() const          { return (int)queues.size(); }
+
+  // Runs every task of "graph", each after its prerequisites; returns when
+  // all have finished
+  void Run(TaskGraph &graph);
+
+  // Calls body(first, last) over [0, count) in ranges of about "grain"
+  // items, spread over the threads; returns when all ranges are done
+  void ParallelFor(int count, int grain, const std::function<void(int first, int last)> &body);
+
+ private:
+  struct Job {
+    std::function<void()> work;
+    std::atomic<int>     *pending;      // Decremented once "work" returns
+  };
+
+  struct Queue {
+    std::mutex      lock;
+    std::deque<Job> jobs;
+  };
+
+  void Push(const Job &job);
+  bool RunOne();
+  void Wait(const std::atomic<int> &pending);
+  void RunTask(TaskGraph &graph, int task, std::atomic<int> *pending);
+  void WorkerLoop(int index);
+
+  std::vector<Queue *>     queues;      // One per thread; 0 is the caller's
+  std::vector<std::thread> workers;
+  std::atomic<int>         queued;      // Jobs sitting in the queues
+  std::mutex               sleep_lock;
+  std::condition_variable  wake;
+  bool                     quit;
+};
+
+// jobs->ParallelFor(), or body(0, count) on the calling thread when "jobs" is NULL
+void ParallelFor(JobSystem *jobs, int count, int grain, const std::function<void(int first, int last)> &body);
+
+#endif
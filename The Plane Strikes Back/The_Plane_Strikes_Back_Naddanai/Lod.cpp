@@ -0,0 +1,356 @@
+//|___________________________________________________________________
+//!
+//! \file Lod.cpp
+//!
+//! \brief Level of detail (see Lod.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <string.h>
+
+#include "Lod.h"
+
+//|___________________
+//|
+//| Constants
+//|___________________
+
+const float LOD_TRIANGLE_RATIO[LOD_IMPOSTOR] = {1.0f, 0.5f, 0.2f};
+const float LOD_MIN_PIXELS[LOD_IMPOSTOR]     = {64.0f, 24.0f, 8.0f};
+
+// Faces meeting at an edge with normals further apart than this (60 degs)
+// make it a feature edge
+const double CREASE_COSINE = 0.5;
+
+// Weight of the planes through feature edges, relative to the triangle planes
+const double FEATURE_WEIGHT = 10.0;
+
+// Symmetric 4x4 error quadric: xx xy xz xw yy yz yw zz zw ww
+struct Quadric {
+  double q[10];
+};
+
+static void AddPlane(Quadric &quadric, const double n[3], double d, double weight)
+{
+  const double p[4] = {n[0], n[1], n[2], d};
+  int k = 0;
+
+  for (int i = 0; i < 4; i++) {
+    for (int j = i; j < 4; j++) quadric.q[k++] += weight*p[i]*p[j];
+  }
+}
+
+static double Error(const Quadric &a, const Quadric &b, const float v[3])
+{
+  const double p[4] = {v[0], v[1], v[2], 1};
+  double error = 0;
+  int k = 0;
+
+  for (int i = 0; i < 4; i++) {
+    for (int j = i; j < 4; j++, k++) error += (i == j ? 1 : 2)*(a.q[k] + b.q[k])*p[i]*p[j];
+  }
+  return error;
+}
+
+// Unnormalized normal of the triangle (a, b, c)
+static void Normal(double n[3], const float a[3], const float b[3], const float c[3])
+{
+  const double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  const double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+
+  n[0] = u[1]*v[2] - u[2]*v[1];
+  n[1] = u[2]*v[0] - u[0]*v[2];
+  n[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+struct PositionLess {
+  bool operator()(const MeshVertex &a, const MeshVertex &b) const {
+    return memcmp(a.position, b.position, sizeof(a.position)) < 0;
+  }
+};
+
+struct Collapse {
+  double cost;
+  int    from, to;            // Welded vertices
+  bool operator<(const Collapse &other) const { return cost < other.cost; }
+};
+
+//|____________________________________________________________________
+//|
+//| Function: DecimateMesh
+//|
+//! \param vertices   [in,out] Mesh vertices.
+//! \param indices    [in,out] Triangle list.
+//! \param triangles  [in] Triangle budget.
+//! \return None.
+//!
+//! Works on welded vertices ("points"): collapsing point a into point b
+//! moves every corner at a to the vertex at b of the same color, adding
+//! one if b has none, so faces keep their colors and stay joined. Meshes
+//! here are a few dozen triangles, so candidates are simply re-ranked after
+//! every collapse.
+//|____________________________________________________________________
+
+void DecimateMesh(std::vector<MeshVertex> &vertices, std::vector<GLushort> &indices, int triangles)
+{
+  const int vertex_count = (int)vertices.size();
+  std::map<MeshVertex, int, PositionLess> welded;
+  std::vector<int> point(vertex_count);         // Point of each vertex
+  std::vector<int> remap(vertex_count);         // Vertex each vertex now stands for
+  std::vector<const float *> position;          // Position of each point (in "welded")
+  std::vector<Quadric> quadric;
+  std::vector<int> tri(indices.begin(), indices.end());
+  std::vector<char> live(tri.size()/3, 1);
+  int live_count = (int)live.size();
+
+  for (int v = 0; v < vertex_count; v++) {
+    std::map<MeshVertex, int, PositionLess>::iterator found = welded.find(vertices[v]);
+    if (found == welded.end()) {
+      found = welded.insert(std::make_pair(vertices[v], (int)position.size())).first;
+      position.push_back(found->first.position);
+    }
+    point[v] = found->second;
+    remap[v] = v;
+  }
+
+  // Triangle planes, weighted by area
+  Quadric zero;
+  memset(&zero, 0, sizeof(zero));
+  quadric.assign(position.size(), zero);
+
+  std::vector<double> normal(tri.size(), 0);     // Unit normal of each triangle, 0 if degenerate
+  std::map<std::pair<int, int>, std::vector<int> > edge_faces;
+  for (size_t t = 0; t < live.size(); t++) {
+    const int *c = &tri[3*t];
+    double *n = &normal[3*t], length;
+
+    Normal(n, vertices[c[0]].position, vertices[c[1]].position, vertices[c[2]].position);
+    length = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (length == 0) continue;
+    for (int k = 0; k < 3; k++) n[k] /= length;
+
+    const float *p = vertices[c[0]].position;
+    const double d = -(n[0]*p[0] + n[1]*p[1] + n[2]*p[2]);
+    for (int k = 0; k < 3; k++) {
+      AddPlane(quadric[point[c[k]]], n, d, length/2);
+
+      const int a = point[c[k]], b = point[c[(k + 1) % 3]];
+      edge_faces[std::make_pair(std::min(a, b), std::max(a, b))].push_back((int)t);
+    }
+  }
+
+  // Planes through the feature edges (open, or where the faces meet at a
+  // sharp angle, like the folds of thin two-sided parts), perpendicular to
+  // each face along the edge
+  for (std::map<std::pair<int, int>, std::vector<int> >::iterator e = edge_faces.begin(); e != edge_faces.end(); ++e) {
+    const std::vector<int> &faces = e->second;
+    bool feature = faces.size() == 1;
+
+    for (size_t i = 0; i < faces.size() && !feature; i++) {
+      for (size_t j = i + 1; j < faces.size() && !feature; j++) {
+        const double *n0 = &normal[3*faces[i]], *n1 = &normal[3*faces[j]];
+        feature = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] < CREASE_COSINE;
+      }
+    }
+    if (!feature) continue;
+
+    const int a = e->first.first, b = e->first.second;
+    const float *pa = position[a], *pb = position[b];
+    const double edge[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+    const double weight = FEATURE_WEIGHT*(edge[0]*edge[0] + edge[1]*edge[1] + edge[2]*edge[2]);
+
+    for (size_t i = 0; i < faces.size(); i++) {
+      const double *n = &normal[3*faces[i]];
+      double side[3] = {edge[1]*n[2] - edge[2]*n[1], edge[2]*n[0] - edge[0]*n[2], edge[0]*n[1] - edge[1]*n[0]};
+      double length = sqrt(side[0]*side[0] + side[1]*side[1] + side[2]*side[2]);
+      if (length == 0) continue;
+      for (int k = 0; k < 3; k++) side[k] /= length;
+
+      const double d = -(side[0]*pa[0] + side[1]*pa[1] + side[2]*pa[2]);
+      AddPlane(quadric[a], side, d, weight);
+      AddPlane(quadric[b], side, d, weight);
+    }
+  }
+
+  while (live_count > triangles) {
+    std::vector<Collapse> candidates;
+
+    for (size_t t = 0; t < live.size(); t++) {
+      if (!live[t]) continue;
+      for (int k = 0; k < 3; k++) {
+        const int a = point[tri[3*t + k]], b = point[tri[3*t + (k + 1) % 3]];
+        Collapse ab = {Error(quadric[a], quadric[b], position[b]), a, b};
+        Collapse ba = {Error(quadric[a], quadric[b], position[a]), b, a};
+        candidates.push_back(ab);
+        candidates.push_back(ba);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    // Cheapest collapse that flips no triangle
+    const Collapse *chosen = NULL;
+    for (size_t i = 0; i < candidates.size() && !chosen; i++) {
+      const Collapse &c = candidates[i];
+      bool flips = false;
+
+      for (size_t t = 0; t < live.size() && !flips; t++) {
+        if (!live[t]) continue;
+        const int *corner = &tri[3*t];
+        const float *before[3], *after[3];
+        bool moves = false, degenerates = false;
+
+        for (int k = 0; k < 3; k++) {
+          before[k] = after[k] = position[point[corner[k]]];
+          if (point[corner[k]] == c.from) {
+            after[k] = position[c.to];
+            moves    = true;
+          }
+          degenerates |= point[corner[k]] == c.to;
+        }
+        if (!moves || degenerates) continue;
+
+        double n0[3], n1[3];
+        Normal(n0, before[0], before[1], before[2]);
+        Normal(n1, after[0], after[1], after[2]);
+        flips = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] <= 0;
+      }
+      if (!flips) chosen = &c;
+    }
+    if (!chosen) break;
+
+    // Move the corners at "from" to the vertex of their color at "to"
+    const Collapse c = *chosen;
+    for (int v = 0; v < (int)vertices.size(); v++) {
+      if (point[v] != c.from || remap[v] != v) continue;
+
+      int match = -1;
+      for (int w = 0; w < (int)vertices.size() && match < 0; w++) {
+        if (point[w] == c.to && remap[w] == w && memcmp(vertices[v].color, vertices[w].color, sizeof(vertices[v].color)) == 0) match = w;
+      }
+      if (match < 0) {
+        MeshVertex moved = vertices[v];
+        memcpy(moved.position, position[c.to], sizeof(moved.position));
+        match = (int)vertices.size();
+        vertices.push_back(moved);
+        point.push_back(c.to);
+        remap.push_back(match);
+      }
+      remap[v] = match;
+    }
+    for (int v = 0; v < (int)vertices.size(); v++) {
+      remap[v] = remap[remap[v]];
+      point[v] = point[remap[v]];
+    }
+    for (int k = 0; k < 10; k++) quadric[c.to].q[k] += quadric[c.from].q[k];
+
+    for (size_t t = 0; t < live.size(); t++) {
+      if (!live[t]) continue;
+      int *corner = &tri[3*t];
+      for (int k = 0; k < 3; k++) corner[k] = remap[corner[k]];
+      if (point[corner[0]] == point[corner[1]] || point[corner[1]] == point[corner[2]] || point[corner[0]] == point[corner[2]]) {
+        live[t] = 0;
+        live_count--;
+      }
+    }
+  }
+
+  // Keep the live triangles and the vertices they use
+  std::vector<MeshVertex> kept_vertices;
+  std::vector<GLushort> kept_indices;
+  std::vector<int> index(vertices.size(), -1);
+
+  for (size_t t = 0; t < live.size(); t++) {
+    if (!live[t]) continue;
+    for (int k = 0; k < 3; k++) {
+      const int v = tri[3*t + k];
+      if (index[v] < 0) {
+        index[v] = (int)kept_vertices.size();
+        kept_vertices.push_back(vertices[v]);
+      }
+      kept_indices.push_back((GLushort)index[v]);
+    }
+  }
+  vertices.swap(kept_vertices);
+  indices.swap(kept_indices);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: ProjectedSize
+//|
+//! \param modelview        [in] Modelview matrix, column-major.
+//! \param projection       [in] Perspective projection matrix, column-major.
+//! \param viewport_height  [in] Viewport height in pixels.
+//! \param center           [in] Sphere center.
+//! \param radius           [in] Sphere radius.
+//! \return Projected diameter in pixels.
+//!
+//! projection[5] is cot(fovy/2), so a length l at depth z covers
+//! l*projection[5]/z of the half viewport. Spheres reaching behind the
+//! viewer are taken as filling the view.
+//|____________________________________________________________________
+
+float ProjectedSize(const float modelview[16], const float projection[16], float viewport_height,
+                    const float center[3], float radius)
+{
+  const float depth = -(modelview[2]*center[0] + modelview[6]*center[1] + modelview[10]*center[2] + modelview[14]);
+
+  if (depth <= radius) return viewport_height;
+  return 2*radius*projection[5]*viewport_height/(2*depth);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SelectLod
+//|
+//! \param current  [in] Level drawn last frame.
+//! \param pixels   [in] Projected diameter.
+//! \return Level to draw.
+//!
+//! Walks down from full detail while the object is below each threshold;
+//! thresholds the object is currently below count LOD_HYSTERESIS higher.
+//|____________________________________________________________________
+
+int SelectLod(int current, float pixels)
+{
+  int level = LOD_FULL;
+
+  while (level < LOD_IMPOSTOR) {
+    float threshold = LOD_MIN_PIXELS[level];
+
+    if (current > level) threshold *= 1 + LOD_HYSTERESIS;
+    if (pixels >= threshold) break;
+    level++;
+  }
+  return level;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: BillboardMatrix
+//|
+//! \param out          [out] Modelview matrix of the quad.
+//! \param modelview    [in] Modelview matrix of the frame "center" is in.
+//! \param center       [in] Quad center.
+//! \param half_size    [in] Half the quad's side.
+//! \return None.
+//!
+//! The rotation is replaced by a uniform scale, so the quad's xy plane
+//! faces the viewer whatever the object's orientation.
+//|____________________________________________________________________
+
+void BillboardMatrix(float out[16], const float modelview[16], const float center[3], float half_size)
+{
+  for (int i = 0; i < 16; i++) out[i] = (i % 5 == 0) ? half_size : 0;
+  for (int r = 0; r < 3; r++) {
+    out[12 + r] = modelview[r]*center[0] + modelview[4 + r]*center[1] + modelview[8 + r]*center[2] + modelview[12 + r];
+  }
+  out[15] = 1;
+}
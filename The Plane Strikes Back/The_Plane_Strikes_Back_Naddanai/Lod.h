@@ -0,0 +1,58 @@
+//|___________________________________________________________________
+//!
+//! \file Lod.h
+//!
+//! \brief Level of detail: mesh decimation and per-frame level selection.
+//!
+//! MeshCache builds the coarser levels of every mesh when it first records
+//! it, by quadric error decimation (Garland and Heckbert): vertices at the
+//! same position are welded, each accumulates the planes of its triangles
+//! (and of the open and sharp edges, so silhouettes hold), and the edge
+//! collapse that moves the least away from those planes is applied until
+//! the triangle budget is met. Collapses that would flip a triangle are
+//! skipped.
+//!
+//! The last level is an impostor: one quad in the mesh's average color,
+//! drawn facing the camera.
+//!
+//! The level is picked each frame from the object's projected size in
+//! pixels. Going back to a finer level needs LOD_HYSTERESIS more pixels
+//! than leaving it did, so an object near a threshold does not flicker
+//! between levels.
+//|___________________________________________________________________
+
+#ifndef LOD_H
+#define LOD_H
+
+#include <vector>
+
+#include "MeshCache.h"
+
+// Fraction of the triangles kept by each decimated level
+extern const float LOD_TRIANGLE_RATIO[LOD_IMPOSTOR];
+
+// Decimated levels keep at least this many triangles
+const int   LOD_MIN_TRIANGLES = 4;
+
+// Projected diameter in pixels below which each level gives way to the next
+extern const float LOD_MIN_PIXELS[LOD_IMPOSTOR];
+
+// Extra size, as a fraction of the threshold, needed to go back to a finer level
+const float LOD_HYSTERESIS = 0.2f;
+
+// Collapses edges until at most "triangles" remain (fewer if the mesh allows
+// no more collapses). Unused vertices are dropped.
+void DecimateMesh(std::vector<MeshVertex> &vertices, std::vector<GLushort> &indices, int triangles);
+
+// Diameter in pixels of a sphere at "center" (in the frame "modelview" maps from)
+float ProjectedSize(const float modelview[16], const float projection[16], float viewport_height,
+                    const float center[3], float radius);
+
+// Level for an object of "pixels" diameter that was drawn at "current" last frame
+int   SelectLod(int current, float pixels);
+
+// Modelview matrix for a camera-facing quad: eye axes, scaled by "half_size",
+// at "center"
+void  BillboardMatrix(float out[16], const float modelview[16], const float center[3], float half_size);
+
+#endif
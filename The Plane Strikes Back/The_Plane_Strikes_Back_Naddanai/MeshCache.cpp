@@ -0,0 +1,345 @@
+//|___________________________________________________________________
+//!
+//! \file MeshCache.cpp
+//!
+//! \brief Retained meshes for the plane parts (see MeshCache.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "GLExtensions.h"
+#include "Lod.h"
+#include "MeshCache.h"
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::MeshBuilder
+//|
+//! \param None.
+//! \return None.
+//!
+//! Starts an empty mesh with white as the current color.
+//|____________________________________________________________________
+
+MeshBuilder::MeshBuilder()
+  : mode(GL_TRIANGLES), corners(0)
+{
+  color[0] = color[1] = color[2] = 1.0f;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Begin
+//|
+//! \param mode   [in] GL_TRIANGLES or GL_QUADS.
+//! \return None.
+//!
+//! Starts a group of primitives, like glBegin().
+//|____________________________________________________________________
+
+void MeshBuilder::Begin(GLenum mode)
+{
+  this->mode = mode;
+  corners    = 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Color3f
+//|
+//! \param r, g, b    [in] Color of the vertices that follow.
+//! \return None.
+//|____________________________________________________________________
+
+void MeshBuilder::Color3f(float r, float g, float b)
+{
+  color[0] = r;
+  color[1] = g;
+  color[2] = b;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::Vertex3f
+//|
+//! \param x, y, z    [in] Vertex position.
+//! \return None.
+//!
+//! Adds a vertex with the current color, like glVertex3f(). A completed
+//! quad is split into the triangles (0, 1, 2) and (0, 2, 3), the same split
+//! the fixed-function pipeline makes.
+//|____________________________________________________________________
+
+void MeshBuilder::Vertex3f(float x, float y, float z)
+{
+  MeshVertex vertex = {{x, y, z}, {color[0], color[1], color[2]}};
+  std::map<MeshVertex, GLushort, VertexLess>::iterator found = lookup.find(vertex);
+  int index;
+
+  if (found != lookup.end()) {
+    index = found->second;
+  } else {
+    index = (int)vertices.size();
+    vertices.push_back(vertex);
+    lookup[vertex] = (GLushort)index;
+  }
+
+  primitive[corners++] = index;
+  if (mode == GL_QUADS && corners == 4) {
+    const int split[6] = {0, 1, 2, 0, 2, 3};
+    for (int i = 0; i < 6; i++) indices.push_back((GLushort)primitive[split[i]]);
+    corners = 0;
+  } else if (mode == GL_TRIANGLES && corners == 3) {
+    for (int i = 0; i < 3; i++) indices.push_back((GLushort)primitive[i]);
+    corners = 0;
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshBuilder::End
+//|
+//! \param None.
+//! \return None.
+//!
+//! Ends a group of primitives, like glEnd(); an incomplete primitive is dropped.
+//|____________________________________________________________________
+
+void MeshBuilder::End()
+{
+  corners = 0;
+}
+
+bool MeshBuilder::VertexLess::operator()(const MeshVertex &a, const MeshVertex &b) const
+{
+  return memcmp(&a, &b, sizeof(MeshVertex)) < 0;
+}
+
+bool MeshCache::Key::operator<(const Key &other) const
+{
+  if (build != other.build) return build < other.build;
+  return memcmp(size, other.size, sizeof(size)) < 0;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::MeshCache
+//|
+//! \param None.
+//! \return None.
+//|____________________________________________________________________
+
+MeshCache::MeshCache()
+  : bound(-1)
+{
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::Get
+//|
+//! \param build      [in] Function that records the part.
+//! \param width      [in] Part dimensions, passed on to "build".
+//! \param length     [in]
+//! \param height     [in]
+//! \return Mesh handle for Draw().
+//!
+//! Looks the part up, recording and uploading it the first time, along with
+//! its bounding box and levels of detail. A level that would keep fewer
+//! than LOD_MIN_TRIANGLES triangles reuses the level above it.
+//|____________________________________________________________________
+
+int MeshCache::Get(MeshBuildFunc build, float width, float length, float height)
+{
+  Key key = {build, {width, length, height}};
+  std::map<Key, int>::iterator found = lookup.find(key);
+
+  if (found != lookup.end()) return found->second;
+
+  MeshBuilder builder;
+  BoundingBox bounds = EmptyBox();
+  int lod[LOD_LEVELS];
+
+  build(builder, width, length, height);
+  for (size_t i = 0; i < builder.vertices.size(); i++) Grow(bounds, builder.vertices[i].position);
+
+  const int triangles = (int)builder.indices.size()/3;
+  lod[LOD_FULL] = Add(builder.vertices, builder.indices, bounds);
+
+  for (int level = LOD_FULL + 1; level < LOD_IMPOSTOR; level++) {
+    const int budget = std::max((int)(triangles*LOD_TRIANGLE_RATIO[level] + 0.5f), std::min(triangles, LOD_MIN_TRIANGLES));
+    std::vector<MeshVertex> vertices(builder.vertices);
+    std::vector<GLushort> indices(builder.indices);
+
+    if (budget >= TriangleCount(lod[level - 1])) {
+      lod[level] = lod[level - 1];
+      continue;
+    }
+    DecimateMesh(vertices, indices, budget);
+    lod[level] = Add(vertices, indices, bounds);
+  }
+
+  // Impostor: a quad in the area-weighted average color
+  float color[3] = {0, 0, 0}, area = 0;
+  for (size_t i = 0; i < builder.indices.size(); i += 3) {
+    const MeshVertex *v[3] = {&builder.vertices[builder.indices[i]], &builder.vertices[builder.indices[i + 1]], &builder.vertices[builder.indices[i + 2]]};
+    float u[3], w[3], n[3], a;
+
+    for (int k = 0; k < 3; k++) {
+      u[k] = v[1]->position[k] - v[0]->position[k];
+      w[k] = v[2]->position[k] - v[0]->position[k];
+    }
+    n[0] = u[1]*w[2] - u[2]*w[1];
+    n[1] = u[2]*w[0] - u[0]*w[2];
+    n[2] = u[0]*w[1] - u[1]*w[0];
+    a = sqrtf(n[0]*n[0] + n[1]*n[1] + n[2]*n[2])/2;
+    for (int k = 0; k < 3; k++) color[k] += a*(v[0]->color[k] + v[1]->color[k] + v[2]->color[k])/3;
+    area += a;
+  }
+  if (area > 0) {
+    for (int k = 0; k < 3; k++) color[k] /= area;
+  }
+
+  MeshBuilder impostor;
+  impostor.Begin(GL_QUADS);
+    impostor.Color3f(color[0], color[1], color[2]);
+    impostor.Vertex3f(-1, -1, 0);
+    impostor.Vertex3f( 1, -1, 0);
+    impostor.Vertex3f( 1,  1, 0);
+    impostor.Vertex3f(-1,  1, 0);
+  impostor.End();
+  lod[LOD_IMPOSTOR] = Add(impostor.vertices, impostor.indices, bounds);
+
+  for (int level = 0; level < LOD_LEVELS; level++) {
+    for (int k = 0; k < LOD_LEVELS; k++) meshes[lod[level]].lod[k] = lod[k];
+  }
+  lookup[key] = lod[LOD_FULL];
+  return lod[LOD_FULL];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::Add
+//|
+//! \param vertices   [in] Mesh vertices.
+//! \param indices    [in] Triangle list.
+//! \param bounds     [in] Bounding box reported for the mesh.
+//! \return Handle of the new mesh.
+//!
+//! Uploads the mesh to buffers, or keeps it in client memory without them.
+//|____________________________________________________________________
+
+int MeshCache::Add(std::vector<MeshVertex> vertices, std::vector<GLushort> indices, const BoundingBox &bounds)
+{
+  const GLExtensions &gl = Extensions();
+  Mesh mesh;
+
+  mesh.vertex_buffer = 0;
+  mesh.index_buffer  = 0;
+  mesh.index_count   = (GLsizei)indices.size();
+  mesh.bounds        = bounds;
+  for (int l = 0; l < LOD_LEVELS; l++) mesh.lod[l] = (int)meshes.size();   // Itself until Get() links the levels
+
+  if (gl.buffers && mesh.index_count > 0) {
+    GLuint names[2];
+    gl.GenBuffers(2, names);
+    mesh.vertex_buffer = names[0];
+    mesh.index_buffer  = names[1];
+    gl.BindBuffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+    gl.BufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(MeshVertex), &vertices[0], GL_STATIC_DRAW);
+    gl.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.index_buffer);
+    gl.BufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+    bound = -1;
+  } else {
+    if (meshes.empty()) printf("Vertex buffer objects unavailable; drawing meshes from client memory\n");
+    mesh.vertices.swap(vertices);
+    mesh.indices.swap(indices);
+  }
+
+  meshes.push_back(mesh);
+  return (int)meshes.size() - 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::Bind
+//|
+//! \param mesh   [in] Handle from Get().
+//! \return Index pointer for glDrawElements (an offset when in a buffer).
+//!
+//! Points the vertex and color arrays at the mesh. This is skipped when the
+//! mesh is the last one drawn, so repeated parts (e.g. the two stabilizers)
+//! cost one call each. The arrays stay enabled afterwards; immediate-mode
+//! drawing is not affected by them.
+//|____________________________________________________________________
+
+const GLvoid *MeshCache::Bind(int mesh)
+{
+  const Mesh &m = meshes[mesh];
+
+  if (bound != mesh) {
+    const char *base = 0;         // Offsets into the bound buffer...
+
+    if (m.vertex_buffer != 0) {
+      Extensions().BindBuffer(GL_ARRAY_BUFFER, m.vertex_buffer);
+      Extensions().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.index_buffer);
+    } else {
+      base = (const char *)&m.vertices[0];    // ... or pointers into client memory
+    }
+    if (bound < 0) {
+      glEnableClientState(GL_VERTEX_ARRAY);
+      glEnableClientState(GL_COLOR_ARRAY);
+    }
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, position));
+    glColorPointer (3, GL_FLOAT, sizeof(MeshVertex), base + offsetof(MeshVertex, color));
+    bound = mesh;
+  }
+  return m.vertex_buffer != 0 ? 0 : &m.indices[0];
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::Draw
+//|
+//! \param mesh   [in] Handle from Get().
+//! \return None.
+//!
+//! Draws the mesh with one glDrawElements call.
+//|____________________________________________________________________
+
+void MeshCache::Draw(int mesh)
+{
+  if (meshes[mesh].index_count == 0) return;
+
+  const GLvoid *indices = Bind(mesh);
+  glDrawElements(GL_TRIANGLES, meshes[mesh].index_count, GL_UNSIGNED_SHORT, indices);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: MeshCache::DrawInstanced
+//|
+//! \param mesh       [in] Handle from Get().
+//! \param instances  [in] Number of copies.
+//! \return None.
+//!
+//! Draws "instances" copies of the mesh with one call; the bound vertex
+//! program places each copy. Requires Extensions().instancing.
+//|____________________________________________________________________
+
+void MeshCache::DrawInstanced(int mesh, int instances)
+{
+  if (meshes[mesh].index_count == 0 || instances <= 0) return;
+
+  const GLvoid *indices = Bind(mesh);
+  Extensions().DrawElementsInstanced(GL_TRIANGLES, meshes[mesh].index_count, GL_UNSIGNED_SHORT, indices, instances);
+}
@@ -0,0 +1,127 @@
+//|___________________________________________________________________
+//!
+//! \file MeshCache.h
+//!
+//! \brief Retained meshes for the plane parts.
+//!
+//! A part's geometry is described once by a build function that records the
+//! same glBegin/glColor3f/glVertex3f/glEnd sequence the immediate-mode code
+//! used to issue every frame. The cache stores the result as an indexed
+//! triangle list in vertex/index buffers, keyed by the build function and the
+//! part's dimensions, so drawing a part is a single glDrawElements call.
+//!
+//! Each mesh comes with coarser levels of detail, decimated when it is
+//! built, and an impostor quad (see Lod.h).
+//!
+//! Buffers need OpenGL 1.5 (see GLExtensions.h); on older drivers the meshes stay in client
+//! memory and are drawn from vertex arrays, still with one call per part.
+//! Meshes are built on first use, which must be with a current GL context;
+//! the buffers live as long as that context.
+//|___________________________________________________________________
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <map>
+#include <vector>
+
+#include <GL/glut.h>
+
+#include "Culling.h"
+
+//|___________________
+//|
+//| Mesh builder
+//|___________________
+
+struct MeshVertex {
+  float position[3];
+  float color[3];
+};
+
+class MeshBuilder
+{
+ public:
+  MeshBuilder();
+
+  // Same meaning as the GL calls of the same name; mode is GL_TRIANGLES or GL_QUADS
+  void Begin(GLenum mode);
+  void Color3f(float r, float g, float b);
+  void Vertex3f(float x, float y, float z);
+  void End();
+
+  std::vector<MeshVertex> vertices;       // Vertices shared by position and color
+  std::vector<GLushort>   indices;        // Triangle list
+
+ private:
+  GLenum mode;
+  float  color[3];
+  int    primitive[4];                    // Vertices of the primitive being recorded
+  int    corners;
+  struct VertexLess {
+    bool operator()(const MeshVertex &a, const MeshVertex &b) const;
+  };
+  std::map<MeshVertex, GLushort, VertexLess> lookup;
+};
+
+// Records a part with the given dimensions; parts with two dimensions ignore "height"
+typedef void (*MeshBuildFunc)(MeshBuilder &mesh, float width, float length, float height);
+
+// Levels of detail of a mesh, finest first. The impostor is a quad spanning
+// -1..1 in x and y, to be drawn facing the camera (see BillboardMatrix).
+enum LodLevel {LOD_FULL = 0, LOD_HALF, LOD_FIFTH, LOD_IMPOSTOR, LOD_LEVELS};
+
+//|___________________
+//|
+//| Mesh cache
+//|___________________
+
+class MeshCache
+{
+ public:
+  MeshCache();
+
+  // Handle of the part's mesh, building it on the first request for these dimensions
+  int  Get(MeshBuildFunc build, float width, float length, float height = 0);
+
+  // Handle of a level of detail of a mesh; Lod(mesh, LOD_FULL) is "mesh"
+  int  Lod(int mesh, int level) const { return meshes[mesh].lod[level]; }
+
+  // Draws a mesh with the current modelview matrix
+  void Draw(int mesh);
+
+  // Draws copies of a mesh, placed by the bound vertex program
+  void DrawInstanced(int mesh, int instances);
+
+  int  MeshCount() const              { return (int)meshes.size(); }
+  int  TriangleCount(int mesh) const  { return meshes[mesh].index_count/3; }
+
+  // Box around the full-detail mesh's vertices, in the part's own frame
+  const BoundingBox &Bounds(int mesh) const   { return meshes[mesh].bounds; }
+
+ private:
+  struct Key {
+    MeshBuildFunc build;
+    float         size[3];
+    bool operator<(const Key &other) const;
+  };
+
+  struct Mesh {
+    GLuint                  vertex_buffer;    // 0 when drawn from client memory
+    GLuint                  index_buffer;
+    GLsizei                 index_count;
+    BoundingBox             bounds;
+    int                     lod[LOD_LEVELS];  // Handles of all the levels
+    std::vector<MeshVertex> vertices;         // Kept only without buffer support
+    std::vector<GLushort>   indices;
+  };
+
+  int  Add(std::vector<MeshVertex> vertices, std::vector<GLushort> indices, const BoundingBox &bounds);
+  const GLvoid *Bind(int mesh);
+
+  std::map<Key, int> lookup;
+  std::vector<Mesh>  meshes;
+  int                bound;                   // Mesh whose arrays are set up, or -1
+};
+
+#endif
@@ -0,0 +1,353 @@
+//|___________________________________________________________________
+//!
+//! \file SceneGraph.cpp
+//!
+//! \brief Flat scene graph (see SceneGraph.h).
+//|___________________________________________________________________
+
+//|___________________
+//|
+//| Includes
+//|___________________
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+
+#include "Lod.h"
+#include "SceneGraph.h"
+
+//|____________________________________________________________________
+//|
+//| Function: MultiplyAffine
+//|
+//! \param out    [out] a*b; must not alias a or b.
+//! \param a      [in]  Column-major affine matrix.
+//! \param b      [in]  Column-major affine matrix.
+//! \return None.
+//|____________________________________________________________________
+
+void MultiplyAffine(float out[16], const float a[16], const float b[16])
+{
+  for (int c = 0; c < 4; c++) {
+    const float *bc = b + 4*c;
+    for (int r = 0; r < 3; r++) {
+      out[4*c + r] = a[r]*bc[0] + a[4 + r]*bc[1] + a[8 + r]*bc[2];
+    }
+    out[4*c + 3] = 0;
+  }
+  out[12] += a[12];
+  out[13] += a[13];
+  out[14] += a[14];
+  out[15]  = 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: LocalMatrix
+//|
+//! \param out    [out] Column-major matrix of the transform.
+//! \param p      [in]  Translation.
+//! \param q      [in]  Unit quaternion (x, y, z, w).
+//! \return None.
+//|____________________________________________________________________
+
+static void LocalMatrix(float out[16], const float p[3], const float q[4])
+{
+  const float x = q[0], y = q[1], z = q[2], w = q[3];
+
+  out[0]  = 1 - 2*(y*y + z*z);  out[4] = 2*(x*y - w*z);      out[8]  = 2*(x*z + w*y);      out[12] = p[0];
+  out[1]  = 2*(x*y + w*z);      out[5] = 1 - 2*(x*x + z*z);  out[9]  = 2*(y*z - w*x);      out[13] = p[1];
+  out[2]  = 2*(x*z - w*y);      out[6] = 2*(y*z + w*x);      out[10] = 1 - 2*(x*x + y*y);  out[14] = p[2];
+  out[3]  = 0;                  out[7] = 0;                  out[11] = 0;                  out[15] = 1;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::SceneGraph
+//|
+//! \param meshes     [in] Cache the node meshes come from.
+//! \return None.
+//|____________________________________________________________________
+
+SceneGraph::SceneGraph(MeshCache &meshes)
+  : meshes(meshes), lod(true), recomputed(0), culled(0)
+{
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::AddNode
+//|
+//! \param parent     [in] Parent handle, or -1 for a root.
+//! \param mesh       [in] MeshCache handle, or -1.
+//! \param frame      [in] Length of the coordinate frame axes, or 0.
+//! \return Handle of the new node.
+//!
+//! The node starts with the identity transform, visible and dirty. Its
+//! bounds are those of the mesh and of the frame's axes.
+//|____________________________________________________________________
+
+int SceneGraph::AddNode(int parent, int mesh, float frame)
+{
+  const int node = (int)this->parent.size();
+  const float origin[3] = {0, 0, 0}, identity[4] = {0, 0, 0, 1};
+  SceneMatrix m;
+  BoundingBox bounds = mesh >= 0 ? meshes.Bounds(mesh) : EmptyBox();
+
+  assert(parent < 0 || subtree_end[parent] == node);     // Depth-first order (see SceneGraph.h)
+  LocalMatrix(m.m, origin, identity);
+  if (frame > 0) {
+    const float axes_end[3] = {frame, frame, frame};
+    Grow(bounds, origin);
+    Grow(bounds, axes_end);
+  }
+
+  // The new node ends the subtree of each of its ancestors
+  for (int a = parent; a >= 0; a = this->parent[a]) subtree_end[a] = node + 1;
+
+  this->parent.push_back(parent);
+  subtree_end.push_back(node + 1);
+  position.insert(position.end(), origin, origin + 3);
+  rotation.insert(rotation.end(), identity, identity + 4);
+  world.push_back(m);
+  this->mesh.push_back(mesh);
+  this->frame.push_back(frame);
+  visible.push_back(1);
+  local_bounds.push_back(bounds);
+  world_bounds.push_back(bounds);
+  subtree_bounds.push_back(bounds);
+  mesh_bounds.push_back(mesh >= 0 ? meshes.Bounds(mesh) : EmptyBox());
+  level.push_back(LOD_FULL);
+  dirty.push_back(0);
+  MarkDirty(node);
+  return node;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::MarkDirty
+//|
+//! \param node   [in] Node handle.
+//! \return None.
+//|____________________________________________________________________
+
+void SceneGraph::MarkDirty(int node)
+{
+  if (dirty[node]) return;
+  dirty[node] = 1;
+  dirty_nodes.push_back(node);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::SetLocal
+//|
+//! \param node       [in] Node handle.
+//! \param position   [in] Translation w.r.t. the parent's frame.
+//! \param rotation   [in] Unit quaternion, applied before the translation.
+//! \return None.
+//|____________________________________________________________________
+
+void SceneGraph::SetLocal(int node, const gmtl::Vec3f &position, const gmtl::Quatf &rotation)
+{
+  float *p = &this->position[3*node];
+  float *q = &this->rotation[4*node];
+  bool changed = false;
+
+  for (int i = 0; i < 3; i++) {
+    changed |= p[i] != position[i];
+    p[i] = position[i];
+  }
+  for (int i = 0; i < 4; i++) {
+    changed |= q[i] != rotation[i];
+    q[i] = rotation[i];
+  }
+  if (changed) MarkDirty(node);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::UpdateWorld
+//|
+//! \param None.
+//! \return None.
+//!
+//! world = world(parent)*local over the subtree range of each dirty node,
+//! in array order. Dirty nodes are sorted so a dirty node inside a subtree
+//! already recomputed is skipped. The bounds of the range are then refit
+//! backwards, children before parents, followed by the range's ancestors.
+//|____________________________________________________________________
+
+void SceneGraph::UpdateWorld()
+{
+  int done = 0;         // Nodes below this handle are up to date
+
+  recomputed = 0;
+  std::sort(dirty_nodes.begin(), dirty_nodes.end());
+  for (size_t d = 0; d < dirty_nodes.size(); d++) {
+    const int first = dirty_nodes[d];
+
+    dirty[first] = 0;
+    if (first < done) continue;
+
+    for (int i = first; i < subtree_end[first]; i++) {
+      if (parent[i] < 0) {
+        LocalMatrix(world[i].m, &position[3*i], &rotation[4*i]);
+      } else {
+        float local[16];
+        LocalMatrix(local, &position[3*i], &rotation[4*i]);
+        MultiplyAffine(world[i].m, world[parent[i]].m, local);
+      }
+      dirty[i] = 0;
+    }
+    for (int i = subtree_end[first] - 1; i >= first; i--) {
+      world_bounds[i] = TransformBox(world[i].m, local_bounds[i]);
+      RefitBounds(i);
+    }
+    for (int a = parent[first]; a >= 0; a = parent[a]) RefitBounds(a);
+    recomputed += subtree_end[first] - first;
+    done = subtree_end[first];
+  }
+  dirty_nodes.clear();
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::RefitBounds
+//|
+//! \param node   [in] Node handle.
+//! \return None.
+//!
+//! subtree box = own world box + subtree boxes of the children, and the
+//! same for the mesh box with the node's mesh alone. The first child
+//! follows the node and each next sibling starts where the previous one's
+//! subtree ends.
+//|____________________________________________________________________
+
+void SceneGraph::RefitBounds(int node)
+{
+  subtree_bounds[node] = world_bounds[node];
+  mesh_bounds[node]    = mesh[node] >= 0 ? TransformBox(world[node].m, meshes.Bounds(mesh[node])) : EmptyBox();
+  for (int c = node + 1; c < subtree_end[node]; c = subtree_end[c]) {
+    Merge(subtree_bounds[node], subtree_bounds[c]);
+    Merge(mesh_bounds[node], mesh_bounds[c]);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::Draw
+//|
+//! \param view         [in] World-to-eye matrix, column-major.
+//! \param draw_frame   [in] Draws a coordinate frame of the given length.
+//! \param frustum      [in] View frustum in world coordinates, or NULL.
+//! \return None.
+//|____________________________________________________________________
+
+void SceneGraph::Draw(const float view[16], void (*draw_frame)(const float length), const Frustum *frustum)
+{
+  GLfloat projection[16];
+  GLint viewport[4];
+
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  Prepare(view, projection, (float)viewport[3], frustum);
+  Submit(draw_frame);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::Prepare
+//|
+//! \param view             [in] World-to-eye matrix, column-major.
+//! \param projection       [in] Projection matrix, column-major.
+//! \param viewport_height  [in] In pixels.
+//! \param frustum          [in] View frustum in world coordinates, or NULL.
+//! \return None.
+//!
+//! Lists view*world for every visible node. A subtree outside the frustum
+//! is skipped whole; below a subtree inside it nothing more is tested.
+//!
+//! A node's mesh is drawn at the level of detail for the projected size of
+//! the meshes in its subtree, so a camera's frame some way off does not
+//! make the plane look bigger. At the impostor level the impostor quad
+//! stands in for the whole subtree, e.g. a distant plane with all its parts.
+//|____________________________________________________________________
+
+void SceneGraph::Prepare(const float view[16], const float projection[16], float viewport_height, const Frustum *frustum)
+{
+  const int count = (int)parent.size();
+  int inside_end = 0;           // Nodes below this handle are known to be inside
+  DrawItem item;
+
+  culled = 0;
+  draw_list.clear();
+  for (int i = 0; i < count; i++) {
+    if (frustum && i >= inside_end) {
+      const CullResult result = frustum->Classify(subtree_bounds[i]);
+
+      if (result == CR_OUTSIDE) {
+        culled += subtree_end[i] - i;
+        i = subtree_end[i] - 1;
+        continue;
+      }
+      if (result == CR_INSIDE) {
+        inside_end = subtree_end[i];
+      } else if (frustum->Classify(world_bounds[i]) == CR_OUTSIDE) {
+        culled++;
+        continue;
+      }
+    }
+    if (!visible[i] || (mesh[i] < 0 && frame[i] <= 0)) continue;
+
+    if (lod && mesh[i] >= 0) {
+      const BoundingBox &box = mesh_bounds[i];
+      float center[3], radius = 0, half_size = 0;
+
+      for (int k = 0; k < 3; k++) {
+        center[k]  = (box.min[k] + box.max[k])/2;
+        radius    += (box.max[k] - box.min[k])*(box.max[k] - box.min[k])/4;
+        half_size += (box.max[k] - box.min[k])/6;
+      }
+      level[i] = (char)SelectLod(level[i], ProjectedSize(view, projection, viewport_height, center, sqrtf(radius)));
+
+      if (level[i] == LOD_IMPOSTOR) {
+        BillboardMatrix(item.modelview, view, center, half_size);
+        item.mesh  = meshes.Lod(mesh[i], LOD_IMPOSTOR);
+        item.frame = 0;
+        draw_list.push_back(item);
+        i = subtree_end[i] - 1;
+        continue;
+      }
+    }
+
+    MultiplyAffine(item.modelview, view, world[i].m);
+    item.mesh  = mesh[i] >= 0 ? meshes.Lod(mesh[i], level[i]) : -1;
+    item.frame = frame[i];
+    draw_list.push_back(item);
+  }
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SceneGraph::Submit
+//|
+//! \param draw_frame   [in] Draws a coordinate frame of the given length.
+//! \return None.
+//!
+//! Loads each listed modelview matrix and draws. Leaves the modelview
+//! matrix set to the last node's.
+//|____________________________________________________________________
+
+void SceneGraph::Submit(void (*draw_frame)(const float length)) const
+{
+  glMatrixMode(GL_MODELVIEW);
+  for (size_t i = 0; i < draw_list.size(); i++) {
+    const DrawItem &item = draw_list[i];
+
+    glLoadMatrixf(item.modelview);
+    if (item.mesh >= 0) meshes.Draw(item.mesh);
+    if (item.frame > 0) draw_frame(item.frame);
+  }
+}
@@ -0,0 +1,132 @@
+//|___________________________________________________________________
+//!
+//! \file SceneGraph.h
+//!
+//! \brief Flat scene graph.
+//!
+//! Nodes live in parallel arrays indexed by node handle: parent index, local
+//! transform (position and rotation quaternion), cached world matrix and
+//! what to draw. Nodes are added in depth-first order, a parent before its
+//! children, so a node's subtree is the contiguous range of handles up to
+//! its subtree end: a forward pass over that range recomputes the subtree's
+//! world matrices, each node reading only its parent's already computed
+//! matrix. Drawing is a second pass that loads each node's modelview matrix
+//! directly instead of walking the GL matrix stack.
+//!
+//! World matrices are cached between frames. Changing a node's local
+//! transform marks it dirty, and UpdateWorld() only recomputes the subtrees
+//! of dirty nodes, so its cost follows what changed, not the scene size.
+//!
+//! Each node has a box around what it draws (its mesh's bounds and its
+//! coordinate frame) and a world box around its whole subtree, refit with
+//! the world matrices. Draw() tests the subtree box against the view
+//! frustum first and skips the subtree's range when it is outside.
+//!
+//! Meshes are drawn at a level of detail picked from the projected size of
+//! the meshes in the node's subtree (see Lod.h); coordinate frames, and
+//! children that draw only a frame such as a camera, do not count. A
+//! subtree small enough on screen is drawn as its top mesh's impostor quad.
+//!
+//! UpdateWorld() and Prepare() make no OpenGL calls, so they can run as a
+//! job off the GL thread; Prepare() leaves a draw list of modelview
+//! matrices and meshes that Submit() loads and draws.
+//|___________________________________________________________________
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <vector>
+
+#include <gmtl/gmtl.h>
+
+#include "Culling.h"
+#include "MeshCache.h"
+
+// Column-major 4x4 matrix, as glLoadMatrixf() expects
+struct SceneMatrix {
+  float m[16];
+};
+
+class SceneGraph
+{
+ public:
+  SceneGraph(MeshCache &meshes);
+
+  // Adds a node below "parent" (-1 for a root) drawing "mesh" (-1 for none)
+  // and a coordinate frame of length "frame" (0 for none); returns its handle.
+  // "parent" must be the last node added or one of its ancestors.
+  int  AddNode(int parent, int mesh = -1, float frame = 0);
+
+  // Local transform w.r.t. the parent: rotates by "rotation", then translates
+  // by "position". Marks the node dirty if the transform changed.
+  void SetLocal(int node, const gmtl::Vec3f &position, const gmtl::Quatf &rotation);
+
+  // Hides or shows the node's own drawing; children are not affected
+  void SetVisible(int node, bool visible)     { this->visible[node] = visible; }
+
+  // Recomputes the world matrices and bounds of the dirty nodes' subtrees
+  void UpdateWorld();
+
+  // World matrices recomputed by the last UpdateWorld()
+  int  Recomputed() const                     { return recomputed; }
+
+  // Lists the visible nodes to draw; "view" is the world-to-eye matrix,
+  // "projection" and "viewport_height" (in pixels) size them on screen for
+  // the level of detail. Nodes outside "frustum" (in world coordinates;
+  // NULL for none) are skipped.
+  void Prepare(const float view[16], const float projection[16], float viewport_height, const Frustum *frustum = NULL);
+
+  // Draws the list of the last Prepare()
+  void Submit(void (*draw_frame)(const float length)) const;
+
+  // Prepare() with the current projection matrix and viewport, then Submit()
+  void Draw(const float view[16], void (*draw_frame)(const float length), const Frustum *frustum = NULL);
+
+  // Picks a level of detail per node (on by default)
+  void SetLod(bool enabled)                   { lod = enabled; }
+
+  // Level the node's mesh was last drawn at
+  int  Level(int node) const                  { return level[node]; }
+
+  // Nodes skipped by the last Prepare() because they were outside the frustum
+  int  Culled() const                         { return culled; }
+
+  const SceneMatrix &World(int node) const    { return world[node]; }
+  int  NodeCount() const                      { return (int)parent.size(); }
+
+ private:
+  void MarkDirty(int node);
+  void RefitBounds(int node);
+
+  MeshCache               &meshes;
+  bool                     lod;
+  std::vector<int>         parent;
+  std::vector<int>         subtree_end;      // One past the node's last descendant
+  std::vector<float>       position;         // 3 per node
+  std::vector<float>       rotation;         // 4 per node, quaternion (x, y, z, w)
+  std::vector<SceneMatrix> world;
+  std::vector<int>         mesh;
+  std::vector<float>       frame;
+  std::vector<char>        visible;
+  std::vector<BoundingBox> local_bounds;     // What the node draws, in its own frame
+  std::vector<BoundingBox> world_bounds;     // The same in world coordinates
+  std::vector<BoundingBox> subtree_bounds;   // World box around the node and its descendants
+  std::vector<BoundingBox> mesh_bounds;      // ... around their meshes only, for the level of detail
+  std::vector<char>        dirty;
+  std::vector<int>         dirty_nodes;      // Nodes with dirty set, in no order
+  int                      recomputed;
+  int                      culled;
+  std::vector<char>        level;            // Level of detail of each node when last drawn
+
+  struct DrawItem {
+    float modelview[16];
+    int   mesh;                              // MeshCache handle at the picked level, or -1
+    float frame;                             // Coordinate frame length, or 0
+  };
+  std::vector<DrawItem>    draw_list;        // Built by Prepare(), in node order
+};
+
+// out = a*b for affine matrices (bottom row 0 0 0 1)
+void MultiplyAffine(float out[16], const float a[16], const float b[16]);
+
+#endif
@@ -4,11 +4,24 @@
 //|___________________
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 #include <gmtl/gmtl.h>
 
 #include <GL/glut.h>
 
+#include "Culling.h"
+#include "FleetRenderer.h"
+#include "FlightDynamics.h"
+#include "FrameLoop.h"
+#include "Input.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "SceneGraph.h"
+#include "../../The Triangle Awakens/partial/PerfCounters.h"
+
 //|___________________
 //|
 //| Constants
@@ -21,7 +34,8 @@ const float P_HEIGHT       = 1.5f;
 
 // Plane transforms
 const gmtl::Vec3f PLANE_FORWARD(0, 0, 1.0f);            // Plane's forward translation vector (w.r.t. local frame)
-const float PLANE_ROTATION = 5.0f;                      // Plane rotated by 5 degs per input
+const float PLANE_SPEED    = 10.0f;                     // Plane moved by 10 units per sec while a key is held
+const float PLANE_TURN_RATE = 90.0f;                    // Plane rotated by 90 degs per sec while a key is held
 
 // Propeller dimensions (subpart)
 const float PP_WIDTH       = 3.0f;
@@ -29,14 +43,61 @@ const float PP_LENGTH      = 3.0f;
 
 // Propeller transforms
 const gmtl::Point3f STABILIZER_POS(P_WIDTH/2, 0, 0);     // Propeller position on the plane (w.r.t. plane's frame)
-const float STABILIZER_ROTATION = 5.0f;                  // Propeller rotated by 5 degs per input
+const float STABILIZER_TURN_RATE = 90.0f;                // Propeller rotated by 90 degs per sec while a key is held
+
+// Subpart offsets from STABILIZER_POS (w.r.t. plane's frame)
+const float sub_a_x_offset = -1.5f;                      // Turret
+const float sub_a_y_offset = -1.3f;
+const float sub_a_z_offset = 0.0f;
+const float sub_sub_a_y_offset = -3.5f;                  // Turret gun, w.r.t. the turret
+const float sub_b_x_offset = 1.3f;                       // Stabilizer b
+const float sub_b_y_offset = -0.9f;
+const float sub_b_z_offset = -2.3f;
+const float sub_c_x_offset = -4.3f;                      // Stabilizer c
+const float sub_c_y_offset = -0.9f;
+const float sub_c_z_offset = -2.3f;
+
+// Fleet of extra aircraft (-fleet <count>)
+const float FLEET_SPACING  = 15.0f;                      // Distance between neighbours on the grid
+const float FLEET_ALTITUDE = 10.0f;
+const float FLEET_THROTTLE = 0.2f;                       // Base throttle; top speed is 4 units/s
+const float FLEET_YAW      = 0.1f;                       // Largest yaw input; turns at up to 0.15 rads/s
+const float FLEET_JOINT_STEP = 5.0f;                     // Joint angle difference between neighbours, in degs
 
 // Camera's view frustum 
 const float CAM_FOV        = 90.0f;                     // Field of view in degs
 
+// Main loop
+const float TICK_RATE      = 60.0f;                     // Simulation ticks per sec
+const float MAX_FRAME_RATE = 120.0f;                    // Frames per sec at most (-fps <rate>, 0 for no cap)
+
 // Keyboard modifiers
 enum KeyModifier {KM_SHIFT = 0, KM_CTRL, KM_ALT};
 
+// Keyboard actions
+enum Action {A_NONE = 0,
+             A_VIEW_CAMERA, A_CONTROL_CAMERA,
+             A_PLANE_FORWARD, A_PLANE_BACKWARD,
+             A_ROLL_POSITIVE, A_ROLL_NEGATIVE, A_PITCH_POSITIVE, A_PITCH_NEGATIVE, A_YAW_POSITIVE, A_YAW_NEGATIVE,
+             A_STABILIZER_B_POSITIVE, A_STABILIZER_B_NEGATIVE, A_STABILIZER_C_POSITIVE, A_STABILIZER_C_NEGATIVE,
+             A_TURRET_POSITIVE, A_TURRET_NEGATIVE, A_TURRET_GUN_POSITIVE, A_TURRET_GUN_NEGATIVE};
+
+// Key bindings: the camera switches act once per press, the rest for as
+// long as the key is held
+const KeyBinding KEY_BINDINGS[] = {
+  {'v', A_VIEW_CAMERA},           {'b', A_CONTROL_CAMERA},
+  {'p', A_PLANE_FORWARD},         {';', A_PLANE_BACKWARD},
+  {'e', A_ROLL_POSITIVE},         {'q', A_ROLL_NEGATIVE},
+  {'w', A_PITCH_POSITIVE},        {'s', A_PITCH_NEGATIVE},
+  {'a', A_YAW_POSITIVE},          {'d', A_YAW_NEGATIVE},
+  {'r', A_STABILIZER_B_POSITIVE}, {'f', A_STABILIZER_B_NEGATIVE},
+  {'t', A_STABILIZER_C_POSITIVE}, {'g', A_STABILIZER_C_NEGATIVE},
+  {'y', A_TURRET_POSITIVE},       {'h', A_TURRET_NEGATIVE},
+  {'u', A_TURRET_GUN_POSITIVE},   {'j', A_TURRET_GUN_NEGATIVE}};
+
+// Joint angles of a fleet aircraft (AircraftInstance::angles)
+enum FleetAngle {FA_TURRET = 0, FA_TURRET_GUN, FA_STABILIZER_B, FA_STABILIZER_C};
+
 //|___________________
 //|
 //| Global Variables
@@ -53,7 +114,12 @@ gmtl::Quatf   plane_q1;      // Quaternion
 gmtl::Point4f plane_p2;     
 gmtl::Quatf   plane_q2;
 
-// Quaternions to rotate plane
+// Plane 1's pose at the last tick, and as drawn: interpolated from there
+// to its current pose
+gmtl::Point4f prev_p1, draw_p1;
+gmtl::Quatf   prev_q1, draw_q1;
+
+// Quaternions to rotate plane over a tick
 gmtl::Quatf zrotp_q;        // Positive and negative Z rotations
 gmtl::Quatf zrotn_q;
 
@@ -81,6 +147,7 @@ float sub_c_min_angle = st_angle_c - st_angle_limit;
 int mx_prev = 0, my_prev = 0;
 bool mbuttons[3]   = {false, false, false};
 bool kmodifiers[3] = {false, false, false};
+InputState input;
 
 // Cameras
 int cam_id         = 0;                                // Selects which camera to view
@@ -89,23 +156,78 @@ float distance[3]  = { 20.0f,  20.0f,  20.0f};                 // Distance of th
 float elevation[3] = {-45.0f, -45.0f, -45.0f};                 // Elevation of the camera. (in degs)
 float azimuth[3]   = { 15.0f,  15.0f, -15.0f};                 // Azimuth of the camera. (in degs)
 
+// Retained meshes of the plane parts, built on first draw
+MeshCache mesh_cache;
+
+// Scene graph: the world frame, the cameras and the two planes with plane 1's subparts
+SceneGraph scene(mesh_cache);
+int world_cam_node;
+int p1_body_node, p1_cam_node, p1_turret_node, p1_turret_gun_node, p1_stabilizer_b_node, p1_stabilizer_c_node;
+int p2_body_node, p2_cam_node;
+
+// Cached transforms, recomputed by DisplayFunc after input changes them
+GLfloat view_mat[16];
+bool view_changed  = true;
+bool scene_changed = true;
+
+// View-frustum culling of the scene nodes and the fleet (-nocull turns it off)
+bool culling = true;
+Frustum view_frustum;
+
+// Level of detail from projected size (-nolod turns it off)
+bool lod = true;
+
+// Fleet of extra aircraft, flown by the flight dynamics and drawn instanced
+std::vector<AircraftInstance> fleet;
+FleetRenderer fleet_renderer(mesh_cache);
+FlightDynamics flight_dynamics;
+
+// Main loop: fixed ticks, frames drawn in between
+FrameLoop frame_loop(TICK_RATE, MAX_FRAME_RATE);
+int pending_ticks = 0;                                   // Fleet ticks the next frame runs
+bool main_loop_asleep = false;                           // IdleFunc unregistered until the next event
+
+// Worker threads preparing each frame (-threads <count>); OpenGL stays on this thread
+JobSystem jobs;
+TaskGraph frame_tasks;
+
+// Hardware counters around DisplayFunc (-counters), reported with the frame pacing
+bool counting = false;
+PerfCounters display_counters;
+PerfSample display_counts;                               // Summed over the frames since the last report
+int display_frames = 0;
+
 //|___________________
 //|
 //| Function Prototypes
 //|___________________
 
 void InitTransforms();
+void InitFleet(int count);
 void InitGL(void);
+void InitFleetParts(void);
+void InitScene(void);
+void UpdateScene(void);
+void UpdateView(void);
+void InterpolatePoses(const float alpha);
 void DisplayFunc(void);
+void PrintFrameStats(void);
+void PrintFrameCounters(void);
+void ResetFrameCounters(void);
+void Tick(void);
+void IdleFunc(void);
+void WakeMainLoop(void);
 void KeyboardFunc(unsigned char key, int x, int y);
+void KeyboardUpFunc(unsigned char key, int x, int y);
 void MouseFunc(int button, int state, int x, int y);
 void MotionFunc(int x, int y);
 void ReshapeFunc(int w, int h);
+void EntryFunc(int state);
 void DrawCoordinateFrame(const float l);
-void DrawPlaneBody(const float width, const float length, const float height);
-void DrawStabilizer(const float width, const float length);
-void DrawTurret(const float width, const float length, const float height);
-void DrawTurretGun(const float width, const float length, const float height);
+void BuildPlaneBody(MeshBuilder &mesh, const float width, const float length, const float height);
+void BuildStabilizer(MeshBuilder &mesh, const float width, const float length, const float height);
+void BuildTurret(MeshBuilder &mesh, const float width, const float length, const float height);
+void BuildTurretGun(MeshBuilder &mesh, const float width, const float length, const float height);
 
 //|____________________________________________________________________
 //|
@@ -119,12 +241,15 @@ void DrawTurretGun(const float width, const float length, const float height);
 
 void InitTransforms()
 {
-  const float COSTHETA_D2  = cos(gmtl::Math::deg2Rad(PLANE_ROTATION/2));  // cos() and sin() expect radians 
-  const float SINTHETA_D2  = sin(gmtl::Math::deg2Rad(PLANE_ROTATION/2));
+  const float TICK_ROTATION = PLANE_TURN_RATE/TICK_RATE;                  // Degs per tick
+  const float COSTHETA_D2  = cos(gmtl::Math::deg2Rad(TICK_ROTATION/2));   // cos() and sin() expect radians 
+  const float SINTHETA_D2  = sin(gmtl::Math::deg2Rad(TICK_ROTATION/2));
 
   // Inits plane pose
   plane_p1.set(1.0f, 0.0f, 4.0f, 1.0f);
   plane_q1.set(0, 0, 0, 1);
+  prev_p1 = draw_p1 = plane_p1;
+  prev_q1 = draw_q1 = plane_q1;
 
   // Z rotations (roll)
   zrotp_q.set(0, 0, SINTHETA_D2, COSTHETA_D2);      // +Z
@@ -139,6 +264,51 @@ void InitTransforms()
   yrotn_q = gmtl::makeConj(yrotp_q);                // -Y
 }
 
+//|____________________________________________________________________
+//|
+//| Function: InitFleet
+//|
+//! \param count  [in] Number of aircraft.
+//! \return None.
+//!
+//! Lays the fleet out on a square grid above the world origin, with
+//! headings, joint angles and control inputs varied per aircraft so they
+//! fly circles of different sizes in both directions.
+//|____________________________________________________________________
+
+void InitFleet(int count)
+{
+  int side = (int)ceil(sqrt((float)count));
+
+  fleet.resize(count);
+  for (int i = 0; i < count; i++) {
+    AircraftInstance &a = fleet[i];
+    float heading = gmtl::Math::deg2Rad((float)((i*37) % 360));
+
+    a.position[0] = (i % side - (side - 1)/2.0f)*FLEET_SPACING;
+    a.position[1] = FLEET_ALTITUDE;
+    a.position[2] = (i / side - (side - 1)/2.0f)*FLEET_SPACING;
+
+    // Yaw about +Y
+    a.orientation[0] = 0;
+    a.orientation[1] = sin(heading/2);
+    a.orientation[2] = 0;
+    a.orientation[3] = cos(heading/2);
+
+    a.angles[FA_TURRET]       = tr_angle_a + (i*23) % 360;
+    a.angles[FA_TURRET_GUN]   = tr_angle_a_sub;
+    a.angles[FA_STABILIZER_B] = st_angle_b + (i % 15)*FLEET_JOINT_STEP - st_angle_limit;
+    a.angles[FA_STABILIZER_C] = st_angle_c - (i % 15)*FLEET_JOINT_STEP + st_angle_limit;
+
+    FlightControls controls;
+    controls.throttle = FLEET_THROTTLE*(1 + (i % 5)/4.0f);
+    controls.pitch    = 0;
+    controls.yaw      = FLEET_YAW*((i % 7) - 3)/3.0f;
+    controls.roll     = 0;
+    flight_dynamics.SetControls(flight_dynamics.Add(a.position, a.orientation), controls);
+  }
+}
+
 //|____________________________________________________________________
 //|
 //| Function: InitGL
@@ -158,26 +328,161 @@ void InitGL(void)
 
 //|____________________________________________________________________
 //|
-//| Function: DisplayFunc
+//| Function: InitFleetParts
 //|
 //! \param None.
 //! \return None.
 //!
-//! GLUT display callback function: called for every redraw event.
+//! Describes the plane's parts and joints (the same hierarchy DisplayFunc
+//! draws for plane 1) to the fleet renderer. Needs the GL context.
 //|____________________________________________________________________
 
-void DisplayFunc(void)
+void InitFleetParts(void)
+{
+  const FleetJoint turret = {{STABILIZER_POS[0] + sub_a_x_offset, STABILIZER_POS[1] + sub_a_y_offset, STABILIZER_POS[2] + sub_a_z_offset},
+                             {0, 1, 0}, FA_TURRET};
+  const FleetJoint turret_gun = {{0, PP_LENGTH + sub_sub_a_y_offset, 0}, {0, 1, 0}, FA_TURRET_GUN};
+  const FleetJoint stabilizer_b = {{STABILIZER_POS[0] + sub_b_x_offset, STABILIZER_POS[1] + sub_b_y_offset, STABILIZER_POS[2] + sub_b_z_offset},
+                                   {1, 0, 0}, FA_STABILIZER_B};
+  const FleetJoint stabilizer_c = {{STABILIZER_POS[0] + sub_c_x_offset, STABILIZER_POS[1] + sub_c_y_offset, STABILIZER_POS[2] + sub_c_z_offset},
+                                   {1, 0, 0}, FA_STABILIZER_C};
+
+  FleetPart body      = {mesh_cache.Get(BuildPlaneBody, P_WIDTH, P_LENGTH, P_HEIGHT), 1,
+                         {FLEET_FIXED_JOINT, FLEET_FIXED_JOINT}, FLEET_FIXED_JOINT};
+  FleetPart base      = {mesh_cache.Get(BuildTurret, P_WIDTH, P_LENGTH, P_HEIGHT), 1,
+                         {turret, FLEET_FIXED_JOINT}, FLEET_FIXED_JOINT};
+  FleetPart gun       = {mesh_cache.Get(BuildTurretGun, P_WIDTH, P_LENGTH, P_HEIGHT), 1,
+                         {turret, FLEET_FIXED_JOINT}, turret_gun};
+  FleetPart stabilizer = {mesh_cache.Get(BuildStabilizer, PP_WIDTH, PP_LENGTH), 2,
+                         {stabilizer_b, stabilizer_c}, FLEET_FIXED_JOINT};
+
+  fleet_renderer.AddPart(body);
+  fleet_renderer.AddPart(base);
+  fleet_renderer.AddPart(gun);
+  fleet_renderer.AddPart(stabilizer);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: InitScene
+//|
+//! \param None.
+//! \return None.
+//!
+//! Builds the scene graph, parents before children. Nodes are drawn in this
+//! order. Needs the GL context for the meshes.
+//|____________________________________________________________________
+
+void InitScene(void)
+{
+  const int body       = mesh_cache.Get(BuildPlaneBody, P_WIDTH, P_LENGTH, P_HEIGHT);
+  const int turret     = mesh_cache.Get(BuildTurret, P_WIDTH, P_LENGTH, P_HEIGHT);
+  const int turret_gun = mesh_cache.Get(BuildTurretGun, P_WIDTH, P_LENGTH, P_HEIGHT);
+  const int stabilizer = mesh_cache.Get(BuildStabilizer, PP_WIDTH, PP_LENGTH);
+
+  const int world       = scene.AddNode(-1, -1, 10);
+  world_cam_node        = scene.AddNode(world, -1, 1);
+  p1_body_node          = scene.AddNode(world, body, 3);
+  p1_cam_node           = scene.AddNode(p1_body_node, -1, 1);
+  p1_turret_node        = scene.AddNode(p1_body_node, turret, 1);
+  p1_turret_gun_node    = scene.AddNode(p1_turret_node, turret_gun, 1);
+  p1_stabilizer_b_node  = scene.AddNode(p1_body_node, stabilizer, 1);
+  p1_stabilizer_c_node  = scene.AddNode(p1_body_node, stabilizer, 1);
+  p2_body_node          = scene.AddNode(world, body, 3);
+  p2_cam_node           = scene.AddNode(world, -1, 1);      // Drawn in the world frame, not plane 2's
+}
+
+//|____________________________________________________________________
+//|
+//| Function: AxisRotation
+//|
+//! \param degs   [in] Angle in degs.
+//! \param axis   [in] Unit rotation axis.
+//! \return Rotation quaternion, as glRotatef(degs, axis) would rotate.
+//|____________________________________________________________________
+
+gmtl::Quatf AxisRotation(const float degs, const gmtl::Vec3f &axis)
+{
+  gmtl::Quatf q;
+  gmtl::set(q, gmtl::AxisAnglef(gmtl::Math::deg2Rad(degs), axis));
+  return q;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: SetCameraNode
+//|
+//! \param node   [in] Scene node of the camera.
+//! \param cam    [in] Camera index into distance, elevation and azimuth.
+//! \return None.
+//!
+//! Camera frame: rotated by azimuth (about Y), then elevation (about X),
+//! then moved back along its Z by distance.
+//|____________________________________________________________________
+
+void SetCameraNode(const int node, const int cam)
+{
+  gmtl::Quatf rotation = AxisRotation(azimuth[cam], gmtl::Vec3f(0, 1, 0)) * AxisRotation(elevation[cam], gmtl::Vec3f(1, 0, 0));
+  gmtl::Vec3f position;
+
+  gmtl::xform(position, rotation, gmtl::Vec3f(0, 0, distance[cam]));
+  scene.SetLocal(node, position, rotation);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: UpdateScene
+//|
+//! \param None.
+//! \return None.
+//!
+//! Copies the plane poses, subpart angles and camera controls into the
+//! local transforms of the scene nodes.
+//|____________________________________________________________________
+
+void UpdateScene(void)
+{
+  const gmtl::Vec3f X_AXIS(1, 0, 0), Y_AXIS(0, 1, 0);
+  const gmtl::Quatf NO_ROTATION;
+
+  scene.SetVisible(world_cam_node, cam_id != 0);
+  SetCameraNode(world_cam_node, 0);
+
+  // Plane 1 and its subparts
+  scene.SetLocal(p1_body_node, gmtl::Vec3f(draw_p1[0] + 5, draw_p1[1], draw_p1[2] + 5), draw_q1);
+  SetCameraNode(p1_cam_node, 1);
+  scene.SetLocal(p1_turret_node,
+                 gmtl::Vec3f(STABILIZER_POS[0] + sub_a_x_offset, STABILIZER_POS[1] + sub_a_y_offset, STABILIZER_POS[2] + sub_a_z_offset),
+                 AxisRotation(tr_angle_a, Y_AXIS));
+  scene.SetLocal(p1_turret_gun_node, gmtl::Vec3f(0, PP_LENGTH + sub_sub_a_y_offset, 0), AxisRotation(tr_angle_a_sub, Y_AXIS));
+  scene.SetLocal(p1_stabilizer_b_node,
+                 gmtl::Vec3f(STABILIZER_POS[0] + sub_b_x_offset, STABILIZER_POS[1] + sub_b_y_offset, STABILIZER_POS[2] + sub_b_z_offset),
+                 AxisRotation(st_angle_b, X_AXIS));
+  scene.SetLocal(p1_stabilizer_c_node,
+                 gmtl::Vec3f(STABILIZER_POS[0] + sub_c_x_offset, STABILIZER_POS[1] + sub_c_y_offset, STABILIZER_POS[2] + sub_c_z_offset),
+                 AxisRotation(st_angle_c, X_AXIS));
+
+  // Plane 2
+  scene.SetLocal(p2_body_node, gmtl::Vec3f(plane_p2[0], plane_p2[1], plane_p2[2]), plane_q2);
+  SetCameraNode(p2_cam_node, 2);
+}
+
+//|____________________________________________________________________
+//|
+//| Function: UpdateView
+//|
+//! \param None.
+//! \return None.
+//!
+//! Recomputes view_mat, the view transform of the selected camera.
+//|____________________________________________________________________
+
+void UpdateView(void)
 {
     gmtl::AxisAnglef aa;    // Converts plane's quaternion to axis-angle form to be used by glRotatef()
     gmtl::Vec3f axis;       // Axis component of axis-angle representation
     float angle;            // Angle component of axis-angle representation
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(CAM_FOV, (float)w_width/w_height, 0.1f, 1000.0f);     // Check MSDN: google "gluPerspective msdn"
-
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
 
@@ -201,11 +506,11 @@ void DisplayFunc(void)
         glRotatef(-elevation[1], 1, 0, 0);
         glRotatef(-azimuth[1], 0, 1, 0);
 
-        gmtl::set(aa, plane_q1);                    // Converts plane's quaternion to axis-angle form to be used by glRotatef()
+        gmtl::set(aa, draw_q1);                     // Converts plane's quaternion to axis-angle form to be used by glRotatef()
         axis  = aa.getAxis();
         angle = aa.getAngle();
         glRotatef(-gmtl::Math::rad2Deg(angle), axis[0], axis[1], axis[2]);
-        glTranslatef(-plane_p1[0], -plane_p1[1], -plane_p1[2]);      
+        glTranslatef(-draw_p1[0], -draw_p1[1], -draw_p1[2]);      
     break;
 
     case 2:
@@ -213,229 +518,381 @@ void DisplayFunc(void)
         glRotatef(-elevation[2], 1, 0, 0);
         glRotatef(-azimuth[2], 0, 1, 0);
 
-        gmtl::set(aa, plane_q1);                    // Converts plane's quaternion to axis-angle form to be used by glRotatef()
+        gmtl::set(aa, draw_q1);                     // Converts plane's quaternion to axis-angle form to be used by glRotatef()
         axis = aa.getAxis();
         angle = aa.getAngle();
         glRotatef(-gmtl::Math::rad2Deg(angle), axis[0], axis[1], axis[2]);
-        glTranslatef(-plane_p1[0], -plane_p1[1], -plane_p1[2]);
+        glTranslatef(-draw_p1[0], -draw_p1[1], -draw_p1[2]);
     break;
   }
 
+    glGetFloatv(GL_MODELVIEW_MATRIX, view_mat);
+}
+
 //|____________________________________________________________________
 //|
-//| Draw traversal begins, start from world (root) node
+//| Function: InterpolatePoses
+//|
+//! \param alpha  [in] How far the frame lies past the last tick, 0..1.
+//! \return None.
+//!
+//! Plane 1's drawn pose: lerp and slerp from its pose at the last tick to
+//! its current one. Marks the view and scene changed when it moved.
 //|____________________________________________________________________
 
-  // World node: draws world coordinate frame
-    DrawCoordinateFrame(10);
-  // World-relative camera:
-    if (cam_id != 0) {
-        glPushMatrix();        
-        glRotatef(azimuth[0], 0, 1, 0);
-        glRotatef(elevation[0], 1, 0, 0);
-        glTranslatef(0, 0, distance[0]);
-        DrawCoordinateFrame(1);
-        glPopMatrix();
+void InterpolatePoses(const float alpha)
+{
+    gmtl::Point4f p;
+    gmtl::Quatf q;
+
+    for (int k = 0; k < 3; k++) p[k] = prev_p1[k] + alpha*(plane_p1[k] - prev_p1[k]);
+    p[3] = 1;
+    if (prev_q1 == plane_q1) {
+        q = plane_q1;                               // At rest; slerp would round differently with alpha
+    } else {
+        gmtl::slerp(q, alpha, prev_q1, plane_q1);
+    }
+
+    if (p != draw_p1 || q != draw_q1) {
+        draw_p1 = p;
+        draw_q1 = q;
+        view_changed  = true;
+        scene_changed = true;
     }
-    // Plane 1 body:
-    glPushMatrix();
-    gmtl::set(aa, plane_q1);                    // Converts plane's quaternion to axis-angle form to be used by glRotatef()
-    axis  = aa.getAxis();
-    angle = aa.getAngle();
-    glTranslatef(plane_p1[0] + 5, plane_p1[1], plane_p1[2] + 5);
-    glRotatef(gmtl::Math::rad2Deg(angle), axis[0], axis[1], axis[2]);
-    DrawPlaneBody(P_WIDTH, P_LENGTH, P_HEIGHT);
-    DrawCoordinateFrame(3);
-    // Plane 1's camera:
-    glPushMatrix();
-    glRotatef(azimuth[1], 0, 1, 0);
-    glRotatef(elevation[1], 1, 0, 0);
-    glTranslatef(0, 0, distance[1]);
-    DrawCoordinateFrame(1);
-    glPopMatrix();
-    // Subpart a
-    const float sub_a_x_offset = -1.5f;
-    const float sub_a_y_offset = -1.3f;
-    const float sub_a_z_offset = 0.0f;
-    const float sub_sub_a_y_offset = -3.5f;
-    glPushMatrix();
-    glTranslatef(STABILIZER_POS[0] + sub_a_x_offset, STABILIZER_POS[1] + sub_a_y_offset, STABILIZER_POS[2] + sub_a_z_offset);
-    glRotatef(tr_angle_a, 0, 1, 0);                                         
-    DrawTurret(P_WIDTH, P_LENGTH, P_HEIGHT);
-    DrawCoordinateFrame(1);
-    // Sub-subpart
-    glPushMatrix();
-    glTranslatef(0, PP_LENGTH + sub_sub_a_y_offset, 0);
-    glRotatef(tr_angle_a_sub, 0, 1, 0);
-    DrawTurretGun(P_WIDTH, P_LENGTH, P_HEIGHT);
-    DrawCoordinateFrame(1);
-    glPopMatrix();
-    glPopMatrix();
-    // Subpart b
-    const float sub_b_x_offset = 1.3f;
-    const float sub_b_y_offset = -0.9f;
-    const float sub_b_z_offset = -2.3f;
-    glPushMatrix();   
-    glTranslatef(STABILIZER_POS[0] + sub_b_x_offset, STABILIZER_POS[1] + sub_b_y_offset, STABILIZER_POS[2] + sub_b_z_offset);
-    glRotatef(st_angle_b, 1, 0, 0);                                         
-    DrawStabilizer(PP_WIDTH, PP_LENGTH);
-    DrawCoordinateFrame(1);
-    glPopMatrix();
-    // Subpart c
-    const float sub_c_x_offset = -4.3f;
-    const float sub_c_y_offset = -0.9f;
-    const float sub_c_z_offset = -2.3f;
-    glPushMatrix();
-    glTranslatef(STABILIZER_POS[0] + sub_c_x_offset, STABILIZER_POS[1] + sub_c_y_offset, STABILIZER_POS[2] + sub_c_z_offset);
-    glRotatef(st_angle_c, 1, 0, 0);                                          
-    DrawStabilizer(PP_WIDTH, PP_LENGTH);
-    DrawCoordinateFrame(1);
-    glPopMatrix();
-    // End Plane 1
-    glPopMatrix();
-    // Plane 2 body:
-    glPushMatrix();
-    gmtl::set(aa, plane_q2);
-    axis = aa.getAxis();
-    angle = aa.getAngle();
-    glTranslatef(plane_p2[0], plane_p2[1], plane_p2[2]);
-    glRotatef(gmtl::Math::rad2Deg(angle), axis[0], axis[1], axis[2]);
-    DrawPlaneBody(P_WIDTH, P_LENGTH, P_HEIGHT);
-    DrawCoordinateFrame(3);
-    glPopMatrix();
-    // Plane 2's camera:
-    glPushMatrix();
-    glRotatef(azimuth[2], 0, 1, 0);
-    glRotatef(elevation[2], 1, 0, 0);
-    glTranslatef(0, 0, distance[2]);
-    DrawCoordinateFrame(1);
-    glPopMatrix();
-    // End Plane 2
-    glPopMatrix();  
-    glutSwapBuffers();                          // Replaces glFlush() to use double buffering
 }
 
 //|____________________________________________________________________
 //|
-//| Function: KeyboardFunc
+//| Function: DisplayFunc
 //|
-//! \param key    [in] Key code.
-//! \param x      [in] X-coordinate of mouse when key is pressed.
-//! \param y      [in] Y-coordinate of mouse when key is pressed.
+//! \param None.
 //! \return None.
 //!
-//! GLUT keyboard callback function: called for every key press event.
+//! GLUT display callback function: called for every redraw event.
 //|____________________________________________________________________
 
-void KeyboardFunc(unsigned char key, int x, int y)
+void DisplayFunc(void)
 {
-    switch (key) {
+    WakeMainLoop();                             // Asleep when GLUT redraws an expose or reshape
+    if (counting) display_counters.Start();
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(CAM_FOV, (float)w_width/w_height, 0.1f, 1000.0f);     // Check MSDN: google "gluPerspective msdn"
+
+    // Ticks owed to the fleet since the last frame, stepped in the frame
+    // tasks below
+    const int ticks = pending_ticks;
+    pending_ticks = 0;
+
+    // Transforms are only recomputed after input or motion changed them
+    if (view_changed) {
+        UpdateView();
+        view_changed = false;
+    }
+
+    // Frustum planes in world coordinates, from projection*view
+    GLfloat projection_mat[16];
+    GLint viewport[4];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection_mat);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    view_frustum.Extract(projection_mat, view_mat);
+
+    const Frustum *frustum = culling ? &view_frustum : NULL;
+    const float viewport_height = (float)viewport[3];
+
 //|____________________________________________________________________
 //|
-//| Camera switch
+//| Frame preparation as tasks on the job system: the scene's world matrices
+//| and draw list, alongside the fleet's flight ticks and then its culling,
+//| levels of detail and packing. The fleet tasks spread their loops over
+//| the workers too. Nothing here calls OpenGL.
 //|____________________________________________________________________
 
-    case 'v': // Select camera to view
-        cam_id = (cam_id + 1) % 3;
-        printf("View camera = %d\n", cam_id);
-        break;
-    case 'b': // Select camera to control
-        camctrl_id = (camctrl_id + 1) % 3;
-        printf("Control camera = %d\n", camctrl_id);
-        break;
+    frame_tasks.Clear();
+    frame_tasks.Add([&]() {
+        if (scene_changed) {
+            UpdateScene();
+            scene_changed = false;
+        }
+        scene.UpdateWorld();                    // Only the subtrees of changed nodes
+        scene.Prepare(view_mat, projection_mat, viewport_height, frustum);
+    });
+    if (!fleet.empty()) {
+        const int flight = frame_tasks.Add([ticks]() {
+            for (int t = 0; t < ticks; t++) flight_dynamics.Step(frame_loop.TickSeconds(), &jobs);
+            flight_dynamics.CopyPoses(fleet[0].position, fleet[0].orientation, sizeof(AircraftInstance), frame_loop.Alpha(), &jobs);
+        });
+        const int fleet_prepare = frame_tasks.Add([&]() {
+            fleet_renderer.Prepare(&fleet[0], (int)fleet.size(), frustum, view_mat, projection_mat, viewport_height, &jobs);
+        });
+        frame_tasks.AddDependency(fleet_prepare, flight);
+    }
+    jobs.Run(frame_tasks);
 
 //|____________________________________________________________________
 //|
-//| Plane controls
+//| Submission: one modelview load per listed node, then the visible
+//| aircraft in one draw call per part type
 //|____________________________________________________________________
 
-    case 'p': { // Forward translation of the plane (+Z translation)  
-        gmtl::Quatf v_q = plane_q1 * gmtl::Quatf(PLANE_FORWARD[0], PLANE_FORWARD[1], PLANE_FORWARD[2], 0) * gmtl::makeConj(plane_q1);
-        plane_p1 = plane_p1 + v_q.mData;
-    } 
-    break;
+    scene.Submit(DrawCoordinateFrame);
+    if (!fleet.empty()) {
+        glLoadMatrixf(view_mat);
+        fleet_renderer.Submit();
+    }
+    glutSwapBuffers();                          // Replaces glFlush() to use double buffering
 
-    case ';': { // Backward translation of the plane (-Z translation)
-        gmtl::Quatf v_q = plane_q1 * gmtl::Quatf(-PLANE_FORWARD[0], -PLANE_FORWARD[1], -PLANE_FORWARD[2], 0) * gmtl::makeConj(plane_q1);
-        plane_p1 = plane_p1 + v_q.mData;
-    } 
-    break;
+    if (counting) {
+        const PerfSample frame = display_counters.Stop();
+        for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+            display_counts.count[i] += frame.count[i];
+            display_counts.valid[i] = display_counts.valid[i] && frame.valid[i];
+        }
+        display_frames++;
+    }
 
-    case 'e': // Rolls the plane (+Z rot)
-        plane_q1 = plane_q1 * zrotp_q;
-    break;
+    FramePacing pacing;
+    if (frame_loop.EndFrame(pacing)) {
+        PrintPacing(pacing);
+        PrintFrameStats();
+        if (counting) PrintFrameCounters();
+    }
+}
 
-    case 'q': // Rolls the plane (-Z rot)
-        plane_q1 = plane_q1 * zrotn_q;
-    break;
+//|____________________________________________________________________
+//|
+//| Function: PrintFrameStats
+//|
+//! \param None.
+//! \return None.
+//!
+//! Prints what the last frame did on one line, after each pacing report:
+//! scene matrices recomputed and nodes culled, then the fleet's drawn
+//! aircraft, draw calls and bounding-volume nodes tested (and how often
+//! the hierarchy has been rebuilt so far).
+//|____________________________________________________________________
 
-    case 'w': // Pitches the plane (+X rot)
-        plane_q1 = plane_q1 * xrotp_q;
-    break;
+void PrintFrameStats(void)
+{
+    printf("Last frame: %d of %d world matrices recomputed, %d nodes culled",
+           scene.Recomputed(), scene.NodeCount(), scene.Culled());
+    if (!fleet.empty()) {
+        printf("; %d of %d aircraft drawn in %d draw calls%s", fleet_renderer.Drawn(), (int)fleet.size(),
+               fleet_renderer.DrawCalls(), fleet_renderer.Instanced() ? " (instanced)" : "");
+        if (culling) {
+            printf(", %d of %d BVH nodes tested (%d builds)", fleet_renderer.BvhTested(), fleet_renderer.BvhNodes(),
+                   fleet_renderer.BvhBuilds());
+        }
+    }
+    printf("\n");
+}
 
-    case 's': // Pitches the plane (+X rot)
-        plane_q1 = plane_q1 * xrotn_q;
-    break;
+//|____________________________________________________________________
+//|
+//| Function: PrintFrameCounters
+//|
+//! \param None.
+//! \return None.
+//!
+//! Prints the hardware counters of DisplayFunc() on one line, after each
+//! pacing report: the mean per frame since the last report, then per node
+//! drawn or culled (scene nodes and fleet aircraft), and the IPC. The
+//! counts include the job system's workers. A counter that missed a frame
+//! prints as "-".
+//|____________________________________________________________________
 
-    case 'a': // Pitches the plane (+Y rot)
-        plane_q1 = plane_q1 * yrotp_q;
-    break;
+void PrintFrameCounters(void)
+{
+    const int nodes = scene.NodeCount() + (int)fleet.size();
+
+    printf("Counters per frame and per node (%d frames, %d nodes):", display_frames, nodes);
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        const char *name = PerfCounters::Name((PerfEvent)i);
+        if (display_frames == 0 || !display_counts.valid[i]) {
+            printf("%s %s -", i > 0 ? "," : "", name);
+            continue;
+        }
+        const double per_frame = (double)display_counts.count[i]/display_frames;
+        printf("%s %s %.0f / %.1f", i > 0 ? "," : "", name, per_frame, nodes > 0 ? per_frame/nodes : 0.0);
+    }
+    if (display_frames > 0 && display_counts.valid[PERF_CYCLES] && display_counts.valid[PERF_INSTRUCTIONS] &&
+        display_counts.count[PERF_CYCLES] > 0) {
+        printf(", IPC %.2f", (double)display_counts.count[PERF_INSTRUCTIONS]/display_counts.count[PERF_CYCLES]);
+    }
+    printf("\n");
+    ResetFrameCounters();
+}
 
-    case 'd': // Rolls the plane (-Y rot)
-        plane_q1 = plane_q1 * yrotn_q;
-    break;
+//|____________________________________________________________________
+//|
+//| Function: ResetFrameCounters
+//|
+//! \param None.
+//! \return None.
+//!
+//! Starts a new report interval for the DisplayFunc() counters.
+//|____________________________________________________________________
+
+void ResetFrameCounters(void)
+{
+    for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+        display_counts.count[i] = 0;
+        display_counts.valid[i] = true;
+    }
+    display_frames = 0;
+}
 
 //|____________________________________________________________________
 //|
-//| controls (subpart)
+//| Function: IdleFunc
+//|
+//! \param None.
+//! \return None.
+//!
+//! GLUT idle callback function: the main loop. Waits for the next frame
+//! to be due and runs the ticks that came due meanwhile; the fleet's are
+//! owed to the frame. Input and motion only mark the view or scene
+//! changed, so however many events arrived there is one redraw. Nothing
+//! is drawn while nothing changed and no fleet is flying, and once no key
+//! is held and plane 1 has come to rest either, the loop unregisters
+//! itself: the process sleeps in GLUT until WakeMainLoop() is called from
+//! the next event.
 //|____________________________________________________________________
 
-    case 'r': // Rotates propeller
-        st_angle_b += STABILIZER_ROTATION;
-        if (st_angle_b > sub_b_max_angle) {
-            st_angle_b = sub_b_max_angle;
+void IdleFunc(void)
+{
+    const int ticks = frame_loop.BeginFrame();
+
+    for (int t = 0; t < ticks; t++) Tick();
+    InterpolatePoses(frame_loop.Alpha());
+
+    if (!fleet.empty()) {
+        pending_ticks += ticks;
+    } else if (!view_changed && !scene_changed) {
+        frame_loop.SkipFrame();
+        if (!input.AnyHeld() && prev_p1 == plane_p1 && prev_q1 == plane_q1) {
+            main_loop_asleep = true;
+            glutIdleFunc(NULL);
         }
-    break;
+        return;
+    }
+    glutPostRedisplay();
+}
 
-    case 'f': // Rotates propeller 
-        st_angle_b -= STABILIZER_ROTATION;
-        if (st_angle_b < sub_b_min_angle) {
-            st_angle_b = sub_b_min_angle;
-        }
-        break;
+//|____________________________________________________________________
+//|
+//| Function: WakeMainLoop
+//|
+//! \param None.
+//! \return None.
+//!
+//! Registers IdleFunc() again if it stopped with nothing to do. The
+//! frame clock restarts, so the time asleep is not owed as ticks.
+//|____________________________________________________________________
 
-    case 't': // Rotates propeller 
-        st_angle_c += STABILIZER_ROTATION;
-        if (st_angle_c > sub_c_max_angle) {
-            st_angle_c = sub_c_max_angle;
-        }
-        break;
-    case 'g': // Rotates propeller 
-        st_angle_c -= STABILIZER_ROTATION;
-        if (st_angle_c < sub_c_min_angle) {
-            st_angle_c = sub_c_min_angle;
-        }
-        break;
+void WakeMainLoop(void)
+{
+    if (!main_loop_asleep) return;
+    main_loop_asleep = false;
+    frame_loop.Resume();
+    glutIdleFunc(IdleFunc);
+}
 
-    case 'y': // Rotates propeller 
-        tr_angle_a += STABILIZER_ROTATION;
-    
-        break;
-    case 'h': // Rotates propeller 
-        tr_angle_a -= STABILIZER_ROTATION;
-     
-        break;
+//|____________________________________________________________________
+//|
+//| Function: Tick
+//|
+//! \param None.
+//! \return None.
+//!
+//! Advances plane 1 and its subparts by one tick of the held actions,
+//! keeping plane 1's pose from before for interpolation.
+//|____________________________________________________________________
 
-    case 'u': // Rotates propeller 
-        tr_angle_a_sub += STABILIZER_ROTATION;
+void Tick(void)
+{
+    const float dt   = frame_loop.TickSeconds();
+    const float turn = STABILIZER_TURN_RATE*dt;
 
-        break;
-    case 'j': // Rotates propeller 
-        tr_angle_a_sub -= STABILIZER_ROTATION;
+    prev_p1 = plane_p1;
+    prev_q1 = plane_q1;
+    if (!input.AnyHeld()) return;
+
+    // Plane: moves along its nose, turns about its own axes
+    const int forward = input.Axis(A_PLANE_FORWARD, A_PLANE_BACKWARD);
+    if (forward != 0) {
+        gmtl::Quatf v_q = plane_q1 * gmtl::Quatf(PLANE_FORWARD[0], PLANE_FORWARD[1], PLANE_FORWARD[2], 0) * gmtl::makeConj(plane_q1);
+        for (int k = 0; k < 3; k++) plane_p1[k] += v_q[k]*forward*PLANE_SPEED*dt;
+    }
+    if (input.Held(A_ROLL_POSITIVE))  plane_q1 = plane_q1 * zrotp_q;
+    if (input.Held(A_ROLL_NEGATIVE))  plane_q1 = plane_q1 * zrotn_q;
+    if (input.Held(A_PITCH_POSITIVE)) plane_q1 = plane_q1 * xrotp_q;
+    if (input.Held(A_PITCH_NEGATIVE)) plane_q1 = plane_q1 * xrotn_q;
+    if (input.Held(A_YAW_POSITIVE))   plane_q1 = plane_q1 * yrotp_q;
+    if (input.Held(A_YAW_NEGATIVE))   plane_q1 = plane_q1 * yrotn_q;
+
+    // Subparts: the stabilizers turn within their limits
+    st_angle_b += input.Axis(A_STABILIZER_B_POSITIVE, A_STABILIZER_B_NEGATIVE)*turn;
+    st_angle_b  = gmtl::Math::clamp(st_angle_b, sub_b_min_angle, sub_b_max_angle);
+    st_angle_c += input.Axis(A_STABILIZER_C_POSITIVE, A_STABILIZER_C_NEGATIVE)*turn;
+    st_angle_c  = gmtl::Math::clamp(st_angle_c, sub_c_min_angle, sub_c_max_angle);
+    tr_angle_a     += input.Axis(A_TURRET_POSITIVE, A_TURRET_NEGATIVE)*turn;
+    tr_angle_a_sub += input.Axis(A_TURRET_GUN_POSITIVE, A_TURRET_GUN_NEGATIVE)*turn;
+
+    scene_changed = true;
+}
 
+//|____________________________________________________________________
+//|
+//| Function: KeyboardFunc
+//|
+//! \param key    [in] Key code.
+//! \param x      [in] X-coordinate of mouse when key is pressed.
+//! \param y      [in] Y-coordinate of mouse when key is pressed.
+//! \return None.
+//!
+//! GLUT keyboard callback function: called for every key press event.
+//! Held actions are only recorded here and run by Tick().
+//|____________________________________________________________________
+
+void KeyboardFunc(unsigned char key, int x, int y)
+{
+    WakeMainLoop();
+    switch (input.KeyDown(key, (glutGetModifiers() & GLUT_ACTIVE_CTRL) != 0)) {
+    case A_VIEW_CAMERA: // Select camera to view
+        cam_id = (cam_id + 1) % 3;
+        printf("View camera = %d\n", cam_id);
         break;
-  }
-  glutPostRedisplay();                    // Asks GLUT to redraw the screen
+    case A_CONTROL_CAMERA: // Select camera to control
+        camctrl_id = (camctrl_id + 1) % 3;
+        printf("Control camera = %d\n", camctrl_id);
+        break;
+    default: // Held actions run in Tick()
+        return;
+    }
+    view_changed  = true;
+    scene_changed = true;
+}
+
+//|____________________________________________________________________
+//|
+//| Function: KeyboardUpFunc
+//|
+//! \param key    [in] Key code.
+//! \param x      [in] X-coordinate of mouse when key is released.
+//! \param y      [in] Y-coordinate of mouse when key is released.
+//! \return None.
+//!
+//! GLUT keyboard-up callback function: called for every key release event.
+//|____________________________________________________________________
+
+void KeyboardUpFunc(unsigned char key, int x, int y)
+{
+    WakeMainLoop();
+    input.KeyUp(key, (glutGetModifiers() & GLUT_ACTIVE_CTRL) != 0);
 }
 
 //|____________________________________________________________________
@@ -517,7 +974,9 @@ void MotionFunc(int x, int y)
       distance[camctrl_id] += d;    
     }
 
-    glutPostRedisplay();      // Asks GLUT to redraw the screen
+    view_changed  = true;                       // Redrawn by the main loop
+    scene_changed = true;
+    WakeMainLoop();
   }
 }
 
@@ -539,6 +998,23 @@ void ReshapeFunc(int w, int h)
   glViewport(0, 0, (GLsizei) w_width, (GLsizei) w_height);
 }
 
+//|____________________________________________________________________
+//|
+//| Function: EntryFunc
+//|
+//! \param state  [in] GLUT_ENTERED or GLUT_LEFT.
+//! \return None.
+//!
+//! GLUT entry callback function: called when the mouse enters or leaves
+//! the window. GLUT reports no keyboard focus changes, and keys let go
+//! in another window send no release, so held keys are let go here.
+//|____________________________________________________________________
+
+void EntryFunc(int state)
+{
+    if (state == GLUT_LEFT) input.ReleaseAll();
+}
+
 //|____________________________________________________________________
 //|
 //| Function: DrawCoordinateFrame
@@ -571,17 +1047,18 @@ void DrawCoordinateFrame(const float l)
 
 //|____________________________________________________________________
 //|
-//| Function: DrawPlaneBody
+//| Function: BuildPlaneBody
 //|
+//! \param mesh        [out] Mesh to record into.
 //! \param width       [in] Width  of the plane.
 //! \param length      [in] Length of the plane.
 //! \param height      [in] Height of the plane.
 //! \return None.
 //!
-//! Draws a plane body.
+//! Records the plane body.
 //|____________________________________________________________________
 
-void DrawPlaneBody(const float width, const float length, const float height)
+void BuildPlaneBody(MeshBuilder &mesh, const float width, const float length, const float height)
 {
     float w = width / 2;
     float l = length / 2;
@@ -594,155 +1071,155 @@ void DrawPlaneBody(const float width, const float length, const float height)
     float hulu = h / 5;
 
     // Body
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 0.0f, 0.0f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(1.0f, 0.0f, 0.0f);
     // Front face
-    glVertex3f(-w, -h, lima);
-    glVertex3f(w, -h, lima);
-    glVertex3f(w, h, lima);
-    glVertex3f(-w, h, lima);
+    mesh.Vertex3f(-w, -h, lima);
+    mesh.Vertex3f(w, -h, lima);
+    mesh.Vertex3f(w, h, lima);
+    mesh.Vertex3f(-w, h, lima);
     // Back face
-    glVertex3f(-w, -h, -lima);
-    glVertex3f(-w, h, -lima);
-    glVertex3f(w, -h, -lima);
-    glVertex3f(w, h, -lima);
+    mesh.Vertex3f(-w, -h, -lima);
+    mesh.Vertex3f(-w, h, -lima);
+    mesh.Vertex3f(w, -h, -lima);
+    mesh.Vertex3f(w, h, -lima);
     // Right face
-    glVertex3f(w, -h, -lima);
-    glVertex3f(w, h, -lima);
-    glVertex3f(w, h, lima);
-    glVertex3f(w, -h, lima);
+    mesh.Vertex3f(w, -h, -lima);
+    mesh.Vertex3f(w, h, -lima);
+    mesh.Vertex3f(w, h, lima);
+    mesh.Vertex3f(w, -h, lima);
     // Left face
-    glVertex3f(-w, -h, -lima);
-    glVertex3f(-w, -h, lima);
-    glVertex3f(-w, h, lima);
-    glVertex3f(-w, h, -lima);
+    mesh.Vertex3f(-w, -h, -lima);
+    mesh.Vertex3f(-w, -h, lima);
+    mesh.Vertex3f(-w, h, lima);
+    mesh.Vertex3f(-w, h, -lima);
     // Top face
-    glVertex3f(-w, h, -lima);
-    glVertex3f(-w, h, lima);
-    glVertex3f(w, h, lima);
-    glVertex3f(w, h, -lima);
+    mesh.Vertex3f(-w, h, -lima);
+    mesh.Vertex3f(-w, h, lima);
+    mesh.Vertex3f(w, h, lima);
+    mesh.Vertex3f(w, h, -lima);
     // Bottom face
-    glVertex3f(-w, -h, -lima);
-    glVertex3f(w, -h, -lima);
-    glVertex3f(w, -h, lima);
-    glVertex3f(-w, -h, lima);
+    mesh.Vertex3f(-w, -h, -lima);
+    mesh.Vertex3f(w, -h, -lima);
+    mesh.Vertex3f(w, -h, lima);
+    mesh.Vertex3f(-w, -h, lima);
     // Bottom face close gap
-    glVertex3f(-w, -h - 0.3, -lima);
-    glVertex3f(w, -h - 0.3, -lima);
-    glVertex3f(w, -h - 0.3, lima);
-    glVertex3f(-w, -h - 0.3, lima);
-    glEnd();
+    mesh.Vertex3f(-w, -h - 0.3, -lima);
+    mesh.Vertex3f(w, -h - 0.3, -lima);
+    mesh.Vertex3f(w, -h - 0.3, lima);
+    mesh.Vertex3f(-w, -h - 0.3, lima);
+    mesh.End();
 
     // Cockpit
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 0.0f, 1.0f);
+    mesh.Begin(GL_TRIANGLES);
+    mesh.Color3f(0.0f, 0.0f, 1.0f);
     // Right side
-    glVertex3f(w, h, lima);
-    glVertex3f(w, -h, lima);
-    glVertex3f(w, -h, lima + l);
+    mesh.Vertex3f(w, h, lima);
+    mesh.Vertex3f(w, -h, lima);
+    mesh.Vertex3f(w, -h, lima + l);
     // Left side
-    glVertex3f(-w, h, lima);
-    glVertex3f(-w, -h, lima);
-    glVertex3f(-w, -h, lima + l);
-    glEnd();
+    mesh.Vertex3f(-w, h, lima);
+    mesh.Vertex3f(-w, -h, lima);
+    mesh.Vertex3f(-w, -h, lima + l);
+    mesh.End();
 
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 0.0f, 1.0f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(0.0f, 0.0f, 1.0f);
     // Front
-    glVertex3f(-w, -h, lima + l);
-    glVertex3f(-w, h, lima);
-    glVertex3f(w, h, lima);
-    glVertex3f(w, -h, lima + l);
+    mesh.Vertex3f(-w, -h, lima + l);
+    mesh.Vertex3f(-w, h, lima);
+    mesh.Vertex3f(w, h, lima);
+    mesh.Vertex3f(w, -h, lima + l);
     // Bottom
-    glVertex3f(-w, -h, lima + l);
-    glVertex3f(-w, -h, lima);
-    glVertex3f(w, -h, lima);
-    glVertex3f(w, -h, lima + l);
+    mesh.Vertex3f(-w, -h, lima + l);
+    mesh.Vertex3f(-w, -h, lima);
+    mesh.Vertex3f(w, -h, lima);
+    mesh.Vertex3f(w, -h, lima + l);
     // Bottom close gap
-    glVertex3f(-w, -h - 0.3, lima + l);
-    glVertex3f(-w, -h - 0.3, lima);
-    glVertex3f(w, -h - 0.3, lima);
-    glVertex3f(w, -h - 0.3, lima + l);
-    glEnd();
+    mesh.Vertex3f(-w, -h - 0.3, lima + l);
+    mesh.Vertex3f(-w, -h - 0.3, lima);
+    mesh.Vertex3f(w, -h - 0.3, lima);
+    mesh.Vertex3f(w, -h - 0.3, lima + l);
+    mesh.End();
 
     // Wings 
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 0.0f);
+    mesh.Begin(GL_TRIANGLES);
+    mesh.Color3f(0.0f, 1.0f, 0.0f);
     // Right wing (top)
-    glVertex3f(w, -h, -lima);
-    glVertex3f(whiskey, -h, -lima);
-    glVertex3f(w, -h, lima + l);
+    mesh.Vertex3f(w, -h, -lima);
+    mesh.Vertex3f(whiskey, -h, -lima);
+    mesh.Vertex3f(w, -h, lima + l);
 
     // Right wing (bottom)
-    glVertex3f(w, -h - 0.3, -lima);
-    glVertex3f(whiskey, -h - 0.3, -lima);
-    glVertex3f(w, -h - 0.3, lima + l);
+    mesh.Vertex3f(w, -h - 0.3, -lima);
+    mesh.Vertex3f(whiskey, -h - 0.3, -lima);
+    mesh.Vertex3f(w, -h - 0.3, lima + l);
     // Left wing (top)
-    glVertex3f(-w, -h, -lima);
-    glVertex3f(-whiskey, -h, -lima);
-    glVertex3f(-w, -h, lima + l);
+    mesh.Vertex3f(-w, -h, -lima);
+    mesh.Vertex3f(-whiskey, -h, -lima);
+    mesh.Vertex3f(-w, -h, lima + l);
     // Left wing (bottom)
-    glVertex3f(-w, -h - 0.3, -lima);
-    glVertex3f(-whiskey, -h - 0.3, -lima);
-    glVertex3f(-w, -h - 0.3, lima + l);
-    glEnd();
+    mesh.Vertex3f(-w, -h - 0.3, -lima);
+    mesh.Vertex3f(-whiskey, -h - 0.3, -lima);
+    mesh.Vertex3f(-w, -h - 0.3, lima + l);
+    mesh.End();
 
     // Tail
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.0f, 1.0f, 1.0f);
+    mesh.Begin(GL_TRIANGLES);
+    mesh.Color3f(0.0f, 1.0f, 1.0f);
     // Right 
-    glVertex3f(tango, h, -lima);
-    glVertex3f(tango, hotel, -lima);
-    glVertex3f(tango, h, tail_lima);
+    mesh.Vertex3f(tango, h, -lima);
+    mesh.Vertex3f(tango, hotel, -lima);
+    mesh.Vertex3f(tango, h, tail_lima);
     // Left
-    glVertex3f(-tango, h, -lima);
-    glVertex3f(-tango, hotel, -lima);
-    glVertex3f(-tango, h, tail_lima);
-    glEnd();
+    mesh.Vertex3f(-tango, h, -lima);
+    mesh.Vertex3f(-tango, hotel, -lima);
+    mesh.Vertex3f(-tango, h, tail_lima);
+    mesh.End();
 
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 1.0f, 1.0f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(0.0f, 1.0f, 1.0f);
     // Tail
-    glVertex3f(-tango, h, tail_lima);
-    glVertex3f(-tango, hotel, -lima);
-    glVertex3f(tango, hotel, -lima);
-    glVertex3f(tango, h, tail_lima);
+    mesh.Vertex3f(-tango, h, tail_lima);
+    mesh.Vertex3f(-tango, hotel, -lima);
+    mesh.Vertex3f(tango, hotel, -lima);
+    mesh.Vertex3f(tango, h, tail_lima);
 
-    glVertex3f(-tango, h, -lima);
-    glVertex3f(-tango, hotel, -lima);
-    glVertex3f(tango, hotel, -lima);
-    glVertex3f(tango, h, -lima);
+    mesh.Vertex3f(-tango, h, -lima);
+    mesh.Vertex3f(-tango, hotel, -lima);
+    mesh.Vertex3f(tango, hotel, -lima);
+    mesh.Vertex3f(tango, h, -lima);
 
-    glEnd();
+    mesh.End();
 
     ////close gap
-    glBegin(GL_QUADS);
-    glColor3f(0.0f, 0.0f, 0.0f);
-
-    glVertex3f(-w, -h - 0.3, lima + l);
-    glVertex3f(-w, -h, lima + l);
-    glVertex3f(w, -h, lima + l);
-    glVertex3f(w, -h - 0.3, lima + l);
-
-    glVertex3f(w, -h - 0.3, lima + l);
-    glVertex3f(w, -h, lima + l);
-    glVertex3f(whiskey, -h, -lima);
-    glVertex3f(whiskey, -h - 0.3, -lima);
-
-    glVertex3f(-w, -h - 0.3, lima + l);
-    glVertex3f(-w, -h, lima + l);
-    glVertex3f(-whiskey, -h, -lima);
-    glVertex3f(-whiskey, -h - 0.3, -lima);
-
-    glVertex3f(whiskey, -h - 0.3, -lima);
-    glVertex3f(whiskey, -h, -lima);
-    glVertex3f(-whiskey, -h, -lima);
-    glVertex3f(-whiskey, -h - 0.3, -lima);
-
-    glEnd();
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(0.0f, 0.0f, 0.0f);
+
+    mesh.Vertex3f(-w, -h - 0.3, lima + l);
+    mesh.Vertex3f(-w, -h, lima + l);
+    mesh.Vertex3f(w, -h, lima + l);
+    mesh.Vertex3f(w, -h - 0.3, lima + l);
+
+    mesh.Vertex3f(w, -h - 0.3, lima + l);
+    mesh.Vertex3f(w, -h, lima + l);
+    mesh.Vertex3f(whiskey, -h, -lima);
+    mesh.Vertex3f(whiskey, -h - 0.3, -lima);
+
+    mesh.Vertex3f(-w, -h - 0.3, lima + l);
+    mesh.Vertex3f(-w, -h, lima + l);
+    mesh.Vertex3f(-whiskey, -h, -lima);
+    mesh.Vertex3f(-whiskey, -h - 0.3, -lima);
+
+    mesh.Vertex3f(whiskey, -h - 0.3, -lima);
+    mesh.Vertex3f(whiskey, -h, -lima);
+    mesh.Vertex3f(-whiskey, -h, -lima);
+    mesh.Vertex3f(-whiskey, -h - 0.3, -lima);
+
+    mesh.End();
 }
 
-void DrawTurretGun(const float width, const float length, const float height) {
+void BuildTurretGun(MeshBuilder &mesh, const float width, const float length, const float height) {
     float w = width / 2;
     float l = length / 2;
     float h = height / 2;
@@ -754,76 +1231,76 @@ void DrawTurretGun(const float width, const float length, const float height) {
     float barrel_offset = gun_barrel_length / 2.0f; 
 
     // Draw the turret head
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 1.0f, 0.0f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(1.0f, 1.0f, 0.0f);
     // Top
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, gun_head_height, head_offset - l);
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset - l);
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset - l);
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset - l);
     // Bottom
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset);
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset);
     // Right
-    glVertex3f(gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(gun_head_radius, gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset - l);
     // Left 
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset - l);
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset - l);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset);
     // Front
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, gun_head_height, head_offset);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset);
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset);
     // Back
-    glVertex3f(-gun_head_radius, gun_head_height, head_offset - l);
-    glVertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(gun_head_radius, -gun_head_height, head_offset - l);
-    glVertex3f(gun_head_radius, gun_head_height, head_offset - l);
-    glEnd();
+    mesh.Vertex3f(-gun_head_radius, gun_head_height, head_offset - l);
+    mesh.Vertex3f(-gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, -gun_head_height, head_offset - l);
+    mesh.Vertex3f(gun_head_radius, gun_head_height, head_offset - l);
+    mesh.End();
     //Gun barrel
-    glBegin(GL_QUADS);
-    glColor3f(0.5f, 0.5f, 0.5f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(0.5f, 0.5f, 0.5f);
     // Front 
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
     // Back 
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset);
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset);
     // Right 
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset);
     // Left
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset);
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
     // Top
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
-    glVertex3f(gun_barrel_radius, gun_head_height, head_offset);
-    glVertex3f(-gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(gun_barrel_radius, gun_head_height, head_offset);
+    mesh.Vertex3f(-gun_barrel_radius, gun_head_height, head_offset);
     // Bottom 
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
-    glVertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset);
-    glVertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
-    glEnd();
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.Vertex3f(-gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset);
+    mesh.Vertex3f(gun_barrel_radius, -gun_head_height, head_offset + barrel_offset);
+    mesh.End();
 }
 
-void DrawTurret(const float width, const float length, const float height) {
+void BuildTurret(MeshBuilder &mesh, const float width, const float length, const float height) {
     float w = width / 2;
     float l = length / 2;
     float h = height / 2;
@@ -838,53 +1315,55 @@ void DrawTurret(const float width, const float length, const float height) {
     float hulu = h / 5;
 
     // Body
-    glBegin(GL_QUADS);
-    glColor3f(0.6f, 0.3f, 0.1f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(0.6f, 0.3f, 0.1f);
     // Front face
-    glVertex3f(-w_offset, -h_offset, l_offset);
-    glVertex3f(w_offset, -h_offset, l_offset);
-    glVertex3f(w_offset, h_offset, l_offset);
-    glVertex3f(-w_offset, h_offset, l_offset);
+    mesh.Vertex3f(-w_offset, -h_offset, l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, l_offset);
+    mesh.Vertex3f(w_offset, h_offset, l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, l_offset);
     // Back face
-    glVertex3f(-w_offset, -h_offset, -l_offset);
-    glVertex3f(-w_offset, h_offset, -l_offset);
-    glVertex3f(w_offset, -h_offset, -l_offset);
-    glVertex3f(w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, h_offset, -l_offset);
     // Right face
-    glVertex3f(w_offset, -h_offset, -l_offset);
-    glVertex3f(w_offset, h_offset, -l_offset);
-    glVertex3f(w_offset, h_offset, l_offset);
-    glVertex3f(w_offset, -h_offset, l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, h_offset, l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, l_offset);
     // Left face
-    glVertex3f(-w_offset, -h_offset, -l_offset);
-    glVertex3f(-w_offset, -h_offset, l_offset);
-    glVertex3f(-w_offset, h_offset, l_offset);
-    glVertex3f(-w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, -h_offset, l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, -l_offset);
     // Top face
-    glVertex3f(-w_offset, h_offset, -l_offset);
-    glVertex3f(-w_offset, h_offset, l_offset);
-    glVertex3f(w_offset, h_offset, l_offset);
-    glVertex3f(w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, -l_offset);
+    mesh.Vertex3f(-w_offset, h_offset, l_offset);
+    mesh.Vertex3f(w_offset, h_offset, l_offset);
+    mesh.Vertex3f(w_offset, h_offset, -l_offset);
     // Bottom face
-    glVertex3f(-w_offset, -h_offset, -l_offset);
-    glVertex3f(w_offset, -h_offset, -l_offset);
-    glVertex3f(w_offset, -h_offset, l_offset);
-    glVertex3f(-w_offset, -h_offset, l_offset);
-    glEnd();
+    mesh.Vertex3f(-w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, -l_offset);
+    mesh.Vertex3f(w_offset, -h_offset, l_offset);
+    mesh.Vertex3f(-w_offset, -h_offset, l_offset);
+    mesh.End();
 }
 
 //|____________________________________________________________________
 //|
-//| Function: DrawStabilizer
+//| Function: BuildStabilizer
 //|
+//! \param mesh        [out] Mesh to record into.
 //! \param width       [in] Width  of the propeller.
 //! \param length      [in] Length of the propeller.
+//! \param height      [in] Unused.
 //! \return None.
 //!
-//! Draws a propeller.
+//! Records a propeller.
 //|____________________________________________________________________
 
-void DrawStabilizer(const float width, const float length)
+void BuildStabilizer(MeshBuilder &mesh, const float width, const float length, const float height)
 {
     float w = width/2;
     float l = length/2;
@@ -894,14 +1373,14 @@ void DrawStabilizer(const float width, const float length)
     float tail_lima = l * 0.2;
 
     //DrawStabilizer
-    glBegin(GL_QUADS);
-    glColor3f(1.0f, 0.5f, 0.0f);
+    mesh.Begin(GL_QUADS);
+    mesh.Color3f(1.0f, 0.5f, 0.0f);
     //face
-    glVertex3f(-w, -lima, 0);
-    glVertex3f(w, -lima, 0);
-    glVertex3f(w, lima, 0);
-    glVertex3f(-w, lima, 0);
-    glEnd();
+    mesh.Vertex3f(-w, -lima, 0);
+    mesh.Vertex3f(w, -lima, 0);
+    mesh.Vertex3f(w, lima, 0);
+    mesh.Vertex3f(-w, lima, 0);
+    mesh.End();
 }
 
 //|____________________________________________________________________
@@ -920,6 +1399,46 @@ int main(int argc, char **argv)
 
   glutInit(&argc, argv);
 
+  // -fleet <count> adds a fleet of aircraft (given once), -nocull draws everything,
+  // -nolod draws everything at full detail, -threads <count> sets the
+  // worker threads preparing frames (default one per extra core), -fps
+  // <rate> caps the frame rate (0 for no cap), -counters reports the
+  // hardware counters of each frame with the frame pacing
+  int threads = -1, fleet_count = -1;
+  bool usage = false;
+  for (int i = 1; i < argc && !usage; i++) {
+    if (strcmp(argv[i], "-fleet") == 0 && i + 1 < argc && fleet_count < 0) {    // Once only
+      fleet_count = atoi(argv[++i]);
+      usage = fleet_count < 0;
+    } else if (strcmp(argv[i], "-fps") == 0 && i + 1 < argc) {
+      frame_loop.SetMaxFrameRate(atof(argv[++i]));
+    } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-nocull") == 0) {
+      culling = false;
+    } else if (strcmp(argv[i], "-nolod") == 0) {
+      lod = false;
+    } else if (strcmp(argv[i], "-counters") == 0) {
+      counting = true;
+    } else {
+      usage = true;
+    }
+  }
+  if (usage) {
+    printf("Usage: %s [-fleet <count>] [-nocull] [-nolod] [-threads <count>] [-fps <rate>] [-counters]\n", argv[0]);
+    return 1;
+  }
+  if (fleet_count > 0) InitFleet(fleet_count);
+
+  // Before the workers start, so that the counters follow them too
+  if (counting && display_counters.Open() == 0) {
+    printf("Hardware counters unavailable (not Linux, no PMU, or perf_event_paranoid too strict)\n");
+    counting = false;
+  }
+  ResetFrameCounters();
+  jobs.Start(threads);
+  input.Bind(KEY_BINDINGS, sizeof(KEY_BINDINGS)/sizeof(KEY_BINDINGS[0]));
+
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);     // Uses GLUT_DOUBLE to enable double buffering
   glutInitWindowSize(w_width, w_height);
   
@@ -927,11 +1446,19 @@ int main(int argc, char **argv)
 
   glutDisplayFunc(DisplayFunc);
   glutKeyboardFunc(KeyboardFunc);
+  glutKeyboardUpFunc(KeyboardUpFunc);
+  glutIgnoreKeyRepeat(1);                                       // Held keys are tracked by InputState
   glutMouseFunc(MouseFunc);
   glutMotionFunc(MotionFunc);
   glutReshapeFunc(ReshapeFunc);
+  glutEntryFunc(EntryFunc);                                     // Held keys let go on leaving the window
+  glutIdleFunc(IdleFunc);                                       // Main loop
   
   InitGL();
+  InitScene();
+  InitFleetParts();
+  scene.SetLod(lod);
+  fleet_renderer.SetLod(lod);
 
   glutMainLoop();
 
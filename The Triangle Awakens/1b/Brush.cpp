@@ -0,0 +1,143 @@
+// Brush-stroke engine (see Brush.h)
+//
+// Stamps are Blit sprites, and dabs are composited with Blit's premultiplied "over"
+// row kernel: dst = color + dst*(255-alpha)/255.
+
+#include <math.h>
+
+#include "Brush.h"
+
+void BrushStamp::Build(const BrushStyle &style)
+{
+  int radius = style.radius > 0 ? style.radius : 0;
+  float r = radius + 0.5f;    // reach to the far side of the outermost pixels
+  float hardness = style.hardness < 0 ? 0 : (style.hardness > 1 ? 1 : style.hardness);
+  float opacity  = style.opacity  < 0 ? 0 : (style.opacity  > 1 ? 1 : style.opacity);
+  int i, j;
+
+  size = 2*radius + 1;
+  std::vector<unsigned char> rgba(size*size*4, 0);   // straight alpha, premultiplied by MakeSprite
+  first.assign(size, 0);
+  last.assign(size, 0);
+
+  for (j = 0; j < size; j++) {
+    first[j] = size;
+    for (i = 0; i < size; i++) {
+      float t = sqrtf((float)((i-radius)*(i-radius) + (j-radius)*(j-radius)))/r;
+      float a;
+
+      if (t >= 1) {
+        a = 0;
+      } else if (t <= hardness) {
+        a = 1;
+      } else {                    // smoothstep falloff from the hard core to the rim
+        float u = (t - hardness)/(1 - hardness);
+        a = 1 - u*u*(3 - 2*u);
+      }
+
+      unsigned char a8 = (unsigned char)(a*opacity*255 + 0.5f);
+      if (a8 == 0) continue;
+
+      unsigned char *p = &rgba[(j*size + i)*4];
+      p[0] = style.color[0];
+      p[1] = style.color[1];
+      p[2] = style.color[2];
+      p[3] = a8;
+      if (i < first[j]) first[j] = i;
+      last[j] = i+1;
+    }
+  }
+  MakeSprite(sprite, &rgba[0], size, size, false);
+}
+
+DirtyRect BrushStamp::Apply(const Canvas &canvas, int cx, int cy) const
+{
+  DirtyRect rect = { canvas.width, canvas.height, 0, 0 };
+  int radius = size/2;
+  int j;
+
+  for (j = 0; j < size; j++) {
+    int y = cy - radius + j;
+    if (y < 0 || y >= canvas.height) continue;
+
+    int x0 = cx - radius + first[j];
+    int x1 = cx - radius + last[j];
+    if (x0 < 0) x0 = 0;
+    if (x1 > canvas.width) x1 = canvas.width;
+    if (x0 >= x1) continue;
+
+    int i = x0 - (cx - radius);
+    BlitOverRow(canvas.pixels + (y*canvas.width + x0)*3,
+                &sprite.color[(j*size + i)*3], &sprite.alpha[(j*size + i)*3], (x1-x0)*3);
+
+    if (x0 < rect.x0) rect.x0 = x0;
+    if (x1 > rect.x1) rect.x1 = x1;
+    if (y < rect.y0) rect.y0 = y;
+    if (y+1 > rect.y1) rect.y1 = y+1;
+  }
+  return rect;
+}
+
+void StrokeEngine::SetStyle(const BrushStyle &new_style)
+{
+  style = new_style;
+  stamp.Build(style);
+}
+
+void StrokeEngine::BeginStroke(float x, float y)
+{
+  Dab dab = { x, y };
+
+  stroking = true;
+  last_x = x;
+  last_y = y;
+  dabs.push_back(dab);
+  to_next_dab = fmaxf(1.0f, style.radius*style.spacing);
+}
+
+// Walks the segment from the previous point, dropping a dab every "step" pixels.
+// The distance left over at the end carries into the next segment, so the spacing
+// stays even however the pointer path is split into events.
+void StrokeEngine::AddPoint(float x, float y)
+{
+  float step = fmaxf(1.0f, style.radius*style.spacing);
+  float dx, dy, length, pos = 0;
+
+  if (!stroking) return;
+
+  dx = x - last_x;
+  dy = y - last_y;
+  length = sqrtf(dx*dx + dy*dy);
+
+  while (pos + to_next_dab <= length) {
+    pos += to_next_dab;
+    Dab dab = { last_x + dx*pos/length, last_y + dy*pos/length };
+    dabs.push_back(dab);
+    to_next_dab = step;
+  }
+  to_next_dab -= length - pos;
+
+  last_x = x;
+  last_y = y;
+}
+
+void StrokeEngine::EndStroke()
+{
+  stroking = false;
+}
+
+DirtyRect StrokeEngine::Flush(const Canvas &canvas)
+{
+  DirtyRect dirty = { canvas.width, canvas.height, 0, 0 };
+
+  for (size_t i = 0; i < dabs.size(); i++) {
+    DirtyRect r = stamp.Apply(canvas, (int)floorf(dabs[i].x + 0.5f), (int)floorf(dabs[i].y + 0.5f));
+    if (r.Empty()) continue;
+    if (r.x0 < dirty.x0) dirty.x0 = r.x0;
+    if (r.y0 < dirty.y0) dirty.y0 = r.y0;
+    if (r.x1 > dirty.x1) dirty.x1 = r.x1;
+    if (r.y1 > dirty.y1) dirty.y1 = r.y1;
+  }
+  dabs.clear();     // keeps the capacity for the next frame
+  return dirty;
+}
@@ -0,0 +1,87 @@
+// Brush-stroke engine for the paint example
+//
+// Mouse positions are turned into dabs (brush imprints) placed at an even spacing
+// along the pointer path, no matter how far apart the input events are. The input
+// handlers only record dabs; the compositing happens once per displayed frame, for
+// every dab recorded since the last one, and reports the rectangle it touched so
+// only that part of the window has to be redrawn.
+
+#ifndef BRUSH_H
+#define BRUSH_H
+
+#include <vector>
+
+#include "../partial/Blit.h"
+
+// RGB pixels, 3 bytes per pixel, row-major, bottom row first
+struct Canvas {
+  unsigned char *pixels;
+  int            width;
+  int            height;
+};
+
+struct BrushStyle {
+  int           radius;       // pixels
+  float         hardness;     // 0 = soft all the way to the center, 1 = hard edge
+  float         opacity;      // alpha of a single dab at its center, 0..1
+  float         spacing;      // distance between dabs as a fraction of the radius
+  unsigned char color[3];
+};
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1)
+struct DirtyRect {
+  int x0, y0, x1, y1;
+
+  bool Empty() const { return x0 >= x1 || y0 >= y1; }
+};
+
+// A brush imprint prepared for compositing: a Blit sprite (premultiplied color and
+// alpha, both laid out like canvas rows), so a dab is composited with Blit's
+// byte-wise "over" row kernel.
+class BrushStamp {
+public:
+  BrushStamp() : size(0) {}
+
+  void Build(const BrushStyle &style);
+
+  // Composites the stamp centered on (cx, cy), clipped to the canvas.
+  // Returns the rectangle that was touched (empty when fully clipped).
+  DirtyRect Apply(const Canvas &canvas, int cx, int cy) const;
+
+private:
+  int              size;     // stamp is size x size pixels, size = 2*radius+1
+  Sprite           sprite;
+  std::vector<int> first;    // per row: first and one-past-last pixel with alpha > 0,
+  std::vector<int> last;     // so the transparent corners of the disc are skipped
+};
+
+class StrokeEngine {
+public:
+  StrokeEngine() : stroking(false), last_x(0), last_y(0), to_next_dab(0) {}
+
+  void SetStyle(const BrushStyle &style);
+
+  // Input side: cheap, no pixels are written here
+  void BeginStroke(float x, float y);
+  void AddPoint(float x, float y);
+  void EndStroke();
+
+  bool HasPendingDabs() const { return !dabs.empty(); }
+
+  // Composites every pending dab and returns the union of the touched rectangles
+  DirtyRect Flush(const Canvas &canvas);
+
+private:
+  struct Dab {
+    float x, y;
+  };
+
+  BrushStyle       style;
+  BrushStamp       stamp;
+  std::vector<Dab> dabs;          // recorded but not yet composited
+  bool             stroking;
+  float            last_x, last_y;
+  float            to_next_dab;   // distance left along the path before the next dab
+};
+
+#endif
@@ -1,6 +1,6 @@
 // CMPS 415/515, University of Louisiana at Lafayette
 //
-// Example 1.b : set pixels to red where the mouse clicks
+// Example 1.b : paint red brush strokes where the mouse drags
 //
 // NOTE: No permission is given for distribution beyond
 //       the 415/515 class, of this file or any derivative works.
@@ -8,10 +8,15 @@
 
 #include <stdio.h>
 #include <GL/glut.h>
+#include "Brush.h"
 #define WIDTH 400		
 #define HEIGHT 300	
+#define FRAME_INTERVAL_MS 16	// at most one redisplay per frame
 static GLubyte frame_buffer[HEIGHT][WIDTH][3];
 
+static StrokeEngine strokes;
+static bool stroke_redisplay = false;	// the pending redisplay only has to show new dabs
+
 /*
    see the description in Example 1.a
 */
@@ -19,30 +24,67 @@ static GLubyte frame_buffer[HEIGHT][WIDTH][3];
 /* Called when mouse button pressed: */
 void mousebuttonhandler(int button, int state, int x, int y)
 {
-  printf("Mouse button event, button=%d, state=%d, x=%d, y=%d\n", button, state, x, y);
-
-  // set a pixel's red color value when left mouse button is pressed down:
+  // start a stroke when the left mouse button is pressed down, end it on release:
   if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
-    frame_buffer[HEIGHT-y-1][x][0] = 255;            
+    strokes.BeginStroke((float)x, (float)(HEIGHT-y-1));
+  else if (button == GLUT_LEFT_BUTTON && state == GLUT_UP)
+    strokes.EndStroke();
+
+  // no redisplay here: the frame timer picks up the new dabs
+}
+
+/* Called when the mouse moves with a button pressed: */
+void mousemotionhandler(int x, int y)
+{
+  // only records dabs along the path, so it keeps up with any event rate
+  strokes.AddPoint((float)x, (float)(HEIGHT-y-1));
+}
 
-  // cause a display event to occur for GLUT:
-  glutPostRedisplay();
+/* Called every frame: asks for one redisplay if dabs are waiting */
+void frametimer(int value)
+{
+  if (strokes.HasPendingDabs() && !stroke_redisplay) {
+    stroke_redisplay = true;
+    glutPostRedisplay();
+  }
+  glutTimerFunc(FRAME_INTERVAL_MS, frametimer, 0);
 }
 
 /* Called by GLUT when a display event occurs: */
 void display(void) {
 
+	Canvas canvas = { &frame_buffer[0][0][0], WIDTH, HEIGHT };
+	DirtyRect dirty = strokes.Flush(canvas);
+
 	/*	Set the raster position to the lower-left corner to avoid a problem 
 		(with glDrawPixels) when the window is resized to smaller dimensions.*/
 	glRasterPos2i(-1,-1);
 
-	// Write the information stored in "frame_buffer" to the color buffer
-	glDrawPixels(WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, frame_buffer);
+	if (stroke_redisplay && !dirty.Empty()) {
+		// Only the rectangle touched by the new dabs: move the raster position
+		// there (glBitmap with no image just offsets it, in window pixels) and let
+		// the unpack state pick the rectangle out of "frame_buffer"
+		glBitmap(0, 0, 0, 0, (GLfloat)dirty.x0, (GLfloat)dirty.y0, NULL);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, WIDTH);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, dirty.x0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, dirty.y0);
+		glDrawPixels(dirty.x1-dirty.x0, dirty.y1-dirty.y0, GL_RGB, GL_UNSIGNED_BYTE, frame_buffer);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	} else {
+		// Write the information stored in "frame_buffer" to the color buffer
+		glDrawPixels(WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, frame_buffer);
+	}
+	stroke_redisplay = false;
 	glFlush();
 }
 
 int main(int argc, char **argv) {
 
+	BrushStyle style = { 6, 0.3f, 0.6f, 0.25f, { 255, 0, 0 } };
+	strokes.SetStyle(style);
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
 	glutInitWindowSize(WIDTH, HEIGHT);
@@ -51,6 +93,8 @@ int main(int argc, char **argv) {
 	// Specify which functions get called for display and mouse events:
 	glutDisplayFunc(display);
     glutMouseFunc(mousebuttonhandler);
+	glutMotionFunc(mousemotionhandler);
+	glutTimerFunc(FRAME_INTERVAL_MS, frametimer, 0);
 
 	glutMainLoop();
 
@@ -0,0 +1,81 @@
+// Benchmark harness (see Benchmark.h)
+
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+#include "Benchmark.h"
+
+struct BenchmarkResult {
+  double     seconds;
+  PerfSample counters;
+};
+
+// Prints "value/divisor" in a column of the given width, or "-" for a missing counter
+static void PrintColumn(bool valid, double value, double divisor, int width, int decimals)
+{
+  if (valid && divisor > 0) {
+    printf(" %*.*f", width, decimals, value/divisor);
+  } else {
+    printf(" %*s", width, "-");
+  }
+}
+
+void RunBenchmarks(const BenchmarkCase *cases, int count, int iterations, PerfCounters &counters)
+{
+  std::vector<BenchmarkResult> results(count);
+  int i, k, opened = 0;
+
+  if (iterations < 1) iterations = 1;
+  for (i = 0; i < PERF_EVENT_COUNT; i++) {
+    if (counters.Available((PerfEvent)i)) opened++;
+  }
+  if (opened == 0) {
+    printf("Hardware counters unavailable (not Linux, no PMU, or perf_event_paranoid too strict); timing only\n");
+  } else {
+    for (i = 0; i < PERF_EVENT_COUNT; i++) {
+      if (!counters.Available((PerfEvent)i)) printf("No counter for %s\n", PerfCounters::Name((PerfEvent)i));
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    cases[i].run(cases[i].user);    // warm-up
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    counters.Start();
+    for (k = 0; k < iterations; k++) cases[i].run(cases[i].user);
+    results[i].counters = counters.Stop();
+    results[i].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  printf("\nPer run (%d runs)       ms    Mcycles    Minstr    IPC        L1D        LLC     branch       dTLB\n",
+         iterations);
+  for (i = 0; i < count; i++) {
+    const PerfSample &c = results[i].counters;
+    printf("%-20s", cases[i].name);
+    printf(" %8.3f", results[i].seconds*1e3/iterations);
+    PrintColumn(c.valid[PERF_CYCLES],       (double)c.count[PERF_CYCLES],       iterations*1e6, 10, 3);
+    PrintColumn(c.valid[PERF_INSTRUCTIONS], (double)c.count[PERF_INSTRUCTIONS], iterations*1e6, 9, 3);
+    PrintColumn(c.valid[PERF_CYCLES] && c.valid[PERF_INSTRUCTIONS],
+                (double)c.count[PERF_INSTRUCTIONS], (double)c.count[PERF_CYCLES], 6, 2);
+    for (k = PERF_L1D_MISSES; k <= PERF_DTLB_MISSES; k++) {
+      PrintColumn(c.valid[k], (double)c.count[k], iterations, 10, 0);
+    }
+    printf("\n");
+  }
+
+  printf("\nPer pixel             pixels     ns   cycles    instr   L1D/kpx   LLC/kpx  br/kpx  dTLB/kpx\n");
+  for (i = 0; i < count; i++) {
+    const PerfSample &c = results[i].counters;
+    double pixels = (double)cases[i].pixels*iterations;
+    printf("%-20s %7ld", cases[i].name, cases[i].pixels);
+    PrintColumn(true, results[i].seconds*1e9, pixels, 6, 2);
+    PrintColumn(c.valid[PERF_CYCLES],       (double)c.count[PERF_CYCLES],       pixels, 8, 2);
+    PrintColumn(c.valid[PERF_INSTRUCTIONS], (double)c.count[PERF_INSTRUCTIONS], pixels, 8, 2);
+    PrintColumn(c.valid[PERF_L1D_MISSES],    c.count[PERF_L1D_MISSES]*1e3,    pixels, 9, 2);
+    PrintColumn(c.valid[PERF_LLC_MISSES],    c.count[PERF_LLC_MISSES]*1e3,    pixels, 9, 3);
+    PrintColumn(c.valid[PERF_BRANCH_MISSES], c.count[PERF_BRANCH_MISSES]*1e3, pixels, 7, 2);
+    PrintColumn(c.valid[PERF_DTLB_MISSES],   c.count[PERF_DTLB_MISSES]*1e3,   pixels, 9, 3);
+    printf("\n");
+  }
+}
@@ -0,0 +1,379 @@
+// Sprite/image blit engine (see Blit.h)
+//
+// Blending works on 8 bit channels with the usual exact rounding of v*a/255:
+// t = v*a + 128; result = (t + (t >> 8)) >> 8.
+
+#include <memory.h>
+
+#include "Blit.h"
+#include "CpuFeatures.h"
+
+// The SIMD kernels are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define BLIT_SSE2
+#define BLIT_AVX2
+#endif
+
+#define BLIT_BAND_ROWS 32   // rows per band of BlitDrawList::Draw
+
+// A row kernel blends n bytes of a sprite row (color and alpha planes) into dst;
+// the constant-alpha kernels also take the constant
+typedef void (*BlitRowKernel)(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n);
+typedef void (*BlitAlphaRowKernel)(unsigned char *dst, const unsigned char *color, const unsigned char *alpha,
+                                   int n, unsigned char constant_alpha);
+
+static inline unsigned MulDiv255(unsigned v, unsigned a)
+{
+  unsigned t = v*a + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+// Scalar kernels, also used for the row tails of the SIMD ones
+
+static void OverRow_Scalar(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  for (int i = 0; i < n; i++) {
+    unsigned v = color[i] + MulDiv255(dst[i], 255 - alpha[i]);
+    dst[i] = (unsigned char)(v > 255 ? 255 : v);
+  }
+}
+
+static void ColorKeyRow_Scalar(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  for (int i = 0; i < n; i++) {
+    if (alpha[i]) dst[i] = color[i];
+  }
+}
+
+static void ConstantAlphaRow_Scalar(unsigned char *dst, const unsigned char *color, const unsigned char *alpha,
+                                    int n, unsigned char constant_alpha)
+{
+  for (int i = 0; i < n; i++) {
+    unsigned c = MulDiv255(color[i], constant_alpha);
+    unsigned a = MulDiv255(alpha[i], constant_alpha);
+    unsigned v = c + MulDiv255(dst[i], 255 - a);
+    dst[i] = (unsigned char)(v > 255 ? 255 : v);
+  }
+}
+
+// SSE2 kernels: 16 bytes per step
+
+#ifdef BLIT_SSE2
+// v*a/255 for 16 bytes
+CPU_TARGET("sse2")
+static inline __m128i MulDiv255_SSE2(__m128i v, __m128i a)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i bias = _mm_set1_epi16(128);
+  __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpacklo_epi8(a, zero)), bias);
+  __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), _mm_unpackhi_epi8(a, zero)), bias);
+  lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+  hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+  return _mm_packus_epi16(lo, hi);
+}
+
+CPU_TARGET("sse2")
+static void OverRow_SSE2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  const __m128i ones = _mm_set1_epi8((char)0xFF);
+  int i;
+
+  for (i = 0; i+16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+    __m128i c = _mm_loadu_si128((const __m128i *)(color+i));
+    __m128i a = _mm_loadu_si128((const __m128i *)(alpha+i));
+    d = _mm_adds_epu8(c, MulDiv255_SSE2(d, _mm_xor_si128(a, ones)));
+    _mm_storeu_si128((__m128i *)(dst+i), d);
+  }
+  OverRow_Scalar(dst+i, color+i, alpha+i, n-i);
+}
+
+CPU_TARGET("sse2")
+static void ColorKeyRow_SSE2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+
+  // Keep dst where alpha is zero (the key color), take the sprite everywhere else
+  for (i = 0; i+16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+    __m128i c = _mm_loadu_si128((const __m128i *)(color+i));
+    __m128i k = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(alpha+i)), zero);
+    d = _mm_or_si128(_mm_and_si128(k, d), _mm_andnot_si128(k, c));
+    _mm_storeu_si128((__m128i *)(dst+i), d);
+  }
+  ColorKeyRow_Scalar(dst+i, color+i, alpha+i, n-i);
+}
+
+// SSE4.1 adds a byte blend, which replaces the and/andnot/or of the color key
+CPU_TARGET("sse4.1")
+static void ColorKeyRow_SSE41(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+
+  for (i = 0; i+16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+    __m128i c = _mm_loadu_si128((const __m128i *)(color+i));
+    __m128i k = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(alpha+i)), zero);
+    _mm_storeu_si128((__m128i *)(dst+i), _mm_blendv_epi8(c, d, k));
+  }
+  ColorKeyRow_Scalar(dst+i, color+i, alpha+i, n-i);
+}
+
+CPU_TARGET("sse2")
+static void ConstantAlphaRow_SSE2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha,
+                                  int n, unsigned char constant_alpha)
+{
+  const __m128i ones = _mm_set1_epi8((char)0xFF);
+  const __m128i k    = _mm_set1_epi8((char)constant_alpha);
+  int i;
+
+  for (i = 0; i+16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst+i));
+    __m128i c = MulDiv255_SSE2(_mm_loadu_si128((const __m128i *)(color+i)), k);
+    __m128i a = MulDiv255_SSE2(_mm_loadu_si128((const __m128i *)(alpha+i)), k);
+    d = _mm_adds_epu8(c, MulDiv255_SSE2(d, _mm_xor_si128(a, ones)));
+    _mm_storeu_si128((__m128i *)(dst+i), d);
+  }
+  ConstantAlphaRow_Scalar(dst+i, color+i, alpha+i, n-i, constant_alpha);
+}
+#endif
+
+// AVX2 kernels: 32 bytes per step (unpack and pack both work within 128 bit
+// lanes, so the byte order is preserved exactly as in the SSE2 version). The
+// row tail goes through the SSE2 kernel.
+
+#ifdef BLIT_AVX2
+CPU_TARGET("avx2")
+static inline __m256i MulDiv255_AVX2(__m256i v, __m256i a)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i bias = _mm256_set1_epi16(128);
+  __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), _mm256_unpacklo_epi8(a, zero)), bias);
+  __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), _mm256_unpackhi_epi8(a, zero)), bias);
+  lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+  hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+  return _mm256_packus_epi16(lo, hi);
+}
+
+CPU_TARGET("avx2")
+static void OverRow_AVX2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  const __m256i ones = _mm256_set1_epi8((char)0xFF);
+  int i;
+
+  for (i = 0; i+32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst+i));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(color+i));
+    __m256i a = _mm256_loadu_si256((const __m256i *)(alpha+i));
+    d = _mm256_adds_epu8(c, MulDiv255_AVX2(d, _mm256_xor_si256(a, ones)));
+    _mm256_storeu_si256((__m256i *)(dst+i), d);
+  }
+  OverRow_SSE2(dst+i, color+i, alpha+i, n-i);
+}
+
+CPU_TARGET("avx2")
+static void ColorKeyRow_AVX2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  int i;
+
+  for (i = 0; i+32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst+i));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(color+i));
+    __m256i k = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(alpha+i)), zero);
+    _mm256_storeu_si256((__m256i *)(dst+i), _mm256_blendv_epi8(c, d, k));
+  }
+  ColorKeyRow_SSE2(dst+i, color+i, alpha+i, n-i);
+}
+
+CPU_TARGET("avx2")
+static void ConstantAlphaRow_AVX2(unsigned char *dst, const unsigned char *color, const unsigned char *alpha,
+                                  int n, unsigned char constant_alpha)
+{
+  const __m256i ones = _mm256_set1_epi8((char)0xFF);
+  const __m256i k    = _mm256_set1_epi8((char)constant_alpha);
+  int i;
+
+  for (i = 0; i+32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst+i));
+    __m256i c = MulDiv255_AVX2(_mm256_loadu_si256((const __m256i *)(color+i)), k);
+    __m256i a = MulDiv255_AVX2(_mm256_loadu_si256((const __m256i *)(alpha+i)), k);
+    d = _mm256_adds_epu8(c, MulDiv255_AVX2(d, _mm256_xor_si256(a, ones)));
+    _mm256_storeu_si256((__m256i *)(dst+i), d);
+  }
+  ConstantAlphaRow_SSE2(dst+i, color+i, alpha+i, n-i, constant_alpha);
+}
+#endif
+
+struct BlitKernels {
+  BlitRowKernel over_row;
+  BlitRowKernel color_key_row;
+  BlitAlphaRowKernel constant_alpha_row;
+};
+
+static BlitKernels SelectKernels()
+{
+  BlitKernels k = { OverRow_Scalar, ColorKeyRow_Scalar, ConstantAlphaRow_Scalar };
+#ifdef BLIT_SSE2
+  unsigned features = CpuFeatures();
+
+  if (features & CPU_AVX2) {
+    k.over_row           = OverRow_AVX2;
+    k.color_key_row      = ColorKeyRow_AVX2;
+    k.constant_alpha_row = ConstantAlphaRow_AVX2;
+  } else if (features & CPU_SSE2) {
+    k.over_row           = OverRow_SSE2;
+    k.color_key_row      = features & CPU_SSE41 ? ColorKeyRow_SSE41 : ColorKeyRow_SSE2;
+    k.constant_alpha_row = ConstantAlphaRow_SSE2;
+  }
+#endif
+  return k;
+}
+
+// The widest kernels the CPU supports, chosen on first use
+static const BlitKernels &Kernels()
+{
+  static const BlitKernels kernels = SelectKernels();
+  return kernels;
+}
+
+// Sprite preparation
+
+void MakeSprite(Sprite &sprite, const unsigned char *rgba, int width, int height, bool premultiplied)
+{
+  size_t i, n = (size_t)width*height;
+
+  sprite.width  = width;
+  sprite.height = height;
+  sprite.color.resize(n*3);
+  sprite.alpha.resize(n*3);
+
+  for (i = 0; i < n; i++) {
+    unsigned a = rgba[i*4+3];
+    for (int c = 0; c < 3; c++) {
+      sprite.color[i*3+c] = (unsigned char)(premultiplied ? rgba[i*4+c] : MulDiv255(rgba[i*4+c], a));
+      sprite.alpha[i*3+c] = (unsigned char)a;
+    }
+  }
+}
+
+void MakeColorKeySprite(Sprite &sprite, const unsigned char *rgb, int width, int height, const unsigned char key[3])
+{
+  size_t i, n = (size_t)width*height;
+
+  sprite.width  = width;
+  sprite.height = height;
+  sprite.color.assign(rgb, rgb + n*3);
+  sprite.alpha.resize(n*3);
+
+  for (i = 0; i < n; i++) {
+    bool keyed = rgb[i*3] == key[0] && rgb[i*3+1] == key[1] && rgb[i*3+2] == key[2];
+    memset(&sprite.alpha[i*3], keyed ? 0x00 : 0xFF, 3);
+  }
+}
+
+// Blitting
+
+// Draws the rows y_begin <= y < y_end of the command (frame coordinates)
+static void BlitRows(const FrameView &view, const BlitCommand &cmd, int y_begin, int y_end)
+{
+  const Sprite &sprite = *cmd.sprite;
+  int dst_w = cmd.width  > 0 ? cmd.width  : sprite.width;
+  int dst_h = cmd.height > 0 ? cmd.height : sprite.height;
+  bool scaled = dst_w != sprite.width || dst_h != sprite.height;
+  int x0 = cmd.x, x1 = cmd.x + dst_w;
+  int y0 = cmd.y, y1 = cmd.y + dst_h;
+  int x, y;
+
+  if (sprite.width <= 0 || sprite.height <= 0) return;
+
+  // Clip against the frame and the requested rows
+  if (x0 < 0) x0 = 0;
+  if (x1 > view.width) x1 = view.width;
+  if (y0 < y_begin) y0 = y_begin;
+  if (y1 > y_end) y1 = y_end;
+  if (x0 >= x1 || y0 >= y1) return;
+
+  int n = (x1-x0)*3;
+  const BlitKernels &kernels = Kernels();
+
+  // Scratch rows for scaled sprites, kept per thread to avoid allocating per call
+  static thread_local std::vector<unsigned char> color_row, alpha_row;
+  static thread_local std::vector<int> src_x;
+
+  if (scaled) {
+    // Nearest-neighbour source column of every destination column
+    color_row.resize(n);
+    alpha_row.resize(n);
+    src_x.resize(x1-x0);
+    for (x = x0; x < x1; x++) {
+      src_x[x-x0] = (int)(((long long)(x - cmd.x)*sprite.width)/dst_w)*3;
+    }
+  }
+
+  for (y = y0; y < y1; y++) {
+    int sy = scaled ? (int)(((long long)(y - cmd.y)*sprite.height)/dst_h) : y - cmd.y;
+    size_t row = (size_t)sy*sprite.width*3;
+    const unsigned char *color = &sprite.color[row];
+    const unsigned char *alpha = &sprite.alpha[row];
+    unsigned char *dst = PixelAt(view, x0, y);
+
+    if (scaled) {
+      for (x = 0; x < x1-x0; x++) {
+        int s = src_x[x];
+        color_row[x*3+0] = color[s+0];
+        color_row[x*3+1] = color[s+1];
+        color_row[x*3+2] = color[s+2];
+        alpha_row[x*3+0] = alpha[s+0];
+        alpha_row[x*3+1] = alpha[s+1];
+        alpha_row[x*3+2] = alpha[s+2];
+      }
+      color = &color_row[0];
+      alpha = &alpha_row[0];
+    } else {
+      color += (x0 - cmd.x)*3;
+      alpha += (x0 - cmd.x)*3;
+    }
+
+    switch (cmd.mode) {
+      case BLIT_COPY:
+        memcpy(dst, color, n);
+        break;
+      case BLIT_OVER:
+        kernels.over_row(dst, color, alpha, n);
+        break;
+      case BLIT_COLOR_KEY:
+        kernels.color_key_row(dst, color, alpha, n);
+        break;
+      case BLIT_CONSTANT_ALPHA:
+        kernels.constant_alpha_row(dst, color, alpha, n, cmd.constant_alpha);
+        break;
+    }
+  }
+}
+
+void Blit(const FrameView &view, const BlitCommand &cmd)
+{
+  BlitRows(view, cmd, 0, view.height);
+}
+
+void BlitOverRow(unsigned char *dst, const unsigned char *color, const unsigned char *alpha, int n)
+{
+  Kernels().over_row(dst, color, alpha, n);
+}
+
+void BlitDrawList::Draw(const FrameView &view) const
+{
+  for (int band = 0; band < view.height; band += BLIT_BAND_ROWS) {
+    int band_end = band + BLIT_BAND_ROWS < view.height ? band + BLIT_BAND_ROWS : view.height;
+
+    for (size_t i = 0; i < commands.size(); i++) {
+      const BlitCommand &cmd = commands[i];
+      int h = cmd.height > 0 ? cmd.height : cmd.sprite->height;
+      if (cmd.y >= band_end || cmd.y + h <= band) continue;
+      BlitRows(view, cmd, band, band_end);
+    }
+  }
+}
@@ -0,0 +1,119 @@
+// Run-time CPU feature detection (see CpuFeatures.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(CPU_X86)
+#include <cpuid.h>
+#endif
+
+#ifdef CPU_X86
+// regs = eax, ebx, ecx, edx of CPUID leaf/subleaf
+static void CpuId(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r, (int)leaf, (int)subleaf);
+  for (int i = 0; i < 4; i++) regs[i] = (unsigned)r[i];
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switches (XCR0)
+static unsigned long long XGetBv()
+{
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  unsigned lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+#endif
+
+static unsigned DetectFeatures()
+{
+  unsigned features = 0;
+
+#ifdef CPU_X86
+  unsigned regs[4];
+
+  CpuId(0, 0, regs);
+  unsigned max_leaf = regs[0];
+  if (max_leaf < 1) return 0;
+
+  CpuId(1, 0, regs);
+  if (!(regs[3] & (1u << 26))) return 0;                     // SSE2
+  features |= CPU_SSE2;
+  if (!(regs[2] & (1u << 19))) return features;              // SSE4.1
+  features |= CPU_SSE41;
+
+  // AVX needs the OS to save the YMM registers (OSXSAVE, then XCR0 bits 1-2)
+  if (!(regs[2] & (1u << 27)) || !(regs[2] & (1u << 28)) || max_leaf < 7) return features;
+  unsigned long long xcr0 = XGetBv();
+  if ((xcr0 & 0x06) != 0x06) return features;
+
+  CpuId(7, 0, regs);
+  if (!(regs[1] & (1u << 5))) return features;               // AVX2
+  features |= CPU_AVX2;
+
+  // AVX-512 also needs the opmask and ZMM state (XCR0 bits 5-7)
+  if ((xcr0 & 0xE0) != 0xE0) return features;
+  if ((regs[1] & (1u << 16)) && (regs[1] & (1u << 30))) {   // AVX512F, AVX512BW
+    features |= CPU_AVX512;
+  }
+#endif
+
+  return features;
+}
+
+static unsigned InitFeatures()
+{
+  static const struct {
+    const char *name;
+    unsigned    mask;
+  } caps[] = {
+    { "scalar", 0 },
+    { "sse2",   CPU_SSE2 },
+    { "sse4.1", CPU_SSE2 | CPU_SSE41 },
+    { "avx2",   CPU_SSE2 | CPU_SSE41 | CPU_AVX2 },
+    { "avx512", CPU_SSE2 | CPU_SSE41 | CPU_AVX2 | CPU_AVX512 },
+  };
+  unsigned features = DetectFeatures();
+  const char *cap = getenv("CPU_FEATURES");
+
+  if (cap) {
+    size_t i;
+    for (i = 0; i < sizeof(caps)/sizeof(caps[0]) && strcmp(cap, caps[i].name) != 0; i++) {}
+    if (i < sizeof(caps)/sizeof(caps[0])) {
+      features &= caps[i].mask;
+    } else {
+      printf("CPU_FEATURES: unknown level \"%s\" (scalar, sse2, sse4.1, avx2, avx512)\n", cap);
+    }
+  }
+  return features;
+}
+
+unsigned CpuFeatures()
+{
+  static const unsigned features = InitFeatures();
+  return features;
+}
+
+const char *CpuFeaturesName()
+{
+  unsigned features = CpuFeatures();
+
+  if (features & CPU_AVX512) return "AVX-512";
+  if (features & CPU_AVX2)   return "AVX2";
+  if (features & CPU_SSE41)  return "SSE4.1";
+  if (features & CPU_SSE2)   return "SSE2";
+  return "scalar";
+}
@@ -0,0 +1,38 @@
+// Run-time CPU feature detection for the SIMD kernels
+//
+// Kernels for instruction sets beyond the build's baseline are compiled with
+// CPU_TARGET(...) so that one binary carries all of them; each module picks the
+// widest one the running CPU supports the first time it needs a kernel.
+// The environment variable CPU_FEATURES ("scalar", "sse2", "sse4.1", "avx2" or
+// "avx512") caps the level, which makes every path testable on a single machine.
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// CPU_X86 is defined where kernels for any x86 instruction set can be compiled,
+// whatever the build flags: GCC/Clang through target attributes, MSVC always.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CPU_X86
+#define CPU_TARGET(isa)
+#endif
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Feature bits; each level implies the ones before it
+#define CPU_SSE2    0x01
+#define CPU_SSE41   0x02
+#define CPU_AVX2    0x04    // AVX2 with OS support for the YMM state
+#define CPU_AVX512  0x08    // AVX-512 F and BW with OS support for the ZMM state
+
+// Features of this CPU (after the CPU_FEATURES cap), detected once
+unsigned CpuFeatures();
+
+// Name of the widest level in CpuFeatures(), for logging
+const char *CpuFeaturesName();
+
+#endif
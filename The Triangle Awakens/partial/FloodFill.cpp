@@ -0,0 +1,475 @@
+// Span-based flood fill (see FloodFill.h)
+
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+
+#include "FloodFill.h"
+#include "SpanWriter.h"
+#include "CpuFeatures.h"
+
+// Smaller frames are filled by Fill(), see FillParallel()
+#define FLOOD_PARALLEL_MIN_PIXELS (256*256)
+
+// The SIMD scans are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define FLOOD_SSE2
+#endif
+
+// Block scans skip whole blocks of 16 pixels (48 bytes): the 3 byte seed color
+// repeats every 48 bytes, so three 16 byte patterns cover every channel position.
+// Each takes the seed repeated over 48 bytes and returns where it stopped.
+struct FloodKernels {
+  // Forwards from x while x+16 <= end and all (match) or none (!match) of the block's pixels match
+  int (*skip_forward)(const unsigned char *row, int x, int end, bool match, const unsigned char *pattern, int tolerance);
+  // Backwards from x while the 16 pixels before x all match
+  int (*skip_backward)(const unsigned char *row, int x, const unsigned char *pattern, int tolerance);
+};
+
+static int SkipForward_Scalar(const unsigned char *, int x, int, bool, const unsigned char *, int)
+{
+  return x;
+}
+
+static int SkipBackward_Scalar(const unsigned char *, int x, const unsigned char *, int)
+{
+  return x;
+}
+
+#ifdef FLOOD_SSE2
+static const uint64_t ALL_MATCH = 0x249249249249ull;   // bit 3k for each of the 16 pixels
+
+// Bit 3k is set when pixel k of the 16 at p matches
+CPU_TARGET("sse2")
+static inline uint64_t Block_SSE2(const unsigned char *p, const __m128i pattern[3], __m128i tol)
+{
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t m = 0;
+  for (int v = 0; v < 3; v++) {
+    __m128i d  = _mm_loadu_si128((const __m128i *)(p + 16*v));
+    __m128i ad = _mm_or_si128(_mm_subs_epu8(d, pattern[v]), _mm_subs_epu8(pattern[v], d));
+    __m128i ok = _mm_cmpeq_epi8(_mm_subs_epu8(ad, tol), zero);
+    m |= (uint64_t)(unsigned)_mm_movemask_epi8(ok) << (16*v);
+  }
+  return m & (m >> 1) & (m >> 2) & ALL_MATCH;
+}
+
+CPU_TARGET("sse2")
+static int SkipForward_SSE2(const unsigned char *row, int x, int end, bool match, const unsigned char *pattern, int tolerance)
+{
+  const __m128i p[3] = { _mm_loadu_si128((const __m128i *)(pattern+0)),
+                         _mm_loadu_si128((const __m128i *)(pattern+16)),
+                         _mm_loadu_si128((const __m128i *)(pattern+32)) };
+  const __m128i tol  = _mm_set1_epi8((char)tolerance);
+  const uint64_t want = match ? ALL_MATCH : 0;
+
+  while (x+16 <= end && Block_SSE2(row + x*3, p, tol) == want) x += 16;
+  return x;
+}
+
+CPU_TARGET("sse2")
+static int SkipBackward_SSE2(const unsigned char *row, int x, const unsigned char *pattern, int tolerance)
+{
+  const __m128i p[3] = { _mm_loadu_si128((const __m128i *)(pattern+0)),
+                         _mm_loadu_si128((const __m128i *)(pattern+16)),
+                         _mm_loadu_si128((const __m128i *)(pattern+32)) };
+  const __m128i tol  = _mm_set1_epi8((char)tolerance);
+
+  while (x >= 16 && Block_SSE2(row + (x-16)*3, p, tol) == ALL_MATCH) x -= 16;
+  return x;
+}
+#endif
+
+static FloodKernels SelectFloodKernels()
+{
+  FloodKernels k = { SkipForward_Scalar, SkipBackward_Scalar };
+#ifdef FLOOD_SSE2
+  if (CpuFeatures() & CPU_SSE2) {
+    k.skip_forward  = SkipForward_SSE2;
+    k.skip_backward = SkipBackward_SSE2;
+  }
+#endif
+  return k;
+}
+
+// The widest scans the CPU supports, chosen on first use
+static const FloodKernels &Kernels()
+{
+  static const FloodKernels kernels = SelectFloodKernels();
+  return kernels;
+}
+
+// Compares pixels with the seed color, whole blocks at a time where the CPU allows.
+// The tolerance is clamped to [0, 255], so the seed pixel always matches itself.
+class ColorMatcher {
+public:
+  ColorMatcher(const unsigned char seed[3], int tolerance)
+    : kernels(Kernels()), tolerance(tolerance < 0 ? 0 : (tolerance < 255 ? tolerance : 255))
+  {
+    memcpy(this->seed, seed, 3);
+    for (int i = 0; i < 48; i++) pattern[i] = seed[i % 3];
+  }
+
+  bool Matches(const unsigned char *p) const
+  {
+    int d0 = p[0] - seed[0], d1 = p[1] - seed[1], d2 = p[2] - seed[2];
+    return (d0 < 0 ? -d0 : d0) <= tolerance &&
+           (d1 < 0 ? -d1 : d1) <= tolerance &&
+           (d2 < 0 ? -d2 : d2) <= tolerance;
+  }
+
+  // First x' >= x whose pixel does not match (or width)
+  int RunEnd(const unsigned char *row, int x, int width) const
+  {
+    x = kernels.skip_forward(row, x, width, true, pattern, tolerance);
+    while (x < width && Matches(row + x*3)) x++;
+    return x;
+  }
+
+  // Smallest x' <= x such that the pixels x'..x all match; pixel x must match
+  int RunStart(const unsigned char *row, int x) const
+  {
+    x = kernels.skip_backward(row, x, pattern, tolerance);
+    while (x > 0 && Matches(row + (x-1)*3)) x--;
+    return x;
+  }
+
+  // First x' >= x whose pixel matches (or "end")
+  int NextMatch(const unsigned char *row, int x, int end) const
+  {
+    x = kernels.skip_forward(row, x, end, false, pattern, tolerance);
+    while (x < end && !Matches(row + x*3)) x++;
+    return x;
+  }
+
+private:
+  const FloodKernels &kernels;
+  unsigned char pattern[48];    // the seed color repeated over a block
+  unsigned char seed[3];
+  int           tolerance;
+};
+
+long FloodFiller::Fill(const FrameView &view, int x, int y, const unsigned char rgb[3], int tolerance)
+{
+  const int width = view.width, height = view.height;
+  long filled = 0;
+
+  if (x < 0 || x >= width || y < 0 || y >= height) return 0;
+  ColorMatcher matcher(PixelAt(view, x, y), tolerance);
+
+  // Normally a filled pixel stops matching, which is what keeps the fill from
+  // visiting it again. When the new color matches as well, remember filled pixels.
+  bool track = matcher.Matches(rgb);
+  if (track) visited.assign(((size_t)width*height + 31)/32, 0);
+
+  #define VISITED(px, py) (visited[((size_t)(py)*width + (px)) >> 5] & (1u << (((size_t)(py)*width + (px)) & 31)))
+  #define INSIDE(px, py)  (matcher.Matches(PixelAt(view, px, py)) && (!track || !VISITED(px, py)))
+
+  // Fills [l, r] of row py
+  #define PAINT(py, l, r) {                                                   \
+    FillSpan(view, py, l, (r)+1, rgb);                                        \
+    if (track) {                                                              \
+      for (size_t bit = (size_t)(py)*width + (l); bit <= (size_t)(py)*width + (r); bit++) { \
+        visited[bit >> 5] |= 1u << (bit & 31);                                \
+      }                                                                       \
+    }                                                                         \
+    filled += (r) - (l) + 1;                                                  \
+  }
+
+  #define PUSH(py, l, r, d) {                                                 \
+    if ((py) >= 0 && (py) < height) {                                         \
+      Segment pushed = { py, l, r, d };                                       \
+      stack.push_back(pushed);                                                \
+    }                                                                         \
+  }
+
+  // Run extension: the SIMD scans when color alone decides, pixel by pixel otherwise
+  #define RUN_START(px, py) (track ? SlowRunStart(px, py) : matcher.RunStart(PixelAt(view, 0, py), px))
+  #define RUN_END(px, py)   (track ? SlowRunEnd(px, py) : matcher.RunEnd(PixelAt(view, 0, py), (px)+1, width) - 1)
+
+  auto SlowRunStart = [&](int px, int py) { while (px > 0 && INSIDE(px-1, py)) px--; return px; };
+  auto SlowRunEnd   = [&](int px, int py) { while (px < width-1 && INSIDE(px+1, py)) px++; return px; };
+
+  int l = RUN_START(x, y), r = RUN_END(x, y);
+  PAINT(y, l, r);
+
+  stack.clear();
+  PUSH(y+1, l, r, 1);
+  PUSH(y-1, l, r, -1);
+
+  while (!stack.empty()) {
+    Segment s = stack.back();
+    stack.pop_back();
+
+    // Every run of row s.y that touches the parent run [x_left, x_right]
+    const unsigned char *row = PixelAt(view, 0, s.y);
+    int px = s.x_left;
+    while (px <= s.x_right) {
+      if (!track) px = matcher.NextMatch(row, px, s.x_right+1);
+      if (px > s.x_right) break;
+      if (!INSIDE(px, s.y)) {
+        px++;
+        continue;
+      }
+
+      int start = px, end = RUN_END(px, s.y);
+      if (px == s.x_left) {     // only the first run can reach left of the parent
+        start = RUN_START(px, s.y);
+      }
+      PAINT(s.y, start, end);
+
+      // Onwards in the same direction, and back towards the parent row where the
+      // new run sticks out past the parent run
+      PUSH(s.y + s.dir, start, end, s.dir);
+      if (start < s.x_left)  PUSH(s.y - s.dir, start, s.x_left-1, -s.dir);
+      if (end   > s.x_right) PUSH(s.y - s.dir, s.x_right+1, end, -s.dir);
+
+      px = end+2;               // end+1 is outside the region
+    }
+  }
+
+  #undef RUN_END
+  #undef RUN_START
+  #undef PUSH
+  #undef PAINT
+  #undef INSIDE
+  #undef VISITED
+
+  return filled;
+}
+
+static int FindRoot(std::vector<int> &parent, int i)
+{
+  int root = i;
+  while (parent[root] != root) root = parent[root];
+  while (parent[i] != root) {   // path compression
+    int next = parent[i];
+    parent[i] = root;
+    i = next;
+  }
+  return root;
+}
+
+// The smaller index becomes the root, so the labels do not depend on the union order
+static void Union(std::vector<int> &parent, int a, int b)
+{
+  a = FindRoot(parent, a);
+  b = FindRoot(parent, b);
+  if (a < b) parent[b] = a;
+  else if (b < a) parent[a] = b;
+}
+
+// Splits the band's rows into matching spans and joins the spans that overlap
+// a span of the row below (4-connectivity). Span parents end up band-local roots.
+void FloodFiller::LabelBand(const FrameView &view, Band &band, const unsigned char seed[3], int tolerance)
+{
+  ColorMatcher matcher(seed, tolerance);
+  std::vector<int> &local = band.labels;
+  int y, x, i;
+
+  band.spans.clear();
+  band.row_start.clear();
+  local.clear();
+
+  for (y = band.y_first; y <= band.y_last; y++) {
+    int prev_begin = band.row_start.empty() ? 0 : band.row_start.back();
+    int prev_end   = (int)band.spans.size();
+    int j = prev_begin;
+    const unsigned char *p = PixelAt(view, 0, y);
+
+    band.row_start.push_back(prev_end);
+
+    for (x = matcher.NextMatch(p, 0, view.width); x < view.width; x = matcher.NextMatch(p, x, view.width)) {
+      Span span;
+      span.x_left  = x;
+      x            = matcher.RunEnd(p, x+1, view.width);
+      span.x_right = x-1;
+      span.parent  = (int)band.spans.size();
+      band.spans.push_back(span);
+      local.push_back(span.parent);
+
+      if (y == band.y_first) continue;
+      while (j < prev_end && band.spans[j].x_right < span.x_left) j++;
+      for (i = j; i < prev_end && band.spans[i].x_left <= span.x_right; i++) {
+        Union(local, span.parent, i);
+      }
+    }
+  }
+  band.row_start.push_back((int)band.spans.size());
+
+  for (i = 0; i < (int)band.spans.size(); i++) {
+    band.spans[i].parent = FindRoot(local, i);
+  }
+}
+
+// Paints the spans of the band whose label is "root"
+void FloodFiller::PaintBand(const FrameView &view, const Band &band, int base, int root,
+                            const unsigned char rgb[3], long *count)
+{
+  for (int r = 0; r+1 < (int)band.row_start.size(); r++) {
+    for (int k = band.row_start[r]; k < band.row_start[r+1]; k++) {
+      const Span &s = band.spans[k];
+      if (parent[base + k] != root) continue;
+      FillSpan(view, band.y_first + r, s.x_left, s.x_right+1, rgb);
+      *count += s.x_right - s.x_left + 1;
+    }
+  }
+}
+
+FloodFiller::FloodFiller()
+  : view(NULL), tolerance(0), rgb(NULL), root(-1), thread_count(1), job(0), busy(0), stopping(false)
+{
+}
+
+FloodFiller::~FloodFiller()
+{
+  StopWorkers();
+}
+
+void FloodFiller::SetThreads(int count)
+{
+  if (count == thread_count) return;
+
+  StopWorkers();
+  thread_count = count;
+  stopping = false;
+  for (int band = 1; band < count; band++) {
+    workers.push_back(std::thread(&FloodFiller::WorkerLoop, this, band, job));
+  }
+}
+
+void FloodFiller::StopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+  workers.clear();
+  thread_count = 1;
+}
+
+void FloodFiller::WorkerLoop(int band, unsigned seen)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;) {
+    wake.wait(lock, [&] { return stopping || job != seen; });
+    if (stopping) return;
+    seen = job;
+
+    lock.unlock();
+    RunBand(band);
+    lock.lock();
+
+    if (--busy == 0) done.notify_one();
+  }
+}
+
+void FloodFiller::RunBand(int band)
+{
+  if (phase == PHASE_LABEL) {
+    LabelBand(*view, bands[band], seed, tolerance);
+  } else {
+    PaintBand(*view, bands[band], base[band], root, rgb, &counts[band]);
+  }
+}
+
+void FloodFiller::RunPhase(Phase next)
+{
+  phase = next;
+  if (thread_count == 1) {
+    RunBand(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job++;
+    busy = thread_count-1;
+  }
+  wake.notify_all();
+
+  RunBand(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&] { return busy == 0; });
+}
+
+long FloodFiller::FillParallel(const FrameView &view, int x, int y, const unsigned char rgb[3], int tolerance,
+                               int threads)
+{
+  int n, b, i, total = 0;
+
+  if (x < 0 || x >= view.width || y < 0 || y >= view.height) return 0;
+
+  // Labelling costs a pass over the whole frame, which only pays off on large frames
+  if ((long)view.width*view.height < FLOOD_PARALLEL_MIN_PIXELS) return Fill(view, x, y, rgb, tolerance);
+
+  n = threads < 1 ? 1 : (threads > view.height ? view.height : threads);
+  SetThreads(n);
+  bands.resize(n);
+  for (b = 0; b < n; b++) {
+    bands[b].y_first = view.height*b/n;
+    bands[b].y_last  = view.height*(b+1)/n - 1;
+  }
+
+  this->view      = &view;
+  this->tolerance = tolerance;
+  this->rgb       = rgb;
+  memcpy(seed, PixelAt(view, x, y), 3);
+
+  // 1. Label every band independently
+  RunPhase(PHASE_LABEL);
+
+  // 2. Give the spans global indices and join the components that meet at band borders
+  base.resize(n);
+  for (b = 0; b < n; b++) {
+    base[b] = total;
+    total += (int)bands[b].spans.size();
+  }
+  parent.resize(total);
+  for (b = 0; b < n; b++) {
+    for (i = 0; i < (int)bands[b].spans.size(); i++) {
+      parent[base[b] + i] = base[b] + bands[b].spans[i].parent;
+    }
+  }
+  for (b = 0; b+1 < n; b++) {
+    const Band &lower = bands[b], &upper = bands[b+1];
+    int a     = lower.row_start[lower.row_start.size()-2], a_end = lower.row_start.back();
+    int u     = upper.row_start[0],                        u_end = upper.row_start[1];
+
+    while (a < a_end && u < u_end) {
+      const Span &sa = lower.spans[a], &su = upper.spans[u];
+      if (sa.x_left <= su.x_right && su.x_left <= sa.x_right) Union(parent, base[b] + a, base[b+1] + u);
+      if (sa.x_right < su.x_right) a++;
+      else u++;
+    }
+  }
+
+  // The seed's span
+  int seed_span = -1;
+  for (b = 0; b < n && seed_span < 0; b++) {
+    const Band &band = bands[b];
+    if (y < band.y_first || y > band.y_last) continue;
+    for (i = band.row_start[y - band.y_first]; i < band.row_start[y - band.y_first + 1]; i++) {
+      if (band.spans[i].x_left <= x && x <= band.spans[i].x_right) {
+        seed_span = base[b] + i;
+        break;
+      }
+    }
+  }
+  root = FindRoot(parent, seed_span);
+
+  // Flatten, so the painting threads only read the labels
+  for (i = 0; i < total; i++) FindRoot(parent, i);
+
+  // 3. Paint the spans of the seed's component, band by band
+  counts.assign(n, 0);
+  RunPhase(PHASE_PAINT);
+
+  long filled = 0;
+  for (b = 0; b < n; b++) filled += counts[b];
+  return filled;
+}
@@ -0,0 +1,104 @@
+// Span-based flood fill (bucket fill) for a FrameView
+//
+// The region is the 4-connected set of pixels around the seed whose color matches
+// the seed color: exactly, or within a per-channel tolerance. Both variants work on
+// horizontal spans rather than single pixels and never recurse:
+//  - Fill() grows the region from the seed with an explicit stack of spans, touching
+//    only the region and its border;
+//  - FillParallel() splits the frame into horizontal bands, labels the matching spans
+//    of every band at the same time (union-find on overlapping spans of adjacent rows),
+//    joins the labels across the band borders, then paints the seed's component.
+//    The bands other than the first run on worker threads that are started by the
+//    first call and kept for the next ones.
+//    Labelling visits every matching span of the frame, however small the seed's
+//    region is: its cost follows the frame size, where Fill() follows the region.
+//    It only wins on large regions; frames under 256x256 pixels always go to Fill().
+
+#ifndef FLOOD_FILL_H
+#define FLOOD_FILL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "FrameBuffer.h"
+
+class FloodFiller {
+public:
+  FloodFiller();
+  ~FloodFiller();
+
+  // Fills the region around (x, y) with "rgb". "tolerance" is the largest difference
+  // allowed in any channel (0 = exact match). Returns the number of pixels filled.
+  long Fill(const FrameView &view, int x, int y, const unsigned char rgb[3], int tolerance);
+
+  // Same region and result as Fill(), computed by "threads" bands in parallel.
+  // Prefer Fill() when the region is known to be small compared to the frame.
+  long FillParallel(const FrameView &view, int x, int y, const unsigned char rgb[3], int tolerance,
+                    int threads);
+
+private:
+  struct Segment {
+    int y;              // row to explore
+    int x_left;         // run on the parent row (y - dir) that was just filled
+    int x_right;
+    int dir;            // +1 going up, -1 going down
+  };
+
+  struct Span {
+    int x_left;         // inclusive
+    int x_right;        // inclusive
+    int parent;         // union-find link, band-local in the labelling pass
+  };
+
+  struct Band {
+    int                y_first, y_last;
+    std::vector<Span>  spans;
+    std::vector<int>   row_start;   // index of the first span of each row, plus an end marker
+    std::vector<int>   labels;      // band-local union-find while labelling
+  };
+
+  enum Phase { PHASE_LABEL, PHASE_PAINT };
+
+  void LabelBand(const FrameView &view, Band &band, const unsigned char seed[3], int tolerance);
+  void PaintBand(const FrameView &view, const Band &band, int base, int root,
+                 const unsigned char rgb[3], long *count);
+
+  // Runs "phase" of the current fill on every band: band 0 on the calling thread,
+  // the others on the workers
+  void RunPhase(Phase phase);
+  void RunBand(int band);
+  void SetThreads(int count);
+  void WorkerLoop(int band, unsigned seen);   // "seen": last job the worker must not run
+  void StopWorkers();
+
+  // Kept between calls so that filling does not allocate in steady state
+  std::vector<Segment>  stack;
+  std::vector<uint32_t> visited;    // 1 bit per pixel, only used when the new color matches too
+  std::vector<Band>     bands;
+  std::vector<int>      parent;     // global union-find over the spans of all bands
+
+  // The current FillParallel() call, read by the workers
+  Phase                 phase;
+  const FrameView      *view;
+  unsigned char         seed[3];
+  int                   tolerance;
+  const unsigned char  *rgb;
+  int                   root;
+  std::vector<int>      base;       // global index of the first span of each band
+  std::vector<long>     counts;     // pixels painted by each band
+
+  // Worker threads run bands 1..N-1
+  int                      thread_count;
+  std::vector<std::thread> workers;
+  std::mutex               mutex;
+  std::condition_variable  wake;
+  std::condition_variable  done;
+  unsigned                 job;       // incremented for every phase
+  int                      busy;      // workers still running the current phase
+  bool                     stopping;
+};
+
+#endif
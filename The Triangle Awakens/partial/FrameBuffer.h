@@ -0,0 +1,29 @@
+// Frame buffer dimensions and the image view shared by the raster modules
+
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <stddef.h>
+
+#define WIDTH 400
+#define HEIGHT 300
+
+/*
+	A FrameView describes a simulated frame buffer with 3 bytes per pixel (24 bit RGB),
+	stored row-major from the bottom row up, which is the layout glDrawPixels expects.
+
+	Example [setting the pixel at (100,10) to red]:
+	PixelAt(view, 100, 10)[0] = 255;
+*/
+struct FrameView {
+  unsigned char *pixels;
+  int            width;
+  int            height;
+};
+
+inline unsigned char *PixelAt(const FrameView &view, int x, int y)
+{
+  return view.pixels + ((size_t)y*view.width + x)*3;
+}
+
+#endif
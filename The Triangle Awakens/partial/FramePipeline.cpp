@@ -0,0 +1,116 @@
+// Pipelined frame rendering (see FramePipeline.h)
+//
+// The three slots are handed around as a triple buffer: the producer owns "back",
+// the consumer owns "front", and "latest" holds the third one. Both sides swap their
+// slot with "latest" through a single atomic exchange, so neither side ever waits
+// on the other.
+
+#include "FramePipeline.h"
+#include "SharedFrameRing.h"
+
+FramePipeline::FramePipeline()
+  : shared(NULL), back(2), front(0), latest(1), running(false), kicked(false), frame_count(0),
+    update_func(NULL), render_func(NULL), user_data(NULL)
+{
+  own_slots = new FrameSlot[FRAME_RING_SIZE]();     // zeroed: every slot starts black
+  slots     = own_slots;
+}
+
+FramePipeline::~FramePipeline()
+{
+  Stop();
+  delete shared;
+  delete [] own_slots;
+}
+
+bool FramePipeline::ExportShared(const char *name)
+{
+  if (running.load() || shared) return false;
+
+  shared = SharedFrameRing::Create(name, FRAME_RING_SIZE);
+  if (!shared) return false;
+
+  slots = shared->Slots();
+  return true;
+}
+
+void FramePipeline::Start(UpdateFunc update, RenderFunc render, void *user)
+{
+  if (running.load()) return;
+
+  update_func = update;
+  render_func = render;
+  user_data   = user;
+  running.store(true);
+  producer = std::thread(&FramePipeline::ProducerLoop, this);
+}
+
+void FramePipeline::Stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(wake_lock);
+    if (!running.exchange(false)) return;
+  }
+  wake.notify_one();
+  producer.join();
+}
+
+void FramePipeline::Kick()
+{
+  {
+    std::lock_guard<std::mutex> guard(wake_lock);
+    kicked = true;
+  }
+  wake.notify_one();
+}
+
+bool FramePipeline::HasNewFrame() const
+{
+  return (latest.load(std::memory_order_acquire) & NEW_FRAME) != 0;
+}
+
+const FrameSlot &FramePipeline::AcquireLatest()
+{
+  if (latest.load(std::memory_order_acquire) & NEW_FRAME) {
+    front = latest.exchange(front, std::memory_order_acq_rel) & SLOT_MASK;
+  }
+  return slots[front];
+}
+
+void FramePipeline::Publish()
+{
+  int done = back;
+
+  back = latest.exchange(back | NEW_FRAME, std::memory_order_acq_rel) & SLOT_MASK;
+  if (shared) shared->Announce(done);
+}
+
+void FramePipeline::ProducerLoop()
+{
+  bool dirty = true;    // always produce the first frame
+
+  while (running.load(std::memory_order_acquire)) {
+    dirty |= update_func(user_data);
+
+    if (dirty) {
+      FrameSlot &slot = slots[back];
+
+      // The sequence number is odd while rendering, so external readers can detect
+      // a frame that was overwritten under them
+      slot.sequence.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      render_func(slot, user_data);
+      slot.frame_id = ++frame_count;
+      slot.sequence.fetch_add(1, std::memory_order_release);
+
+      Publish();
+      dirty = false;
+      continue;
+    }
+
+    // Nothing to do: sleep until the GLUT thread queues more input or stops the pipeline
+    std::unique_lock<std::mutex> guard(wake_lock);
+    wake.wait(guard, [this]() { return kicked || !running.load(); });
+    kicked = false;
+  }
+}
@@ -0,0 +1,109 @@
+// Pipelined frame rendering: a producer thread rasterizes into a ring of frame buffers
+// while the GLUT display callback presents the newest finished one.
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+#include "FrameBuffer.h"
+
+#define FRAME_RING_SIZE 3	// one slot being presented, one being rendered, one ready
+
+// One frame buffer of the ring
+struct FrameSlot {
+  std::atomic<uint32_t> sequence;    // odd while the producer is rendering into the slot
+  uint32_t              pad;
+  uint64_t              frame_id;
+  unsigned char         pixels[HEIGHT][WIDTH][3];
+};
+
+class SharedFrameRing;
+
+// Single-producer/single-consumer lock-free queue, used to hand input events
+// from the GLUT thread to the producer thread. N must be a power of two.
+template <typename T, unsigned N>
+class SpscQueue {
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  // Called by the producer side only; returns false when the queue is full
+  bool Push(const T &item)
+  {
+    unsigned t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N) return false;
+    items[t & (N-1)] = item;
+    tail.store(t+1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer side only; returns false when the queue is empty
+  bool Pop(T &item)
+  {
+    unsigned h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return false;
+    item = items[h & (N-1)];
+    head.store(h+1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T                     items[N];
+  std::atomic<unsigned> head;
+  std::atomic<unsigned> tail;
+};
+
+class FramePipeline {
+public:
+  // Runs on the producer thread. Applies pending scene updates and returns true
+  // when the scene changed and a new frame should be rasterized.
+  typedef bool (*UpdateFunc)(void *user);
+  // Runs on the producer thread. Rasterizes the whole scene into "slot".
+  typedef void (*RenderFunc)(FrameSlot &slot, void *user);
+
+  FramePipeline();
+  ~FramePipeline();
+
+  // Moves the ring into the POSIX shared-memory segment "name" so external viewers
+  // can map the frames (see SharedFrameRing.h). Must be called before Start().
+  bool ExportShared(const char *name);
+
+  void Start(UpdateFunc update, RenderFunc render, void *user);
+  void Stop();
+
+  // Wakes the producer thread up (e.g. after queueing input)
+  void Kick();
+
+  // Consumer side (GLUT thread). HasNewFrame() is cheap and can be polled from a timer.
+  bool HasNewFrame() const;
+  const FrameSlot &AcquireLatest();
+
+private:
+  void ProducerLoop();
+  void Publish();
+
+  enum { SLOT_MASK = 0x3, NEW_FRAME = 0x4 };
+
+  FrameSlot         *slots;
+  FrameSlot         *own_slots;  // heap ring, unused while exported
+  SharedFrameRing   *shared;
+  int                back;       // owned by the producer
+  int                front;      // owned by the consumer
+  std::atomic<int>   latest;     // slot index of the newest finished frame | NEW_FRAME
+  std::atomic<bool>  running;
+  std::mutex         wake_lock;
+  std::condition_variable wake;  // notified by Kick() and Stop()
+  bool               kicked;     // guarded by wake_lock
+  uint64_t           frame_count;
+  std::thread        producer;
+
+  UpdateFunc         update_func;
+  RenderFunc         render_func;
+  void              *user_data;
+};
+
+#endif
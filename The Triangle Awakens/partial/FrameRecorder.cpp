@@ -0,0 +1,429 @@
+// Frame-sequence recorder (see FrameRecorder.h)
+
+#include <string.h>
+
+#include "FrameRecorder.h"
+
+#define RECORD_VERSION 1
+
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS  14
+
+static inline void Put32(unsigned char *p, uint32_t v)
+{
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static inline uint32_t Get32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ---- LZ block compression ----
+//
+// A block is a list of sequences: token (literal count << 4 | (match length - 4)),
+// extra literal count bytes, literals, match offset (2 bytes), extra match length
+// bytes. A count of 15 in the token continues in extra bytes, each adding up to 255.
+// The last sequence has literals only.
+
+size_t LzBound(size_t size)
+{
+  return size + size/255 + 16;
+}
+
+static unsigned char *PutLength(unsigned char *op, size_t length)
+{
+  for (length -= 15; length >= 255; length -= 255) *op++ = 255;
+  *op++ = (unsigned char)length;
+  return op;
+}
+
+static unsigned char *PutSequence(unsigned char *op, const unsigned char *literals, size_t literal_count,
+                                  size_t offset, size_t match_length)
+{
+  unsigned char *token = op++;
+  size_t extra = match_length ? match_length - LZ_MIN_MATCH : 0;
+
+  *token = (unsigned char)(((literal_count < 15 ? literal_count : 15) << 4) | (extra < 15 ? extra : 15));
+  if (literal_count >= 15) op = PutLength(op, literal_count);
+  if (literal_count) memcpy(op, literals, literal_count);
+  op += literal_count;
+
+  if (match_length) {
+    *op++ = (unsigned char)offset;
+    *op++ = (unsigned char)(offset >> 8);
+    if (extra >= 15) op = PutLength(op, extra);
+  }
+  return op;
+}
+
+size_t LzCompress(const unsigned char *in, size_t size, unsigned char *out)
+{
+  std::vector<int32_t> table((size_t)1 << LZ_HASH_BITS, -1);    // last position of each 4 byte hash
+  const unsigned char *ip = in, *anchor = in, *end = in + size;
+  unsigned char *op = out;
+
+  while (ip + LZ_MIN_MATCH <= end) {
+    uint32_t sequence;
+    memcpy(&sequence, ip, 4);
+    uint32_t h = (sequence*2654435761u) >> (32 - LZ_HASH_BITS);
+    int32_t ref = table[h];
+    table[h] = (int32_t)(ip - in);
+
+    if (ref >= 0 && (ip - in) - ref <= LZ_MAX_OFFSET && memcmp(in + ref, ip, 4) == 0) {
+      const unsigned char *p = ip + 4, *m = in + ref + 4;
+      while (p < end && *p == *m) {
+        p++;
+        m++;
+      }
+      op = PutSequence(op, anchor, ip - anchor, (ip - in) - ref, p - ip);
+      ip = anchor = p;
+      continue;
+    }
+
+    // Step faster through data that keeps failing to match
+    ip += 1 + ((ip - anchor) >> 6);
+  }
+
+  op = PutSequence(op, anchor, end - anchor, 0, 0);
+  return op - out;
+}
+
+bool LzDecompress(const unsigned char *in, size_t in_size, unsigned char *out, size_t size)
+{
+  const unsigned char *ip = in, *in_end = in + in_size;
+  unsigned char *op = out, *out_end = out + size;
+
+  while (ip < in_end) {
+    unsigned token = *ip++;
+    size_t length = token >> 4;
+    unsigned char b;
+
+    if (length == 15) {
+      do {
+        if (ip >= in_end) return false;
+        b = *ip++;
+        length += b;
+      } while (b == 255);
+    }
+    if (length > (size_t)(in_end - ip) || length > (size_t)(out_end - op)) return false;
+    if (length) memcpy(op, ip, length);
+    op += length;
+    ip += length;
+
+    if (ip == in_end) break;    // the last sequence has no match
+
+    if (in_end - ip < 2) return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - out)) return false;
+
+    length = token & 15;
+    if (length == 15) {
+      do {
+        if (ip >= in_end) return false;
+        b = *ip++;
+        length += b;
+      } while (b == 255);
+    }
+    length += LZ_MIN_MATCH;
+    if (length > (size_t)(out_end - op)) return false;
+
+    // Byte by byte: the match may overlap the bytes it produces (runs)
+    const unsigned char *m = op - offset;
+    for (size_t i = 0; i < length; i++) op[i] = m[i];
+    op += length;
+  }
+  return op == out_end;
+}
+
+// ---- Recorder ----
+
+FrameRecorder::FrameRecorder()
+  : file(NULL), width(0), height(0), tiles_x(0), tiles_y(0), running(false), submitted(false), frame_number(0),
+    frames(0), dropped(0), raw_bytes(0), file_bytes(0), tiles_stored(0), failed(false)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+  Close();
+}
+
+bool FrameRecorder::Open(const char *path, int width, int height)
+{
+  unsigned char header[20];
+  int i;
+
+  if (file) return false;
+
+  file = fopen(path, "wb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  this->width  = width;
+  this->height = height;
+  tiles_x = (width  + RECORD_TILE_SIZE-1)/RECORD_TILE_SIZE;
+  tiles_y = (height + RECORD_TILE_SIZE-1)/RECORD_TILE_SIZE;
+
+  memcpy(header, "FRSQ", 4);
+  Put32(header+4,  RECORD_VERSION);
+  Put32(header+8,  width);
+  Put32(header+12, height);
+  Put32(header+16, RECORD_TILE_SIZE);
+  if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+    perror(path);
+    fclose(file);
+    file = NULL;
+    return false;
+  }
+  file_bytes.store(sizeof(header));
+  failed.store(false);
+
+  buffers.assign((size_t)RECORD_QUEUE_SIZE*width*height*3, 0);
+  previous.assign((size_t)width*height*3, 0);     // playback starts from a black frame too
+  bitmap.resize((tiles_x*tiles_y + 7)/8);
+  frame_number = 0;
+
+  for (i = 0; i < RECORD_QUEUE_SIZE; i++) free_buffers.Push(i);
+
+  running.store(true);
+  encoder = std::thread(&FrameRecorder::EncoderLoop, this);
+  return true;
+}
+
+void FrameRecorder::Close()
+{
+  int index;
+
+  if (!file) return;
+
+  {
+    std::lock_guard<std::mutex> guard(wake_lock);
+    running.store(false);
+  }
+  wake.notify_one();
+  encoder.join();
+  if (fclose(file) != 0 && !failed.load()) {    // the last buffered bytes are written here
+    perror("Frame recording");
+    failed.store(true);
+  }
+  file = NULL;
+
+  while (free_buffers.Pop(index)) {}
+}
+
+bool FrameRecorder::Submit(const FrameView &view)
+{
+  size_t frame_size = (size_t)width*height*3;
+  int index, y;
+
+  if (!file || failed.load(std::memory_order_relaxed)) return false;
+
+  if (!free_buffers.Pop(index)) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  unsigned char *dst = &buffers[index*frame_size];
+  if (view.width == width && view.height >= height) {
+    memcpy(dst, view.pixels, frame_size);
+  } else {
+    memset(dst, 0, frame_size);
+    for (y = 0; y < height && y < view.height; y++) {
+      memcpy(dst + (size_t)y*width*3, PixelAt(view, 0, y), (view.width < width ? view.width : width)*3);
+    }
+  }
+
+  full_buffers.Push(index);
+  {
+    std::lock_guard<std::mutex> guard(wake_lock);
+    submitted = true;
+  }
+  wake.notify_one();
+  return true;
+}
+
+RecorderStats FrameRecorder::Stats() const
+{
+  RecorderStats stats;
+  stats.frames       = frames.load();
+  stats.dropped      = dropped.load();
+  stats.raw_bytes    = raw_bytes.load();
+  stats.file_bytes   = file_bytes.load();
+  stats.tiles_stored = tiles_stored.load();
+  stats.failed       = failed.load();
+  return stats;
+}
+
+void FrameRecorder::EncoderLoop()
+{
+  size_t frame_size = (size_t)width*height*3;
+
+  for (;;) {
+    int index;
+    if (full_buffers.Pop(index)) {
+      // After a failed write, what is still queued is let go unwritten
+      if (!failed.load() && !Encode(&buffers[index*frame_size])) {
+        perror("Frame recording stopped");
+        failed.store(true);
+      }
+      free_buffers.Push(index);
+      continue;
+    }
+
+    // Close() only stops the loop once everything queued has been written
+    if (!running.load()) break;
+
+    // Sleep until Submit() queues a frame; a frame queued since the last check has set "submitted"
+    std::unique_lock<std::mutex> guard(wake_lock);
+    wake.wait(guard, [this]() { return submitted || !running.load(); });
+    submitted = false;
+  }
+}
+
+bool FrameRecorder::Encode(const unsigned char *pixels)
+{
+  bool keyframe = frame_number % RECORD_KEYFRAME_INTERVAL == 0;
+  size_t row_size = (size_t)width*3;
+  uint32_t stored = 0;
+  int tx, ty, y;
+
+  memset(&bitmap[0], 0, bitmap.size());
+  tile_data.clear();
+
+  for (ty = 0; ty < tiles_y; ty++) {
+    int y0 = ty*RECORD_TILE_SIZE;
+    int y1 = y0 + RECORD_TILE_SIZE < height ? y0 + RECORD_TILE_SIZE : height;
+
+    for (tx = 0; tx < tiles_x; tx++) {
+      int x0 = tx*RECORD_TILE_SIZE;
+      int x1 = x0 + RECORD_TILE_SIZE < width ? x0 + RECORD_TILE_SIZE : width;
+      size_t offset = y0*row_size + x0*3, tile_row = (x1-x0)*3;
+      bool changed = keyframe;
+
+      for (y = y0; y < y1 && !changed; y++, offset += row_size) {
+        changed = memcmp(pixels + offset, &previous[offset], tile_row) != 0;
+      }
+      if (!changed) continue;
+
+      int tile = ty*tiles_x + tx;
+      bitmap[tile >> 3] |= (unsigned char)(1 << (tile & 7));
+      stored++;
+
+      for (y = y0, offset = y0*row_size + x0*3; y < y1; y++, offset += row_size) {
+        tile_data.insert(tile_data.end(), pixels + offset, pixels + offset + tile_row);
+        memcpy(&previous[offset], pixels + offset, tile_row);
+      }
+    }
+  }
+
+  packed.resize(LzBound(tile_data.size()));
+  size_t packed_size = tile_data.empty() ? 0 : LzCompress(&tile_data[0], tile_data.size(), &packed[0]);
+
+  unsigned char header[20];
+  Put32(header,    (uint32_t)(12 + bitmap.size() + packed_size));
+  Put32(header+4,  frame_number);
+  Put32(header+8,  keyframe ? RECORD_KEYFRAME : 0);
+  Put32(header+12, (uint32_t)tile_data.size());
+  if (fwrite(header, 1, 16, file) != 16 || fwrite(&bitmap[0], 1, bitmap.size(), file) != bitmap.size() ||
+      (packed_size && fwrite(&packed[0], 1, packed_size, file) != packed_size)) {
+    return false;
+  }
+
+  frame_number++;
+  frames.fetch_add(1, std::memory_order_relaxed);
+  raw_bytes.fetch_add(height*row_size, std::memory_order_relaxed);
+  file_bytes.fetch_add(16 + bitmap.size() + packed_size, std::memory_order_relaxed);
+  tiles_stored.fetch_add(stored, std::memory_order_relaxed);
+  return true;
+}
+
+// ---- Playback ----
+
+bool FrameSequenceReader::Open(const char *path)
+{
+  unsigned char header[20];
+
+  Close();
+  file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "FRSQ", 4) != 0 ||
+      Get32(header+4) != RECORD_VERSION) {
+    printf("%s: not a frame recording\n", path);
+    Close();
+    return false;
+  }
+  uint32_t w = Get32(header+8), h = Get32(header+12), tile = Get32(header+16);
+  if (w < 1 || w > RECORD_MAX_DIMENSION || h < 1 || h > RECORD_MAX_DIMENSION || tile < 1 || tile > RECORD_MAX_DIMENSION) {
+    printf("%s: bad frame size %ux%u or tile size %u\n", path, w, h, tile);
+    Close();
+    return false;
+  }
+  width     = (int)w;
+  height    = (int)h;
+  tile_size = (int)tile;
+  return true;
+}
+
+void FrameSequenceReader::Close()
+{
+  if (file) fclose(file);
+  file = NULL;
+}
+
+bool FrameSequenceReader::ReadFrame(unsigned char *pixels, uint32_t *frame_number)
+{
+  unsigned char size_field[4];
+  int tiles_x, tiles_y, tx, ty, y;
+
+  if (!file || fread(size_field, 1, 4, file) != 4) return false;
+
+  uint32_t record_size = Get32(size_field);
+  size_t frame_size = (size_t)width*height*3;
+  tiles_x = (width  + tile_size-1)/tile_size;
+  tiles_y = (height + tile_size-1)/tile_size;
+  size_t bitmap_size = ((size_t)tiles_x*tiles_y + 7)/8;
+  if (record_size < 12 + bitmap_size || record_size > 12 + bitmap_size + LzBound(frame_size)) return false;
+
+  record.resize(record_size);
+  if (fread(&record[0], 1, record_size, file) != record_size) return false;
+
+  if (frame_number) *frame_number = Get32(&record[0]);
+  uint32_t raw_size = Get32(&record[8]);
+  const unsigned char *bitmap = &record[12];
+  if (raw_size > frame_size) return false;    // stored tiles never add up to more than a frame
+
+  tile_data.resize(raw_size);
+  if (raw_size && !LzDecompress(bitmap + bitmap_size, record_size - 12 - bitmap_size, &tile_data[0], raw_size)) {
+    return false;
+  }
+
+  // Stored tiles, in the order they were written
+  size_t row_size = (size_t)width*3, used = 0;
+  for (ty = 0; ty < tiles_y; ty++) {
+    int y0 = ty*tile_size, y1 = y0 + tile_size < height ? y0 + tile_size : height;
+    for (tx = 0; tx < tiles_x; tx++) {
+      int tile = ty*tiles_x + tx;
+      if (!(bitmap[tile >> 3] & (1 << (tile & 7)))) continue;
+
+      int x0 = tx*tile_size, x1 = x0 + tile_size < width ? x0 + tile_size : width;
+      size_t tile_row = (x1-x0)*3;
+      if (used + (y1-y0)*tile_row > raw_size) return false;
+      for (y = y0; y < y1; y++, used += tile_row) {
+        memcpy(pixels + y*row_size + x0*3, &tile_data[used], tile_row);
+      }
+    }
+  }
+  return used == raw_size;
+}
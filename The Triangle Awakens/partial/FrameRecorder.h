@@ -0,0 +1,126 @@
+// Frame-sequence recorder: captures rendered frames into a compact file for later review
+//
+// Frames are split into RECORD_TILE_SIZE x RECORD_TILE_SIZE tiles and only the tiles
+// that differ from the previous frame are stored, LZ-compressed. Submit() only copies
+// the frame into a free buffer of a small fixed pool; the comparison, compression and
+// file writes happen on a background thread. When every buffer is still waiting to be
+// encoded the frame is dropped (and counted) instead of blocking the renderer.
+// A failed write (disk full, I/O error) is reported once and stops the recording;
+// the frames counted until then were written in full.
+//
+// File layout (all integers little-endian):
+//   header:  "FRSQ", version, width, height, tile size               (5 x uint32)
+//   frames:  record size (uint32, bytes after this field), frame number (uint32),
+//            flags (uint32, RECORD_KEYFRAME), raw size (uint32), tile bitmap
+//            (1 bit per tile, row-major from the bottom, 1 = stored), compressed tiles
+//   A stored tile is its rows, bottom first, clipped to the frame.
+
+#ifndef FRAME_RECORDER_H
+#define FRAME_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "FrameBuffer.h"
+#include "FramePipeline.h"
+
+#define RECORD_TILE_SIZE          16
+#define RECORD_QUEUE_SIZE         8     // frame buffers between the renderer and the encoder (power of two)
+#define RECORD_KEYFRAME_INTERVAL  300   // every Nth frame stores all tiles, so playback can start there
+#define RECORD_KEYFRAME           1     // record flag
+#define RECORD_MAX_DIMENSION      16384 // largest width or height a reader accepts
+
+// LZ77 block compression in the style of LZ4: sequences of literals followed by a
+// match (2 byte offset, length >= 4). Returns the compressed size; "out" must hold
+// LzBound(size) bytes.
+size_t LzBound(size_t size);
+size_t LzCompress(const unsigned char *in, size_t size, unsigned char *out);
+// Returns false on corrupt input or when the output would not be exactly "size" bytes
+bool LzDecompress(const unsigned char *in, size_t in_size, unsigned char *out, size_t size);
+
+struct RecorderStats {
+  uint32_t frames;          // frames written
+  uint32_t dropped;         // frames skipped because the encoder was behind
+  uint64_t raw_bytes;       // 3 bytes per pixel of every written frame
+  uint64_t file_bytes;
+  uint64_t tiles_stored;
+  bool     failed;          // a write failed and the recording stopped there
+};
+
+class FrameRecorder {
+public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+  bool Open(const char *path, int width, int height);
+  void Close();             // encodes what is queued, then closes the file
+  bool IsOpen() const { return file != NULL; }
+
+  // Queues a copy of the frame; returns false when it had to be dropped, or once a
+  // write has failed
+  bool Submit(const FrameView &view);
+
+  RecorderStats Stats() const;
+
+private:
+  void EncoderLoop();
+  bool Encode(const unsigned char *pixels);    // false when the file write failed
+
+  FILE                       *file;
+  int                         width, height;
+  int                         tiles_x, tiles_y;
+  std::vector<unsigned char>  buffers;     // RECORD_QUEUE_SIZE frames
+  SpscQueue<int, RECORD_QUEUE_SIZE> free_buffers;    // renderer pops, encoder pushes
+  SpscQueue<int, RECORD_QUEUE_SIZE> full_buffers;    // renderer pushes, encoder pops
+  std::atomic<bool>           running;
+  std::thread                 encoder;
+  std::mutex                  wake_lock;
+  std::condition_variable     wake;        // notified by Submit() and Close()
+  bool                        submitted;   // guarded by wake_lock
+
+  // Encoder state
+  std::vector<unsigned char>  previous;    // last frame as written
+  std::vector<unsigned char>  tile_data;
+  std::vector<unsigned char>  packed;
+  std::vector<unsigned char>  bitmap;
+  uint32_t                    frame_number;
+
+  std::atomic<uint32_t>       frames;
+  std::atomic<uint32_t>       dropped;
+  std::atomic<uint64_t>       raw_bytes;
+  std::atomic<uint64_t>       file_bytes;
+  std::atomic<uint64_t>       tiles_stored;
+  std::atomic<bool>           failed;
+};
+
+// Plays a recording back frame by frame
+class FrameSequenceReader {
+public:
+  FrameSequenceReader() : file(NULL), width(0), height(0), tile_size(0) {}
+  ~FrameSequenceReader() { Close(); }
+
+  bool Open(const char *path);
+  void Close();
+
+  int Width() const  { return width; }
+  int Height() const { return height; }
+
+  // Decodes the next frame into "pixels" (width*height*3 bytes, holding the previous
+  // frame). Returns false at the end of the file or on a corrupt record.
+  // Open() rejects a header with a tile size below 1, or a width or height outside
+  // 1..RECORD_MAX_DIMENSION.
+  bool ReadFrame(unsigned char *pixels, uint32_t *frame_number);
+
+private:
+  FILE                       *file;
+  int                         width, height, tile_size;
+  std::vector<unsigned char>  record;
+  std::vector<unsigned char>  tile_data;
+};
+
+#endif
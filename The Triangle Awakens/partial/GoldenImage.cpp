@@ -0,0 +1,119 @@
+// Reference images (see GoldenImage.h)
+
+#include <stdio.h>
+
+#include "GoldenImage.h"
+
+bool WritePpm(const char *path, const FrameView &view)
+{
+  FILE *file = fopen(path, "wb");
+  bool ok;
+
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  ok = fprintf(file, "P6\n%d %d\n255\n", view.width, view.height) > 0;
+  for (int y = view.height-1; y >= 0 && ok; y--) {
+    ok = fwrite(PixelAt(view, 0, y), 3, view.width, file) == (size_t)view.width;
+  }
+  if (fclose(file) != 0) ok = false;
+  if (!ok) printf("%s: write failed\n", path);
+  return ok;
+}
+
+bool ReadPpm(const char *path, std::vector<unsigned char> &pixels, int &width, int &height)
+{
+  FILE *file = fopen(path, "rb");
+  int max_value;
+
+  if (!file) return false;
+
+  // The single whitespace byte after the maximum value ends the header
+  if (fscanf(file, "P6 %d %d %d", &width, &height, &max_value) != 3 || max_value != 255 ||
+      width <= 0 || height <= 0 || fgetc(file) == EOF) {
+    printf("%s: not a binary 8 bit PPM\n", path);
+    fclose(file);
+    return false;
+  }
+
+  pixels.resize((size_t)width*height*3);
+  FrameView view = { &pixels[0], width, height };
+  for (int y = height-1; y >= 0; y--) {
+    if (fread(PixelAt(view, 0, y), 3, width, file) != (size_t)width) {
+      printf("%s: truncated\n", path);
+      fclose(file);
+      return false;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static int LargestDifference(const unsigned char *a, const unsigned char *b)
+{
+  int largest = 0;
+  for (int c = 0; c < 3; c++) {
+    int d = a[c] - b[c];
+    if (d < 0) d = -d;
+    if (d > largest) largest = d;
+  }
+  return largest;
+}
+
+// True when the reference pixel at (x, y) has a neighbour more than "edge_tolerance" away
+// from it
+static bool OnEdge(const unsigned char *reference, int width, int height, int x, int y, int edge_tolerance)
+{
+  const unsigned char *center = reference + ((size_t)y*width + x)*3;
+
+  for (int ny = y-1; ny <= y+1; ny++) {
+    for (int nx = x-1; nx <= x+1; nx++) {
+      if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+      if (LargestDifference(reference + ((size_t)ny*width + nx)*3, center) > edge_tolerance) return true;
+    }
+  }
+  return false;
+}
+
+// True when the pixel's value is within "edge_tolerance" of a reference neighbour across
+// the edge at (x, y), i.e. the coverage decision moved by at most one pixel
+static bool CoverageMoved(const unsigned char *reference, int width, int height, int x, int y,
+                          const unsigned char *value, int edge_tolerance)
+{
+  const unsigned char *center = reference + ((size_t)y*width + x)*3;
+
+  for (int ny = y-1; ny <= y+1; ny++) {
+    for (int nx = x-1; nx <= x+1; nx++) {
+      if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+      const unsigned char *neighbour = reference + ((size_t)ny*width + nx)*3;
+      if (LargestDifference(neighbour, center) > edge_tolerance &&
+          LargestDifference(neighbour, value) <= edge_tolerance) return true;
+    }
+  }
+  return false;
+}
+
+ImageDiff CompareImages(const FrameView &view, const unsigned char *reference, int tolerance, int edge_tolerance)
+{
+  ImageDiff diff = { 0, 0, 0, 0, 0, 0 };
+
+  for (int y = 0; y < view.height; y++) {
+    for (int x = 0; x < view.width; x++) {
+      const unsigned char *value = PixelAt(view, x, y);
+      int largest = LargestDifference(value, reference + ((size_t)y*view.width + x)*3);
+      bool edge = OnEdge(reference, view.width, view.height, x, y, edge_tolerance);
+
+      if (edge) diff.edge_pixels++;
+      if (largest > diff.max_difference) diff.max_difference = largest;
+      if (largest == 0) continue;
+      diff.differing++;
+      if (largest <= tolerance) continue;
+      diff.over_tolerance++;
+      if (edge && CoverageMoved(reference, view.width, view.height, x, y, value, edge_tolerance)) diff.on_edge++;
+      else diff.off_edge++;
+    }
+  }
+  return diff;
+}
@@ -0,0 +1,36 @@
+// Reference images for the golden-image tests of the raster paths
+//
+// References are binary PPM files (P6, 8 bits per channel), which any image viewer
+// opens. PPM stores the top row first; FrameView stores the bottom row first, so
+// rows are flipped on the way in and out.
+
+#ifndef GOLDEN_IMAGE_H
+#define GOLDEN_IMAGE_H
+
+#include <vector>
+
+#include "FrameBuffer.h"
+
+bool WritePpm(const char *path, const FrameView &view);
+
+// Reads a PPM into "pixels" (FrameView layout); returns false if it is missing or not a P6 file
+bool ReadPpm(const char *path, std::vector<unsigned char> &pixels, int &width, int &height);
+
+struct ImageDiff {
+  int  max_difference;      // largest channel difference over the image
+  long differing;           // pixels with any difference
+  long over_tolerance;      // pixels with a channel difference above the tolerance
+  long on_edge;             // ... of which a coverage difference on an edge of the reference
+  long off_edge;            // ... of which anything else
+  long edge_pixels;         // pixels on an edge of the reference
+};
+
+// Compares a rendered frame with reference pixels of the same size. Along triangle
+// edges, raster paths may legitimately disagree about coverage by a pixel. A reference
+// pixel is on an edge when one of its 8 neighbours differs from it by more than
+// "edge_tolerance" (a color discontinuity, not a gradient); a pixel over the tolerance
+// counts as on an edge only there, and only when its value is within "edge_tolerance" of
+// one of those neighbours, i.e. the coverage decision moved by one pixel.
+ImageDiff CompareImages(const FrameView &view, const unsigned char *reference, int tolerance, int edge_tolerance);
+
+#endif
@@ -0,0 +1,166 @@
+// Micro-triangle fast path (see MicroTriangle.h)
+//
+// Each candidate row holds at most four pixel positions, which map onto the four
+// lanes of an SSE register. A pixel is covered when its three edge functions are
+// all non-negative (after normalizing for winding order), and the same edge
+// functions divided by the triangle area are its barycentric weights, so color
+// interpolation needs a single reciprocal instead of per-edge slopes.
+
+#include "MicroTriangle.h"
+#include "CpuFeatures.h"
+
+// The SIMD kernel is built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define MICRO_TRIANGLE_SSE2
+#endif
+
+// Edge function of the edge (xa, ya) -> (xb, yb), written as e(x, y) = a*x + b*y + c
+struct EdgeFunc {
+  float a, b, c;
+};
+
+static EdgeFunc MakeEdge(int xa, int ya, int xb, int yb)
+{
+  EdgeFunc e;
+  e.a = (float)-(yb-ya);
+  e.b = (float)(xb-xa);
+  e.c = (float)((yb-ya)*xa - (xb-xa)*ya);
+  return e;
+}
+
+// Everything the coverage kernels need, set up once per triangle
+struct MicroSetup {
+  EdgeFunc e0, e1, e2;          // edge i weighs vertex i
+  float sign, inv_area;         // winding of the vertices, 1 / twice the signed area
+  int x_min, x_max, y_min, y_max;   // candidate box, clipped to the frame
+  float r[3], g[3], b[3];       // vertex colors
+};
+
+typedef void (*MicroKernel)(const FrameView &view, const MicroSetup &t);
+
+// The scalar kernel groups its sums the way the SSE2 one does, so both round alike
+static void CoverMicroTriangle_Scalar(const FrameView &view, const MicroSetup &t)
+{
+  for (int y = t.y_min; y <= t.y_max; y++) {
+    for (int x = t.x_min; x <= t.x_max; x++) {
+      float w0 = t.e0.a*x + (t.e0.b*y + t.e0.c);
+      float w1 = t.e1.a*x + (t.e1.b*y + t.e1.c);
+      float w2 = t.e2.a*x + (t.e2.b*y + t.e2.c);
+
+      if (!(w0*t.sign >= 0) || !(w1*t.sign >= 0) || !(w2*t.sign >= 0)) continue;
+
+      w0 *= t.inv_area;
+      w1 *= t.inv_area;
+      w2 *= t.inv_area;
+
+      unsigned char *p = PixelAt(view, x, y);
+      p[0] = (unsigned char)((w0*t.r[0] + w1*t.r[1]) + (w2*t.r[2] + 0.5f));
+      p[1] = (unsigned char)((w0*t.g[0] + w1*t.g[1]) + (w2*t.g[2] + 0.5f));
+      p[2] = (unsigned char)((w0*t.b[0] + w1*t.b[1]) + (w2*t.b[2] + 0.5f));
+    }
+  }
+}
+
+#ifdef MICRO_TRIANGLE_SSE2
+// One candidate row per step, its (at most four) pixels in the four lanes
+CPU_TARGET("sse2")
+static void CoverMicroTriangle_SSE2(const FrameView &view, const MicroSetup &t)
+{
+  const __m128 xs    = _mm_add_ps(_mm_set1_ps((float)t.x_min), _mm_setr_ps(0, 1, 2, 3));
+  const __m128 zero  = _mm_setzero_ps();
+  const __m128 half  = _mm_set1_ps(0.5f);
+  const __m128 vsign = _mm_set1_ps(t.sign);
+  const __m128 vinv  = _mm_set1_ps(t.inv_area);
+  const __m128 lanes = _mm_cmple_ps(xs, _mm_set1_ps((float)t.x_max));   // lanes inside the box
+
+  const __m128 e0_ax = _mm_mul_ps(_mm_set1_ps(t.e0.a), xs);
+  const __m128 e1_ax = _mm_mul_ps(_mm_set1_ps(t.e1.a), xs);
+  const __m128 e2_ax = _mm_mul_ps(_mm_set1_ps(t.e2.a), xs);
+
+  for (int y = t.y_min; y <= t.y_max; y++) {
+    __m128 w0 = _mm_add_ps(e0_ax, _mm_set1_ps(t.e0.b*y + t.e0.c));
+    __m128 w1 = _mm_add_ps(e1_ax, _mm_set1_ps(t.e1.b*y + t.e1.c));
+    __m128 w2 = _mm_add_ps(e2_ax, _mm_set1_ps(t.e2.b*y + t.e2.c));
+
+    // Coverage: all three edge functions non-negative once the winding is normalized
+    __m128 inside = _mm_and_ps(lanes, _mm_cmpge_ps(_mm_mul_ps(w0, vsign), zero));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_mul_ps(w1, vsign), zero));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_mul_ps(w2, vsign), zero));
+
+    int mask = _mm_movemask_ps(inside);
+    if (mask == 0) continue;
+
+    // Barycentric weights -> Gouraud color, rounded like FillScanLine does
+    w0 = _mm_mul_ps(w0, vinv);
+    w1 = _mm_mul_ps(w1, vinv);
+    w2 = _mm_mul_ps(w2, vinv);
+
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(t.r[0])), _mm_mul_ps(w1, _mm_set1_ps(t.r[1]))),
+                          _mm_add_ps(_mm_mul_ps(w2, _mm_set1_ps(t.r[2])), half));
+    __m128 g = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(t.g[0])), _mm_mul_ps(w1, _mm_set1_ps(t.g[1]))),
+                          _mm_add_ps(_mm_mul_ps(w2, _mm_set1_ps(t.g[2])), half));
+    __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(t.b[0])), _mm_mul_ps(w1, _mm_set1_ps(t.b[1]))),
+                          _mm_add_ps(_mm_mul_ps(w2, _mm_set1_ps(t.b[2])), half));
+
+    int ri[4], gi[4], bi[4];
+    _mm_storeu_si128((__m128i *)ri, _mm_cvttps_epi32(r));
+    _mm_storeu_si128((__m128i *)gi, _mm_cvttps_epi32(g));
+    _mm_storeu_si128((__m128i *)bi, _mm_cvttps_epi32(b));
+
+    for (int i = 0; i < 4; i++) {
+      if (mask & (1 << i)) {
+        unsigned char *p = PixelAt(view, t.x_min+i, y);
+        p[0] = (unsigned char)ri[i];
+        p[1] = (unsigned char)gi[i];
+        p[2] = (unsigned char)bi[i];
+      }
+    }
+  }
+}
+#endif
+
+static MicroKernel SelectMicroKernel()
+{
+#ifdef MICRO_TRIANGLE_SSE2
+  if (CpuFeatures() & CPU_SSE2) return CoverMicroTriangle_SSE2;
+#endif
+  return CoverMicroTriangle_Scalar;
+}
+
+void ScanConvertMicroTriangle(
+  const FrameView &view,
+  int x0, int y0, int r0, int g0, int b0,
+  int x1, int y1, int r1, int g1, int b1,
+  int x2, int y2, int r2, int g2, int b2)
+{
+  static const MicroKernel cover = SelectMicroKernel();
+  int area = (x1-x0)*(y2-y0) - (y1-y0)*(x2-x0);    // twice the signed area
+  MicroSetup t;
+
+  if (area == 0) return;    // degenerate triangles cover no pixels
+
+  // The edge opposite each vertex, so that edge i weighs vertex i
+  t.e0 = MakeEdge(x1, y1, x2, y2);
+  t.e1 = MakeEdge(x2, y2, x0, y0);
+  t.e2 = MakeEdge(x0, y0, x1, y1);
+  t.sign     = area > 0 ? 1.0f : -1.0f;
+  t.inv_area = 1.0f/area;
+
+  t.x_min = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+  t.x_max = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+  t.y_min = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+  t.y_max = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+
+  // Clip the candidate box to the frame
+  if (t.x_min < 0) t.x_min = 0;
+  if (t.y_min < 0) t.y_min = 0;
+  if (t.x_max > view.width-1)  t.x_max = view.width-1;
+  if (t.y_max > view.height-1) t.y_max = view.height-1;
+  if (t.x_min > t.x_max || t.y_min > t.y_max) return;
+
+  t.r[0] = (float)r0; t.r[1] = (float)r1; t.r[2] = (float)r2;
+  t.g[0] = (float)g0; t.g[1] = (float)g1; t.g[2] = (float)g2;
+  t.b[0] = (float)b0; t.b[1] = (float)b1; t.b[2] = (float)b2;
+
+  cover(view, t);
+}
@@ -0,0 +1,37 @@
+// Micro-triangle fast path for triangles that cover only a few pixels
+//
+// Dense meshes produce many triangles whose bounding box spans a handful of pixels.
+// For those, the slope setup of ScanConvertTriangle costs more than the pixels
+// themselves, so they are sent to a kernel that tests the few candidate pixel
+// positions directly against the three edge functions.
+
+#ifndef MICRO_TRIANGLE_H
+#define MICRO_TRIANGLE_H
+
+#include "FrameBuffer.h"
+
+// Triangles whose bounding box is smaller than this (in pixels, both axes) take the fast path
+#ifndef MICRO_TRIANGLE_SIZE
+#define MICRO_TRIANGLE_SIZE 4
+#endif
+
+inline bool IsMicroTriangle(int x0, int y0, int x1, int y1, int x2, int y2)
+{
+  int y_min = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+  int y_max = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+  int x_min = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+  int x_max = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+
+  return x_max - x_min < MICRO_TRIANGLE_SIZE && y_max - y_min < MICRO_TRIANGLE_SIZE;
+}
+
+// Fills a triangle with a bounding box of at most MICRO_TRIANGLE_SIZE x MICRO_TRIANGLE_SIZE
+// pixels. Covers the same pixels as ScanConvertTriangle: every integer (x, y) inside the
+// triangle or on its edges, with Gouraud interpolated colors. Vertices may come in any order.
+void ScanConvertMicroTriangle(
+  const FrameView &view,
+  int x0, int y0, int r0, int g0, int b0,
+  int x1, int y1, int r1, int g1, int b1,
+  int x2, int y2, int r2, int g2, int b2);
+
+#endif
@@ -0,0 +1,469 @@
+// Bezier path filling with area coverage (see PathFill.h)
+//
+// A line segment crossing row y adds, to the cells of that row, the change in
+// coverage it causes from one pixel to the next: the area between the segment and
+// the right edge of each pixel it passes through, signed by its vertical direction.
+// Summing the cells from left to right then gives each pixel's covered area, and
+// everything right of the outline sums back to zero.
+
+#include <math.h>
+#include <string.h>
+
+#include "PathFill.h"
+#include "CpuFeatures.h"
+
+// The SIMD kernel is built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define PATH_SSE2
+#endif
+
+#define MAX_CURVE_SEGMENTS 256   // upper bound on the flattening of a single curve
+
+void Path::Clear()
+{
+  commands.clear();
+  points.clear();
+}
+
+void Path::MoveTo(float x, float y)
+{
+  PolyPoint p = { x, y };
+  commands.push_back(MOVE_TO);
+  points.push_back(p);
+}
+
+// Drawing commands before the first MoveTo start at (0, 0)
+void Path::LineTo(float x, float y)
+{
+  PolyPoint p = { x, y };
+  if (commands.empty()) MoveTo(0, 0);
+  commands.push_back(LINE_TO);
+  points.push_back(p);
+}
+
+void Path::QuadTo(float cx, float cy, float x, float y)
+{
+  PolyPoint c = { cx, cy }, p = { x, y };
+  if (commands.empty()) MoveTo(0, 0);
+  commands.push_back(QUAD_TO);
+  points.push_back(c);
+  points.push_back(p);
+}
+
+void Path::CubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y)
+{
+  PolyPoint c1 = { c1x, c1y }, c2 = { c2x, c2y }, p = { x, y };
+  if (commands.empty()) MoveTo(0, 0);
+  commands.push_back(CUBIC_TO);
+  points.push_back(c1);
+  points.push_back(c2);
+  points.push_back(p);
+}
+
+void Path::Close()
+{
+  if (!commands.empty()) commands.push_back(CLOSE);
+}
+
+// FNV-1a over the commands and the bit patterns of the points
+uint64_t Path::Hash() const
+{
+  uint64_t h = 14695981039346656037ull;
+  size_t i;
+
+  for (i = 0; i < commands.size(); i++) {
+    h = (h ^ commands[i])*1099511628211ull;
+  }
+  for (i = 0; i < points.size(); i++) {
+    uint32_t bits[2];
+    memcpy(&bits[0], &points[i].x, 4);
+    memcpy(&bits[1], &points[i].y, 4);
+    h = (h ^ bits[0])*1099511628211ull;
+    h = (h ^ bits[1])*1099511628211ull;
+  }
+  return h;
+}
+
+bool Path::operator==(const Path &other) const
+{
+  if (commands != other.commands || points.size() != other.points.size()) return false;
+  for (size_t i = 0; i < points.size(); i++) {
+    if (points[i].x != other.points[i].x || points[i].y != other.points[i].y) return false;
+  }
+  return true;
+}
+
+// Adds a line segment given in accumulation coordinates
+void PathRasterizer::AddLine(PolyPoint p0, PolyPoint p1)
+{
+  float dir = 1, dxdy, x;
+  int y, y_first, y_last, i;
+
+  if (p0.y == p1.y) return;     // horizontal segments enclose no area
+  if (p0.y > p1.y) {            // walk upwards, remember the direction in the sign
+    PolyPoint t = p0; p0 = p1; p1 = t;
+    dir = -1;
+  }
+
+  dxdy    = (p1.x - p0.x)/(p1.y - p0.y);
+  y_first = (int)floorf(p0.y);
+  y_last  = (int)ceilf(p1.y) - 1;
+  if (y_first < 0) y_first = 0;
+  if (y_last > height-1) y_last = height-1;
+
+  x = p0.x;
+  if (y_first > p0.y) x += (y_first - p0.y)*dxdy;
+
+  for (y = y_first; y <= y_last; y++) {
+    float dy     = fminf((float)(y+1), p1.y) - fmaxf((float)y, p0.y);
+    float x_next = x + dxdy*dy;
+    float d      = dy*dir;
+    float xa     = fminf(x, x_next), xb = fmaxf(x, x_next);
+    float *row   = &cells[(size_t)y*stride];
+    int xa_i, xb_i;
+
+    // Rounding can push x a hair outside the bounds the area was sized for
+    if (xa < 0) xa = 0;
+    if (xb > width) xb = (float)width;
+    if (xb < xa) xb = xa;
+    xa_i = (int)floorf(xa);
+    xb_i = (int)ceilf(xb);
+
+    if (xb_i <= xa_i + 1) {
+      // Within one pixel column: the column gets the area right of the segment,
+      // the next one the rest of the full-height step
+      float xm = 0.5f*(xa + xb) - xa_i;
+      row[xa_i]   += d - d*xm;
+      row[xa_i+1] += d*xm;
+      xb_i = xa_i + 1;
+    } else {
+      // Across several columns: the coverage ramps up linearly (in x) from xa to xb
+      float s    = 1/(xb - xa);
+      float xa_f = xa - xa_i;
+      float xb_f = xb - xb_i + 1;
+      float a0   = 0.5f*s*(1 - xa_f)*(1 - xa_f);   // triangle in the first column
+      float am   = 0.5f*s*xb_f*xb_f;               // triangle in the last column
+
+      row[xa_i] += d*a0;
+      if (xb_i == xa_i + 2) {
+        row[xa_i+1] += d*(1 - a0 - am);
+      } else {
+        float a1 = s*(1.5f - xa_f);
+        float a2 = a1 + (xb_i - xa_i - 3)*s;
+        row[xa_i+1] += d*(a1 - a0);
+        for (i = xa_i+2; i < xb_i-1; i++) row[i] += d*s;
+        row[xb_i-1] += d*(1 - a2 - am);
+      }
+      row[xb_i] += d*am;
+    }
+
+    if (xa_i < row_min[y]) row_min[y] = xa_i;
+    if (xb_i > row_max[y]) row_max[y] = xb_i;
+    x = x_next;
+  }
+}
+
+// Curves are cut into n chords, n chosen so that no chord strays more than
+// FLATTEN_TOLERANCE from the curve: for a parameter step h the error is at most
+// |B''|*h*h/8, with |B''| = 2|p0-2p1+p2| for a quadratic and at most
+// 6*max(|p0-2p1+p2|, |p1-2p2+p3|) for a cubic.
+
+static int CurveSegments(float error_bound_at_h1)
+{
+  int n = (int)ceilf(sqrtf(error_bound_at_h1/FLATTEN_TOLERANCE));
+  return n < 1 ? 1 : (n > MAX_CURVE_SEGMENTS ? MAX_CURVE_SEGMENTS : n);
+}
+
+void PathRasterizer::AddQuad(PolyPoint p0, PolyPoint p1, PolyPoint p2)
+{
+  float ddx = p0.x - 2*p1.x + p2.x, ddy = p0.y - 2*p1.y + p2.y;
+  int n = CurveSegments(0.25f*sqrtf(ddx*ddx + ddy*ddy));
+  PolyPoint prev = p0;
+
+  for (int i = 1; i < n; i++) {
+    float t = (float)i/n, mt = 1-t;
+    PolyPoint q = { mt*mt*p0.x + 2*mt*t*p1.x + t*t*p2.x,
+                    mt*mt*p0.y + 2*mt*t*p1.y + t*t*p2.y };
+    AddLine(prev, q);
+    prev = q;
+  }
+  AddLine(prev, p2);
+}
+
+void PathRasterizer::AddCubic(PolyPoint p0, PolyPoint p1, PolyPoint p2, PolyPoint p3)
+{
+  float ax = p0.x - 2*p1.x + p2.x, ay = p0.y - 2*p1.y + p2.y;
+  float bx = p1.x - 2*p2.x + p3.x, by = p1.y - 2*p2.y + p3.y;
+  int n = CurveSegments(0.75f*sqrtf(fmaxf(ax*ax + ay*ay, bx*bx + by*by)));
+  PolyPoint prev = p0;
+
+  for (int i = 1; i < n; i++) {
+    float t = (float)i/n, mt = 1-t;
+    float w0 = mt*mt*mt, w1 = 3*mt*mt*t, w2 = 3*mt*t*t, w3 = t*t*t;
+    PolyPoint q = { w0*p0.x + w1*p1.x + w2*p2.x + w3*p3.x,
+                    w0*p0.y + w1*p1.y + w2*p2.y + w3*p3.y };
+    AddLine(prev, q);
+    prev = q;
+  }
+  AddLine(prev, p3);
+}
+
+// Prefix sum of the cells i..end of one row into coverage bytes (out has "width"
+// bytes). The cells are cleared on the way, so the row is all zeros again for the
+// next path.
+typedef void (*ResolveRowKernel)(float *row, unsigned char *out, int i, int end, int width);
+
+static void ResolveRow_Scalar(float *row, unsigned char *out, int i, int end, int width)
+{
+  float acc = 0;
+
+  for (; i <= end; i++) {
+    acc += row[i];
+    row[i] = 0;
+    if (i < width) {
+      float a = fminf(fabsf(acc), 1.0f);
+      out[i] = (unsigned char)(a*255 + 0.5f);
+    }
+  }
+}
+
+#ifdef PATH_SSE2
+// 4 cells per step; reads and clears up to 3 cells past "end", which the row padding allows
+CPU_TARGET("sse2")
+static void ResolveRow_SSE2(float *row, unsigned char *out, int i, int end, int width)
+{
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  const __m128 one      = _mm_set1_ps(1.0f);
+  const __m128 scale    = _mm_set1_ps(255.0f);
+  const __m128 half     = _mm_set1_ps(0.5f);
+  __m128 acc = _mm_setzero_ps();
+
+  for (; i <= end; i += 4) {
+    // In-register prefix sum of 4 cells, plus the running total from the left
+    __m128 v = _mm_loadu_ps(row+i);
+    v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+    v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+    v = _mm_add_ps(v, acc);
+    acc = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+    _mm_storeu_ps(row+i, _mm_setzero_ps());
+
+    __m128 a = _mm_min_ps(_mm_and_ps(v, abs_mask), one);
+    __m128i a32 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a, scale), half));
+    __m128i a16 = _mm_packs_epi32(a32, a32);
+    int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(a16, a16));
+
+    if (i+4 <= width) {
+      memcpy(out+i, &bytes, 4);
+    } else if (i < width) {
+      memcpy(out+i, &bytes, width-i);
+    }
+  }
+}
+#endif
+
+static ResolveRowKernel SelectResolveRow()
+{
+#ifdef PATH_SSE2
+  if (CpuFeatures() & CPU_SSE2) return ResolveRow_SSE2;
+#endif
+  return ResolveRow_Scalar;
+}
+
+// Resolves every touched row, with the widest kernel the CPU supports
+void PathRasterizer::Resolve(CoverageMask &mask)
+{
+  static const ResolveRowKernel resolve_row = SelectResolveRow();
+
+  for (int y = 0; y < height; y++) {
+    if (row_max[y] < row_min[y]) continue;    // no outline crossed this row
+    resolve_row(&cells[(size_t)y*stride], &mask.alpha[(size_t)y*width], row_min[y], row_max[y], width);
+  }
+}
+
+void PathRasterizer::Rasterize(const Path &path, float dx, float dy, CoverageMask &mask)
+{
+  const std::vector<PolyPoint> &pts = path.points;
+  float x_min = 1e30f, y_min = 1e30f, x_max = -1e30f, y_max = -1e30f;
+  size_t c, k;
+
+  mask.x = mask.y = mask.width = mask.height = 0;
+  mask.alpha.clear();
+  if (pts.empty()) return;
+
+  // The control points bound the curves, so their box bounds the whole shape
+  for (k = 0; k < pts.size(); k++) {
+    x_min = fminf(x_min, pts[k].x + dx);
+    y_min = fminf(y_min, pts[k].y + dy);
+    x_max = fmaxf(x_max, pts[k].x + dx);
+    y_max = fmaxf(y_max, pts[k].y + dy);
+  }
+  mask.x      = (int)floorf(x_min);
+  mask.y      = (int)floorf(y_min);
+  mask.width  = (int)ceilf(x_max) - mask.x;
+  mask.height = (int)ceilf(y_max) - mask.y;
+  if (mask.width  < 1) mask.width  = 1;
+  if (mask.height < 1) mask.height = 1;
+  mask.alpha.assign((size_t)mask.width*mask.height, 0);
+
+  // Cells reach one past the last pixel, plus room for the 4-wide resolve
+  width    = mask.width;
+  height   = mask.height;
+  stride   = width + 8;
+  origin_x = mask.x - dx;
+  origin_y = mask.y - dy;
+  if (cells.size() < (size_t)stride*height) cells.resize((size_t)stride*height);
+  row_min.assign(height, stride);
+  row_max.assign(height, -1);
+
+  #define LOCAL(p) PolyPoint p; p.x = pts[k].x - origin_x; p.y = pts[k].y - origin_y; k++;
+
+  PolyPoint start = { 0, 0 }, cur = { 0, 0 };
+  bool open = false;
+  for (c = 0, k = 0; c < path.commands.size(); c++) {
+    switch (path.commands[c]) {
+      case Path::MOVE_TO: {
+        LOCAL(p);
+        if (open) AddLine(cur, start);
+        start = cur = p;
+        open = true;
+        break;
+      }
+      case Path::LINE_TO: {
+        LOCAL(p);
+        AddLine(cur, p);
+        cur = p;
+        open = true;
+        break;
+      }
+      case Path::QUAD_TO: {
+        LOCAL(p1);
+        LOCAL(p2);
+        AddQuad(cur, p1, p2);
+        cur = p2;
+        open = true;
+        break;
+      }
+      case Path::CUBIC_TO: {
+        LOCAL(p1);
+        LOCAL(p2);
+        LOCAL(p3);
+        AddCubic(cur, p1, p2, p3);
+        cur = p3;
+        open = true;
+        break;
+      }
+      case Path::CLOSE:
+        if (open) AddLine(cur, start);
+        cur = start;
+        open = false;
+        break;
+    }
+  }
+  if (open) AddLine(cur, start);
+
+  #undef LOCAL
+
+  Resolve(mask);
+}
+
+void PathCache::Clear()
+{
+  lru.clear();
+  index.clear();
+  bytes = 0;
+}
+
+const CoverageMask &PathCache::Get(const Path &path, float x, float y, int &mask_x, int &mask_y)
+{
+  // Integer part of the position is applied when drawing, the fraction is part of the key
+  int ix = (int)floorf(x), iy = (int)floorf(y);
+  int phase_x = (int)((x - ix)*4 + 0.5f), phase_y = (int)((y - iy)*4 + 0.5f);
+  if (phase_x == 4) { ix++; phase_x = 0; }
+  if (phase_y == 4) { iy++; phase_y = 0; }
+
+  uint64_t key = path.Hash() ^ ((uint64_t)(phase_x*4 + phase_y + 1)*0x9E3779B97F4A7C15ull);
+  std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator found = index.find(key);
+
+  if (found != index.end()) {
+    Entry &e = *found->second;
+    if (e.phase_x == phase_x && e.phase_y == phase_y && e.path == path) {
+      lru.splice(lru.begin(), lru, found->second);
+      mask_x = ix + e.mask.x;
+      mask_y = iy + e.mask.y;
+      return e.mask;
+    }
+    // A different shape with the same key: replace it
+    bytes -= sizeof(Entry) + e.mask.alpha.size();
+    lru.erase(found->second);
+    index.erase(found);
+  }
+
+  lru.push_front(Entry());
+  Entry &e = lru.front();
+  e.key     = key;
+  e.path    = path;
+  e.phase_x = phase_x;
+  e.phase_y = phase_y;
+  rasterizer.Rasterize(path, phase_x*0.25f, phase_y*0.25f, e.mask);
+  index[key] = lru.begin();
+  bytes += sizeof(Entry) + e.mask.alpha.size();
+
+  while (bytes > max_bytes && lru.size() > 1) {
+    Entry &old = lru.back();
+    bytes -= sizeof(Entry) + old.mask.alpha.size();
+    index.erase(old.key);
+    lru.pop_back();
+  }
+
+  mask_x = ix + e.mask.x;
+  mask_y = iy + e.mask.y;
+  return e.mask;
+}
+
+static inline unsigned MulDiv255(unsigned v, unsigned a)
+{
+  unsigned t = v*a + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+void FillMask(const FrameView &view, const CoverageMask &mask, int x, int y, const unsigned char rgb[3])
+{
+  int i0 = x < 0 ? -x : 0, i1 = mask.width;
+  int j0 = y < 0 ? -y : 0, j1 = mask.height;
+  if (x + i1 > view.width)  i1 = view.width - x;
+  if (y + j1 > view.height) j1 = view.height - y;
+
+  for (int j = j0; j < j1; j++) {
+    const unsigned char *a = &mask.alpha[(size_t)j*mask.width];
+    unsigned char *p = PixelAt(view, x+i0, y+j);
+
+    for (int i = i0; i < i1; i++, p += 3) {
+      unsigned c = a[i];
+      if (c == 0) continue;
+      if (c == 255) {         // the inside of a shape is mostly fully covered
+        p[0] = rgb[0];
+        p[1] = rgb[1];
+        p[2] = rgb[2];
+        continue;
+      }
+      p[0] = (unsigned char)(MulDiv255(rgb[0], c) + MulDiv255(p[0], 255-c));
+      p[1] = (unsigned char)(MulDiv255(rgb[1], c) + MulDiv255(p[1], 255-c));
+      p[2] = (unsigned char)(MulDiv255(rgb[2], c) + MulDiv255(p[2], 255-c));
+    }
+  }
+}
+
+void FillPath(const FrameView &view, const Path &path, float x, float y, const unsigned char rgb[3],
+              PathCache *cache)
+{
+  if (cache) {
+    int mask_x, mask_y;
+    const CoverageMask &mask = cache->Get(path, x, y, mask_x, mask_y);
+    FillMask(view, mask, mask_x, mask_y, rgb);
+  } else {
+    PathRasterizer rasterizer;
+    CoverageMask mask;
+    rasterizer.Rasterize(path, x, y, mask);
+    FillMask(view, mask, mask.x, mask.y, rgb);
+  }
+}
@@ -0,0 +1,124 @@
+// Filled paths made of lines and quadratic/cubic Bezier segments, with
+// anti-aliased (area coverage) edges
+//
+// Each outline segment adds its exact signed area to a per-row accumulation buffer;
+// a prefix sum along each row then turns those deltas into the covered fraction of
+// every pixel. Curves are flattened to line segments within FLATTEN_TOLERANCE of the
+// true curve on the fly, so no triangles are ever produced. Rasterized shapes can be
+// kept in a PathCache and reused wherever the same shape is drawn again, at the cost
+// of snapping its position to the nearest quarter pixel.
+
+#ifndef PATH_FILL_H
+#define PATH_FILL_H
+
+#include <list>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "FrameBuffer.h"
+#include "PolygonFill.h"
+
+#ifndef FLATTEN_TOLERANCE
+#define FLATTEN_TOLERANCE 0.02f  // largest distance (pixels) between a curve and its flattening
+#endif
+
+class Path {
+public:
+  void Clear();
+
+  // Coordinates are in frame pixels: pixel (x, y) is the unit square [x, x+1) x [y, y+1)
+  void MoveTo(float x, float y);
+  void LineTo(float x, float y);
+  void QuadTo(float cx, float cy, float x, float y);
+  void CubicTo(float c1x, float c1y, float c2x, float c2y, float x, float y);
+  void Close();   // subpaths are also closed implicitly by the next MoveTo and at the end
+
+  bool Empty() const { return commands.empty(); }
+
+  // Identifies the shape for PathCache; equal paths give equal hashes
+  uint64_t Hash() const;
+  bool operator==(const Path &other) const;
+
+private:
+  friend class PathRasterizer;
+
+  enum Command { MOVE_TO, LINE_TO, QUAD_TO, CUBIC_TO, CLOSE };
+
+  std::vector<unsigned char> commands;
+  std::vector<PolyPoint>     points;    // 1 point per MOVE_TO/LINE_TO, 2 per QUAD_TO, 3 per CUBIC_TO
+};
+
+// Rasterized shape: one coverage byte per pixel (0..255), bottom row first.
+// (x, y) is where the mask's lower-left pixel goes relative to the path origin.
+struct CoverageMask {
+  int                        x, y;
+  int                        width, height;
+  std::vector<unsigned char> alpha;
+};
+
+class PathRasterizer {
+public:
+  PathRasterizer() : width(0), height(0), stride(0), origin_x(0), origin_y(0) {}
+
+  // Rasterizes the path moved by (dx, dy). Coverage uses the nonzero rule,
+  // saturated at full coverage where outlines overlap.
+  void Rasterize(const Path &path, float dx, float dy, CoverageMask &mask);
+
+private:
+  void AddLine(PolyPoint p0, PolyPoint p1);
+  void AddQuad(PolyPoint p0, PolyPoint p1, PolyPoint p2);
+  void AddCubic(PolyPoint p0, PolyPoint p1, PolyPoint p2, PolyPoint p3);
+  void Resolve(CoverageMask &mask);
+
+  // Kept between calls so that rasterizing does not allocate in steady state
+  int                width, height;   // accumulation area, in pixels
+  int                stride;          // floats per accumulation row (width + padding)
+  float              origin_x, origin_y;
+  std::vector<float> cells;           // signed area deltas, "stride" per row
+  std::vector<int>   row_min;         // per row: first and last cell touched, so the
+  std::vector<int>   row_max;         // resolve only visits the cells an outline crossed
+};
+
+// Cache of rasterized shapes, keyed by the path and the sub-pixel part of its
+// position rounded to 1/4 pixel, holding at most "max_bytes" of masks (least
+// recently used go first). A mask is rasterized at the rounded position, so it
+// matches an uncached fill only where the position is a multiple of 1/4 pixel;
+// elsewhere the shape lands up to 1/8 pixel off in each direction.
+class PathCache {
+public:
+  explicit PathCache(size_t max_bytes = 4 << 20) : max_bytes(max_bytes), bytes(0) {}
+
+  // Returns the mask for the path placed at (x, y), rounded to 1/4 pixel; (mask_x, mask_y)
+  // receive where its lower-left pixel goes in the frame. The reference stays valid
+  // until the next call.
+  const CoverageMask &Get(const Path &path, float x, float y, int &mask_x, int &mask_y);
+
+  void Clear();
+  size_t Size() const { return lru.size(); }
+
+private:
+  struct Entry {
+    uint64_t     key;
+    Path         path;        // compared on lookup, so hash collisions cannot mix up shapes
+    int          phase_x;     // sub-pixel position in 1/4 pixels
+    int          phase_y;
+    CoverageMask mask;
+  };
+
+  size_t                                                   max_bytes;
+  size_t                                                   bytes;
+  std::list<Entry>                                         lru;     // most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  PathRasterizer                                           rasterizer;
+};
+
+// Blends "rgb" into the frame with the mask's coverage, its lower-left pixel at (x, y)
+void FillMask(const FrameView &view, const CoverageMask &mask, int x, int y, const unsigned char rgb[3]);
+
+// Fills the path placed at (x, y). "cache" may be NULL to rasterize every time at
+// the exact position; with a cache, (x, y) is rounded to 1/4 pixel (see PathCache).
+void FillPath(const FrameView &view, const Path &path, float x, float y, const unsigned char rgb[3],
+              PathCache *cache);
+
+#endif
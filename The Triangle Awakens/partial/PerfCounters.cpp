@@ -0,0 +1,135 @@
+// Hardware performance counters (see PerfCounters.h)
+
+#include <string.h>
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int PerfEventOpen(uint32_t type, uint64_t config)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.inherit        = 1;      // and the threads it starts from now on
+  attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  // This thread and its new threads, any CPU, no group
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t CacheMiss(uint64_t cache)
+{
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+#endif
+
+PerfCounters::PerfCounters()
+{
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+    fds[i] = -1;
+    start_enabled[i] = start_running[i] = 0;
+  }
+}
+
+PerfCounters::~PerfCounters()
+{
+  Close();
+}
+
+int PerfCounters::Open()
+{
+  int opened = 0;
+
+  Close();
+#ifdef __linux__
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } events[PERF_EVENT_COUNT] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_L1D) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },         // last-level cache
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { PERF_TYPE_HW_CACHE, CacheMiss(PERF_COUNT_HW_CACHE_DTLB) },
+  };
+
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+    fds[i] = PerfEventOpen(events[i].type, events[i].config);
+    if (fds[i] >= 0) opened++;
+  }
+#endif
+  return opened;
+}
+
+void PerfCounters::Close()
+{
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+#ifdef __linux__
+    if (fds[i] >= 0) close(fds[i]);
+#endif
+    fds[i] = -1;
+  }
+}
+
+void PerfCounters::Start()
+{
+#ifdef __linux__
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+    uint64_t values[3];     // count, time enabled, time running
+    if (fds[i] < 0) continue;
+    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+
+    // The times keep accumulating across resets, so the interval is measured from here
+    if (read(fds[i], values, sizeof(values)) == (ssize_t)sizeof(values)) {
+      start_enabled[i] = values[1];
+      start_running[i] = values[2];
+    } else {
+      start_enabled[i] = start_running[i] = 0;
+    }
+    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+PerfSample PerfCounters::Stop()
+{
+  PerfSample sample;
+
+  memset(&sample, 0, sizeof(sample));
+#ifdef __linux__
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+    if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+    uint64_t values[3];     // count, time enabled, time running
+    if (fds[i] < 0 || read(fds[i], values, sizeof(values)) != (ssize_t)sizeof(values)) continue;
+
+    uint64_t enabled = values[1] - start_enabled[i], running = values[2] - start_running[i];
+    if (running == 0) continue;       // never got a hardware counter in this interval
+
+    sample.count[i] = running < enabled ? (uint64_t)((double)values[0]*enabled/running) : values[0];
+    sample.valid[i] = true;
+  }
+#endif
+  return sample;
+}
+
+const char *PerfCounters::Name(PerfEvent event)
+{
+  static const char *names[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "L1D misses", "LLC misses", "branch misses", "dTLB misses"
+  };
+  return names[event];
+}
@@ -0,0 +1,57 @@
+// Hardware performance counters for the benchmark mode
+//
+// Wraps Linux perf_event_open: cycles, instructions, L1D and last-level cache
+// misses, branch misses and data TLB misses of the calling thread, user space only.
+// Threads that the calling thread starts after Open() are counted too; threads that
+// were already running are not, so open the counters before starting any workers.
+// Each counter is opened on its own, so a CPU or VM that lacks one event (or a
+// kernel that restricts perf_event_paranoid) still reports the others. When the
+// kernel multiplexes the counters, the counts are scaled to the full interval.
+//
+// Only available on Linux; elsewhere Open() finds no counters.
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdint.h>
+
+enum PerfEvent {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_EVENT_COUNT
+};
+
+struct PerfSample {
+  uint64_t count[PERF_EVENT_COUNT];
+  bool     valid[PERF_EVENT_COUNT];     // false when the event could not be counted
+};
+
+class PerfCounters {
+public:
+  PerfCounters();
+  ~PerfCounters();
+
+  // Opens every counter the system allows; returns the number opened
+  int  Open();
+  void Close();
+  bool Available(PerfEvent event) const { return fds[event] >= 0; }
+
+  // Counts between Start() and Stop() (all zero and invalid without counters)
+  void Start();
+  PerfSample Stop();
+
+  static const char *Name(PerfEvent event);
+
+private:
+  int fds[PERF_EVENT_COUNT];
+
+  // Times enabled and running at Start(); PERF_EVENT_IOC_RESET clears only the counts
+  uint64_t start_enabled[PERF_EVENT_COUNT];
+  uint64_t start_running[PERF_EVENT_COUNT];
+};
+
+#endif
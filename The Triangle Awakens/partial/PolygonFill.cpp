@@ -0,0 +1,108 @@
+// Scanline polygon filler (see PolygonFill.h)
+
+#include <algorithm>
+#include <math.h>
+
+#include "PolygonFill.h"
+#include "SpanWriter.h"
+
+// Builds the edge table: one entry per non-horizontal edge that crosses at least one
+// scanline of the frame, bucketed by its first scanline and sorted by x within a bucket.
+// An edge covers the scanlines ymin <= y < ymax, so shared vertices are counted once.
+void PolygonFiller::BuildEdgeTable(const FrameView &view, const PolyContour *contours, int num_contours)
+{
+  int c, i;
+
+  edges.clear();
+  for (c = 0; c < num_contours; c++) {
+    const PolyPoint *pts = contours[c].points;
+    int n = contours[c].count;
+
+    for (i = 0; i < n; i++) {
+      PolyPoint p0 = pts[i];
+      PolyPoint p1 = pts[(i+1) % n];
+      Edge e;
+
+      if (p0.y == p1.y) continue;     // horizontal edges never cross a scanline
+
+      e.winding = 1;
+      if (p0.y > p1.y) {              // make p0 the lower endpoint
+        PolyPoint t = p0; p0 = p1; p1 = t;
+        e.winding = -1;
+      }
+
+      e.y_first = (int)ceil(p0.y);
+      e.y_last  = (int)ceil(p1.y) - 1;
+      if (e.y_first < 0) e.y_first = 0;
+      if (e.y_last > view.height-1) e.y_last = view.height-1;
+      if (e.y_first > e.y_last) continue;
+
+      e.dxdy = (p1.x - p0.x)/(p1.y - p0.y);
+      e.x    = p0.x + (e.y_first - p0.y)*e.dxdy;
+      edges.push_back(e);
+    }
+  }
+
+  std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) {
+    return a.y_first < b.y_first || (a.y_first == b.y_first && a.x < b.x);
+  });
+}
+
+void PolygonFiller::Fill(const FrameView &view, const PolyContour *contours, int num_contours,
+                         FillRule rule, const unsigned char rgb[3])
+{
+  size_t next = 0;    // next edge of the edge table to activate
+  size_t i, j;
+  int y = 0;
+
+  BuildEdgeTable(view, contours, num_contours);
+  active.clear();
+
+  while (next < edges.size() || !active.empty()) {
+    // Jump over empty scanlines straight to the next bucket
+    y = active.empty() ? edges[next].y_first : y+1;
+
+    // Retire edges that ended on the previous scanline
+    for (i = 0, j = 0; i < active.size(); i++) {
+      if (active[i].y_last >= y) active[j++] = active[i];
+    }
+    active.resize(j);
+
+    // Activate the edges of this scanline's bucket
+    while (next < edges.size() && edges[next].y_first == y) {
+      active.push_back(edges[next++]);
+    }
+
+    // Crossings move little between scanlines, so insertion sort runs in near linear time
+    for (i = 1; i < active.size(); i++) {
+      Edge e = active[i];
+      for (j = i; j > 0 && active[j-1].x > e.x; j--) {
+        active[j] = active[j-1];
+      }
+      active[j] = e;
+    }
+
+    // Walk the crossings left to right and emit the inside spans
+    int   winding = 0;
+    float x_start = 0;
+    for (i = 0; i < active.size(); i++) {
+      bool was_inside = (rule == FILL_EVEN_ODD) ? (winding & 1) != 0 : winding != 0;
+      winding += (rule == FILL_EVEN_ODD) ? 1 : active[i].winding;
+      bool is_inside  = (rule == FILL_EVEN_ODD) ? (winding & 1) != 0 : winding != 0;
+
+      if (!was_inside && is_inside) {
+        x_start = active[i].x;
+      } else if (was_inside && !is_inside) {
+        int x_left  = (int)ceil(x_start);
+        int x_right = (int)ceil(active[i].x);
+        if (x_left < 0) x_left = 0;
+        if (x_right > view.width) x_right = view.width;
+        FillSpan(view, y, x_left, x_right, rgb);
+      }
+    }
+
+    for (i = 0; i < active.size(); i++) {
+      active[i].x += active[i].dxdy;
+    }
+  }
+}
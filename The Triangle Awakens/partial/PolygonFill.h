@@ -0,0 +1,51 @@
+// Scanline polygon filler with an active edge table
+//
+// Fills general polygons (convex, concave, self-intersecting, with holes) in a
+// single pass over the scanlines, without triangulating them first.
+
+#ifndef POLYGON_FILL_H
+#define POLYGON_FILL_H
+
+#include <vector>
+
+#include "FrameBuffer.h"
+
+enum FillRule {
+  FILL_EVEN_ODD,   // inside where a ray crosses the outline an odd number of times
+  FILL_NONZERO     // inside where the signed crossing count (winding number) is not zero
+};
+
+struct PolyPoint {
+  float x, y;
+};
+
+// A closed outline; the last point connects back to the first
+struct PolyContour {
+  const PolyPoint *points;
+  int              count;
+};
+
+class PolygonFiller {
+public:
+  // Fills all contours as one polygon. Like ScanConvertTriangle, a pixel is
+  // covered when its integer (x, y) position lies inside the polygon.
+  void Fill(const FrameView &view, const PolyContour *contours, int num_contours,
+            FillRule rule, const unsigned char rgb[3]);
+
+private:
+  struct Edge {
+    int   y_first;    // first scanline crossed by the edge
+    int   y_last;     // last scanline crossed by the edge
+    float x;          // x at the current scanline
+    float dxdy;       // x step per scanline
+    int   winding;    // +1 for upward edges, -1 for downward edges
+  };
+
+  void BuildEdgeTable(const FrameView &view, const PolyContour *contours, int num_contours);
+
+  // Kept between calls so that filling does not allocate in steady state
+  std::vector<Edge> edges;       // sorted by y_first, then by x
+  std::vector<Edge> active;      // active edge table, sorted by x
+};
+
+#endif
@@ -0,0 +1,422 @@
+// Post-processing stage (see PostProcess.h)
+//
+// A separable pass over the band [y0, y1) works in place. Output row y needs the
+// horizontally filtered rows y-R..y+R; those are kept in a window of 2R+1 rows that
+// is refilled one row ahead of the output, so input row y+R is always read before
+// row y+R is overwritten. The only rows another thread may overwrite are the R rows
+// just above and below the band: they are filtered before a barrier, and the output
+// is written after it.
+
+#include <math.h>
+
+#include "CpuFeatures.h"
+#include "PostProcess.h"
+
+// The SIMD kernels are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define POST_SSE2
+#define POST_AVX2
+#endif
+
+// dst[i] = sum of w[k]*rows[k][i] over the taps, for begin <= i < end. Each SIMD
+// kernel hands the columns it cannot fill a register with to the next narrower one.
+
+static void WeightedSum_Scalar(const float *const *rows, const float *w, int taps, float *dst, int begin, int end)
+{
+  for (int i = begin; i < end; i++) {
+    float acc = 0;
+    for (int k = 0; k < taps; k++) acc += w[k]*rows[k][i];
+    dst[i] = acc;
+  }
+}
+
+#ifdef POST_SSE2
+CPU_TARGET("sse2")
+static void WeightedSum_SSE2(const float *const *rows, const float *w, int taps, float *dst, int begin, int end)
+{
+  int i;
+
+  for (i = begin; i+4 <= end; i += 4) {
+    __m128 acc = _mm_setzero_ps();
+    for (int k = 0; k < taps; k++) {
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k]+i)));
+    }
+    _mm_storeu_ps(dst+i, acc);
+  }
+  WeightedSum_Scalar(rows, w, taps, dst, i, end);
+}
+#endif
+
+#ifdef POST_AVX2
+CPU_TARGET("avx2")
+static void WeightedSum_AVX2(const float *const *rows, const float *w, int taps, float *dst, int begin, int end)
+{
+  int i;
+
+  for (i = begin; i+8 <= end; i += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (int k = 0; k < taps; k++) {
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), _mm256_loadu_ps(rows[k]+i)));
+    }
+    _mm256_storeu_ps(dst+i, acc);
+  }
+  WeightedSum_SSE2(rows, w, taps, dst, i, end);
+}
+
+// AVX-512 implies FMA, and the compiler would fuse a plain multiply and add; the
+// explicit rounding forms keep them separate so every kernel rounds the same way
+CPU_TARGET("avx512f")
+static void WeightedSum_AVX512(const float *const *rows, const float *w, int taps, float *dst, int begin, int end)
+{
+  const __mmask16 all = 0xFFFF;
+  int i;
+
+  for (i = begin; i+16 <= end; i += 16) {
+    __m512 acc = _mm512_setzero_ps();
+    for (int k = 0; k < taps; k++) {
+      __m512 product = _mm512_maskz_mul_round_ps(all, _mm512_set1_ps(w[k]), _mm512_loadu_ps(rows[k]+i),
+                                                 _MM_FROUND_CUR_DIRECTION);
+      acc = _mm512_maskz_add_round_ps(all, acc, product, _MM_FROUND_CUR_DIRECTION);
+    }
+    _mm512_storeu_ps(dst+i, acc);
+  }
+  WeightedSum_AVX2(rows, w, taps, dst, i, end);
+}
+#endif
+
+typedef void (*WeightedSumKernel)(const float *const *rows, const float *w, int taps, float *dst, int begin, int end);
+
+static WeightedSumKernel SelectWeightedSum()
+{
+#ifdef POST_AVX2
+  unsigned features = CpuFeatures();
+  if (features & CPU_AVX512) return WeightedSum_AVX512;
+  if (features & CPU_AVX2)   return WeightedSum_AVX2;
+  if (features & CPU_SSE2)   return WeightedSum_SSE2;
+#endif
+  return WeightedSum_Scalar;
+}
+
+// Runs the widest kernel the CPU supports, chosen on first use
+static void WeightedSum(const float *const *rows, const float *w, int taps, float *dst, int begin, int end)
+{
+  static const WeightedSumKernel kernel = SelectWeightedSum();
+  kernel(rows, w, taps, dst, begin, end);
+}
+
+static inline float Clamp255(float v)
+{
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Runs the per-pixel operations on a row of filtered values and stores the result.
+// Values stay in float through color matrices and are rounded where a LUT needs bytes.
+void PostProcessChain::StoreRow(const std::vector<PointOp> &ops, const float *in, unsigned char *out, int width)
+{
+  size_t n = ops.size();
+
+  if (n == 0) {
+    for (int i = 0; i < width*3; i++) out[i] = (unsigned char)(Clamp255(in[i]) + 0.5f);
+    return;
+  }
+
+  for (int x = 0; x < width; x++, in += 3, out += 3) {
+    float c[3] = { in[0], in[1], in[2] };
+
+    for (size_t j = 0; j < n; j++) {
+      const PointOp &op = ops[j];
+      if (op.is_matrix) {
+        float r = op.matrix[0][0]*c[0] + op.matrix[0][1]*c[1] + op.matrix[0][2]*c[2] + op.matrix[0][3];
+        float g = op.matrix[1][0]*c[0] + op.matrix[1][1]*c[1] + op.matrix[1][2]*c[2] + op.matrix[1][3];
+        float b = op.matrix[2][0]*c[0] + op.matrix[2][1]*c[1] + op.matrix[2][2]*c[2] + op.matrix[2][3];
+        c[0] = r;
+        c[1] = g;
+        c[2] = b;
+      } else {
+        c[0] = op.lut[(int)(Clamp255(c[0]) + 0.5f)];
+        c[1] = op.lut[(int)(Clamp255(c[1]) + 0.5f)];
+        c[2] = op.lut[(int)(Clamp255(c[2]) + 0.5f)];
+      }
+    }
+
+    out[0] = (unsigned char)(Clamp255(c[0]) + 0.5f);
+    out[1] = (unsigned char)(Clamp255(c[1]) + 0.5f);
+    out[2] = (unsigned char)(Clamp255(c[2]) + 0.5f);
+  }
+}
+
+PostProcessChain::PostProcessChain()
+  : scratch(1), thread_count(1), job(0), busy(0), stopping(false), barrier_count(0), barrier_phase(0)
+{
+  target.pixels = NULL;
+  target.width  = 0;
+  target.height = 0;
+}
+
+PostProcessChain::~PostProcessChain()
+{
+  StopWorkers();
+}
+
+void PostProcessChain::Clear()
+{
+  passes.clear();
+}
+
+void PostProcessChain::AddSeparable(int radius, const std::vector<float> &weights, float amount)
+{
+  Pass pass;
+  pass.radius  = radius;
+  pass.weights = weights;
+  pass.amount  = amount;
+  passes.push_back(pass);
+}
+
+void PostProcessChain::AddBoxBlur(int radius)
+{
+  if (radius <= 0) return;
+  AddSeparable(radius, std::vector<float>(2*radius+1, 1.0f/(2*radius+1)), 0);
+}
+
+static std::vector<float> GaussianWeights(float sigma)
+{
+  int radius = (int)ceilf(3*sigma);
+  std::vector<float> weights(2*radius+1);
+  float sum = 0;
+
+  for (int k = -radius; k <= radius; k++) {
+    weights[k+radius] = expf(-(k*k)/(2*sigma*sigma));
+    sum += weights[k+radius];
+  }
+  for (size_t k = 0; k < weights.size(); k++) weights[k] /= sum;
+  return weights;
+}
+
+void PostProcessChain::AddGaussianBlur(float sigma)
+{
+  if (sigma <= 0) return;
+  std::vector<float> weights = GaussianWeights(sigma);
+  AddSeparable((int)weights.size()/2, weights, 0);
+}
+
+void PostProcessChain::AddUnsharpMask(float sigma, float amount)
+{
+  if (sigma <= 0 || amount == 0) return;
+  std::vector<float> weights = GaussianWeights(sigma);
+  AddSeparable((int)weights.size()/2, weights, amount);
+}
+
+void PostProcessChain::AddPointOp(const PointOp &op)
+{
+  if (passes.empty()) {
+    Pass pass;
+    pass.radius = -1;
+    pass.amount = 0;
+    passes.push_back(pass);
+  }
+
+  // Point operations ride along with the previous pass; back-to-back LUTs become one
+  std::vector<PointOp> &ops = passes.back().point_ops;
+  if (!op.is_matrix && !ops.empty() && !ops.back().is_matrix) {
+    PointOp &last = ops.back();
+    for (int i = 0; i < 256; i++) last.lut[i] = op.lut[last.lut[i]];
+    return;
+  }
+  ops.push_back(op);
+}
+
+void PostProcessChain::AddColorMatrix(const float matrix[3][4])
+{
+  PointOp op;
+  op.is_matrix = true;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) op.matrix[i][j] = matrix[i][j];
+  }
+  AddPointOp(op);
+}
+
+void PostProcessChain::AddGamma(float gamma)
+{
+  PointOp op;
+  op.is_matrix = false;
+  for (int i = 0; i < 256; i++) {
+    op.lut[i] = (unsigned char)(255*powf(i/255.0f, 1/gamma) + 0.5f);
+  }
+  AddPointOp(op);
+}
+
+void PostProcessChain::SetThreads(int count)
+{
+  if (count < 1) count = 1;
+  if (count == thread_count) return;
+
+  StopWorkers();
+  thread_count = count;
+  scratch.resize(count);
+  stopping = false;
+  for (int band = 1; band < count; band++) {
+    workers.push_back(std::thread(&PostProcessChain::WorkerLoop, this, band, job));
+  }
+}
+
+void PostProcessChain::StopWorkers()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+  workers.clear();
+  thread_count = 1;     // an Apply() after this runs on the calling thread instead of waiting for no one
+}
+
+void PostProcessChain::WorkerLoop(int band, unsigned seen)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;) {
+    wake.wait(lock, [&] { return stopping || job != seen; });
+    if (stopping) return;
+    seen = job;
+
+    lock.unlock();
+    RunBand(band);
+    lock.lock();
+
+    if (--busy == 0) done.notify_one();
+  }
+}
+
+// Waits until every band has reached this point
+void PostProcessChain::Barrier()
+{
+  if (thread_count == 1) return;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  unsigned phase = barrier_phase;
+  if (++barrier_count == thread_count) {
+    barrier_count = 0;
+    barrier_phase++;
+    barrier_wake.notify_all();
+  } else {
+    barrier_wake.wait(lock, [&] { return barrier_phase != phase; });
+  }
+}
+
+void PostProcessChain::Apply(const FrameView &view)
+{
+  if (passes.empty()) return;
+
+  target = view;
+  if (thread_count == 1) {
+    RunBand(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job++;
+    busy = thread_count-1;
+  }
+  wake.notify_all();
+
+  RunBand(0);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&] { return busy == 0; });
+}
+
+void PostProcessChain::RunBand(int band)
+{
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (i > 0) Barrier();   // the next pass reads rows the other bands just wrote
+    RunPass(passes[i], band, scratch[band]);
+  }
+}
+
+// Horizontal filter of one input row into "dst" (3 floats per pixel)
+void PostProcessChain::FilterRow(const Pass &pass, const unsigned char *src, float *dst, Scratch &s)
+{
+  int width = target.width, radius = pass.radius, taps = 2*radius+1;
+  float *padded = &s.padded[0];
+  int i, c;
+
+  // Clamp to edge: repeat the first and last pixel "radius" times
+  for (i = 0; i < radius; i++) {
+    for (c = 0; c < 3; c++) {
+      padded[i*3 + c]                = src[c];
+      padded[(radius+width+i)*3 + c] = src[(width-1)*3 + c];
+    }
+  }
+  for (i = 0; i < width*3; i++) padded[radius*3 + i] = src[i];
+
+  // Interleaved RGB: tap k of every channel sits 3*k floats further on
+  for (i = 0; i < taps; i++) s.taps[i] = padded + i*3;
+  WeightedSum(&s.taps[0], &pass.weights[0], taps, dst, 0, width*3);
+}
+
+void PostProcessChain::RunPass(const Pass &pass, int band, Scratch &s)
+{
+  int width = target.width, height = target.height;
+  int y0 = height*band/thread_count;
+  int y1 = height*(band+1)/thread_count;
+  int row_size = width*3, y, yy;
+
+  #define ROW(y) (target.pixels + (size_t)(y)*row_size)
+
+  if (pass.radius < 0) {
+    s.result.resize(row_size);
+    for (y = y0; y < y1; y++) {
+      unsigned char *row = ROW(y);
+      for (int i = 0; i < row_size; i++) s.result[i] = row[i];
+      StoreRow(pass.point_ops, &s.result[0], row, width);
+    }
+    return;
+  }
+
+  int radius = pass.radius, taps = 2*radius+1;
+  s.padded.resize((width + 2*radius)*3);
+  s.window.resize((size_t)taps*row_size);
+  s.bottom.resize((size_t)radius*row_size);
+  s.result.resize(row_size);
+  s.taps.resize(taps);
+  s.rows.resize(taps);
+
+  #define CLAMP_Y(y) ((y) < 0 ? 0 : ((y) > height-1 ? height-1 : (y)))
+  #define WINDOW_ROW(y) (&s.window[(size_t)(((y)+radius) % taps)*row_size])
+
+  // Rows shared with the neighbouring bands, plus the first rows of this band
+  if (y0 < y1) {
+    for (yy = y0-radius; yy < y0+radius && yy < y1; yy++) {
+      FilterRow(pass, ROW(CLAMP_Y(yy)), WINDOW_ROW(yy), s);
+    }
+    for (yy = y1; yy < y1+radius; yy++) {
+      FilterRow(pass, ROW(CLAMP_Y(yy)), &s.bottom[(size_t)(yy-y1)*row_size], s);
+    }
+  }
+
+  Barrier();
+
+  for (y = y0; y < y1; y++) {
+    yy = y+radius;
+    if (yy < y1) FilterRow(pass, ROW(yy), WINDOW_ROW(yy), s);
+
+    // Vertical filter: the taps are whole rows of the window
+    for (int k = 0; k < taps; k++) {
+      yy = y-radius+k;
+      s.rows[k] = yy >= y1 ? &s.bottom[(size_t)(yy-y1)*row_size] : WINDOW_ROW(yy);
+    }
+    WeightedSum(&s.rows[0], &pass.weights[0], taps, &s.result[0], 0, row_size);
+
+    unsigned char *row = ROW(y);
+    if (pass.amount != 0) {   // unsharp mask: row y still holds the unfiltered input
+      for (int i = 0; i < row_size; i++) s.result[i] = row[i] + pass.amount*(row[i] - s.result[i]);
+    }
+    StoreRow(pass.point_ops, &s.result[0], row, width);
+  }
+
+  #undef WINDOW_ROW
+  #undef CLAMP_Y
+  #undef ROW
+}
@@ -0,0 +1,94 @@
+// Post-processing stage applied to a finished frame before it is presented
+//
+// A chain of filters is compiled into as few passes over the frame as possible:
+// a pass is at most one separable filter (box blur, Gaussian blur or unsharp mask)
+// followed by any number of per-pixel operations (color matrix, gamma), which are
+// applied to each output row while it is still in cache. A separable pass keeps
+// only a sliding window of horizontally filtered rows, so the frame is read and
+// written once per pass, in place. The frame is split into row bands, one per
+// worker thread.
+
+#ifndef POST_PROCESS_H
+#define POST_PROCESS_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FrameBuffer.h"
+
+class PostProcessChain {
+public:
+  PostProcessChain();
+  ~PostProcessChain();
+
+  void Clear();
+  bool Empty() const { return passes.empty(); }
+
+  // Filters, applied in the order they are added
+  void AddBoxBlur(int radius);
+  void AddGaussianBlur(float sigma);
+  void AddUnsharpMask(float sigma, float amount);   // out = in + amount*(in - blurred)
+  void AddColorMatrix(const float matrix[3][4]);    // out = M*(r, g, b, 1), channels 0..255
+  void AddGamma(float gamma);                       // out = 255*(in/255)^(1/gamma)
+
+  // Number of row bands processed in parallel; 1 runs everything on the calling thread
+  void SetThreads(int count);
+
+  void Apply(const FrameView &view);
+
+private:
+  struct PointOp {
+    bool          is_matrix;
+    float         matrix[3][4];
+    unsigned char lut[256];
+  };
+
+  struct Pass {
+    int                  radius;      // -1: no separable filter, point operations only
+    std::vector<float>   weights;     // 2*radius+1 taps, sum 1
+    float                amount;      // unsharp mask amount, 0 for a plain blur
+    std::vector<PointOp> point_ops;
+  };
+
+  // Per-thread scratch rows (floats, 3 per pixel)
+  struct Scratch {
+    std::vector<float>         padded;    // input row with "radius" pixels of clamped border
+    std::vector<float>         window;    // 2*radius+1 horizontally filtered rows
+    std::vector<float>         bottom;    // rows below the band, captured before it is overwritten
+    std::vector<float>         result;
+    std::vector<const float *> taps;      // horizontal taps: offsets into "padded"
+    std::vector<const float *> rows;      // vertical taps: rows of "window" and "bottom"
+  };
+
+  void AddSeparable(int radius, const std::vector<float> &weights, float amount);
+  void AddPointOp(const PointOp &op);
+
+  void RunBand(int band);
+  void RunPass(const Pass &pass, int band, Scratch &scratch);
+  void FilterRow(const Pass &pass, const unsigned char *src, float *dst, Scratch &scratch);
+  static void StoreRow(const std::vector<PointOp> &ops, const float *in, unsigned char *out, int width);
+  void Barrier();
+  void WorkerLoop(int band, unsigned seen);   // "seen": last job the worker must not run
+  void StopWorkers();
+
+  std::vector<Pass>        passes;
+  std::vector<Scratch>     scratch;   // one per band
+  FrameView                target;
+
+  // Worker threads run bands 1..N-1, the calling thread runs band 0
+  int                      thread_count;
+  std::vector<std::thread> workers;
+  std::mutex               mutex;
+  std::condition_variable  wake;
+  std::condition_variable  done;
+  std::condition_variable  barrier_wake;
+  unsigned                 job;             // incremented for every Apply()
+  int                      busy;            // workers still running the current job
+  bool                     stopping;
+  int                      barrier_count;
+  unsigned                 barrier_phase;
+};
+
+#endif
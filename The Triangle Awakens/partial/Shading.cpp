@@ -0,0 +1,122 @@
+// Pixel-shader path with coarse-rate shading (see Shading.h)
+
+#include <math.h>
+
+#include "Shading.h"
+
+void GouraudShader(const ShaderInput &in, unsigned char out[3], void *user)
+{
+  out[0] = (unsigned char)(in.r+0.5f);
+  out[1] = (unsigned char)(in.g+0.5f);
+  out[2] = (unsigned char)(in.b+0.5f);
+}
+
+// Edge function e(x, y) = a*x + b*y + c, exact in integers
+struct IntEdge {
+  int a, b, c;
+};
+
+static IntEdge MakeEdge(int xa, int ya, int xb, int yb, int sign)
+{
+  IntEdge e;
+  e.a = -(yb-ya)*sign;
+  e.b =  (xb-xa)*sign;
+  e.c = ((yb-ya)*xa - (xb-xa)*ya)*sign;
+  return e;
+}
+
+static float Clamp255(float v)
+{
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+void ScanConvertTriangleShaded(const FrameView &view,
+                               const ShadedVertex &v0, const ShadedVertex &v1, const ShadedVertex &v2,
+                               PixelShader shader, void *user,
+                               const ShadingOptions &options, ShadingStats *stats)
+{
+  int area = (v1.x-v0.x)*(v2.y-v0.y) - (v1.y-v0.y)*(v2.x-v0.x);   // twice the signed area
+  int sign, rate, x_min, x_max, y_min, y_max, bx, by, x, y;
+  long pixels = 0, invocations = 0;
+
+  if (area == 0) return;    // degenerate triangles cover no pixels
+
+  // Edge opposite each vertex, oriented so that inside is >= 0 and e0+e1+e2 == |area|
+  sign = area > 0 ? 1 : -1;
+  IntEdge e0 = MakeEdge(v1.x, v1.y, v2.x, v2.y, sign);
+  IntEdge e1 = MakeEdge(v2.x, v2.y, v0.x, v0.y, sign);
+  IntEdge e2 = MakeEdge(v0.x, v0.y, v1.x, v1.y, sign);
+  float inv_area = 1.0f/(area*sign);
+
+  // Attribute planes: value = a*x + b*y + c
+  float ra = (e0.a*v0.r + e1.a*v1.r + e2.a*v2.r)*inv_area;
+  float rb = (e0.b*v0.r + e1.b*v1.r + e2.b*v2.r)*inv_area;
+  float rc = ((float)e0.c*v0.r + (float)e1.c*v1.r + (float)e2.c*v2.r)*inv_area;
+  float ga = (e0.a*v0.g + e1.a*v1.g + e2.a*v2.g)*inv_area;
+  float gb = (e0.b*v0.g + e1.b*v1.g + e2.b*v2.g)*inv_area;
+  float gc = ((float)e0.c*v0.g + (float)e1.c*v1.g + (float)e2.c*v2.g)*inv_area;
+  float ba = (e0.a*v0.b + e1.a*v1.b + e2.a*v2.b)*inv_area;
+  float bb = (e0.b*v0.b + e1.b*v1.b + e2.b*v2.b)*inv_area;
+  float bc = ((float)e0.c*v0.b + (float)e1.c*v1.b + (float)e2.c*v2.b)*inv_area;
+
+  // Gouraud attributes are linear, so their gradient is the same over the whole
+  // triangle: pick the coarsest block whose attribute change stays under the threshold
+  float gradient = fmaxf(fabsf(ra)+fabsf(rb), fmaxf(fabsf(ga)+fabsf(gb), fabsf(ba)+fabsf(bb)));
+  for (rate = options.max_rate; rate > 1; rate /= 2) {
+    if (gradient*(rate-1) < options.gradient_threshold) break;
+  }
+
+  x_min = v0.x < v1.x ? (v0.x < v2.x ? v0.x : v2.x) : (v1.x < v2.x ? v1.x : v2.x);
+  x_max = v0.x > v1.x ? (v0.x > v2.x ? v0.x : v2.x) : (v1.x > v2.x ? v1.x : v2.x);
+  y_min = v0.y < v1.y ? (v0.y < v2.y ? v0.y : v2.y) : (v1.y < v2.y ? v1.y : v2.y);
+  y_max = v0.y > v1.y ? (v0.y > v2.y ? v0.y : v2.y) : (v1.y > v2.y ? v1.y : v2.y);
+  if (x_min < 0) x_min = 0;
+  if (y_min < 0) y_min = 0;
+  if (x_max > view.width-1)  x_max = view.width-1;
+  if (y_max > view.height-1) y_max = view.height-1;
+
+  // Blocks are aligned to the rate so neighbouring triangles share the block grid
+  for (by = y_min - y_min % rate; by <= y_max; by += rate) {
+    for (bx = x_min - x_min % rate; bx <= x_max; bx += rate) {
+      unsigned char color[3];
+      bool shaded = false;
+
+      for (y = by; y < by+rate; y++) {
+        if (y < y_min || y > y_max) continue;
+
+        for (x = bx; x < bx+rate; x++) {
+          if (x < x_min || x > x_max) continue;
+
+          // Coverage is resolved per pixel, whatever the shading rate
+          if (e0.a*x + e0.b*y + e0.c < 0 ||
+              e1.a*x + e1.b*y + e1.c < 0 ||
+              e2.a*x + e2.b*y + e2.c < 0) continue;
+
+          if (rate == 1 || !shaded) {
+            ShaderInput in;
+            in.x = rate == 1 ? x : bx + (rate-1)*0.5f;
+            in.y = rate == 1 ? y : by + (rate-1)*0.5f;
+            // The block center may lie outside the triangle, so keep the colors in range
+            in.r = Clamp255(ra*in.x + rb*in.y + rc);
+            in.g = Clamp255(ga*in.x + gb*in.y + gc);
+            in.b = Clamp255(ba*in.x + bb*in.y + bc);
+            shader(in, color, user);
+            shaded = true;
+            invocations++;
+          }
+
+          unsigned char *p = PixelAt(view, x, y);
+          p[0] = color[0];
+          p[1] = color[1];
+          p[2] = color[2];
+          pixels++;
+        }
+      }
+    }
+  }
+
+  if (stats) {
+    stats->pixels      += pixels;
+    stats->invocations += invocations;
+  }
+}
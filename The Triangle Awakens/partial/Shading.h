@@ -0,0 +1,54 @@
+// Pixel-shader path for triangles, with coarse-rate (variable-rate) shading
+//
+// Triangles are traversed in square blocks. Coverage is always resolved per pixel
+// from the edge functions, but where the interpolated attributes change by less
+// than a threshold across a block, the shader runs once for the whole block and
+// its result is broadcast to every covered pixel of the block.
+
+#ifndef SHADING_H
+#define SHADING_H
+
+#include "FrameBuffer.h"
+
+// Interpolated attributes handed to a pixel shader
+struct ShaderInput {
+  float x, y;         // where the attributes were evaluated (block center for coarse shading)
+  float r, g, b;      // Gouraud color, 0..255
+};
+
+typedef void (*PixelShader)(const ShaderInput &in, unsigned char out[3], void *user);
+
+// Writes the interpolated color, rounded like FillScanLine
+void GouraudShader(const ShaderInput &in, unsigned char out[3], void *user);
+
+enum ShadingRate {
+  SHADING_RATE_1X1 = 1,
+  SHADING_RATE_2X2 = 2,
+  SHADING_RATE_4X4 = 4
+};
+
+struct ShadingOptions {
+  ShadingRate max_rate;             // coarsest rate allowed
+  float       gradient_threshold;   // largest attribute change (color units) allowed across a coarse block
+};
+
+struct ShadingStats {
+  long pixels;        // covered pixels
+  long invocations;   // shader calls
+};
+
+struct ShadedVertex {
+  int           x, y;
+  unsigned char r, g, b;
+};
+
+// Shades the triangle. Covers every integer (x, y) inside the triangle or on its
+// edges, from exact edge functions; ScanConvertTriangle steps its edges in float and
+// can miss a pixel lying exactly on an edge. Vertices may come in any order.
+// "stats" may be NULL.
+void ScanConvertTriangleShaded(const FrameView &view,
+                               const ShadedVertex &v0, const ShadedVertex &v1, const ShadedVertex &v2,
+                               PixelShader shader, void *user,
+                               const ShadingOptions &options, ShadingStats *stats);
+
+#endif
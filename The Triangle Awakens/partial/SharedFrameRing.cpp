@@ -0,0 +1,219 @@
+// Shared-memory export of the frame ring (see SharedFrameRing.h)
+//
+// The readiness signal is a futex on a word inside the segment rather than an
+// eventfd: an eventfd can only reach processes it was passed to, while a shared
+// futex works for any process that maps the segment by name.
+
+#include <stdio.h>
+#include <string.h>
+#include <new>
+
+#include "SharedFrameRing.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static long Futex(std::atomic<uint32_t> *word, int op, uint32_t value, const struct timespec *timeout)
+{
+  return syscall(SYS_futex, (uint32_t *)word, op, value, timeout, NULL, 0);
+}
+#endif
+
+SharedFrameRing::SharedFrameRing()
+  : header(NULL), slots(NULL), mapped_size(0), owner(false)
+{
+  name[0] = '\0';
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+#ifdef __linux__
+  if (header) munmap(header, mapped_size);
+  if (owner) shm_unlink(name);
+#endif
+}
+
+SharedFrameRing *SharedFrameRing::Create(const char *name, int slot_count)
+{
+#ifdef __linux__
+  size_t size = sizeof(SharedFrameRingHeader) + sizeof(FrameSlot)*slot_count;
+  int fd;
+  void *base;
+
+  fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST && IsStale(name)) {
+    printf("Replacing stale shared frame ring %s\n", name);
+    shm_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      printf("Shared frame ring %s already exists and its producer is still running\n", name);
+    } else {
+      perror("shm_open");
+    }
+    return NULL;
+  }
+  if (ftruncate(fd, size) < 0) {    // new pages read as zero
+    perror("ftruncate");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    shm_unlink(name);
+    return NULL;
+  }
+
+  SharedFrameRing *ring = new SharedFrameRing();
+  ring->header      = new (base) SharedFrameRingHeader();
+  ring->slots       = (FrameSlot *)((char *)base + sizeof(SharedFrameRingHeader));
+  for (int i = 0; i < slot_count; i++) {
+    new (&ring->slots[i]) FrameSlot();
+  }
+  ring->mapped_size = size;
+  ring->owner       = true;
+  strncpy(ring->name, name, sizeof(ring->name)-1);
+  ring->name[sizeof(ring->name)-1] = '\0';
+
+  SharedFrameRingHeader *h = ring->header;
+  h->width         = WIDTH;
+  h->height        = HEIGHT;
+  h->slot_count    = slot_count;
+  h->slot_size     = sizeof(FrameSlot);
+  h->pixels_offset = offsetof(FrameSlot, pixels);
+  h->frame_counter.store(0);
+  h->latest_slot.store(-1);
+  h->owner_pid     = getpid();
+  h->version       = SHARED_FRAME_RING_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  h->magic         = SHARED_FRAME_RING_MAGIC;   // written last: readers check it first
+
+  return ring;
+#else
+  printf("Shared-memory frame export is not supported on this platform\n");
+  return NULL;
+#endif
+}
+
+// True when "name" holds a complete ring whose producer process has exited.
+// A segment of another layout, or one still being set up, is never stale.
+bool SharedFrameRing::IsStale(const char *name)
+{
+#ifdef __linux__
+  struct stat st;
+  bool stale = false;
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) return false;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SharedFrameRingHeader)) {
+    void *base = mmap(NULL, sizeof(SharedFrameRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+    if (base != MAP_FAILED) {
+      const SharedFrameRingHeader *h = (const SharedFrameRingHeader *)base;
+      if (h->magic == SHARED_FRAME_RING_MAGIC && h->version == SHARED_FRAME_RING_VERSION &&
+          h->owner_pid > 0) {
+        stale = kill(h->owner_pid, 0) < 0 && errno == ESRCH;
+      }
+      munmap(base, sizeof(SharedFrameRingHeader));
+    }
+  }
+  close(fd);
+  return stale;
+#else
+  return false;
+#endif
+}
+
+SharedFrameRing *SharedFrameRing::Attach(const char *name)
+{
+#ifdef __linux__
+  struct stat st;
+  int fd;
+  void *base;
+
+  fd = shm_open(name, O_RDWR, 0);   // read-write because readers wait on the futex word
+  if (fd < 0) {
+    perror("shm_open");
+    return NULL;
+  }
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SharedFrameRingHeader)) {
+    printf("Shared frame ring %s is too small\n", name);
+    close(fd);
+    return NULL;
+  }
+  base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror("mmap");
+    return NULL;
+  }
+
+  SharedFrameRingHeader *h = (SharedFrameRingHeader *)base;
+  if (h->magic != SHARED_FRAME_RING_MAGIC || h->version != SHARED_FRAME_RING_VERSION ||
+      h->slot_size != sizeof(FrameSlot) ||
+      (size_t)st.st_size < sizeof(SharedFrameRingHeader) + (size_t)h->slot_size*h->slot_count) {
+    printf("Shared frame ring %s has an unexpected layout\n", name);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  SharedFrameRing *ring = new SharedFrameRing();
+  ring->header      = h;
+  ring->slots       = (FrameSlot *)((char *)base + sizeof(SharedFrameRingHeader));
+  ring->mapped_size = st.st_size;
+  return ring;
+#else
+  printf("Shared-memory frame export is not supported on this platform\n");
+  return NULL;
+#endif
+}
+
+void SharedFrameRing::Announce(int slot)
+{
+  header->latest_slot.store(slot, std::memory_order_release);
+  header->frame_counter.fetch_add(1, std::memory_order_release);
+#ifdef __linux__
+  Futex(&header->frame_counter, FUTEX_WAKE, 0x7fffffff, NULL);
+#endif
+}
+
+const FrameSlot *SharedFrameRing::WaitForFrame(uint32_t &last_counter, int timeout_ms, uint32_t &sequence) const
+{
+  uint32_t counter = header->frame_counter.load(std::memory_order_acquire);
+
+#ifdef __linux__
+  if (counter == last_counter) {
+    struct timespec timeout;
+    timeout.tv_sec  = timeout_ms/1000;
+    timeout.tv_nsec = (timeout_ms%1000)*1000000L;
+    // Returns at once (EAGAIN) if a frame was announced after the load above
+    Futex(&header->frame_counter, FUTEX_WAIT, last_counter, &timeout);
+    counter = header->frame_counter.load(std::memory_order_acquire);
+  }
+#endif
+  if (counter == last_counter) return NULL;
+
+  int slot = header->latest_slot.load(std::memory_order_acquire);
+  if (slot < 0) return NULL;
+
+  last_counter = counter;
+  sequence     = slots[slot].sequence.load(std::memory_order_acquire);
+  if (sequence & 1) return NULL;     // already being overwritten
+  return &slots[slot];
+}
+
+bool SharedFrameRing::IsStillValid(const FrameSlot *slot, uint32_t sequence) const
+{
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->sequence.load(std::memory_order_relaxed) == sequence;
+}
@@ -0,0 +1,82 @@
+// Shared-memory export of the frame ring for zero-copy external viewers
+//
+// The FramePipeline ring can live in a POSIX shared-memory segment so that other
+// local tools (recorders, inspectors, compositors) map the same frames without a
+// copy on either side. Segment layout:
+//
+//   SharedFrameRingHeader   (fixed size, describes the frames)
+//   FrameSlot[slot_count]   (slot header + pixels, see FramePipeline.h)
+//
+// Readers wait on the header's futex word for a new frame, read the announced
+// slot in place, and then check the slot's sequence number to make sure the
+// producer did not start overwriting it while they were reading.
+//
+// The segment is created readable by the owning user only. Create refuses to
+// replace a segment that already exists unless the producer that created it is
+// gone (its pid in the header no longer runs), so two producers cannot clobber
+// each other's ring.
+//
+// Only available on Linux (shm_open + futex); Create/Attach return NULL elsewhere.
+
+#ifndef SHARED_FRAME_RING_H
+#define SHARED_FRAME_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "FramePipeline.h"
+
+#define SHARED_FRAME_RING_MAGIC   0x524d5246u   // "FRMR"
+#define SHARED_FRAME_RING_VERSION 2
+
+struct SharedFrameRingHeader {
+  uint32_t              magic;
+  uint32_t              version;
+  uint32_t              width;          // frame size in pixels, 3 bytes (RGB) per pixel
+  uint32_t              height;
+  uint32_t              slot_count;
+  uint32_t              slot_size;      // bytes per FrameSlot
+  uint32_t              pixels_offset;  // offset of the pixels within a FrameSlot
+  std::atomic<uint32_t> frame_counter;  // futex word, incremented for every published frame
+  std::atomic<int32_t>  latest_slot;    // slot of the newest published frame, -1 before the first
+  int32_t               owner_pid;      // producer process, to recognise a stale segment
+  uint8_t               pad[24];
+};
+
+class SharedFrameRing {
+public:
+  // Producer: creates the segment "name", e.g. "/trianglescan". Fails when a
+  // live producer already owns it; a segment left by a dead one is replaced.
+  static SharedFrameRing *Create(const char *name, int slot_count);
+  // External reader: maps an existing segment
+  static SharedFrameRing *Attach(const char *name);
+
+  ~SharedFrameRing();
+
+  FrameSlot *Slots() const { return slots; }
+  const SharedFrameRingHeader *Header() const { return header; }
+
+  // Producer: announces that "slot" holds a finished frame and wakes waiting readers
+  void Announce(int slot);
+
+  // Reader: blocks until frame_counter differs from "last_counter" (or the timeout
+  // expires), updates "last_counter" and returns the newest slot, or NULL on timeout.
+  // The returned sequence must be passed to IsStillValid() after reading the pixels.
+  const FrameSlot *WaitForFrame(uint32_t &last_counter, int timeout_ms, uint32_t &sequence) const;
+
+  // Reader: true when the slot was not touched by the producer since WaitForFrame()
+  bool IsStillValid(const FrameSlot *slot, uint32_t sequence) const;
+
+private:
+  SharedFrameRing();
+
+  static bool IsStale(const char *name);
+
+  SharedFrameRingHeader *header;
+  FrameSlot             *slots;
+  size_t                 mapped_size;
+  char                   name[64];
+  bool                   owner;
+};
+
+#endif
@@ -0,0 +1,194 @@
+// Span-buffer hidden-surface removal (see SpanBuffer.h)
+
+#include <algorithm>
+#include <math.h>
+
+#include "SpanBuffer.h"
+
+SpanBuffer::SpanBuffer(int width, int height)
+  : width(width), height(height), rows(height)
+{
+}
+
+void SpanBuffer::Clear()
+{
+  for (size_t y = 0; y < rows.size(); y++) {
+    rows[y].clear();    // keeps the capacity, so steady-state frames do not allocate
+  }
+  prims.clear();
+}
+
+// Appends a piece of "from" to the scratch row, merging it with the previous
+// piece when both come from the same primitive and touch
+void SpanBuffer::Emit(const Span &from, int x_left, int x_right)
+{
+  if (x_left >= x_right) return;
+
+  if (!merged.empty()) {
+    Span &last = merged.back();
+    if (last.prim == from.prim && last.x_right == x_left) {
+      last.x_right = x_right;
+      return;
+    }
+  }
+
+  Span s = from;
+  s.x_left  = x_left;
+  s.x_right = x_right;
+  merged.push_back(s);
+}
+
+// Merges a new span into the sorted span list of row y, keeping whichever
+// primitive is closer for every pixel. On equal depth the existing span wins.
+// Only the spans the new one overlaps are rebuilt (in the scratch row) and
+// spliced back; the rest of the row is left where it is.
+void SpanBuffer::InsertSpan(int y, const Span &span)
+{
+  std::vector<Span> &row = rows[y];
+  int cur = span.x_left;    // first pixel of the new span that is still undecided
+
+  // Overlapped spans: first ends after the new span starts, last starts before it ends
+  std::vector<Span>::iterator first = std::upper_bound(row.begin(), row.end(), span.x_left,
+    [](int x, const Span &s) { return x < s.x_right; });
+  std::vector<Span>::iterator last = first;
+  while (last != row.end() && last->x_left < span.x_right) last++;
+
+  merged.clear();
+  for (std::vector<Span>::iterator it = first; it != last; it++) {
+    const Span &s = *it;
+    int a = s.x_left > cur ? s.x_left : cur;
+    int b = s.x_right < span.x_right ? s.x_right : span.x_right;
+
+    Emit(s, s.x_left, a);       // part of s left of the new span
+    Emit(span, cur, a);         // gap before s filled by the new span
+
+    // Depth difference is linear in x, so the new span wins on one interval [na, nb).
+    // With nearly parallel depths the crossing may be far outside the int range, or
+    // infinite, so it is clamped to [a-1, b] before the conversion; a crossing beyond
+    // either bound gives the same interval as the bound.
+    float d0 = span.z0 - s.z0;
+    float dd = span.dzdx - s.dzdx;
+    int na, nb;
+    if (dd == 0) {
+      na = a;
+      nb = d0 < 0 ? b : a;
+    } else {
+      float x_cross = fminf(fmaxf(-d0/dd, (float)(a-1)), (float)b);
+      if (dd > 0) {             // new is closer left of the crossing
+        na = a;
+        nb = (int)ceil(x_cross);
+      } else {                  // new is closer right of the crossing
+        na = (int)floor(x_cross) + 1;
+        nb = b;
+      }
+      if (na < a) na = a;
+      if (nb > b) nb = b;
+      if (na > nb) na = nb = a;
+    }
+
+    Emit(s, a, na);
+    Emit(span, na, nb);
+    Emit(s, nb, b);
+    cur = b;
+
+    Emit(s, b, s.x_right);      // part of s right of the new span
+  }
+  Emit(span, cur, span.x_right);
+
+  // Splice: overwrite the overlapped spans, then insert or erase the difference
+  size_t at = first - row.begin(), count = last - first;
+  size_t common = count < merged.size() ? count : merged.size();
+  std::copy(merged.begin(), merged.begin() + common, row.begin() + at);
+  if (merged.size() > count) {
+    row.insert(row.begin() + at + count, merged.begin() + common, merged.end());
+  } else {
+    row.erase(row.begin() + at + common, row.begin() + at + count);
+  }
+}
+
+void SpanBuffer::InsertTriangle(const DepthVertex &v0, const DepthVertex &v1, const DepthVertex &v2)
+{
+  float area = (v1.x-v0.x)*(v2.y-v0.y) - (v1.y-v0.y)*(v2.x-v0.x);   // twice the signed area
+  const DepthVertex *v[3] = { &v0, &v1, &v2 };
+  int y_first, y_last, y, i;
+
+  if (area == 0) return;    // degenerate triangles cover no pixels
+
+  // Plane equation of an attribute from its values at the three vertices
+  #define ATTRIBUTE_PLANE(p, f0, f1, f2)                                          \
+    p.a = ((f1-f0)*(v2.y-v0.y) - (f2-f0)*(v1.y-v0.y))/area;                       \
+    p.b = ((f2-f0)*(v1.x-v0.x) - (f1-f0)*(v2.x-v0.x))/area;                       \
+    p.c = f0 - p.a*v0.x - p.b*v0.y;
+
+  Plane z;
+  Primitive prim;
+  ATTRIBUTE_PLANE(z,      v0.z, v1.z, v2.z);
+  ATTRIBUTE_PLANE(prim.r, v0.r, v1.r, v2.r);
+  ATTRIBUTE_PLANE(prim.g, v0.g, v1.g, v2.g);
+  ATTRIBUTE_PLANE(prim.b, v0.b, v1.b, v2.b);
+  #undef ATTRIBUTE_PLANE
+
+  prims.push_back(prim);
+
+  float y_min = fminf(v0.y, fminf(v1.y, v2.y));
+  float y_max = fmaxf(v0.y, fmaxf(v1.y, v2.y));
+  y_first = (int)ceil(y_min);
+  y_last  = (int)floor(y_max);
+  if (y_first < 0) y_first = 0;
+  if (y_last > height-1) y_last = height-1;
+
+  for (y = y_first; y <= y_last; y++) {
+    // Intersect the scanline with the three edges to get the covered x range
+    float x_min = 1e30f, x_max = -1e30f;
+    for (i = 0; i < 3; i++) {
+      const DepthVertex *p = v[i], *q = v[(i+1) % 3];
+      if ((p->y <= y && y <= q->y) || (q->y <= y && y <= p->y)) {
+        if (p->y == q->y) {     // horizontal edge lying on the scanline
+          x_min = fminf(x_min, fminf(p->x, q->x));
+          x_max = fmaxf(x_max, fmaxf(p->x, q->x));
+        } else {
+          float x = p->x + (y - p->y)*(q->x - p->x)/(q->y - p->y);
+          x_min = fminf(x_min, x);
+          x_max = fmaxf(x_max, x);
+        }
+      }
+    }
+
+    Span span;
+    span.x_left  = (int)ceil(x_min);
+    span.x_right = (int)floor(x_max) + 1;
+    if (span.x_left < 0) span.x_left = 0;
+    if (span.x_right > width) span.x_right = width;
+    if (span.x_left >= span.x_right) continue;
+
+    span.z0   = z.b*y + z.c;
+    span.dzdx = z.a;
+    span.prim = (int)prims.size() - 1;
+    InsertSpan(y, span);
+  }
+}
+
+void SpanBuffer::Resolve(const FrameView &view) const
+{
+  for (int y = 0; y < height && y < view.height; y++) {
+    const std::vector<Span> &row = rows[y];
+
+    for (size_t i = 0; i < row.size(); i++) {
+      const Span &s = row[i];
+      const Primitive &p = prims[s.prim];
+      float r = p.r.a*s.x_left + p.r.b*y + p.r.c;
+      float g = p.g.a*s.x_left + p.g.b*y + p.g.c;
+      float b = p.b.a*s.x_left + p.b.b*y + p.b.c;
+      unsigned char *pixel = PixelAt(view, s.x_left, y);
+
+      for (int x = s.x_left; x < s.x_right; x++, pixel += 3) {
+        pixel[0] = (unsigned char)(r+0.5f);
+        pixel[1] = (unsigned char)(g+0.5f);
+        pixel[2] = (unsigned char)(b+0.5f);
+        r += p.r.a;
+        g += p.g.a;
+        b += p.b.a;
+      }
+    }
+  }
+}
@@ -0,0 +1,71 @@
+// Span-buffer (S-buffer) hidden-surface removal
+//
+// Instead of a depth value per pixel, every scanline keeps a sorted list of visible,
+// non-overlapping spans. Each span stores the depth equation of its primitive along
+// the scanline (z = z0 + dzdx*x). New spans are clipped against the list before any
+// pixel is written; pixels are only written once, by Resolve(), for the spans that
+// survived. Scenes made of large primitives need a few spans per scanline, which is
+// much less memory and bandwidth than a full depth buffer.
+
+#ifndef SPAN_BUFFER_H
+#define SPAN_BUFFER_H
+
+#include <vector>
+
+#include "FrameBuffer.h"
+
+enum VisibilityMode {
+  VIS_NONE,          // no hidden-surface removal: primitives overwrite in drawing order
+  VIS_SPAN_BUFFER    // per-scanline span lists, resolved once per frame
+};
+
+// Triangle vertex with depth; smaller z is closer to the viewer
+struct DepthVertex {
+  float         x, y, z;
+  unsigned char r, g, b;
+};
+
+class SpanBuffer {
+public:
+  SpanBuffer(int width, int height);
+
+  // Empties every scanline; call once per frame before inserting primitives
+  void Clear();
+
+  // Clips the triangle against the visible spans and keeps the parts in front.
+  // Covers every integer (x, y) inside the triangle or on its edges, found exactly
+  // per row. This is not quite ScanConvertTriangle's coverage: it steps its edges
+  // per column in float and can miss a pixel lying exactly on an edge. Nothing is
+  // written to the frame yet.
+  void InsertTriangle(const DepthVertex &v0, const DepthVertex &v1, const DepthVertex &v2);
+
+  // Writes the visible spans with their Gouraud colors
+  void Resolve(const FrameView &view) const;
+
+private:
+  // Attribute of a primitive as a linear function of the pixel position
+  struct Plane {
+    float a, b, c;      // value = a*x + b*y + c
+  };
+
+  struct Primitive {
+    Plane r, g, b;
+  };
+
+  struct Span {
+    int   x_left, x_right;   // pixels x_left <= x < x_right
+    float z0, dzdx;          // depth along the scanline: z0 + dzdx*x
+    int   prim;              // index into prims
+  };
+
+  void InsertSpan(int y, const Span &span);
+  void Emit(const Span &from, int x_left, int x_right);
+
+  int                             width;
+  int                             height;
+  std::vector<std::vector<Span> > rows;
+  std::vector<Primitive>          prims;
+  std::vector<Span>               merged;   // scratch: the pieces replacing the spans an insert overlaps
+};
+
+#endif
@@ -0,0 +1,91 @@
+// Row-major span writer (see SpanWriter.h)
+//
+// The 3 byte color repeats every 12 bytes (4 pixels) and every 48 bytes (16
+// pixels, three 16 byte vectors), so a span is written as whole copies of a
+// repeating pattern followed by a partial one.
+
+#include <memory.h>
+
+#include "SpanWriter.h"
+#include "CpuFeatures.h"
+
+// The SIMD kernels are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define SPAN_SSE2
+#define SPAN_AVX2
+#endif
+
+// A span kernel writes n pixels of the color at p, n > 0; "pattern" is the color
+// repeated over 96 bytes (32 pixels)
+typedef void (*SpanKernel)(unsigned char *p, int n, const unsigned char *pattern);
+
+static void FillSpan_Scalar(unsigned char *p, int n, const unsigned char *pattern)
+{
+  for (; n >= 4; n -= 4, p += 12) {
+    memcpy(p, pattern, 12);
+  }
+  memcpy(p, pattern, n*3);
+}
+
+#ifdef SPAN_SSE2
+// 16 pixels per step
+CPU_TARGET("sse2")
+static void FillSpan_SSE2(unsigned char *p, int n, const unsigned char *pattern)
+{
+  const __m128i v0 = _mm_loadu_si128((const __m128i *)(pattern+0));
+  const __m128i v1 = _mm_loadu_si128((const __m128i *)(pattern+16));
+  const __m128i v2 = _mm_loadu_si128((const __m128i *)(pattern+32));
+
+  for (; n >= 16; n -= 16, p += 48) {
+    _mm_storeu_si128((__m128i *)(p+0),  v0);
+    _mm_storeu_si128((__m128i *)(p+16), v1);
+    _mm_storeu_si128((__m128i *)(p+32), v2);
+  }
+  memcpy(p, pattern, n*3);
+}
+#endif
+
+#ifdef SPAN_AVX2
+// 32 pixels per step; the tail goes through the SSE2 kernel
+CPU_TARGET("avx2")
+static void FillSpan_AVX2(unsigned char *p, int n, const unsigned char *pattern)
+{
+  const __m256i v0 = _mm256_loadu_si256((const __m256i *)(pattern+0));
+  const __m256i v1 = _mm256_loadu_si256((const __m256i *)(pattern+32));
+  const __m256i v2 = _mm256_loadu_si256((const __m256i *)(pattern+64));
+
+  for (; n >= 32; n -= 32, p += 96) {
+    _mm256_storeu_si256((__m256i *)(p+0),  v0);
+    _mm256_storeu_si256((__m256i *)(p+32), v1);
+    _mm256_storeu_si256((__m256i *)(p+64), v2);
+  }
+  FillSpan_SSE2(p, n, pattern);
+}
+#endif
+
+static SpanKernel SelectFillSpan()
+{
+#ifdef SPAN_SSE2
+  unsigned features = CpuFeatures();
+
+  if (features & CPU_AVX2) return FillSpan_AVX2;
+  if (features & CPU_SSE2) return FillSpan_SSE2;
+#endif
+  return FillSpan_Scalar;
+}
+
+void FillSpan(const FrameView &view, int y, int x_left, int x_right, const unsigned char rgb[3])
+{
+  static const SpanKernel fill_span = SelectFillSpan();
+  unsigned char pattern[96];
+  int n = x_right - x_left;
+
+  if (n <= 0) return;
+
+  // Doubling copies: 3, 6, 12, 24, 48, 96 bytes
+  memcpy(pattern, rgb, 3);
+  for (int size = 3; size < 96; size *= 2) {
+    memcpy(pattern+size, pattern, size);
+  }
+  fill_span(PixelAt(view, x_left, y), n, pattern);
+}
@@ -0,0 +1,12 @@
+// Row-major span writer: fills horizontal runs of pixels in a FrameView
+
+#ifndef SPAN_WRITER_H
+#define SPAN_WRITER_H
+
+#include "FrameBuffer.h"
+
+// Fills the pixels x_left <= x < x_right of row y with a constant color.
+// The span must already be clipped to the frame.
+void FillSpan(const FrameView &view, int y, int x_left, int x_right, const unsigned char rgb[3]);
+
+#endif
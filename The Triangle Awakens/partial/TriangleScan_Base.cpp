@@ -1,40 +1,167 @@
 /* Extend the code to satisfy the assignment 1 requirements */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <memory.h>
+#include <string.h>
+#include <chrono>
 #include <GL/glut.h>
-#define WIDTH 400		
-#define HEIGHT 300	
-static GLubyte frame_buffer[HEIGHT][WIDTH][3];
+#include "FrameBuffer.h"
+#include "FramePipeline.h"
+#include "Blit.h"
+#include "MicroTriangle.h"
+#include "PolygonFill.h"
+#include "PathFill.h"
+#include "FloodFill.h"
+#include "SpanBuffer.h"
+#include "Shading.h"
+#include "PostProcess.h"
+#include "FrameRecorder.h"
+#include "CpuFeatures.h"
+#include "Benchmark.h"
+#include "GoldenImage.h"
+
+#define PRESENT_INTERVAL_MS 4	// how often the GLUT thread polls for a finished frame
+#define SHADING_THRESHOLD 8.0f	// largest color change across a coarse shading block
+#define BENCH_RUNS 200		// default number of timed runs per case of -bench
+#define GOLDEN_RUNS 20		// timed renders per scene and variant of -golden
+#define GOLDEN_SHADED_TOLERANCE 8	// coarse shading may be off by up to SHADING_THRESHOLD
+#define GOLDEN_SPAN_TOLERANCE 2		// span buffer interpolates along rows, so it rounds differently
+#define GOLDEN_PATH_TOLERANCE 6		// curves are flattened to within FLATTEN_TOLERANCE (0.02 of a pixel, 5 levels)
+#define GOLDEN_MICRO_TOLERANCE 1	// the micro-triangle kernel interpolates barycentrically, not along slopes
+#define GOLDEN_EDGE_TOLERANCE 8	// an edge pixel may take a neighbour's reference color within this
+#define GOLDEN_EDGE_SLACK 16		// ... in at most 1 in this many of the reference's edge pixels
+
+// Current render target: points into the ring slot the producer thread is rasterizing
+static GLubyte (*frame_buffer)[WIDTH][3];
+
+// Records every finished frame when started with -record; declared before the pipeline
+// so that the producer thread is gone before the recorder is destroyed
+static FrameRecorder recorder;
+
+// Hidden-surface removal of the span-buffer visibility mode, used by the producer thread;
+// declared before the pipeline for the same reason
+static SpanBuffer span_buffer(WIDTH, HEIGHT);
+
+// Markers on the vertices clicked so far for the next triangle, in the vertex colors;
+// drawn by the producer thread, so declared before the pipeline as well
+#define MARKER_SIZE 9
+static Sprite marker_sprites[3];
+
+// Post-processing of finished frames, toggled with 'p'. The chain itself is used on the producer
+// thread, so it is declared before the pipeline too: its destructor stops the worker threads.
+static std::atomic<bool> post_process_enabled(false);
+static PostProcessChain post_process;
+
+// Rasterizes on a producer thread while the display callback presents finished frames
+static FramePipeline pipeline;
+
+// Mouse clicks, queued by the GLUT thread and consumed by the producer thread
+struct ClickEvent {
+  int x, y;
+};
+static SpscQueue<ClickEvent, 256> click_queue;
+
+// Visibility mode, toggled with 'v' on the GLUT thread
+static std::atomic<int> visibility_mode(VIS_NONE);
+static std::atomic<bool> mode_changed(false);
+
+// Coarsest shading rate of the shader path, cycled with 's'; 1 draws with ScanConvertTriangle
+static std::atomic<int> shading_rate(SHADING_RATE_1X1);
+
+// Scene state, owned by the producer thread
+static int cnt = 0;
+static int points[3][2];
+static bool has_triangle = false;
+static int triangle[3][2];
+static unsigned char color[3][3] = {
+  {255,   0,   0},      // r0, g0, b0
+  {  0, 255,   0},      // r1, g1, b1
+  {  0,   0, 255}       // r2, g2, b2
+};
+
+// ScanConvertTriangle's micro-triangle fast path; -golden-update turns it off, so that
+// the references come from the slope/scan path alone
+static bool micro_triangles = true;
+
+// The column kernels of FillScanLine are built into every x86 binary and picked at run time
+#ifdef CPU_X86
+#define SCAN_LINE_SSE2
+#endif
+
+// A column kernel writes "count" pixels from p downwards in memory (one row apart),
+// starting at color "start" and adding "step" to it per pixel
+typedef void (*ScanLineKernel)(unsigned char *p, int count, const float start[3], const float step[3]);
+
+static void FillColumn_Scalar(unsigned char *p, int count, const float start[3], const float step[3])
+{
+  float r = start[0], g = start[1], b = start[2];
+
+  for (; count > 0; count--, p += WIDTH*3) {
+    p[0] = (unsigned char)(r+0.5f);
+    p[1] = (unsigned char)(g+0.5f);
+    p[2] = (unsigned char)(b+0.5f);
+
+    r += step[0];
+    g += step[1];
+    b += step[2];
+  }
+}
+
+#ifdef SCAN_LINE_SSE2
+// r, g and b in three lanes of one register: each lane sees the same additions as
+// the scalar accumulators, so the colors match exactly
+CPU_TARGET("sse2")
+static void FillColumn_SSE2(unsigned char *p, int count, const float start[3], const float step[3])
+{
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 d    = _mm_setr_ps(step[0], step[1], step[2], 0);
+  __m128 c = _mm_setr_ps(start[0], start[1], start[2], 0);
+
+  for (; count > 0; count--, p += WIDTH*3) {
+    int rgb[4];
+    _mm_storeu_si128((__m128i *)rgb, _mm_cvttps_epi32(_mm_add_ps(c, half)));
+    p[0] = (unsigned char)rgb[0];
+    p[1] = (unsigned char)rgb[1];
+    p[2] = (unsigned char)rgb[2];
+    c = _mm_add_ps(c, d);
+  }
+}
+#endif
+
+static ScanLineKernel SelectFillColumn()
+{
+#ifdef SCAN_LINE_SSE2
+  if (CpuFeatures() & CPU_SSE2) return FillColumn_SSE2;
+#endif
+  return FillColumn_Scalar;
+}
 
 // Fill each scanline
 // yT = top of the scanline, yB = bottom of the scanline
 void FillScanLine(int x, float yT, float rT, float gT, float bT, float yB, float rB, float gB, float bB)
 {
+  static const ScanLineKernel fill_column = SelectFillColumn();
   int yT_floor, yB_ceil;
-  int y;
-  float r, g, b, mr, mg, mb;
+  float start[3], step[3];
 
   yT_floor = floor(yT);
   yB_ceil  = ceil(yB);
+  if (yB_ceil > yT_floor) return;
 
-  mr = (rT-rB)/(yT-yB);
-  mg = (gT-gB)/(yT-yB);
-  mb = (bT-bB)/(yT-yB);
-  r  = rB + (yB_ceil-yB)*mr;
-  g  = gB + (yB_ceil-yB)*mg;
-  b  = bB + (yB_ceil-yB)*mb;
-
-  for(y = yB_ceil; y <= yT_floor; y++) {
-    frame_buffer[y][x][0] = (unsigned char)(r+0.5f);
-    frame_buffer[y][x][1] = (unsigned char)(g+0.5f);
-    frame_buffer[y][x][2] = (unsigned char)(b+0.5f);
-
-    r += mr;
-    g += mg;
-    b += mb;
+  if (yT == yB) {  // both edges meet here (at a vertex), the span is a single point
+    step[0] = step[1] = step[2] = 0;
+  } else {
+    step[0] = (rT-rB)/(yT-yB);
+    step[1] = (gT-gB)/(yT-yB);
+    step[2] = (bT-bB)/(yT-yB);
   }
+  start[0] = rB + (yB_ceil-yB)*step[0];
+  start[1] = gB + (yB_ceil-yB)*step[1];
+  start[2] = bB + (yB_ceil-yB)*step[2];
+
+  fill_column(frame_buffer[yB_ceil][x], yT_floor - yB_ceil + 1, start, step);
 }
 
 // The main triangle scan conversion function 
@@ -48,110 +175,332 @@ void ScanConvertTriangle(
   float l01_r, l01_g, l01_b, l01_mr, l01_mg, l01_mb;
   float l02_y, l02_m; 
   float l02_r, l02_g, l02_b, l02_mr, l02_mg, l02_mb;
+  float l12_y, l12_m;
+  float l12_r, l12_g, l12_b, l12_mr, l12_mg, l12_mb;
   int x;
-  
-  // Computes the slopes for L01 and L02
-  l01_m  = (float)(y1-y0)/(x1-x0);
-  l01_mr = (float)(r1-r0)/(x1-x0);
-  l01_mg = (float)(g1-g0)/(x1-x0);
-  l01_mb = (float)(b1-b0)/(x1-x0);
 
+  // Degenerate triangles (all points on a line) cover no pixels
+  if ((x1-x0)*(y2-y0) - (y1-y0)*(x2-x0) == 0) return;
+
+  // Triangles covering a few pixels skip the slope setup entirely
+  if (micro_triangles && IsMicroTriangle(x0, y0, x1, y1, x2, y2)) {
+    FrameView view = { &frame_buffer[0][0][0], WIDTH, HEIGHT };
+    ScanConvertMicroTriangle(view, x0, y0, r0, g0, b0, x1, y1, r1, g1, b1, x2, y2, r2, g2, b2);
+    return;
+  }
+
+  // Computes the slope for L02 (x0 < x2, since the triangle is not degenerate)
   l02_m  = (float)(y2-y0)/(x2-x0);
   l02_mr = (float)(r2-r0)/(x2-x0);
   l02_mg = (float)(g2-g0)/(x2-x0);
   l02_mb = (float)(b2-b0)/(x2-x0);
 
-  // Initializes the edge tracing
-  l01_y = y0;
-  l01_r = r0;
-  l01_g = g0;
-  l01_b = b0;
-
   l02_y = y0;
   l02_r = r0;
   l02_g = g0;
   l02_b = b0;
 
-  // Scan the first half of the triangle
-  // TODO: handle the case when x0==x1 
-  for(x=x0; x<x1; x++) {
-    if (l02_y >= l01_y) { 
-      FillScanLine(x, l02_y, l02_r, l02_g, l02_b, l01_y, l01_r, l01_g, l01_b);
+  // Scan the first half of the triangle (empty when x0==x1)
+  if (x0 < x1) {
+    l01_m  = (float)(y1-y0)/(x1-x0);
+    l01_mr = (float)(r1-r0)/(x1-x0);
+    l01_mg = (float)(g1-g0)/(x1-x0);
+    l01_mb = (float)(b1-b0)/(x1-x0);
+
+    l01_y = y0;
+    l01_r = r0;
+    l01_g = g0;
+    l01_b = b0;
+
+    for(x=x0; x<x1; x++) {
+      if (l02_y >= l01_y) { 
+        FillScanLine(x, l02_y, l02_r, l02_g, l02_b, l01_y, l01_r, l01_g, l01_b);
+      } else {
+        FillScanLine(x, l01_y, l01_r, l01_g, l01_b, l02_y, l02_r, l02_g, l02_b);
+      }
+
+      l01_y += l01_m;
+      l01_r += l01_mr;
+      l01_g += l01_mg;
+      l01_b += l01_mb;
+
+      l02_y += l02_m;
+      l02_r += l02_mr;
+      l02_g += l02_mg;
+      l02_b += l02_mb;
+    }
+  }
+
+  // Scan the second half of the triangle
+  if (x1 == x2) {
+    // L12 is vertical: the last column runs from v1 straight to v2
+    if (y2 >= y1) {
+      FillScanLine(x2, (float)y2, r2, g2, b2, (float)y1, r1, g1, b1);
     } else {
-      FillScanLine(x, l01_y, l01_r, l01_g, l01_b, l02_y, l02_r, l02_g, l02_b);
+      FillScanLine(x2, (float)y1, r1, g1, b1, (float)y2, r2, g2, b2);
     }
-    
-    l01_y += l01_m;
-    l01_r += l01_mr;
-    l01_g += l01_mg;
-    l01_b += l01_mb;
+    return;
+  }
+
+  l12_m  = (float)(y2-y1)/(x2-x1);
+  l12_mr = (float)(r2-r1)/(x2-x1);
+  l12_mg = (float)(g2-g1)/(x2-x1);
+  l12_mb = (float)(b2-b1)/(x2-x1);
+
+  l12_y = y1;
+  l12_r = r1;
+  l12_g = g1;
+  l12_b = b1;
+
+  for(x=x1; x<=x2; x++) {
+    if (l02_y >= l12_y) { 
+      FillScanLine(x, l02_y, l02_r, l02_g, l02_b, l12_y, l12_r, l12_g, l12_b);
+    } else {
+      FillScanLine(x, l12_y, l12_r, l12_g, l12_b, l02_y, l02_r, l02_g, l02_b);
+    }
+
+    l12_y += l12_m;
+    l12_r += l12_mr;
+    l12_g += l12_mg;
+    l12_b += l12_mb;
 
     l02_y += l02_m;
     l02_r += l02_mr;
     l02_g += l02_mg;
     l02_b += l02_mb;
   }
+}
 
-  // Scan the second half of the triangle
-  // TODO: handle the case when x1==x2 
+// Draws the clicked triangle, passing its points in the order ScanConvertTriangle expects
+void DrawTriangle(int points[3][2])
+{
+  // Pass the points (with their colors) in the order x0 <= x1 <= x2
+  if (points[0][0] <= points[1][0]) {
+    if (points[1][0] <= points[2][0]) { // x0 <= x1 <= x2
+      ScanConvertTriangle(
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2],  // x1, y1, r1, g1, b1
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2]   // x2, y2, r2, g2, b2
+      );
+    } else 
+    if (points[0][0] <= points[2][0]) { // x0 <= x2 <= x1
+      ScanConvertTriangle(
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2]   // x1, y1, r1, g1, b1            
+      );
+    } else { // x2 <= x0 <= x1
+      ScanConvertTriangle(
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0				    
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2]   // x1, y1, r1, g1, b1            
+      );
+    }
+  } else { // x1 < x0
+    if (points[0][0] <= points[2][0]) { // x1 < x0 <= x2
+      ScanConvertTriangle(
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2],  // x1, y1, r1, g1, b1
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2]   // x2, y2, r2, g2, b2
+      );
+    } else
+    if (points[1][0] <= points[2][0]) { // x1 <= x2 < x0
+      ScanConvertTriangle(
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2],  // x1, y1, r1, g1, b1
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2]   // x0, y0, r0, g0, b0
+      );
+    } else { // x2 < x1 < x0
+      ScanConvertTriangle(
+        points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
+        points[1][0], points[1][1], color[1][0], color[1][1], color[1][2],  // x1, y1, r1, g1, b1
+        points[0][0], points[0][1], color[0][0], color[0][1], color[0][2]   // x0, y0, r0, g0, b0
+      );
+    }
+  }
 }
 
-/* Called when mouse button pressed: */
-void mousebuttonhandler(int button, int state, int x, int y)
+// Soft disc sprite source: "rgb" everywhere, with a straight alpha that falls off towards the rim
+static void MakeDiscRgba(unsigned char *rgba, int size, const unsigned char rgb[3])
 {
-  static int cnt = 0;
-  static int points[3][2];
-  static unsigned char color[3][3] = {
-    {255,   0,   0},      // r0, g0, b0
-    {  0, 255,   0},      // r1, g1, b1
-    {  0,   0, 255}       // r2, g2, b2
-  };
+  float radius = size*0.5f;
 
-  //printf("Mouse button event, button=%d, state=%d, x=%d, y=%d\n", button, state, x, y);
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      float dx = x + 0.5f - radius, dy = y + 0.5f - radius;
+      float t = 1 - sqrtf(dx*dx + dy*dy)/radius;
+      unsigned char *p = rgba + (y*size + x)*4;
+      memcpy(p, rgb, 3);
+      p[3] = (unsigned char)(t <= 0 ? 0 : t >= 0.5f ? 255 : t*2*255 + 0.5f);
+    }
+  }
+}
 
-  // set a pixel's red color value when left mouse button is pressed down:
-  if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
-    points[cnt][0] = x;
-    points[cnt][1] = HEIGHT-y-1;
+static void BuildMarkers()
+{
+  unsigned char rgba[MARKER_SIZE*MARKER_SIZE*4];
+
+  for (int i = 0; i < 3; i++) {
+    MakeDiscRgba(rgba, MARKER_SIZE, color[i]);
+    MakeSprite(marker_sprites[i], rgba, MARKER_SIZE, MARKER_SIZE, false);
+  }
+}
+
+// Producer thread: applies the queued clicks to the scene
+bool UpdateScene(void *user)
+{
+  ClickEvent click;
+  bool changed = mode_changed.exchange(false);
+
+  while (click_queue.Pop(click)) {
+    points[cnt][0] = click.x;
+    points[cnt][1] = HEIGHT-click.y-1;
     cnt++;
 
-    //printf("Mouse clicked=%d, x=%d, y=%d\n", cnt, x, y);
+    //printf("Mouse clicked=%d, x=%d, y=%d\n", cnt, click.x, click.y);
     if (cnt == 1) {
-      memset(frame_buffer, 0, sizeof(frame_buffer));
+      has_triangle = false;   // the first click of a new triangle clears the frame
     }
+    changed = true;           // every click adds a marker or completes the triangle
 
     if (cnt == 3) {
-      // TODO: make sure point0, 1, 2 are passed in the correct order x0<=x1<=x2
-      if (points[0][0] <= points[1][0]) {
-        if (points[1][0] <= points[2][0]) { // x0 <= x1 <= x2
-          ScanConvertTriangle(
-            points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0
-            points[1][0], points[1][1], color[1][0], color[1][1], color[1][2],  // x1, y1, r1, g1, b1
-            points[2][0], points[2][1], color[2][0], color[2][1], color[2][2]   // x2, y2, r2, g2, b2
-          );
-        } else 
-		    if (points[0][0] <= points[2][0]) { // x0 <= x2 <= x1
-          ScanConvertTriangle(
-            points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0
-            points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
-            points[1][0], points[1][1], color[1][0], color[1][1], color[1][2]   // x1, y1, r1, g1, b1            
-          );
-		    } else { // x2 <= x0 <= x1
-          ScanConvertTriangle(
-            points[2][0], points[2][1], color[2][0], color[2][1], color[2][2],  // x2, y2, r2, g2, b2
-				    points[0][0], points[0][1], color[0][0], color[0][1], color[0][2],  // x0, y0, r0, g0, b0				    
-				    points[1][0], points[1][1], color[1][0], color[1][1], color[1][2]   // x1, y1, r1, g1, b1            
-			    );
-		    }
-      } else { // x1 < x0
-        // TODO: fill in the rest here
-      }
+      memcpy(triangle, points, sizeof(triangle));
+      has_triangle = true;
+      changed = true;
       cnt = 0;
     }
   }
+  return changed;
+}
+
+// Draws triangles into frame_buffer with the given visibility mode and shading rate.
+// "depths" holds the z of every vertex for the span buffer; NULL puts every triangle
+// in front of the ones drawn before it, so overlaps resolve as they do when drawing
+// without visibility.
+static void DrawTriangles(int (*triangles)[3][2], const float (*depths)[3], int count, int visibility, int rate)
+{
+  FrameView view = { &frame_buffer[0][0][0], WIDTH, HEIGHT };
+  int t, i;
 
-  // cause a display event to occur for GLUT:
-  glutPostRedisplay();
+  if (visibility == VIS_SPAN_BUFFER) {
+    span_buffer.Clear();
+    for (t = 0; t < count; t++) {
+      DepthVertex v[3];
+      for (i = 0; i < 3; i++) {
+        v[i].x = (float)triangles[t][i][0];
+        v[i].y = (float)triangles[t][i][1];
+        v[i].z = depths ? depths[t][i] : (float)-t;
+        v[i].r = color[i][0];
+        v[i].g = color[i][1];
+        v[i].b = color[i][2];
+      }
+      span_buffer.InsertTriangle(v[0], v[1], v[2]);
+    }
+    span_buffer.Resolve(view);
+  } else if (rate != SHADING_RATE_1X1) {
+    ShadingOptions options = { (ShadingRate)rate, SHADING_THRESHOLD };
+    for (t = 0; t < count; t++) {
+      ShadedVertex v[3];
+      for (i = 0; i < 3; i++) {
+        v[i].x = triangles[t][i][0];
+        v[i].y = triangles[t][i][1];
+        v[i].r = color[i][0];
+        v[i].g = color[i][1];
+        v[i].b = color[i][2];
+      }
+      ScanConvertTriangleShaded(view, v[0], v[1], v[2], GouraudShader, NULL, options, NULL);
+    }
+  } else {
+    for (t = 0; t < count; t++) DrawTriangle(triangles[t]);
+  }
+}
+
+// Producer thread: rasterizes the whole scene into a ring slot
+void RenderScene(FrameSlot &slot, void *user)
+{
+  FrameView view = { &slot.pixels[0][0][0], WIDTH, HEIGHT };
+
+  frame_buffer = slot.pixels;
+  memset(slot.pixels, 0, sizeof(slot.pixels));
+
+  if (has_triangle) {
+    DrawTriangles(&triangle, NULL, 1, visibility_mode.load(), shading_rate.load());
+  }
+  for (int i = 0; i < cnt; i++) {
+    BlitCommand marker = { &marker_sprites[i], points[i][0] - MARKER_SIZE/2, points[i][1] - MARKER_SIZE/2,
+                           0, 0, BLIT_OVER, 255 };
+    Blit(view, marker);
+  }
+
+  if (post_process_enabled.load()) {
+    post_process.Apply(view);
+  }
+  if (recorder.IsOpen()) {
+    recorder.Submit(view);    // never waits: drops the frame when the encoder is behind
+  }
+}
+
+/* Called when mouse button pressed: */
+void mousebuttonhandler(int button, int state, int x, int y)
+{
+  //printf("Mouse button event, button=%d, state=%d, x=%d, y=%d\n", button, state, x, y);
+
+  // queue the click for the producer thread when left mouse button is pressed down:
+  if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+    ClickEvent click = { x, y };
+    if (click_queue.Push(click)) {
+      pipeline.Kick();
+    }
+  }
+}
+
+/* Called when a key is pressed: */
+void keyboardhandler(unsigned char key, int x, int y)
+{
+  switch (key) {
+    case 'v': // Toggles the visibility mode (hidden-surface removal)
+      visibility_mode.store(visibility_mode.load() == VIS_NONE ? VIS_SPAN_BUFFER : VIS_NONE);
+      printf("Visibility mode = %s\n", visibility_mode.load() == VIS_NONE ? "none" : "span buffer");
+      mode_changed.store(true);
+      pipeline.Kick();
+      break;
+
+    case 's': // Cycles the coarsest shading rate of the shader path: 1x1, 2x2, 4x4
+      shading_rate.store(shading_rate.load() == SHADING_RATE_4X4 ? SHADING_RATE_1X1 : shading_rate.load()*2);
+      printf("Shading rate = %dx%d\n", shading_rate.load(), shading_rate.load());
+      mode_changed.store(true);
+      pipeline.Kick();
+      break;
+
+    case 'p': // Toggles post-processing of the frame
+      post_process_enabled.store(!post_process_enabled.load());
+      printf("Post-processing = %s\n", post_process_enabled.load() ? "on" : "off");
+      mode_changed.store(true);
+      pipeline.Kick();
+      break;
+  }
+}
+
+/* Called by a GLUT timer: asks for a redraw once the producer has finished a frame */
+void presenttimer(int value)
+{
+  if (pipeline.HasNewFrame()) {
+    glutPostRedisplay();
+  }
+  glutTimerFunc(PRESENT_INTERVAL_MS, presenttimer, 0);
+}
+
+/* Called at exit: stops the producer, then finishes the recording */
+void stoprecording(void)
+{
+  pipeline.Stop();
+  recorder.Close();
+
+  RecorderStats stats = recorder.Stats();
+  printf("Recorded %u frames (%u dropped), %llu bytes raw, %llu bytes written, %llu tiles stored\n",
+         stats.frames, stats.dropped, (unsigned long long)stats.raw_bytes,
+         (unsigned long long)stats.file_bytes, (unsigned long long)stats.tiles_stored);
+  if (stats.failed) printf("Recording stopped early: a write failed\n");
 }
 
 /* Called by GLUT when a display event occurs: */
@@ -161,14 +510,895 @@ void display(void) {
 		(with glDrawPixels) when the window is resized to smaller dimensions.*/
 	glRasterPos2i(-1,-1);
 
-	// Write the information stored in "frame_buffer" to the color buffer
-	glDrawPixels(WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, frame_buffer);
+	// Write the newest finished frame to the color buffer
+	const FrameSlot &frame = pipeline.AcquireLatest();
+	glDrawPixels(WIDTH, HEIGHT, GL_RGB, GL_UNSIGNED_BYTE, frame.pixels);
 	glFlush();
 }
 
+// Render target of the -bench and -golden modes, which run without a window or the pipeline
+static GLubyte offscreen_frame[HEIGHT][WIDTH][3];
+
+// Shapes for the fill kernels other than the triangle paths, shared by -bench and -golden
+
+struct TestPolygon {
+  const PolyContour *contours;
+  int                count;
+  FillRule           rule;
+};
+
+static const unsigned char fill_color[3] = { 255, 160, 40 };
+
+static const PolyPoint star_points[]  = { {200, 280}, {259.5f, 99.25f}, {105.25f, 210.5f}, {294.75f, 210.5f}, {140.5f, 99.25f} };
+static const PolyPoint frame_outer[]  = { {40.5f, 30.25f}, {360.75f, 40.5f}, {350.25f, 270.5f}, {50.5f, 260.75f} };
+static const PolyPoint frame_hole[]   = { {120, 100}, {120.5f, 200.5f}, {280, 190}, {270.5f, 110.25f} };   // opposite winding
+static const PolyPoint comb_points[]  = { {20, 20}, {380, 20}, {380, 280}, {320.5f, 280}, {300.25f, 60.5f}, {260.5f, 280},
+                                          {200.25f, 280}, {180.5f, 60.5f}, {140.25f, 280}, {20, 280} };
+
+static const PolyContour star_contour[]  = { { star_points, 5 } };
+static const PolyContour frame_contour[] = { { frame_outer, 4 }, { frame_hole, 4 } };
+static const PolyContour comb_contour[]  = { { comb_points, 10 } };
+
+static const TestPolygon star_even_odd = { star_contour,  1, FILL_EVEN_ODD };
+static const TestPolygon star_nonzero  = { star_contour,  1, FILL_NONZERO };
+static const TestPolygon frame_nonzero = { frame_contour, 2, FILL_NONZERO };
+static const TestPolygon comb_even_odd = { comb_contour,  1, FILL_EVEN_ODD };
+
+static PolygonFiller polygon_filler;
+
+static void FillPolygon(const FrameView &view, const void *shape)
+{
+  const TestPolygon &polygon = *(const TestPolygon *)shape;
+  polygon_filler.Fill(view, polygon.contours, polygon.count, polygon.rule, fill_color);
+}
+
+// Brute-force reference for FillPolygon: a pixel is inside by the winding of the edges whose
+// half-open row range [y_low, y_high) holds its row and that cross the row at or left of it
+static void ReferencePolygon(const FrameView &view, const void *shape)
+{
+  const TestPolygon &polygon = *(const TestPolygon *)shape;
+
+  for (int y = 0; y < view.height; y++) {
+    for (int x = 0; x < view.width; x++) {
+      int winding = 0;
+      for (int c = 0; c < polygon.count; c++) {
+        const PolyPoint *p = polygon.contours[c].points;
+        int n = polygon.contours[c].count;
+        for (int i = 0; i < n; i++) {
+          PolyPoint a = p[i], b = p[(i+1) % n];
+          int direction = a.y < b.y ? 1 : -1;
+          if (a.y == b.y) continue;
+          if (a.y > b.y) { PolyPoint t = a; a = b; b = t; }
+          if (y < a.y || y >= b.y) continue;
+          if (a.x + (y - a.y)*(b.x - a.x)/(b.y - a.y) <= x) winding += polygon.rule == FILL_EVEN_ODD ? 1 : direction;
+        }
+      }
+      if (polygon.rule == FILL_EVEN_ODD ? (winding & 1) != 0 : winding != 0) {
+        memcpy(PixelAt(view, x, y), fill_color, 3);
+      }
+    }
+  }
+}
+
+// Triangles with per-vertex depth for the span buffer: the first two pierce each other
+// along a line, the third lies behind both and shows only around them
+struct DepthScene {
+  int        (*triangles)[3][2];
+  const float (*depths)[3];
+  int          count;
+};
+
+static int depth_triangles[3][3][2] = {
+  { {30, 40},  {370, 70},  {190, 280} },
+  { {40, 250}, {360, 230}, {210, 20} },
+  { {10, 150}, {200, 295}, {390, 5} },
+};
+static const float depth_z[3][3] = {
+  { 0.1f, 0.9f, 0.5f },
+  { 0.8f, 0.2f, 0.5f },
+  { 0.95f, 0.95f, 0.95f },
+};
+static const DepthScene depth_scene = { depth_triangles, depth_z, 3 };
+
+static void FillDepthScene(const FrameView &view, const void *shape)
+{
+  const DepthScene &scene = *(const DepthScene *)shape;
+  DrawTriangles(scene.triangles, scene.depths, scene.count, VIS_SPAN_BUFFER, SHADING_RATE_1X1);
+}
+
+// Brute-force reference for FillDepthScene: tests every pixel against every triangle,
+// edges included, and keeps the color of the closest one (the first on equal depth)
+static void ReferenceDepthScene(const FrameView &view, const void *shape)
+{
+  const DepthScene &scene = *(const DepthScene *)shape;
+
+  for (int y = 0; y < view.height; y++) {
+    for (int x = 0; x < view.width; x++) {
+      float nearest = 0;
+      bool covered = false;
+      for (int t = 0; t < scene.count; t++) {
+        const int (*p)[2] = scene.triangles[t];
+        int area = (p[1][0]-p[0][0])*(p[2][1]-p[0][1]) - (p[1][1]-p[0][1])*(p[2][0]-p[0][0]);
+        int w0 = (p[2][0]-p[1][0])*(y-p[1][1]) - (p[2][1]-p[1][1])*(x-p[1][0]);
+        int w1 = (p[0][0]-p[2][0])*(y-p[2][1]) - (p[0][1]-p[2][1])*(x-p[2][0]);
+        int w2 = (p[1][0]-p[0][0])*(y-p[0][1]) - (p[1][1]-p[0][1])*(x-p[0][0]);
+        if (area == 0) continue;
+        if (area < 0) { area = -area; w0 = -w0; w1 = -w1; w2 = -w2; }
+        if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+
+        float b0 = (float)w0/area, b1 = (float)w1/area, b2 = (float)w2/area;
+        float z = b0*scene.depths[t][0] + b1*scene.depths[t][1] + b2*scene.depths[t][2];
+        if (covered && z >= nearest) continue;
+        nearest = z;
+        covered = true;
+
+        unsigned char *pixel = PixelAt(view, x, y);
+        for (int c = 0; c < 3; c++) {
+          pixel[c] = (unsigned char)(b0*color[0][c] + b1*color[1][c] + b2*color[2][c] + 0.5f);
+        }
+      }
+    }
+  }
+}
+
+// Sprites over a gradient background, drawn as one BlitDrawList: every blend mode, scaled
+// up and down, overlapping across bands and clipped on every side of the frame
+#define TEST_SPRITE_SIZE 24
+
+static unsigned char disc_rgba[TEST_SPRITE_SIZE*TEST_SPRITE_SIZE*4];   // soft disc, straight alpha
+static unsigned char ring_rgb[TEST_SPRITE_SIZE*TEST_SPRITE_SIZE*3];    // ring around the key color
+static const unsigned char ring_key[3] = { 255, 0, 255 };
+static Sprite disc_sprite, ring_sprite;
+
+static const BlitCommand blit_commands[] = {
+  { &ring_sprite,  10,  10,  0,  0, BLIT_COLOR_KEY,      255 },
+  { &disc_sprite,  50,  40,  0,  0, BLIT_OVER,           255 },
+  { &disc_sprite,  60,  50, 96, 72, BLIT_OVER,           255 },
+  { &disc_sprite, 200, 100,  0,  0, BLIT_CONSTANT_ALPHA, 128 },
+  { &ring_sprite, 150, 150, 40, 16, BLIT_COPY,           255 },
+  { &disc_sprite, 300, 120, 13,  9, BLIT_CONSTANT_ALPHA, 200 },
+  { &disc_sprite, -10, 285,  0,  0, BLIT_OVER,           255 },
+  { &ring_sprite, 390,  -8,  0,  0, BLIT_COLOR_KEY,      255 },
+  { &ring_sprite, 120,  60, 64, 64, BLIT_COLOR_KEY,      255 },
+};
+static BlitDrawList blit_list;
+
+static void BuildTestSprites()
+{
+  int size = TEST_SPRITE_SIZE, x, y;
+
+  MakeDiscRgba(disc_rgba, size, fill_color);
+  for (y = 0; y < size; y++) {
+    for (x = 0; x < size; x++) {
+      float dx = x + 0.5f - size*0.5f, dy = y + 0.5f - size*0.5f;
+      float d = sqrtf(dx*dx + dy*dy);
+      unsigned char *p = ring_rgb + (y*size + x)*3;
+      if (d < size*0.25f || d > size*0.5f) {
+        memcpy(p, ring_key, 3);
+      } else {
+        p[0] = (unsigned char)(x*10);
+        p[1] = (unsigned char)(y*10);
+        p[2] = 128;
+      }
+    }
+  }
+  MakeSprite(disc_sprite, disc_rgba, size, size, false);
+  MakeColorKeySprite(ring_sprite, ring_rgb, size, size, ring_key);
+
+  blit_list.Clear();
+  for (size_t i = 0; i < sizeof(blit_commands)/sizeof(blit_commands[0]); i++) blit_list.Add(blit_commands[i]);
+}
+
+static void FillBackground(const FrameView &view)
+{
+  for (int y = 0; y < view.height; y++) {
+    for (int x = 0; x < view.width; x++) {
+      unsigned char *p = PixelAt(view, x, y);
+      p[0] = (unsigned char)(x*255/(view.width-1));
+      p[1] = (unsigned char)(y*255/(view.height-1));
+      p[2] = 96;
+    }
+  }
+}
+
+static void FillBlits(const FrameView &view, const void *shape)
+{
+  FillBackground(view);
+  blit_list.Draw(view);
+}
+
+// v*a/255 rounded to nearest, computed differently from the blit kernels
+static inline unsigned RoundMul255(unsigned v, unsigned a)
+{
+  return (2*v*a + 255)/510;
+}
+
+// Brute-force reference for FillBlits: blends every covered pixel of every command,
+// in order, straight from the sprite sources
+static void ReferenceBlits(const FrameView &view, const void *shape)
+{
+  int size = TEST_SPRITE_SIZE;
+
+  FillBackground(view);
+  for (size_t i = 0; i < sizeof(blit_commands)/sizeof(blit_commands[0]); i++) {
+    const BlitCommand &cmd = blit_commands[i];
+    int w = cmd.width  > 0 ? cmd.width  : size;
+    int h = cmd.height > 0 ? cmd.height : size;
+
+    for (int y = cmd.y; y < cmd.y + h; y++) {
+      for (int x = cmd.x; x < cmd.x + w; x++) {
+        if (x < 0 || y < 0 || x >= view.width || y >= view.height) continue;
+
+        int sx = (x - cmd.x)*size/w, sy = (y - cmd.y)*size/h;
+        unsigned src[3], a;
+        if (cmd.sprite == &disc_sprite) {
+          const unsigned char *s = disc_rgba + (sy*size + sx)*4;
+          a = s[3];
+          for (int c = 0; c < 3; c++) src[c] = RoundMul255(s[c], a);
+        } else {
+          const unsigned char *s = ring_rgb + (sy*size + sx)*3;
+          a = memcmp(s, ring_key, 3) == 0 ? 0 : 255;
+          for (int c = 0; c < 3; c++) src[c] = s[c];
+        }
+
+        unsigned char *p = PixelAt(view, x, y);
+        for (int c = 0; c < 3; c++) {
+          unsigned v = src[c], va = a;
+          switch (cmd.mode) {
+            case BLIT_COPY:
+              p[c] = (unsigned char)v;
+              break;
+            case BLIT_COLOR_KEY:
+              if (va) p[c] = (unsigned char)v;
+              break;
+            case BLIT_CONSTANT_ALPHA:
+              v  = RoundMul255(v, cmd.constant_alpha);
+              va = RoundMul255(va, cmd.constant_alpha);
+              // fall through
+            case BLIT_OVER:
+              v += RoundMul255(p[c], 255 - va);
+              p[c] = (unsigned char)(v > 255 ? 255 : v);
+              break;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Bezier paths: a ring of cubics with a reversed hole, a lens of quadratics and a
+// self-overlapping star, placed at quarter-pixel positions. The ring is drawn twice
+// at the same phase, so the second one comes from the PathCache.
+struct PathSegment {
+  char  kind;     // 'M'ove, 'L'ine, 'Q'uadratic, 'C'ubic
+  float p[6];     // control points, then the end point
+};
+
+struct PathPlacement {
+  const PathSegment *segments;
+  int                count;
+  float              x, y;
+};
+
+#define K 0.5523f   // cubic control distance of a quarter circle of radius 1
+
+static const PathSegment ring_path[] = {
+  { 'M', { 50, 0 } },
+  { 'C', { 50, 50*K,   50*K, 50,    0, 50 } },
+  { 'C', { -50*K, 50,  -50, 50*K,   -50, 0 } },
+  { 'C', { -50, -50*K, -50*K, -50,  0, -50 } },
+  { 'C', { 50*K, -50,  50, -50*K,   50, 0 } },
+  { 'M', { 25, 0 } },
+  { 'C', { 25, -25*K,  25*K, -25,   0, -25 } },
+  { 'C', { -25*K, -25, -25, -25*K,  -25, 0 } },
+  { 'C', { -25, 25*K,  -25*K, 25,   0, 25 } },
+  { 'C', { 25*K, 25,   25, 25*K,    25, 0 } },
+};
+static const PathSegment lens_path[] = {
+  { 'M', { 0, 0 } },
+  { 'Q', { 45, 60,  0, 110 } },
+  { 'Q', { -45, 60, 0, 0 } },
+};
+static const PathSegment star_path[] = {
+  { 'M', { 0, 50 } }, { 'L', { 29.4f, -40.5f } }, { 'L', { -47.6f, 15.5f } }, { 'L', { 47.6f, 15.5f } },
+  { 'L', { -29.4f, -40.5f } },
+};
+
+#undef K
+
+// On quarter pixels, where PathCache's masks match the exact position
+static const PathPlacement path_placements[] = {
+  { ring_path, 10, 90.25f,  200.5f },
+  { ring_path, 10, 300.25f, 90.5f },
+  { lens_path, 3,  200.75f, 20 },
+  { star_path, 5,  300.5f,  225.25f },
+};
+static const int path_placement_count = sizeof(path_placements)/sizeof(path_placements[0]);
+
+static Path test_paths[path_placement_count];
+static PathCache path_cache;
+
+static void BuildTestPaths()
+{
+  for (int i = 0; i < path_placement_count; i++) {
+    Path &path = test_paths[i];
+    path.Clear();
+    for (int k = 0; k < path_placements[i].count; k++) {
+      const PathSegment &s = path_placements[i].segments[k];
+      switch (s.kind) {
+        case 'M': path.MoveTo(s.p[0], s.p[1]); break;
+        case 'L': path.LineTo(s.p[0], s.p[1]); break;
+        case 'Q': path.QuadTo(s.p[0], s.p[1], s.p[2], s.p[3]); break;
+        case 'C': path.CubicTo(s.p[0], s.p[1], s.p[2], s.p[3], s.p[4], s.p[5]); break;
+      }
+    }
+  }
+  path_cache.Clear();
+}
+
+static void FillPaths(const FrameView &view, const void *shape)
+{
+  for (int i = 0; i < path_placement_count; i++) {
+    FillPath(view, test_paths[i], path_placements[i].x, path_placements[i].y, fill_color, &path_cache);
+  }
+}
+
+// Signed area of the part of the polygon inside the pixel square [x, x+1) x [y, y+1),
+// by clipping it against the four sides in turn
+static float ClippedArea(const std::vector<PolyPoint> &polygon, int x, int y)
+{
+  std::vector<PolyPoint> in = polygon, out;
+  float bounds[4] = { (float)x, (float)(x+1), (float)y, (float)(y+1) };
+
+  for (int side = 0; side < 4 && !in.empty(); side++) {
+    bool vertical = side < 2, upper = side & 1;
+    out.clear();
+    for (size_t i = 0; i < in.size(); i++) {
+      PolyPoint a = in[i], b = in[(i+1) % in.size()];
+      float da = (vertical ? a.x : a.y) - bounds[side], db = (vertical ? b.x : b.y) - bounds[side];
+      if (upper) { da = -da; db = -db; }
+      if (da >= 0) out.push_back(a);
+      if ((da >= 0) != (db >= 0)) {
+        float t = da/(da - db);
+        PolyPoint p = { a.x + t*(b.x - a.x), a.y + t*(b.y - a.y) };
+        out.push_back(p);
+      }
+    }
+    in.swap(out);
+  }
+
+  float area = 0;
+  for (size_t i = 0; i < in.size(); i++) {
+    const PolyPoint &a = in[i], &b = in[(i+1) % in.size()];
+    area += a.x*b.y - b.x*a.y;
+  }
+  return area*0.5f;
+}
+
+// Brute-force reference for FillPaths: flattens every curve into many more segments
+// than the rasterizer needs, then gives each pixel the exact area of the outlines
+// inside it (signed, so holes subtract), saturated at full coverage
+static void ReferencePaths(const FrameView &view, const void *shape)
+{
+  const int steps = 256;
+
+  for (int i = 0; i < path_placement_count; i++) {
+    const PathPlacement &placement = path_placements[i];
+    std::vector<std::vector<PolyPoint> > contours;
+    float x_min = 1e30f, y_min = 1e30f, x_max = -1e30f, y_max = -1e30f;
+    PolyPoint cur = { 0, 0 };
+
+    for (int k = 0; k < placement.count; k++) {
+      const PathSegment &s = placement.segments[k];
+      PolyPoint end = { s.p[0], s.p[1] };
+      if (s.kind == 'M') contours.push_back(std::vector<PolyPoint>());
+      if (s.kind == 'M' || s.kind == 'L') {
+        contours.back().push_back(end);
+      } else {
+        int last = s.kind == 'Q' ? 2 : 4;
+        for (int n = 1; n <= steps; n++) {
+          float t = (float)n/steps, u = 1 - t;
+          PolyPoint q;
+          if (s.kind == 'Q') {
+            q.x = u*u*cur.x + 2*u*t*s.p[0] + t*t*s.p[2];
+            q.y = u*u*cur.y + 2*u*t*s.p[1] + t*t*s.p[3];
+          } else {
+            q.x = u*u*u*cur.x + 3*u*u*t*s.p[0] + 3*u*t*t*s.p[2] + t*t*t*s.p[4];
+            q.y = u*u*u*cur.y + 3*u*u*t*s.p[1] + 3*u*t*t*s.p[3] + t*t*t*s.p[5];
+          }
+          contours.back().push_back(q);
+        }
+        end.x = s.p[last];
+        end.y = s.p[last+1];
+      }
+      cur = end;
+    }
+    for (size_t c = 0; c < contours.size(); c++) {
+      for (size_t k = 0; k < contours[c].size(); k++) {
+        PolyPoint &q = contours[c][k];
+        q.x += placement.x;
+        q.y += placement.y;
+        x_min = fminf(x_min, q.x);
+        y_min = fminf(y_min, q.y);
+        x_max = fmaxf(x_max, q.x);
+        y_max = fmaxf(y_max, q.y);
+      }
+    }
+
+    for (int y = (int)floorf(y_min); y < (int)ceilf(y_max); y++) {
+      for (int x = (int)floorf(x_min); x < (int)ceilf(x_max); x++) {
+        if (x < 0 || y < 0 || x >= view.width || y >= view.height) continue;
+
+        float area = 0;
+        for (size_t c = 0; c < contours.size(); c++) area += ClippedArea(contours[c], x, y);
+        unsigned a = (unsigned)(fminf(fabsf(area), 1.0f)*255 + 0.5f);
+
+        unsigned char *p = PixelAt(view, x, y);
+        for (int c = 0; c < 3; c++) p[c] = (unsigned char)(RoundMul255(fill_color[c], a) + RoundMul255(p[c], 255 - a));
+      }
+    }
+  }
+}
+
+// Flood fill: walls over a noisy floor, filled from the middle with a tolerance that
+// just covers the noise. About 62% of the pixels are floor, a little above the share
+// at which 4-connected floor spans the frame, so the region is large and ragged and
+// crosses every band border of FillParallel().
+#define FLOOD_TOLERANCE 8
+
+static unsigned char flood_pattern[HEIGHT][WIDTH][3];
+static const int flood_seed[2] = { 200, 150 };
+static const int flood_threads[2] = { 0, 4 };   // 0 = Fill(), otherwise FillParallel() with that many bands
+static FloodFiller flood_filler;
+
+static void BuildFloodPattern()
+{
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      unsigned h = (unsigned)x*73856093u ^ (unsigned)y*19349663u;
+      h ^= h >> 13;
+      h *= 0x5bd1e995u;
+      h ^= h >> 15;
+
+      unsigned char *p = flood_pattern[y][x];
+      bool seed = x == flood_seed[0] && y == flood_seed[1];
+      if (!seed && h % 100 < 38) {
+        p[0] = 40;
+        p[1] = 40;
+        p[2] = 200;
+      } else {                // floor: the seed color give or take FLOOD_TOLERANCE per channel
+        p[0] = (unsigned char)(120 + (seed ? 8 : (h >> 8) % 17));
+        p[1] = (unsigned char)(100 + (seed ? 8 : (h >> 13) % 17));
+        p[2] = (unsigned char)(60 + (seed ? 8 : (h >> 18) % 17));
+      }
+    }
+  }
+}
+
+static void FillFlood(const FrameView &view, const void *shape)
+{
+  int threads = *(const int *)shape;
+
+  memcpy(view.pixels, flood_pattern, sizeof(flood_pattern));
+  if (threads == 0) {
+    flood_filler.Fill(view, flood_seed[0], flood_seed[1], fill_color, FLOOD_TOLERANCE);
+  } else {
+    flood_filler.FillParallel(view, flood_seed[0], flood_seed[1], fill_color, FLOOD_TOLERANCE, threads);
+  }
+}
+
+// Brute-force reference for FillFlood: a breadth-first search over single pixels
+static void ReferenceFlood(const FrameView &view, const void *shape)
+{
+  std::vector<bool> seen((size_t)view.width*view.height, false);
+  std::vector<int> queue;
+  unsigned char seed[3];
+
+  memcpy(view.pixels, flood_pattern, sizeof(flood_pattern));
+  memcpy(seed, PixelAt(view, flood_seed[0], flood_seed[1]), 3);
+  queue.push_back(flood_seed[1]*view.width + flood_seed[0]);
+  seen[queue[0]] = true;
+
+  for (size_t head = 0; head < queue.size(); head++) {
+    int x = queue[head] % view.width, y = queue[head] / view.width;
+    const int neighbours[4][2] = { { x-1, y }, { x+1, y }, { x, y-1 }, { x, y+1 } };
+
+    for (int n = 0; n < 4; n++) {
+      int nx = neighbours[n][0], ny = neighbours[n][1];
+      if (nx < 0 || ny < 0 || nx >= view.width || ny >= view.height || seen[ny*view.width + nx]) continue;
+
+      const unsigned char *p = PixelAt(view, nx, ny);
+      if (abs(p[0] - seed[0]) > FLOOD_TOLERANCE || abs(p[1] - seed[1]) > FLOOD_TOLERANCE ||
+          abs(p[2] - seed[2]) > FLOOD_TOLERANCE) continue;
+      seen[ny*view.width + nx] = true;
+      queue.push_back(ny*view.width + nx);
+    }
+  }
+  for (size_t i = 0; i < queue.size(); i++) {
+    memcpy(PixelAt(view, queue[i] % view.width, queue[i] / view.width), fill_color, 3);
+  }
+}
+
+// Benchmark mode: times the raster paths on fixed scenes
+
+struct BenchScene {
+  int (*triangles)[3][2];
+  int count;
+  int visibility;
+  int rate;
+};
+
+static int bench_large[1][3][2]    = { { {20, 20}, {200, 290}, {380, 140} } };
+static int bench_slivers[64][3][2];                                   // full width, 0-3 pixels high
+static int bench_micro[(WIDTH/4)*(HEIGHT/4)][3][2];                   // one 3x4 triangle per 4x4 cell
+
+static void BenchDraw(void *user)
+{
+  const BenchScene &scene = *(const BenchScene *)user;
+  DrawTriangles(scene.triangles, NULL, scene.count, scene.visibility, scene.rate);
+}
+
+// A fill kernel drawing one of the test shapes
+struct BenchFill {
+  void      (*fill)(const FrameView &view, const void *shape);
+  const void *shape;
+};
+
+static void BenchFillShape(void *user)
+{
+  const BenchFill &bench = *(const BenchFill *)user;
+  FrameView view = { &offscreen_frame[0][0][0], WIDTH, HEIGHT };
+  bench.fill(view, bench.shape);
+}
+
+static void BenchPostProcess(void *user)
+{
+  FrameView view = { &offscreen_frame[0][0][0], WIDTH, HEIGHT };
+  post_process.Apply(view);
+}
+
+// Pixels a case writes: everything it draws has a color, so count the non-black ones
+static long BenchCoverage(const BenchmarkCase &bench)
+{
+  const unsigned char *p = &offscreen_frame[0][0][0];
+  long covered = 0;
+
+  memset(offscreen_frame, 0, sizeof(offscreen_frame));
+  bench.run(bench.user);
+  for (int i = 0; i < WIDTH*HEIGHT; i++, p += 3) {
+    if (p[0] | p[1] | p[2]) covered++;
+  }
+  return covered;
+}
+
+static void RunBench(int runs)
+{
+  PerfCounters counters;
+  int i, x, y;
+
+  // Before the flood bands start their workers, so the counters follow them
+  counters.Open();
+
+  frame_buffer = offscreen_frame;
+  BuildTestSprites();
+  BuildTestPaths();
+  BuildFloodPattern();
+
+  for (i = 0; i < 64; i++) {
+    int y0 = 4*i + 20;
+    bench_slivers[i][0][0] = 0;       bench_slivers[i][0][1] = y0;
+    bench_slivers[i][1][0] = WIDTH-1; bench_slivers[i][1][1] = y0+1;
+    bench_slivers[i][2][0] = WIDTH-1; bench_slivers[i][2][1] = y0+3;
+  }
+  for (i = 0, y = 0; y+4 <= HEIGHT; y += 4) {
+    for (x = 0; x+4 <= WIDTH; x += 4, i++) {
+      bench_micro[i][0][0] = x;   bench_micro[i][0][1] = y;
+      bench_micro[i][1][0] = x+2; bench_micro[i][1][1] = y+1;
+      bench_micro[i][2][0] = x+1; bench_micro[i][2][1] = y+3;
+    }
+  }
+
+  BenchScene scenes[] = {
+    { bench_large,   1,  VIS_NONE,        SHADING_RATE_1X1 },
+    { bench_slivers, 64, VIS_NONE,        SHADING_RATE_1X1 },
+    { bench_micro,   i,  VIS_NONE,        SHADING_RATE_1X1 },
+    { bench_large,   1,  VIS_NONE,        SHADING_RATE_2X2 },
+    { bench_large,   1,  VIS_NONE,        SHADING_RATE_4X4 },
+    { bench_large,   1,  VIS_SPAN_BUFFER, SHADING_RATE_1X1 },
+    { bench_micro,   i,  VIS_SPAN_BUFFER, SHADING_RATE_1X1 },
+  };
+  BenchFill fills[] = {
+    { FillPolygon, &star_nonzero },
+    { FillPolygon, &frame_nonzero },
+    { FillDepthScene, &depth_scene },
+    { FillBlits, NULL },
+    { FillPaths, NULL },
+    { FillFlood, &flood_threads[0] },
+    { FillFlood, &flood_threads[1] },
+  };
+  BenchmarkCase cases[] = {
+    { "scan large",     BenchDraw, &scenes[0], 0 },
+    { "scan slivers",   BenchDraw, &scenes[1], 0 },
+    { "scan micro",     BenchDraw, &scenes[2], 0 },
+    { "shaded 2x2",     BenchDraw, &scenes[3], 0 },
+    { "shaded 4x4",     BenchDraw, &scenes[4], 0 },
+    { "span buf large", BenchDraw, &scenes[5], 0 },
+    { "span buf micro", BenchDraw, &scenes[6], 0 },
+    { "span buf depth", BenchFillShape, &fills[2], 0 },
+    { "blit sprites",   BenchFillShape, &fills[3], 0 },
+    { "path cached",    BenchFillShape, &fills[4], 0 },
+    { "flood span",     BenchFillShape, &fills[5], 0 },
+    { "flood bands",    BenchFillShape, &fills[6], 0 },
+    { "polygon star",   BenchFillShape, &fills[0], 0 },
+    { "polygon hole",   BenchFillShape, &fills[1], 0 },
+    { "post-process",   BenchPostProcess, NULL, WIDTH*HEIGHT },
+  };
+  int count = sizeof(cases)/sizeof(cases[0]);
+
+  for (i = 0; i < count-1; i++) cases[i].pixels = BenchCoverage(cases[i]);
+
+  // The post-process case filters the last scene's frame
+  RunBenchmarks(cases, count, runs, counters);
+}
+
+// Golden-image mode: renders a fixed corpus of scenes with every raster path and compares
+// them with reference images rendered by ScanConvertTriangle's slope/scan path, without
+// the micro-triangle kernel (golden/<scene>.ppm), then
+// checks the other fill kernels against brute-force references
+struct GoldenScene {
+  const char *name;
+  int         count;
+  int         triangles[6][3][2];
+  int         tolerance;        // least tolerance of every variant, 0 unless given
+};
+
+static GoldenScene golden_scenes[] = {
+  { "large",          1, { { {20, 20}, {200, 290}, {380, 140} } } },
+
+  // Every vertex order DrawTriangle sorts (the colors stay with their vertex index)
+  { "order-012",      1, { { {60, 40}, {150, 250}, {330, 120} } } },
+  { "order-021",      1, { { {60, 40}, {330, 120}, {150, 250} } } },
+  { "order-102",      1, { { {150, 250}, {60, 40}, {330, 120} } } },
+  { "order-120",      1, { { {150, 250}, {330, 120}, {60, 40} } } },
+  { "order-201",      1, { { {330, 120}, {60, 40}, {150, 250} } } },
+  { "order-210",      1, { { {330, 120}, {150, 250}, {60, 40} } } },
+
+  // Neighbours must leave no gap along the edges they share
+  { "shared-edge",    2, { { {50, 50}, {350, 60}, {100, 250} }, { {100, 250}, {350, 60}, {320, 270} } } },
+  { "fan",            6, { { {200, 150}, {320, 150}, {260, 254} }, { {200, 150}, {260, 254}, {140, 254} },
+                           { {200, 150}, {140, 254}, {80, 150} },  { {200, 150}, {80, 150}, {140, 46} },
+                           { {200, 150}, {140, 46}, {260, 46} },   { {200, 150}, {260, 46}, {320, 150} } } },
+
+  // x0 == x1 and x1 == x2: one half of the scan is a vertical edge
+  { "vertical-edges", 2, { { {100, 40}, {100, 140}, {250, 90} }, { {150, 200}, {300, 160}, {300, 280} } } },
+
+  // Collinear points, a single point and a vertical line cover no pixels
+  { "degenerate",     3, { { {50, 50}, {150, 150}, {250, 250} }, { {300, 100}, {300, 100}, {300, 100} },
+                           { {350, 20}, {350, 120}, {350, 280} } } },
+
+  // Slivers a few pixels wide (below one pixel, which pixels a path samples is a convention)
+  { "thin",           3, { { {10, 100}, {390, 101}, {390, 105} }, { {20, 20}, {24, 280}, {26, 150} },
+                           { {200, 290}, {380, 130}, {383, 136} } } },
+  { "micro",          6, { { {100, 100}, {102, 101}, {101, 103} }, { {110, 100}, {111, 100}, {110, 101} },
+                           { {120, 100}, {123, 103}, {120, 103} }, { {130, 100}, {131, 102}, {133, 101} },
+                           { {140, 100}, {140, 103}, {143, 100} }, { {150, 100}, {152, 102}, {151, 101} } },
+                        GOLDEN_MICRO_TOLERANCE },
+  // Micro-triangles in both windings, right-angled, slanted and flat
+  { "micro-windings", 6, { { {200, 200}, {203, 200}, {200, 203} }, { {210, 203}, {213, 203}, {213, 200} },
+                           { {220, 200}, {220, 203}, {223, 203} }, { {230, 200}, {233, 201}, {231, 203} },
+                           { {243, 200}, {240, 201}, {241, 203} }, { {250, 200}, {253, 202}, {250, 202} } },
+                        GOLDEN_MICRO_TOLERANCE },
+};
+
+// The first variant renders the references (without the micro-triangle kernel) and must
+// match them within the scene's tolerance. The others may differ by "tolerance" per
+// channel, and with "edge_slack" take a neighbour's color on the edges of the reference
+// (coverage decisions along triangle edges) in up to 1 in GOLDEN_EDGE_SLACK edge pixels,
+// but nowhere else.
+struct GoldenVariant {
+  const char *name;
+  int         visibility;
+  int         rate;
+  int         tolerance;
+  bool        edge_slack;
+};
+
+static const GoldenVariant golden_variants[] = {
+  { "scan",        VIS_NONE,        SHADING_RATE_1X1, 0,                       false },
+  { "shaded 2x2",  VIS_NONE,        SHADING_RATE_2X2, GOLDEN_SHADED_TOLERANCE, true },
+  { "shaded 4x4",  VIS_NONE,        SHADING_RATE_4X4, GOLDEN_SHADED_TOLERANCE, true },
+  { "span buffer", VIS_SPAN_BUFFER, SHADING_RATE_1X1, GOLDEN_SPAN_TOLERANCE,   true },
+};
+
+// The other fill kernels: each is checked against a reference rendered by a brute-force
+// per-pixel test (golden/<name>.ppm), within "tolerance", and with "edge_slack" like the
+// triangle variants
+struct GoldenFill {
+  const char *name;
+  const char *kernel;
+  int         tolerance;
+  bool        edge_slack;
+  void      (*reference)(const FrameView &view, const void *shape);
+  void      (*fill)(const FrameView &view, const void *shape);
+  const void *shape;
+};
+
+static const GoldenFill golden_fills[] = {
+  { "star-evenodd", "polygon",     0,                     false, ReferencePolygon,    FillPolygon,    &star_even_odd },
+  { "star-nonzero", "polygon",     0,                     false, ReferencePolygon,    FillPolygon,    &star_nonzero },
+  { "poly-hole",    "polygon",     0,                     false, ReferencePolygon,    FillPolygon,    &frame_nonzero },
+  { "poly-comb",    "polygon",     0,                     false, ReferencePolygon,    FillPolygon,    &comb_even_odd },
+  { "depth-cross",  "span buffer", GOLDEN_SPAN_TOLERANCE, false, ReferenceDepthScene, FillDepthScene, &depth_scene },
+  { "blit",         "blit list",   0,                     false, ReferenceBlits,      FillBlits,      NULL },
+  { "paths",        "path fill",   GOLDEN_PATH_TOLERANCE, false, ReferencePaths,      FillPaths,      NULL },
+  { "flood",        "flood span",  0,                     false, ReferenceFlood,      FillFlood,      &flood_threads[0] },
+  { "flood",        "flood bands", 0,                     false, ReferenceFlood,      FillFlood,      &flood_threads[1] },
+};
+
+// True when the differences are within what the variant or fill allows
+static bool GoldenPassed(const ImageDiff &diff, bool edge_slack)
+{
+  if (!edge_slack) return diff.over_tolerance == 0;
+  return diff.off_edge == 0 && diff.on_edge*GOLDEN_EDGE_SLACK <= diff.edge_pixels;
+}
+
+static void GoldenRender(GoldenScene &scene, const GoldenVariant &variant)
+{
+  memset(offscreen_frame, 0, sizeof(offscreen_frame));
+  DrawTriangles(scene.triangles, NULL, scene.count, variant.visibility, variant.rate);
+}
+
+// Checks every scene and variant against the references in "dir" (or rewrites the
+// references with "update"); returns false when any comparison fails
+static bool RunGolden(const char *dir, bool update)
+{
+  FrameView view = { &offscreen_frame[0][0][0], WIDTH, HEIGHT };
+  std::vector<unsigned char> reference;
+  int scene_count   = sizeof(golden_scenes)/sizeof(golden_scenes[0]);
+  int variant_count = sizeof(golden_variants)/sizeof(golden_variants[0]);
+  int failed = 0, s, v, k;
+  char path[512];
+
+  frame_buffer = offscreen_frame;
+  BuildTestSprites();
+  BuildTestPaths();
+  BuildFloodPattern();
+
+  if (!update) printf("scene           variant          us/frame  max diff  differing  over tol   on edge  off edge  edge px\n");
+  for (s = 0; s < scene_count; s++) {
+    GoldenScene &scene = golden_scenes[s];
+    int width, height;
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", dir, scene.name);
+    if (update) {
+      micro_triangles = false;
+      GoldenRender(scene, golden_variants[0]);
+      micro_triangles = true;
+      if (!WritePpm(path, view)) failed++;
+      else printf("Wrote %s\n", path);
+      continue;
+    }
+
+    if (!ReadPpm(path, reference, width, height) || width != WIDTH || height != HEIGHT) {
+      printf("%-15s missing or wrong size: %s (run -golden-update)\n", scene.name, path);
+      failed++;
+      continue;
+    }
+
+    for (v = 0; v < variant_count; v++) {
+      const GoldenVariant &variant = golden_variants[v];
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (k = 0; k < GOLDEN_RUNS; k++) GoldenRender(scene, variant);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      int tolerance = variant.tolerance > scene.tolerance ? variant.tolerance : scene.tolerance;
+      ImageDiff diff = CompareImages(view, &reference[0], tolerance, GOLDEN_EDGE_TOLERANCE);
+      bool passed = GoldenPassed(diff, variant.edge_slack);
+      if (!passed) failed++;
+
+      printf("%-15s %-12s %12.1f %9d %10ld %9ld %9ld %9ld %9ld  %s\n", scene.name, variant.name, seconds*1e6/GOLDEN_RUNS,
+             diff.max_difference, diff.differing, diff.over_tolerance, diff.on_edge, diff.off_edge, diff.edge_pixels,
+             passed ? "ok" : "FAILED");
+    }
+  }
+
+  for (s = 0; s < (int)(sizeof(golden_fills)/sizeof(golden_fills[0])); s++) {
+    const GoldenFill &fill = golden_fills[s];
+    int width, height;
+
+    snprintf(path, sizeof(path), "%s/%s.ppm", dir, fill.name);
+    if (update) {
+      memset(offscreen_frame, 0, sizeof(offscreen_frame));
+      fill.reference(view, fill.shape);
+      if (!WritePpm(path, view)) failed++;
+      else printf("Wrote %s\n", path);
+      continue;
+    }
+
+    if (!ReadPpm(path, reference, width, height) || width != WIDTH || height != HEIGHT) {
+      printf("%-15s missing or wrong size: %s (run -golden-update)\n", fill.name, path);
+      failed++;
+      continue;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (k = 0; k < GOLDEN_RUNS; k++) {
+      memset(offscreen_frame, 0, sizeof(offscreen_frame));
+      fill.fill(view, fill.shape);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ImageDiff diff = CompareImages(view, &reference[0], fill.tolerance, GOLDEN_EDGE_TOLERANCE);
+    bool passed = GoldenPassed(diff, fill.edge_slack);
+    if (!passed) failed++;
+
+    printf("%-15s %-12s %12.1f %9d %10ld %9ld %9ld %9ld %9ld  %s\n", fill.name, fill.kernel, seconds*1e6/GOLDEN_RUNS,
+           diff.max_difference, diff.differing, diff.over_tolerance, diff.on_edge, diff.off_edge, diff.edge_pixels,
+           passed ? "ok" : "FAILED");
+  }
+
+  if (!update) printf("%d failed (%s kernels)\n", failed, CpuFeaturesName());
+  return failed == 0;
+}
+
 int main(int argc, char **argv) {
+	int i, bench_runs = 0;
+	const char *golden_dir = NULL;
+	bool golden_update = false;
+
+	// -bench and -golden never open a window, so they must not need a display for GLUT either
+	for (i = 1; i < argc && strcmp(argv[i], "-bench") != 0 && strncmp(argv[i], "-golden", 7) != 0; i++) {}
+	if (i == argc) glutInit(&argc, argv);
+
+	// Command line options (after GLUT removed its own):
+	//   -shm <name>      also export the frame ring as POSIX shared memory, e.g. -shm /trianglescan
+	//   -record <file>   record the rendered frames to a compressed frame sequence
+	//   -bench [runs]    time the raster paths (with hardware counters on Linux) and exit
+	//   -golden [dir]    compare every raster path with the reference images in dir (default golden) and exit
+	//   -golden-update [dir]   render the reference images again
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-shm") == 0 && i+1 < argc) {
+			if (pipeline.ExportShared(argv[++i])) {
+				printf("Exporting frames to shared memory %s\n", argv[i]);
+			}
+		} else if (strcmp(argv[i], "-record") == 0 && i+1 < argc) {
+			if (recorder.Open(argv[++i], WIDTH, HEIGHT)) {
+				printf("Recording frames to %s\n", argv[i]);
+				atexit(stoprecording);
+			}
+		} else if (strcmp(argv[i], "-bench") == 0) {
+			bench_runs = i+1 < argc && atoi(argv[i+1]) > 0 ? atoi(argv[++i]) : BENCH_RUNS;
+		} else if (strcmp(argv[i], "-golden") == 0 || strcmp(argv[i], "-golden-update") == 0) {
+			golden_update = strcmp(argv[i], "-golden-update") == 0;
+			golden_dir = i+1 < argc && argv[i+1][0] != '-' ? argv[++i] : "golden";
+		}
+	}
+
+	printf("SIMD kernels: %s\n", CpuFeaturesName());
+
+	if (golden_dir) {
+		return RunGolden(golden_dir, golden_update) ? 0 : 1;
+	}
+
+	// Post-processing preview: soften the edges, then desaturate and brighten.
+	// The color matrix and gamma run inside the blur's pass, so this is one pass over the frame.
+	const float desaturate[3][4] = {
+		{ 0.8f+0.2f*0.299f,      0.2f*0.587f,      0.2f*0.114f, 0 },
+		{      0.2f*0.299f, 0.8f+0.2f*0.587f,      0.2f*0.114f, 0 },
+		{      0.2f*0.299f,      0.2f*0.587f, 0.8f+0.2f*0.114f, 0 }
+	};
+	post_process.AddGaussianBlur(1.0f);
+	post_process.AddColorMatrix(desaturate);
+	post_process.AddGamma(1.2f);
+
+	if (bench_runs > 0) {
+		// Post-processing stays on this thread, so its row measures the filter chain alone
+		RunBench(bench_runs);
+		return 0;
+	}
+	post_process.SetThreads((int)std::thread::hardware_concurrency());
 
-	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB);
 	glutInitWindowSize(WIDTH, HEIGHT);
 	glutCreateWindow("Frame Buffer Example");
@@ -176,6 +1406,13 @@ int main(int argc, char **argv) {
 	// Specify which functions get called for display and mouse events:
 	glutDisplayFunc(display);
     glutMouseFunc(mousebuttonhandler);
+	glutKeyboardFunc(keyboardhandler);
+	glutTimerFunc(PRESENT_INTERVAL_MS, presenttimer, 0);
+
+	BuildMarkers();
+
+	// Scene updates and rasterization run on the producer thread from here on
+	pipeline.Start(UpdateScene, RenderScene, NULL);
 
 	glutMainLoop();
 